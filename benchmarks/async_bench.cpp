@@ -0,0 +1,80 @@
+#include <benchmark/benchmark.h>
+#include <cstdint>
+#include "async_session.h"
+
+static onnx::AttributeProto intsAttr(const std::string& name, std::vector<int64_t> values) {
+    onnx::AttributeProto attr;
+    attr.set_name(name);
+    attr.set_type(onnx::AttributeProto::INTS);
+    for (auto v : values) attr.add_ints(v);
+    return attr;
+}
+
+// Conv 3x3 3->16 and Conv 1x1 16->32 on 64x64 images.
+static ComputationGraph makeModel() {
+    ComputationGraph graph;
+    graph.tensors["c1_w"] = Tensor({16, 3, 3, 3});
+    graph.tensors["c1_b"] = Tensor({16});
+    graph.tensors["c2_w"] = Tensor({32, 1, 1, 16});
+    graph.tensors["c2_b"] = Tensor({32});
+    for (auto& [name, tensor] : graph.tensors) tensor.fillRandom();
+    graph.nodes = {
+        {"Conv", {"input", "c1_w", "c1_b"}, {"c1"}, {intsAttr("kernel_shape", {3, 3}), intsAttr("pads", {1, 1, 1, 1})}},
+        {"Conv", {"c1", "c2_w", "c2_b"}, {"output"}, {intsAttr("kernel_shape", {1, 1})}},
+    };
+    graph.topologicalSort();
+    return graph;
+}
+
+constexpr int kSize = 64;
+constexpr int kRequests = 32;
+
+// Stand-in for request decoding: an 8-bit NCHW image is normalized and
+// converted to the NHWC float input.
+static Tensor stageInput(const std::vector<uint8_t>& image) {
+    Tensor input({1, kSize, kSize, 3});
+    float* out = input.data().data();
+    for (int c = 0; c < 3; ++c) {
+        for (int i = 0; i < kSize * kSize; ++i) out[i * 3 + c] = (image[c * kSize * kSize + i] / 255.0f - 0.5f) * 4.0f;
+    }
+    return input;
+}
+
+static std::vector<uint8_t> makeImage() {
+    std::vector<uint8_t> image(3 * kSize * kSize);
+    for (size_t i = 0; i < image.size(); ++i) image[i] = static_cast<uint8_t>(i * 31);
+    return image;
+}
+
+// One service thread stages each request's input, then blocks on run().
+static void BM_SyncPipeline(benchmark::State& state) {
+    Session session(makeModel());
+    std::vector<uint8_t> image = makeImage();
+    session.run(stageInput(image));
+
+    for (auto _ : state) {
+        for (int r = 0; r < kRequests; ++r) benchmark::DoNotOptimize(session.run(stageInput(image)));
+    }
+    state.SetItemsProcessed(int64_t(state.iterations()) * kRequests);
+}
+
+// The same requests through AsyncSession: staging of request N+1 overlaps the
+// computation of request N. Arg 0: max requests in flight.
+static void BM_AsyncPipeline(benchmark::State& state) {
+    Session session(makeModel());
+    AsyncOptions options;
+    options.max_in_flight = state.range(0);
+    AsyncSession async(session, options);
+    std::vector<uint8_t> image = makeImage();
+    session.run(stageInput(image));
+
+    for (auto _ : state) {
+        std::vector<std::future<std::vector<Tensor>>> results;
+        for (int r = 0; r < kRequests; ++r) results.push_back(async.submit([&] { return stageInput(image); }));
+        for (auto& result : results) benchmark::DoNotOptimize(result.get());
+    }
+    state.SetItemsProcessed(int64_t(state.iterations()) * kRequests);
+}
+
+BENCHMARK(BM_SyncPipeline)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_AsyncPipeline)->Arg(1)->Arg(2)->Arg(4)->Arg(8)->UseRealTime()->Unit(benchmark::kMillisecond);
@@ -0,0 +1,75 @@
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <thread>
+#include "batching_server.h"
+
+static onnx::AttributeProto intsAttr(const std::string& name, std::vector<int64_t> values) {
+    onnx::AttributeProto attr;
+    attr.set_name(name);
+    attr.set_type(onnx::AttributeProto::INTS);
+    for (auto v : values) attr.add_ints(v);
+    return attr;
+}
+
+// Small classifier head on 32x32 images: Conv 3x3 3->16, MaxPool 2x2,
+// Conv 1x1 16->32, GlobalAveragePool.
+static ComputationGraph makeModel() {
+    ComputationGraph graph;
+    graph.tensors["c1_w"] = Tensor({16, 3, 3, 3});
+    graph.tensors["c1_b"] = Tensor({16});
+    graph.tensors["c2_w"] = Tensor({32, 1, 1, 16});
+    graph.tensors["c2_b"] = Tensor({32});
+    for (auto& [name, tensor] : graph.tensors) tensor.fillRandom();
+    graph.nodes = {
+        {"Conv", {"input", "c1_w", "c1_b"}, {"c1"}, {intsAttr("kernel_shape", {3, 3}), intsAttr("pads", {1, 1, 1, 1})}},
+        {"MaxPool", {"c1"}, {"p1"}, {intsAttr("kernel_shape", {2, 2}), intsAttr("strides", {2, 2})}},
+        {"Conv", {"p1", "c2_w", "c2_b"}, {"c2"}, {intsAttr("kernel_shape", {1, 1})}},
+        {"GlobalAveragePool", {"c2"}, {"output"}, {}},
+    };
+    graph.topologicalSort();
+    return graph;
+}
+
+// Load generator: 16 closed-loop clients send single 32x32 images, each
+// sending its next request as soon as the previous one returns.
+// Arg 0: max batch size (1 runs every request on its own).
+// Reports request throughput against the mean and p99 latency of a request.
+static void BM_BatchingServer(benchmark::State& state) {
+    constexpr int kClients = 16;
+    constexpr int kRequestsPerClient = 8;
+    BatchingOptions options;
+    options.max_batch = state.range(0);
+    options.max_wait = std::chrono::milliseconds(2);
+    BatchingServer server(makeModel(), options);
+    Tensor sample({1, 32, 32, 3});
+    sample.fillRandom();
+    server.run(sample);
+
+    std::vector<double> latencies;
+    for (auto _ : state) {
+        std::vector<std::vector<double>> client_latencies(kClients);
+        std::vector<std::thread> clients;
+        for (int c = 0; c < kClients; ++c) {
+            clients.emplace_back([&, c] {
+                for (int r = 0; r < kRequestsPerClient; ++r) {
+                    auto start = std::chrono::steady_clock::now();
+                    benchmark::DoNotOptimize(server.run(sample));
+                    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+                    client_latencies[c].push_back(elapsed.count());
+                }
+            });
+        }
+        for (auto& client : clients) client.join();
+        for (const auto& client : client_latencies) latencies.insert(latencies.end(), client.begin(), client.end());
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    double mean = 0;
+    for (double latency : latencies) mean += latency;
+    state.counters["requests_per_s"] = benchmark::Counter(double(latencies.size()), benchmark::Counter::kIsRate);
+    state.counters["mean_ms"] = mean / latencies.size();
+    state.counters["p99_ms"] = latencies[std::min(latencies.size() - 1, latencies.size() * 99 / 100)];
+    state.counters["mean_batch"] = server.stats().meanBatch();
+}
+
+BENCHMARK(BM_BatchingServer)->Arg(1)->Arg(4)->Arg(8)->Arg(16)->UseRealTime()->Unit(benchmark::kMillisecond);
@@ -1,7 +1,12 @@
+#include <algorithm>
+#include <iterator>
+#include <vector>
 #include <benchmark/benchmark.h>
 #include <xnnpack.h>
 #include "tensor.h"
 #include "operators.h"
+#include "execution_engine.h"
+#include "tiled_execution.h"
 
 static void BM_Conv2D(benchmark::State& state) {
     int N = 1;
@@ -31,7 +36,7 @@ static void BM_Conv2D(benchmark::State& state) {
             input, weights, bias, 
             {K, K}, 
             {stride, stride}, 
-            {pad, pad}, 
+            {pad, pad, pad, pad}, 
             {dilation, dilation}, 
             groups,
             pthreadpool_
@@ -46,8 +51,148 @@ static void BM_Conv2D(benchmark::State& state) {
     
 }
 
-BENCHMARK(BM_Conv2D)
-    ->Args({3, 32, 224, 3, 2, 1, 1})   // e.g. first layer in MobileNet
-    ->Args({320, 1280, 7, 1, 1, 0, 1}) // MobileNet last Conv
-    ->Args({32, 32, 28, 3, 1, 1, 1})   // Mid depthwise Conv
-    ->Unit(benchmark::kMillisecond);
+// Same layers with the operator created once and only set up/run per iteration,
+// as ExecutionEngine does after prepare().
+static void BM_Conv2DPrepared(benchmark::State& state) {
+    int N = 1;
+    int IC = state.range(0);
+    int OC = state.range(1);
+    int H  = state.range(2);
+    int K  = state.range(3);
+    int stride = state.range(4);
+    int pad    = state.range(5);
+    int dilation = state.range(6);
+    int groups = 1;
+    Tensor input({N, H, H, IC});
+    Tensor weights({OC, K, K, IC/groups});
+    Tensor bias({OC});
+
+    input.fillRandom();
+    weights.fillRandom();
+    bias.fillRandom();
+
+    Operators ops;
+
+    xnn_initialize(nullptr);
+    pthreadpool_t pthreadpool_ = pthreadpool_create(0);
+    auto conv = ops.createConv2d(
+        weights, bias,
+        {K, K},
+        {stride, stride},
+        {pad, pad, pad, pad},
+        {dilation, dilation},
+        groups
+    );
+
+    for (auto _ : state) {
+        Tensor result = ops.runConv2d(*conv, input, pthreadpool_);
+        benchmark::DoNotOptimize(result);
+    }
+
+    state.SetItemsProcessed(int64_t(state.iterations()) * OC * H * H);
+
+    conv.reset();
+    xnn_deinitialize();
+    if (pthreadpool_) pthreadpool_destroy(pthreadpool_);
+}
+
+static void Conv2DArgs(benchmark::internal::Benchmark* b) {
+    b->Args({3, 32, 224, 3, 2, 1, 1})   // e.g. first layer in MobileNet
+     ->Args({320, 1280, 7, 1, 1, 0, 1}) // MobileNet last Conv
+     ->Args({32, 32, 28, 3, 1, 1, 1})   // Mid depthwise Conv
+     ->Unit(benchmark::kMillisecond);
+}
+
+BENCHMARK(BM_Conv2D)->Apply(Conv2DArgs);
+BENCHMARK(BM_Conv2DPrepared)->Apply(Conv2DArgs);
+
+static onnx::AttributeProto intsAttr(const std::string& name, std::vector<int64_t> values) {
+    onnx::AttributeProto attr;
+    attr.set_name(name);
+    attr.set_type(onnx::AttributeProto::INTS);
+    for (auto v : values) attr.add_ints(v);
+    return attr;
+}
+
+// MobileNet block at 112x112: Conv 3x3 16->32, depthwise 3x3, Conv 1x1 32->64.
+struct ChainLayer { const char* name; const char* input; int oc, ic, k, groups; };
+static const ChainLayer kConvChain[] = {{"c1", "input", 32, 16, 3, 1}, {"c2", "c1", 32, 1, 3, 32}, {"c3", "c2", 64, 32, 1, 1}};
+static const int kChainSize = 112;
+static const int kChainChannels = 16;
+
+static ComputationGraph makeConvChain() {
+    ComputationGraph graph;
+    for (const ChainLayer& l : kConvChain) {
+        graph.tensors[std::string(l.name) + "_w"] = Tensor({l.oc, l.k, l.k, l.ic});
+        graph.tensors[std::string(l.name) + "_b"] = Tensor({l.oc});
+        graph.tensors[std::string(l.name) + "_w"].fillRandom();
+        graph.tensors[std::string(l.name) + "_b"].fillRandom();
+        int pad = l.k / 2;
+        onnx::AttributeProto group;
+        group.set_name("group");
+        group.set_type(onnx::AttributeProto::INT);
+        group.set_i(l.groups);
+        graph.nodes.push_back({"Conv", {l.input, std::string(l.name) + "_w", std::string(l.name) + "_b"}, {l.name},
+                               {intsAttr("kernel_shape", {l.k, l.k}), intsAttr("pads", {pad, pad, pad, pad}), group}});
+    }
+    graph.topologicalSort();
+    return graph;
+}
+
+// Bytes moved per run by the chain when its output is produced in bands of
+// `band_rows` rows: the input read and output written, the bytes of c1 and c2
+// written and read back between Convs (only when each Conv runs on its own),
+// and the halo rows each band reads or computes again beyond its share.
+static void chainTraffic(int band_rows, bool tiled, double& intermediate_bytes, double& halo_bytes) {
+    const int layers = static_cast<int>(std::size(kConvChain));
+    std::vector<int> channels{kChainChannels};
+    for (const ChainLayer& l : kConvChain) channels.push_back(l.oc);
+    auto rowBytes = [&](int j) { return double(kChainSize) * channels[j] * sizeof(float); };
+
+    intermediate_bytes = 0;
+    halo_bytes = 0;
+    if (!tiled) {
+        for (int j = 1; j < layers; ++j) intermediate_bytes += 2 * kChainSize * rowBytes(j);
+        return;
+    }
+    // Same walk as tiled execution: stride 1, so a band of r rows needs r + k - 1 input rows.
+    std::vector<int> rows(layers + 1, 0);
+    for (int row = 0; row < kChainSize; row += band_rows) {
+        int begin = row, end = std::min(row + band_rows, kChainSize);
+        for (int j = layers; j-- > 0;) {
+            int pad = kConvChain[j].k / 2;
+            begin = std::max(begin - pad, 0);
+            end = std::min(end + kConvChain[j].k - 1 - pad, kChainSize);
+            rows[j] += end - begin;
+        }
+    }
+    for (int j = 0; j < layers; ++j) halo_bytes += (rows[j] - kChainSize) * rowBytes(j);
+}
+
+// Arg 0: band budget in KB for tiled execution, 0 runs each Conv on its own.
+// `memory_bytes` is the same per-run measure in both modes: input and output
+// bytes, plus `intermediate_bytes` (c1 and c2 leaving the chain, 0 when tiled)
+// and `halo_bytes` (rows read or recomputed again by neighbouring bands).
+static void BM_ConvChain(benchmark::State& state) {
+    ComputationGraph graph = makeConvChain();
+    Tensor input({1, kChainSize, kChainSize, kChainChannels});
+    input.fillRandom();
+
+    ExecutionEngine engine;
+    engine.setTiledExecution(state.range(0) * 1024);
+    engine.executeGraph(graph, input);
+
+    for (auto _ : state) {
+        engine.executeGraph(graph, input);
+    }
+
+    bool tiled = graph.tile_plan && !graph.tile_plan->chains.empty();
+    double intermediate_bytes = 0, halo_bytes = 0;
+    chainTraffic(tiled ? graph.tile_plan->chains[0].tile_rows : kChainSize, tiled, intermediate_bytes, halo_bytes);
+    double io_bytes = double(kChainSize) * kChainSize * (kChainChannels + std::end(kConvChain)[-1].oc) * sizeof(float);
+    state.counters["memory_bytes"] = io_bytes + intermediate_bytes + halo_bytes;
+    state.counters["intermediate_bytes"] = intermediate_bytes;
+    state.counters["halo_bytes"] = halo_bytes;
+}
+
+BENCHMARK(BM_ConvChain)->Arg(0)->Arg(128)->Arg(512)->Arg(2048)->Unit(benchmark::kMillisecond);
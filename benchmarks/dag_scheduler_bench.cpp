@@ -0,0 +1,56 @@
+#include <benchmark/benchmark.h>
+#include "execution_engine.h"
+
+static onnx::AttributeProto intAttr(const std::string& name, int64_t value) {
+    onnx::AttributeProto attr;
+    attr.set_name(name);
+    attr.set_type(onnx::AttributeProto::INT);
+    attr.set_i(value);
+    return attr;
+}
+
+// Inception-style block: `branches` independent Gemm -> Relu -> Gemm chains over
+// the same input, summed by a chain of Adds.
+static ComputationGraph makeBranchyGraph(int branches, int features) {
+    ComputationGraph graph;
+    std::string sum;
+    for (int b = 0; b < branches; ++b) {
+        std::string id = "b" + std::to_string(b);
+        for (const char* layer : {"_w1", "_w2"}) {
+            graph.tensors[id + layer] = Tensor({features, features});
+            graph.tensors[id + layer + "_bias"] = Tensor({features});
+            graph.tensors[id + layer].fillRandom();
+            graph.tensors[id + layer + "_bias"].fillRandom();
+        }
+        GraphNode fc1{"Gemm", {"input", id + "_w1", id + "_w1_bias"}, {id + "_fc1"}, {intAttr("transB", 1)}};
+        GraphNode relu{"Relu", {id + "_fc1"}, {id + "_relu"}, {}};
+        GraphNode fc2{"Gemm", {id + "_relu", id + "_w2", id + "_w2_bias"}, {id}, {intAttr("transB", 1)}};
+        graph.nodes.insert(graph.nodes.end(), {fc1, relu, fc2});
+        if (b == 0) {
+            sum = id;
+        } else {
+            std::string next = b + 1 == branches ? "output" : "sum" + std::to_string(b);
+            graph.nodes.push_back({"Add", {sum, id}, {next}, {}});
+            sum = next;
+        }
+    }
+    graph.topologicalSort();
+    return graph;
+}
+
+// Arg 0: inter-op threads (1 runs the nodes sequentially).
+static void BM_BranchyGraph(benchmark::State& state) {
+    ComputationGraph graph = makeBranchyGraph(8, 256);
+    Tensor input({16, 256});
+    input.fillRandom();
+
+    ExecutionEngine engine;
+    engine.setInterOpThreads(state.range(0));
+    engine.executeGraph(graph, input);
+
+    for (auto _ : state) {
+        engine.executeGraph(graph, input);
+    }
+}
+
+BENCHMARK(BM_BranchyGraph)->Arg(1)->Arg(2)->Arg(4)->Arg(8)->UseRealTime()->Unit(benchmark::kMillisecond);
@@ -1,6 +1,7 @@
 #include <benchmark/benchmark.h>
 #include "operators.h"
 #include "tensor.h"
+#include "threading_runtime.h"
 
 static void BM_MatMul(benchmark::State& state) {
     int N = state.range(0);
@@ -21,3 +22,53 @@ static void BM_MatMul(benchmark::State& state) {
 }
 
 BENCHMARK(BM_MatMul)->RangeMultiplier(2)->Range(64, 1024)->Complexity();
+
+// Scaling of the native operators with the intra-op thread count.
+// Arg 0: threads (1 runs on the calling thread).
+static void BM_GemmThreads(benchmark::State& state) {
+    ThreadingOptions options;
+    options.threads = state.range(0);
+    ThreadingRuntime runtime(options);
+    Tensor a({64, 1024});
+    Tensor b({1000, 1024});
+    Tensor c({1000});
+    a.fillRandom();
+    b.fillRandom();
+    c.fillRandom();
+    Operators ops;
+    Tensor output;
+
+    for (auto _ : state) {
+        ops.gemm_transB(a, b, c, 1.0f, 1.0f, output, Operators::kNoMin, Operators::kNoMax, runtime.threadpool());
+        benchmark::DoNotOptimize(output.data().data());
+    }
+    state.SetItemsProcessed(int64_t(state.iterations()) * 64 * 1000 * 1024);
+}
+
+static void BM_ElementwiseThreads(benchmark::State& state) {
+    ThreadingOptions options;
+    options.threads = state.range(0);
+    ThreadingRuntime runtime(options);
+    Tensor a({8, 56, 56, 64});
+    Tensor b({8, 56, 56, 64});
+    a.fillRandom();
+    b.fillRandom();
+    Operators ops;
+    Tensor output;
+
+    for (auto _ : state) {
+        ops.add(a, b, output, runtime.threadpool());
+        ops.relu(output, output, runtime.threadpool());
+        ops.softmax(output, -1, false, output, runtime.threadpool());
+        benchmark::DoNotOptimize(output.data().data());
+    }
+    state.SetBytesProcessed(int64_t(state.iterations()) * a.size() * sizeof(float) * 3);
+}
+
+static void ThreadCounts(benchmark::internal::Benchmark* b) {
+    for (int threads = 1; threads <= 16; threads *= 2) b->Arg(threads);
+    b->UseRealTime()->Unit(benchmark::kMillisecond);
+}
+
+BENCHMARK(BM_GemmThreads)->Apply(ThreadCounts);
+BENCHMARK(BM_ElementwiseThreads)->Apply(ThreadCounts);
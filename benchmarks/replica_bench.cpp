@@ -0,0 +1,65 @@
+#include <benchmark/benchmark.h>
+#include <thread>
+#include "replicated_session.h"
+
+static onnx::AttributeProto intsAttr(const std::string& name, std::vector<int64_t> values) {
+    onnx::AttributeProto attr;
+    attr.set_name(name);
+    attr.set_type(onnx::AttributeProto::INTS);
+    for (auto v : values) attr.add_ints(v);
+    return attr;
+}
+
+// Conv 3x3 3->32, Conv 3x3 32->64, Conv 1x1 64->64, GlobalAveragePool on
+// 28x28 images: about 100 KB of weights and 500 KB of activations per request.
+static ComputationGraph makeModel() {
+    ComputationGraph graph;
+    graph.tensors["c1_w"] = Tensor({32, 3, 3, 3});
+    graph.tensors["c1_b"] = Tensor({32});
+    graph.tensors["c2_w"] = Tensor({64, 3, 3, 32});
+    graph.tensors["c2_b"] = Tensor({64});
+    graph.tensors["c3_w"] = Tensor({64, 1, 1, 64});
+    graph.tensors["c3_b"] = Tensor({64});
+    for (auto& [name, tensor] : graph.tensors) tensor.fillRandom();
+    graph.nodes = {
+        {"Conv", {"input", "c1_w", "c1_b"}, {"c1"}, {intsAttr("kernel_shape", {3, 3}), intsAttr("pads", {1, 1, 1, 1})}},
+        {"Conv", {"c1", "c2_w", "c2_b"}, {"c2"}, {intsAttr("kernel_shape", {3, 3}), intsAttr("pads", {1, 1, 1, 1})}},
+        {"Conv", {"c2", "c3_w", "c3_b"}, {"c3"}, {intsAttr("kernel_shape", {1, 1})}},
+        {"GlobalAveragePool", {"c3"}, {"output"}, {}},
+    };
+    graph.topologicalSort();
+    return graph;
+}
+
+// 16 closed-loop clients, each sending its next request once the previous
+// one returns.
+// Arg 0: replicas. 1 is the single-pool setup, one engine whose pool spans
+// every CPU; 0 starts one replica per NUMA node; larger counts split the
+// nodes into core groups.
+static void BM_ReplicatedSession(benchmark::State& state) {
+    constexpr int kClients = 16;
+    constexpr int kRequestsPerClient = 4;
+    ReplicaOptions options;
+    options.replicas = state.range(0);
+    ReplicatedSession session(makeModel(), options);
+    Tensor sample({1, 28, 28, 3});
+    sample.fillRandom();
+    for (size_t i = 0; i < session.numReplicas(); ++i) session.run(sample);
+
+    size_t requests = 0;
+    for (auto _ : state) {
+        std::vector<std::thread> clients;
+        for (int c = 0; c < kClients; ++c) {
+            clients.emplace_back([&] {
+                for (int r = 0; r < kRequestsPerClient; ++r) benchmark::DoNotOptimize(session.run(sample));
+            });
+        }
+        for (auto& client : clients) client.join();
+        requests += kClients * kRequestsPerClient;
+    }
+
+    state.counters["requests_per_s"] = benchmark::Counter(double(requests), benchmark::Counter::kIsRate);
+    state.counters["replicas"] = double(session.numReplicas());
+}
+
+BENCHMARK(BM_ReplicatedSession)->Arg(1)->Arg(0)->Arg(2)->Arg(4)->UseRealTime()->Unit(benchmark::kMillisecond);
@@ -0,0 +1,50 @@
+#include <benchmark/benchmark.h>
+#include <thread>
+#include <xnnpack.h>
+#include "operators.h"
+#include "threading_runtime.h"
+
+// Two branches run at once, as with inter-op parallelism: one runs an XNNPACK
+// Conv, the other a native parallel loop over a 4 MB activation.
+// Arg 0: 1 runs both on one shared pool, 2 gives the native loop a second
+// pool of the same size, as the native kernels' OpenMP team used to be.
+static void BM_SharedThreadpool(benchmark::State& state) {
+    const size_t threads = std::max(2u, std::thread::hardware_concurrency());
+    ThreadingOptions options;
+    options.threads = threads;
+    ThreadingRuntime runtime(options);
+    std::unique_ptr<ThreadingRuntime> native_runtime;
+    if (state.range(0) == 2) native_runtime = std::make_unique<ThreadingRuntime>(options);
+    pthreadpool_t native_pool = native_runtime ? native_runtime->threadpool() : runtime.threadpool();
+
+    Tensor input({1, 56, 56, 64});
+    Tensor weights({64, 3, 3, 64});
+    Tensor bias({64});
+    input.fillRandom();
+    weights.fillRandom();
+    bias.fillRandom();
+    xnn_initialize(nullptr);
+    Operators ops;
+    auto conv = ops.createConv2d(weights, bias, {3, 3}, {1, 1}, {1, 1, 1, 1}, {1, 1}, 1);
+    Tensor output;
+    std::vector<float> activation(1 << 20, 1.0f);
+
+    for (auto _ : state) {
+        std::thread native([&] {
+            for (int repeat = 0; repeat < 8; ++repeat) {
+                parallelFor(native_pool, activation.size() / 4096, [&](size_t block) {
+                    float* data = activation.data() + block * 4096;
+                    for (int i = 0; i < 4096; ++i) data[i] = data[i] * 0.999f + 0.001f;
+                });
+            }
+        });
+        ops.runConv2d(*conv, input, output, runtime.threadpool());
+        native.join();
+        benchmark::DoNotOptimize(output.data().data());
+    }
+
+    conv.reset();
+    xnn_deinitialize();
+}
+
+BENCHMARK(BM_SharedThreadpool)->Arg(1)->Arg(2)->UseRealTime()->Unit(benchmark::kMillisecond);
@@ -0,0 +1,79 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "session.h"
+
+struct AsyncOptions {
+    size_t max_in_flight = 4;  // submitted requests not yet completed; submit() blocks beyond this
+    size_t workers = 1;        // requests computed at once
+};
+
+// Non-blocking front-end over a Session.
+//
+// Requests go through two stages: a staging thread produces each request's
+// input (decoding, layout conversion, ...) and hands it to a compute worker
+// that runs the model. While a worker computes request N, the staging thread
+// is already preparing request N+1, and the caller is free to do its own work.
+// At most max_in_flight requests are between submit() and completion; further
+// submit() calls block until one completes, so a burst cannot queue unbounded
+// inputs.
+class AsyncSession {
+public:
+    // Produces a request's input; runs on the staging thread.
+    using Stage = std::function<Tensor()>;
+    // Receives the outputs, or the exception that prevented them, on a compute worker.
+    using Callback = std::function<void(std::vector<Tensor> outputs, std::exception_ptr error)>;
+
+    explicit AsyncSession(Session& session, AsyncOptions options = {});
+    // Completes every submitted request, then stops the threads.
+    ~AsyncSession();
+    AsyncSession(const AsyncSession&) = delete;
+    AsyncSession& operator=(const AsyncSession&) = delete;
+
+    // Runs the model outputs (Session::outputNames()) of the input made by `stage`.
+    // The request holds its in-flight slot until its callback has returned or
+    // its future is ready; see inFlight().
+    std::future<std::vector<Tensor>> submit(Stage stage);
+    std::future<std::vector<Tensor>> submit(Tensor input);
+    void submit(Stage stage, Callback done);
+
+    // Blocks until every request submitted so far has completed, callbacks included.
+    void wait();
+    // Requests submitted and not yet completed. A request stops counting only
+    // after its callback returns or its future is made ready, so a caller woken
+    // by a future may still see it here for a moment; wait() to observe 0.
+    // Callbacks therefore count against max_in_flight, and a slow callback
+    // holds back further submit() calls.
+    size_t inFlight() const;
+
+private:
+    struct Job {
+        Stage stage;
+        Callback done;
+        Tensor input;
+        std::exception_ptr error;
+    };
+
+    void stagingLoop();
+    void computeLoop();
+    void complete(Job& job, std::vector<Tensor> outputs, std::exception_ptr error);
+
+    Session& session_;
+    AsyncOptions options_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable staging_cv_;
+    std::condition_variable compute_cv_;
+    std::condition_variable done_cv_;  // a request completed
+    std::deque<Job> staging_queue_;
+    std::deque<Job> compute_queue_;
+    size_t in_flight_ = 0;
+    bool stopping_ = false;
+    std::vector<std::thread> threads_;
+};
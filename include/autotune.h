@@ -0,0 +1,92 @@
+#pragma once
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "graph.h"
+#include "operators.h"
+#include "threading_runtime.h"
+
+// Kernel computing a Conv node.
+enum class ConvAlgorithm {
+    Xnnpack,    // the node's XNNPACK operator (the default)
+    General,    // conv2d_general: any Conv
+    Pointwise,  // conv2d_pointwise: 1x1 kernel, one group, no padding
+    Depthwise,  // conv2d_depthwise: one group per input and output channel
+};
+
+const char* convAlgorithmName(ConvAlgorithm algorithm);
+
+// Kernel and intra-op thread count picked for a node at one input shape.
+struct TuningChoice {
+    ConvAlgorithm algorithm = ConvAlgorithm::Xnnpack;
+    size_t threads = 0;   // 0: the engine's whole pool
+    double micros = 0;    // measured time of one run
+};
+
+// Conv attributes, as the kernels take them.
+struct ConvParams {
+    std::vector<int> kernel_shape;  // empty: taken from the weights
+    std::vector<int> strides;
+    std::vector<int> pads;          // top, left, bottom, right
+    std::vector<int> dilations;
+    int groups = 1;
+    float output_min = Operators::kNoMin;  // fused Relu/Clip
+    float output_max = Operators::kNoMax;
+};
+
+ConvParams convParams(const GraphNode& node);
+
+// Kernels able to run a Conv with these attributes and weights
+// ([OC, KH, KW, IC/groups]); always starts with Xnnpack.
+std::vector<ConvAlgorithm> convCandidates(const ConvParams& params, const std::vector<int>& weights_shape);
+
+// Runs a Conv with `algorithm`. `xnn` is the node's XNNPACK operator, used
+// only by ConvAlgorithm::Xnnpack.
+void runConvWith(ConvAlgorithm algorithm, Operators& ops, XnnOperator& xnn, const ConvParams& params,
+                 const Tensor& input, const Tensor& weights, const Tensor& bias, Tensor& output,
+                 pthreadpool_t threadpool);
+
+// Times every candidate kernel at 1, 2, 4, ... threads up to all of
+// `threading`'s, on a random input of `input_shape`, and returns the fastest.
+// Each candidate runs once to warm up, then kTuningRuns times; the best run counts.
+constexpr int kTuningRuns = 3;
+TuningChoice autotuneConv(Operators& ops, const ThreadingRuntime& threading, const ConvParams& params,
+                          const Tensor& weights, const Tensor& bias, const std::vector<int>& input_shape);
+
+// Fingerprint of a model's nodes, attributes and initializers.
+uint64_t modelFingerprint(const ComputationGraph& graph);
+
+// Autotuning choices of one model on one CPU, stored in a text file so that
+// later startups reuse them instead of measuring again. Choices are keyed by
+// node and input shape (key()). A file written for another model or CPU is
+// ignored, and replaced by save(). Thread-safe.
+class TuningCache {
+public:
+    // Loads `path` if it exists and matches; an empty path keeps the choices in memory only.
+    TuningCache(std::string path, uint64_t model_fingerprint, std::string cpu = cpuModel());
+
+    std::optional<TuningChoice> find(const std::string& key) const;
+    void set(const std::string& key, const TuningChoice& choice);
+    size_t size() const;
+    // Choices read from the file at construction.
+    size_t loaded() const { return loaded_; }
+
+    // Writes every choice to the file; false (and logged) on I/O failure.
+    bool save() const;
+
+    // `node_name` (a node's first output) at `input_shape`, e.g. "conv1@1x224x224x3".
+    static std::string key(const std::string& node_name, const std::vector<int>& input_shape);
+    // CPU model name and hardware thread count, e.g. "Neoverse-N1 x64".
+    static std::string cpuModel();
+
+private:
+    std::string path_;
+    uint64_t model_;
+    std::string cpu_;
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, TuningChoice> choices_;
+    size_t loaded_ = 0;
+};
@@ -0,0 +1,66 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "session.h"
+
+struct BatchingOptions {
+    size_t max_batch = 8;                         // samples run together at most
+    std::chrono::microseconds max_wait{2000};     // longest a request waits for others to join its batch
+    size_t workers = 1;                           // batches run at once, each on its own Session context
+};
+
+// Front-end that coalesces single-sample requests into batched runs.
+//
+// run() queues a sample ([1, ...]) and blocks until its result is ready. A
+// worker takes the oldest request and waits up to max_wait from its arrival
+// for more; once max_batch requests are queued or the wait is over, it stacks
+// the queued samples shaped like the oldest one (max_batch at most) into one
+// [N, ...] input, runs the model once and hands every caller its own row of
+// each output. Samples of other shapes stay queued for a later batch. The model
+// must keep the batch as the leading dimension of its outputs.
+class BatchingServer {
+public:
+    struct Stats {
+        size_t requests = 0;
+        size_t batches = 0;
+        size_t largest_batch = 0;
+        double meanBatch() const { return batches ? static_cast<double>(requests) / batches : 0.0; }
+    };
+
+    explicit BatchingServer(ComputationGraph graph, BatchingOptions options = {},
+                            ExecutionEngine::Backend backend = ExecutionEngine::Backend::Native);
+    // Serves the requests still queued, then stops the workers.
+    ~BatchingServer();
+    BatchingServer(const BatchingServer&) = delete;
+    BatchingServer& operator=(const BatchingServer&) = delete;
+
+    // Returns the model outputs (Session::outputNames()) for `sample`, each
+    // with a leading dimension of 1. Safe to call from any number of threads.
+    // Throws std::runtime_error if `sample` is not a single sample or its batch fails.
+    std::vector<Tensor> run(const Tensor& sample);
+
+    Session& session() { return session_; }
+    const BatchingOptions& options() const { return options_; }
+    Stats stats() const;
+
+private:
+    struct Request;
+
+    void workerLoop();
+    void runBatch(const std::vector<Request*>& batch);
+
+    BatchingOptions options_;
+    Session session_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable queue_cv_;
+    std::deque<Request*> queue_;
+    bool stopping_ = false;
+    Stats stats_;
+    std::vector<std::thread> workers_;
+};
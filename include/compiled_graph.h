@@ -0,0 +1,45 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "graph.h"
+#include "tensor.h"
+#include "kernel_registry.h"
+
+// A node with its kernel and tensors resolved to slots of CompiledGraph.
+struct CompiledNode {
+    const GraphNode* node = nullptr;
+    const Kernel* kernel = nullptr;  // null if no kernel is registered for the op type
+    std::vector<int> inputs;
+    std::vector<int> outputs;
+    std::string label;  // "Op: <op_type>", for timers
+
+    // Filled in by the kernel's prepare() before the node first runs.
+    bool prepared = false;
+    std::unique_ptr<KernelState> state;
+};
+
+// graph.sorted_nodes with every tensor name resolved to a dense slot index and
+// every op type to its registered kernel, so that execution walks arrays
+// instead of hashing names.
+//
+// Slots point at the entries of graph.tensors, which stay at a fixed address
+// as long as they are not erased: tensors must be released by assigning an
+// empty Tensor, never by erasing them from the map.
+struct CompiledGraph {
+    std::vector<CompiledNode> nodes;  // in graph.sorted_nodes order
+    std::vector<Tensor*> slots;
+    std::unordered_map<std::string, int> slot_index;
+    int input_slot = -1;
+
+    std::unordered_map<const GraphNode*, size_t> node_index;
+
+    Tensor& tensor(int slot) const { return *slots[slot]; }
+    // Compiled form of `node`, for callers holding GraphNode pointers.
+    CompiledNode& at(const GraphNode* node) { return nodes[node_index.at(node)]; }
+};
+
+// Resolves every tensor referenced by the graph (plus "input") to a slot,
+// inserting empty entries into graph.tensors for activations not produced yet.
+std::shared_ptr<CompiledGraph> compileGraph(ComputationGraph& graph);
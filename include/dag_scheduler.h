@@ -0,0 +1,49 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "compiled_graph.h"
+#include "memory_planner.h"
+#include "tiled_execution.h"
+#include "work_stealing_pool.h"
+
+// Ordering constraints between the nodes of a CompiledGraph, by index.
+// A node may start once all of its predecessors have finished: the producers
+// of its inputs and, when activations share arena bytes, every node still
+// using a tensor that lived in the bytes its outputs are written to.
+struct NodeDependencies {
+    std::vector<std::vector<size_t>> successors;
+    std::vector<int> num_predecessors;
+    size_t num_edges = 0;
+};
+
+// `plan` may be null when activations are not placed in a shared arena. With
+// `tiles`, a chain's nodes are taken to all run with its first node.
+std::shared_ptr<NodeDependencies> buildDependencies(const CompiledGraph& graph, const MemoryPlan* plan,
+                                                    const TilePlan* tiles = nullptr);
+
+// Runs the nodes of a dependency graph on a work-stealing pool, each as soon as
+// its predecessors are done. The intra-op thread pool is handed to one node at
+// a time: fn(node, fan_out) is told whether the node may use it, and nodes
+// running alongside it are expected to run single-threaded, so concurrent
+// nodes never ask for more threads than the machine has.
+class DagScheduler {
+public:
+    // Workers are set up (pinned) and wait as `runtime` says, if given.
+    explicit DagScheduler(size_t threads, const ThreadingRuntime* runtime = nullptr)
+        : pool_(threads,
+                runtime ? WorkStealingPool::WorkerSetup([runtime](size_t index) { runtime->setupWorker(index); }) : nullptr,
+                runtime ? runtime->options().wait : WaitPolicy::Sleep) {}
+
+    size_t threads() const { return pool_.size(); }
+
+    // Blocks until every node has run. If fn throws, nodes not started yet are
+    // skipped and the first exception is rethrown.
+    void run(const NodeDependencies& dependencies, const std::function<void(size_t node, bool fan_out)>& fn);
+
+private:
+    WorkStealingPool pool_;
+    std::atomic<bool> intra_op_busy_{false};
+};
@@ -2,15 +2,117 @@
 #include "graph.h"
 #include "tensor.h"
 #include "operators.h"
+#include "weights_cache.h"
+#include "compiled_graph.h"
+#include "dag_scheduler.h"
+#include "threading_runtime.h"
+#include <memory>
 #include <pthreadpool.h>
 
+class TuningCache;
+
 class ExecutionEngine {
 public:
-    ExecutionEngine();
+    enum class Backend {
+        Native,           // node-by-node dispatch to Operators
+        XnnpackSubgraph,  // lower supported runs of nodes into XNNPACK runtimes, native fallback for the rest
+    };
+
+    // Engines given the same weights cache (e.g. WeightsCache::shared()) keep a
+    // single packed copy of identical Conv weights.
+    explicit ExecutionEngine(std::shared_ptr<WeightsCache> weights_cache = nullptr);
+    explicit ExecutionEngine(Backend backend, std::shared_ptr<WeightsCache> weights_cache = nullptr);
     ~ExecutionEngine();
+
+    // Runs every node's kernel prepare() once: attributes are parsed and the
+    // XNNPACK operators of Conv/MaxPool nodes created, so that executeGraph()
+    // only has to run them. Nodes not prepared here are prepared on first
+    // execution. Soft-finalizes the weights cache, if any, once all operators
+    // are created.
+    void prepare(ComputationGraph& graph);
+    // Additionally infers every tensor shape for `input_shape`, throwing
+    // std::runtime_error if the model is invalid for it, and with the native
+    // backend allocates all activations ahead of the first run.
+    void prepare(ComputationGraph& graph, const std::vector<int>& input_shape);
+    // With the native backend, the first run for a given input shape infers
+    // the activation shapes and builds graph.memory_plan; every intermediate
+    // is written into the plan's arena. Only graph outputs are guaranteed to
+    // hold their values after the run. Graphs containing kernels without a
+    // shape function discover the shapes during their first run instead.
+    // Plans are kept in graph.plan_cache, so returning to a recently seen
+    // input shape reuses its plan instead of planning again.
+    // Concurrent calls are safe as long as each uses a different graph; see
+    // Session for running one model from many threads.
     void executeGraph(ComputationGraph& graph, const Tensor& input);
+    // Selects `outputs` (see selectOutputs()) and runs the graph.
+    void executeGraph(ComputationGraph& graph, const Tensor& input, const std::vector<std::string>& outputs);
+
+    // Restricts prepare() and executeGraph() to the nodes `outputs` depend on;
+    // an empty list selects the whole graph again. The compiled nodes, XNNPACK
+    // lowering and memory plans of each output set are kept on the graph, so
+    // switching back to a set served before does not rebuild them. Throws
+    // std::runtime_error if an output is not produced by any node.
+    void selectOutputs(ComputationGraph& graph, std::vector<std::string> outputs);
+
+    // Number of input shapes whose memory plans are kept per graph (default 4).
+    // Each cached plan holds its own activation arena.
+    void setPlanCacheCapacity(size_t capacity) { plan_cache_capacity_ = capacity; }
+
+    // Number of nodes the native backend may run at once (default 1: nodes run
+    // one after another in sorted order). With more, every node is started as
+    // soon as its inputs are ready, so independent branches overlap. Only one
+    // running node at a time uses the intra-op thread pool; the others run
+    // single-threaded on their own worker.
+    void setInterOpThreads(size_t threads);
+    size_t interOpThreads() const { return scheduler_ ? scheduler_->threads() : 1; }
+
+    // Replaces the engine's threads (by default one intra-op thread per
+    // hardware thread, spin-waiting and unpinned). XNNPACK, the native kernels
+    // and the inter-op workers all run on this one runtime. Only before the
+    // first prepare() or executeGraph(): XNNPACK runtimes keep the pool they
+    // were created with.
+    void setThreading(const ThreadingOptions& options);
+    const ThreadingRuntime& threading() const { return *threading_; }
+
+    // Runs chains of Conv nodes depth first, in bands of rows whose input,
+    // intermediate and output bytes fit `tile_bytes`, so that intermediate
+    // activations stay in cache instead of going through memory (see
+    // tiled_execution.h). 0, the default, runs every Conv on its own. Applies
+    // to the native backend and to graphs compiled after the call.
+    void setTiledExecution(size_t tile_bytes) { tile_bytes_ = tile_bytes; }
+
+    // Picks the kernel (XNNPACK or one of the native convolutions) and the
+    // intra-op thread count of every Conv node, per input shape (autotune.h).
+    // prepare(graph, input_shape) times the candidates of each node that has
+    // no choice in `cache` yet, then saves the cache, so later startups with
+    // the same model on the same CPU skip the measuring. Runs use the choices
+    // found in the cache; other nodes and shapes keep XNNPACK on the whole
+    // pool. Native backend only; Convs of tiled chains are not tuned. Null,
+    // the default, disables autotuning.
+    void setAutotuning(std::shared_ptr<TuningCache> cache);
 
 private:
-    pthreadpool_t pthreadpool_;
+    void prepareNode(const CompiledGraph& graph, CompiledNode& step);
+    void autotune(const ComputationGraph& graph, const std::unordered_map<std::string, std::vector<int>>& shapes);
+    void buildMemoryPlan(ComputationGraph& graph, const std::vector<int>& input_shape,
+                         const std::unordered_map<std::string, std::vector<int>>& shapes);
+    void profileAndPlan(ComputationGraph& graph, const std::vector<int>& input_shape);
+    void bindMemoryPlan(ComputationGraph& graph, std::shared_ptr<MemoryPlan> plan);
+    PlanCache& planCache(ComputationGraph& graph);
+    static std::vector<TensorLifetime> lifetimes(const ComputationGraph& graph);
+    void executeNode(const CompiledGraph& graph, CompiledNode& step) { executeNode(graph, step, context_); }
+    void executeNode(const CompiledGraph& graph, CompiledNode& step, const KernelContext& context);
+    void executeParallel(ComputationGraph& graph);
+    void compile(ComputationGraph& graph);
+    void runStep(ComputationGraph& graph, CompiledNode& step, const KernelContext& context);
+
+    Backend backend_;
+    std::unique_ptr<ThreadingRuntime> threading_;
+    std::shared_ptr<WeightsCache> weights_cache_;
     Operators operators_;
+    KernelContext context_;
+    KernelContext serial_context_;  // context_ without the intra-op thread pool
+    std::unique_ptr<DagScheduler> scheduler_;
+    size_t plan_cache_capacity_ = 4;
+    size_t tile_bytes_ = 0;
 };
@@ -1,10 +1,18 @@
 #pragma once
+#include <map>
 #include <vector>
 #include <string>
+#include <memory>
 #include <unordered_map>
 #include "onnx.pb.h"
 #include "tensor.h"
 
+struct XnnGraphPlan;
+struct MemoryPlan;
+class PlanCache;
+struct CompiledGraph;
+struct TilePlan;
+
 struct GraphNode {
     std::string op_type;
     std::vector<std::string> inputs;
@@ -12,12 +20,46 @@ struct GraphNode {
     std::vector<onnx::AttributeProto> attributes; 
 };
 
+// Execution state built for one set of requested outputs; see
+// ExecutionEngine::selectOutputs().
+struct OutputSelection {
+    std::vector<const GraphNode*> sorted_nodes;
+    std::shared_ptr<XnnGraphPlan> xnn_plan;
+    std::shared_ptr<CompiledGraph> compiled;
+    std::shared_ptr<PlanCache> plan_cache;
+    std::shared_ptr<TilePlan> tile_plan;
+};
+
 class ComputationGraph {
 public:
     std::vector<GraphNode> nodes; // original order
     std::vector<const GraphNode*> sorted_nodes; // topologically sorted
     std::unordered_map<std::string, Tensor> tensors;
 
+    // Lowering used by the XNNPACK subgraph backend, built on first execution.
+    std::shared_ptr<XnnGraphPlan> xnn_plan;
+    // Slot-resolved form of sorted_nodes, built on first execution.
+    std::shared_ptr<CompiledGraph> compiled;
+    // Conv chains the native backend runs band by band, planned along with
+    // `compiled` when tiled execution is enabled.
+    std::shared_ptr<TilePlan> tile_plan;
+    // Activation arena layout of the native backend, built on first execution.
+    std::shared_ptr<MemoryPlan> memory_plan;
+    // Memory plans of recent input shapes, including memory_plan.
+    std::shared_ptr<PlanCache> plan_cache;
+
+    // Outputs declared by the model (GraphProto.output), in order. They keep
+    // their own storage even when later nodes read them. Empty for graphs built
+    // in code, whose outputs are the tensors no node reads.
+    std::vector<std::string> outputs;
+    // Outputs sorted_nodes is pruned to, sorted; empty when every node runs.
+    std::vector<std::string> requested_outputs;
+    // State of the other output sets used so far, keyed like requested_outputs.
+    std::map<std::vector<std::string>, OutputSelection> output_selections;
+
+    // True if `name` must outlive the run: a graph output or requested output.
+    bool keepsOutput(const std::string& name) const;
+
     void topologicalSort();
     void printNodes();
     void printSortedNodes();
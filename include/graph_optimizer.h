@@ -0,0 +1,52 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "graph.h"
+
+// Graph rewrites applied after parsing, before the graph is executed or saved
+// as an execution plan. They read and replace initializers in graph.tensors, so
+// they must run before the graph is compiled.
+
+// Moves a graph from ONNX's NCHW layout to the NHWC layout of the spatial
+// kernels (Conv, pooling, BatchNormalization). The layout of every tensor is
+// tracked from the graph input on: elementwise ops keep their input's layout,
+// and a Transpose is inserted only where a consumer needs the other layout.
+// Conv weights are reordered to OHWI (through a Transpose when a node computes
+// them; foldConstants() folds it for Constant weights), 4D constants of
+// elementwise ops with NHWC operands are permuted, and 4D graph `outputs` are
+// converted back to NCHW.
+// Runs cancelTransposes() afterwards. Called by ONNXModel::parseGraph().
+void assignLayouts(ComputationGraph& graph, const std::vector<std::string>& outputs);
+
+// Merges each Transpose reading another Transpose's output into one, removing
+// both when they cancel out. Tensors in `outputs` are kept. Returns the number
+// of pairs merged.
+size_t cancelTransposes(ComputationGraph& graph, const std::vector<std::string>& outputs);
+
+// Evaluates every node whose inputs are all initializers (or outputs of such
+// nodes), Constant nodes included, once with its registered kernel and turns
+// its outputs into initializers. Steady-state runs then only execute nodes that
+// depend on the graph input. Returns the number of nodes folded.
+size_t foldConstants(ComputationGraph& graph);
+
+// Folds each BatchNormalization whose input comes from a Conv with initializer
+// weights, and is read by nothing else and not a graph output, into that Conv's weights and bias:
+//   w' = w * scale / sqrt(var + eps),  b' = (b - mean) * scale / sqrt(var + eps) + B
+// The BatchNormalization node is removed. Returns the number of nodes folded.
+size_t foldBatchNorms(ComputationGraph& graph);
+
+// Fuses each Relu or Clip whose input comes from a Conv or Gemm, and is read by
+// nothing else and not a graph output, into that node's output clamp, stored as its (TinyONNX-specific)
+// "activation_min" and "activation_max" float attributes. The Relu/Clip node and
+// its input tensor disappear. Returns the number of nodes fused.
+size_t fuseActivations(ComputationGraph& graph);
+
+// The nodes of `sorted_nodes` that `outputs` depend on, in the same order.
+// Throws std::runtime_error if an output is not produced by any of them.
+std::vector<const GraphNode*> pruneToOutputs(const std::vector<const GraphNode*>& sorted_nodes,
+                                             const std::vector<std::string>& outputs);
+
+// Runs foldConstants(), foldBatchNorms() and fuseActivations(), in that order.
+// Each pass leaves graph.sorted_nodes up to date.
+void optimizeGraph(ComputationGraph& graph);
@@ -0,0 +1,92 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <pthreadpool.h>
+#include "graph.h"
+#include "operators.h"
+#include "tensor.h"
+#include "weights_cache.h"
+
+struct CompiledGraph;
+struct CompiledNode;
+class ThreadingRuntime;
+class TuningCache;
+
+// Per-node data a kernel computes once in prepare() and reuses on every run,
+// typically the node's parsed attributes and any persistent backend operator.
+struct KernelState {
+    virtual ~KernelState() = default;
+};
+
+// Engine-wide resources available to kernels.
+struct KernelContext {
+    Operators& ops;
+    pthreadpool_t threadpool;
+    std::shared_ptr<WeightsCache> weights_cache;
+    uint32_t threadpool_flags = 0;  // for the kernel's own parallel loops (ThreadingRuntime::parallelFlags())
+    const ThreadingRuntime* threading = nullptr;    // owner of threadpool, for its smaller pools
+    std::shared_ptr<TuningCache> tuning = nullptr;  // autotuned kernel choices, if enabled
+};
+
+// The tensors bound to one node.
+class KernelArgs {
+public:
+    KernelArgs(const CompiledGraph& graph, const CompiledNode& node) : graph_(graph), node_(node) {}
+
+    size_t numInputs() const;
+    const Tensor& input(size_t i) const;
+    Tensor& output(size_t i = 0) const;
+
+private:
+    const CompiledGraph& graph_;
+    const CompiledNode& node_;
+};
+
+// A node's tensor shapes during ahead-of-time shape inference.
+struct ShapeArgs {
+    std::vector<std::vector<int>> inputs;
+    std::vector<const Tensor*> values;  // inputs whose contents are known ahead of time (initializers), else null
+    std::vector<std::vector<int>> outputs;
+    std::vector<Tensor> output_values;  // set by kernels whose outputs are known ahead of time (Constant)
+    uint64_t flops = 0;
+};
+
+// An operator implementation.
+//   - prepare() parses the node's attributes into a KernelState. It runs once per
+//     node, either from ExecutionEngine::prepare() or before the first run.
+//     Inputs produced by other nodes are still empty at that point.
+//     May be null for kernels without state.
+//   - run() computes the node's outputs from its inputs and that state.
+//   - infer() fills in the output shapes and FLOPs of the node from its input
+//     shapes, throwing std::runtime_error if the inputs are invalid for it.
+//     Graphs with nodes lacking infer() fall back to discovering shapes on
+//     their first run.
+struct Kernel {
+    using PrepareFn = std::unique_ptr<KernelState> (*)(const GraphNode& node, const KernelContext& ctx, const KernelArgs& args);
+    using RunFn = void (*)(KernelState* state, const KernelContext& ctx, const KernelArgs& args);
+    using InferFn = void (*)(const GraphNode& node, ShapeArgs& shapes);
+
+    PrepareFn prepare = nullptr;
+    RunFn run = nullptr;
+    InferFn infer = nullptr;
+};
+
+// Maps ONNX op types to kernels. The built-in operators are registered on first
+// use; further kernels can be added before a graph is compiled.
+class KernelRegistry {
+public:
+    static KernelRegistry& instance();
+
+    // Replaces any kernel already registered for op_type.
+    void add(const std::string& op_type, Kernel kernel);
+    const Kernel* find(const std::string& op_type) const;
+
+private:
+    KernelRegistry();
+    std::unordered_map<std::string, Kernel> kernels_;
+};
+
+// Defined in kernels.cpp.
+void registerBuiltinKernels(KernelRegistry& registry);
@@ -0,0 +1,96 @@
+#pragma once
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "graph.h"
+
+struct NodeDependencies;
+
+// Live range of an intermediate tensor, in positions of graph.sorted_nodes.
+struct TensorLifetime {
+    std::string name;
+    size_t first_use = 0;  // node producing the tensor
+    size_t last_use = 0;   // last node reading it
+    size_t bytes = 0;
+};
+
+// Offsets of every intermediate tensor inside one shared activation arena.
+// Two tensors share bytes only if their live ranges do not overlap.
+struct MemoryPlan {
+    static constexpr size_t kAlignment = 64;
+
+    std::vector<int> input_shape;  // graph input shape the plan was built for
+    std::unordered_map<std::string, size_t> offsets;
+    std::unordered_map<std::string, std::vector<int>> shapes;
+    std::unordered_map<std::string, std::vector<int>> output_shapes;  // node outputs kept outside the arena
+    size_t arena_bytes = 0;
+    size_t unplanned_bytes = 0;  // sum of all planned tensors, i.e. the footprint without reuse
+
+    std::shared_ptr<float> arena;  // kAlignment-aligned, arena_bytes long
+    // Node ordering that keeps concurrently running nodes out of each other's
+    // arena bytes; built on the first parallel run with this plan.
+    std::shared_ptr<NodeDependencies> dependencies;
+
+    // Replaces every planned tensor in graph.tensors with a view into the arena.
+    void bind(ComputationGraph& graph);
+};
+
+// Activations produced by a node and read by a later node. Graph outputs (never
+// read, or kept by graph.keepsOutput()) and Constant outputs are excluded: they must survive the run or are
+// materialized once, so they keep their own storage.
+// `bytes` is left at 0; planMemory() fills it in from the recorded shapes.
+std::vector<TensorLifetime> computeLifetimes(const ComputationGraph& graph);
+
+// Greedy-by-size offset assignment: tensors are placed largest first, each into
+// the smallest gap not used by a tensor whose live range overlaps its own.
+// Tensors without an entry in `shapes` are left out of the plan.
+std::shared_ptr<MemoryPlan> planMemory(const std::vector<TensorLifetime>& lifetimes,
+                                       const std::unordered_map<std::string, std::vector<int>>& shapes);
+
+// Largest sum of bytes of the planned tensors (see computeLifetimes()) live
+// at once while graph.sorted_nodes runs in order: a lower bound of the arena
+// any plan for that order needs. Tensors without a shape count as empty.
+size_t peakLiveBytes(const ComputationGraph& graph, const std::unordered_map<std::string, std::vector<int>>& shapes);
+
+struct MemoryOrdering {
+    size_t fifo_peak_bytes = 0;  // peakLiveBytes() of the order the graph had
+    size_t peak_bytes = 0;       // peakLiveBytes() of the chosen order
+};
+
+// Reorders graph.sorted_nodes to keep fewer activations alive at once. Among
+// the nodes whose inputs are ready, the one that grows the live set least
+// (bytes of its outputs minus bytes of inputs it is the last reader of) runs
+// next, which finishes a branch before starting the next instead of
+// advancing all branches in step. The original order is kept if it peaks
+// lower. Must be called before the graph is first executed or has outputs
+// selected; throws std::runtime_error otherwise.
+MemoryOrdering orderForMemory(ComputationGraph& graph, const std::unordered_map<std::string, std::vector<int>>& shapes);
+
+// The memory plans of the most recently executed input shapes. Each plan keeps
+// its own arena, so switching between cached shapes only rebinds views; the
+// least recently used plan is dropped once `capacity` plans are held.
+class PlanCache {
+public:
+    explicit PlanCache(size_t capacity = 4) : capacity_(capacity) {}
+
+    // Returns the plan built for input_shape, or null, and counts a hit or miss.
+    std::shared_ptr<MemoryPlan> find(const std::vector<int>& input_shape);
+    void insert(std::shared_ptr<MemoryPlan> plan);
+    void setCapacity(size_t capacity);
+
+    size_t size() const { return plans_.size(); }
+    size_t capacity() const { return capacity_; }
+    size_t hits() const { return hits_; }
+    size_t misses() const { return misses_; }
+
+private:
+    void evict();
+
+    size_t capacity_;
+    std::list<std::shared_ptr<MemoryPlan>> plans_;  // most recently used first
+    size_t hits_ = 0;
+    size_t misses_ = 0;
+};
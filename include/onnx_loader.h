@@ -1,14 +1,33 @@
 #pragma once
+#include <memory>
 #include <string>
+#include <unordered_map>
+#include <vector>
 #include "onnx.pb.h"
 #include "graph.h"
+#include "utils/mapped_file.h"
 
 class ONNXModel {
 public:
     ONNXModel();
-    bool load(const std::string& model_path);
+
+    // With use_mmap the model file and its external-data files are memory mapped
+    // and float initializers in the parsed graph alias the mapping instead of
+    // being copied.
+    bool load(const std::string& model_path, bool use_mmap = false);
     ComputationGraph parseGraph();
 
 private:
+    Tensor loadInitializer(int index, const onnx::TensorProto& initializer);
+    Tensor loadExternalInitializer(const onnx::TensorProto& initializer);
+    std::shared_ptr<MappedFile> mapExternalFile(const std::string& location);
+
     onnx::ModelProto model_proto_;
+    std::string model_dir_;
+    bool use_mmap_ = false;
+    std::shared_ptr<MappedFile> model_file_;
+    // raw_data payload of each initializer inside model_file_ (nullptr when absent),
+    // indexed like graph().initializer().
+    std::vector<std::pair<char*, size_t>> raw_data_;
+    std::unordered_map<std::string, std::shared_ptr<MappedFile>> external_files_;
 };
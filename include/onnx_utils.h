@@ -1,4 +1,5 @@
 #pragma once
+#include <functional>
 #include <string>
 #include "onnx.pb.h"
 #include "graph.h"
@@ -6,3 +7,10 @@
 float getFloatAttr(const GraphNode* node, const std::string& name, float default_value);
 int64_t getIntAttr(const GraphNode* node, const std::string& name, int64_t default_value);
 std::vector<int> getIntListAttr(const GraphNode* node, const std::string& name);
+
+// Clamp range of a Relu or Clip node. Clip bounds come from its optional min/max
+// inputs (opset 11+), else from its attributes, which default to 0 and 6.
+// `bound(i)` gives the value of input i, or null if it is not known yet; returns
+// false if a bound input is given but not known.
+bool activationRange(const GraphNode& node, const std::function<const Tensor*(size_t)>& bound,
+                     float& min_val, float& max_val);
@@ -1,21 +1,96 @@
 #pragma once
 #include "tensor.h"
+#include "weights_cache.h"
+#include <limits>
+#include <memory>
+#include <xnnpack.h>
 #include <pthreadpool.h>
 
+// XNNPACK operator that outlives a single inference. Weights are packed once at
+// creation; the operator is reshaped again only when the input dims change.
+struct XnnOperator {
+    XnnOperator() = default;
+    ~XnnOperator();
+    XnnOperator(const XnnOperator&) = delete;
+    XnnOperator& operator=(const XnnOperator&) = delete;
+
+    float* workspaceData();
+
+    xnn_operator_t op = nullptr;
+    int channels = 0;                // output channels (Conv) or pooled channels (MaxPool)
+    std::vector<int> input_shape;    // shape the operator is currently reshaped for
+    std::vector<int> output_shape;
+    std::vector<char> workspace;
+    size_t workspace_alignment = 1;
+    std::shared_ptr<WeightsCache> weights_cache;  // keeps packed weights alive while op exists
+};
+
+// Every operator comes in two forms: one returning a freshly allocated Tensor,
+// and one writing into `output`. The latter reuses output's storage, e.g. a
+// view into the engine's activation arena, when it already has the result shape.
+// Conv and Gemm clamp their outputs to [output_min, output_max], which lets a
+// following Relu or Clip be fused into them.
+// The native operators split their loops over `threadpool` in tiles (see
+// parallelForTiles()); without one, or for tensors too small to be worth
+// splitting, they run on the calling thread. Results do not depend on the
+// number of threads.
 class Operators {
 public:
+    static constexpr float kNoMin = -std::numeric_limits<float>::infinity();
+    static constexpr float kNoMax = +std::numeric_limits<float>::infinity();
+
+    // pthreadpool flags of the native operators' parallel loops.
+    void setParallelFlags(uint32_t flags) { parallel_flags_ = flags; }
+
     Tensor transpose(const Tensor& input, const std::vector<int>& perm);
+    void transpose(const Tensor& input, const std::vector<int>& perm, Tensor& output, pthreadpool_t threadpool = nullptr);
     Tensor conv2d(const Tensor& input, const Tensor& weights, const Tensor& bias, const std::vector<int>& kernel_shape, const std::vector<int>& strides, const std::vector<int>& pads, const std::vector<int>& dilations, int groups, pthreadpool_t threadpool);
+    std::unique_ptr<XnnOperator> createConv2d(const Tensor& weights, const Tensor& bias, const std::vector<int>& kernel_shape, const std::vector<int>& strides, const std::vector<int>& pads, const std::vector<int>& dilations, int groups, std::shared_ptr<WeightsCache> weights_cache = nullptr, float output_min = kNoMin, float output_max = kNoMax);
+    Tensor runConv2d(XnnOperator& conv, const Tensor& input, pthreadpool_t threadpool);
+    void runConv2d(XnnOperator& conv, const Tensor& input, Tensor& output, pthreadpool_t threadpool);
     Tensor matmul(const Tensor& a, const Tensor& b);
+    void matmul(const Tensor& a, const Tensor& b, Tensor& output, pthreadpool_t threadpool = nullptr);
     Tensor gemm(const Tensor& a, const Tensor& b, const Tensor& c, float alpha, float beta);
+    void gemm(const Tensor& a, const Tensor& b, const Tensor& c, float alpha, float beta, Tensor& output, float output_min = kNoMin, float output_max = kNoMax, pthreadpool_t threadpool = nullptr);
     Tensor gemm_transB(const Tensor& a, const Tensor& b, const Tensor& c, float alpha, float beta);
+    void gemm_transB(const Tensor& a, const Tensor& b, const Tensor& c, float alpha, float beta, Tensor& output, float output_min = kNoMin, float output_max = kNoMax, pthreadpool_t threadpool = nullptr);
     Tensor add(const Tensor& a, const Tensor& b);
+    void add(const Tensor& a, const Tensor& b, Tensor& output, pthreadpool_t threadpool = nullptr);
     Tensor relu(const Tensor& input);
+    void relu(const Tensor& input, Tensor& output, pthreadpool_t threadpool = nullptr);
     Tensor clip(const Tensor& input, float min_val, float max_val);
-    Tensor softmax(const Tensor& input);
+    void clip(const Tensor& input, float min_val, float max_val, Tensor& output, pthreadpool_t threadpool = nullptr);
+    // Normalizes every slice of `input` along `axis` (negative values count
+    // from the last dim), as ONNX Softmax does from opset 13. With `coerce_2d`
+    // a slice spans all dims from `axis` on instead, as in earlier opsets.
+    Tensor softmax(const Tensor& input, int axis = -1, bool coerce_2d = false);
+    void softmax(const Tensor& input, int axis, bool coerce_2d, Tensor& output, pthreadpool_t threadpool = nullptr);
     Tensor batchNorm(const Tensor& input, const Tensor& scale, const Tensor& bias, const Tensor& mean, const Tensor& var, float epsilon);
+    void batchNorm(const Tensor& input, const Tensor& scale, const Tensor& bias, const Tensor& mean, const Tensor& var, float epsilon, Tensor& output, pthreadpool_t threadpool = nullptr);
     Tensor globalAveragePool(const Tensor& input);
+    void globalAveragePool(const Tensor& input, Tensor& output, pthreadpool_t threadpool = nullptr);
     Tensor maxPool(const Tensor& input, int ceil_mode, const std::vector<int>& dilations, const std::vector<int>& kernel_shape, const std::vector<int>& pads, const std::vector<int>& strides, pthreadpool_t pthreadpool);
+    std::unique_ptr<XnnOperator> createMaxPool(int ceil_mode, const std::vector<int>& dilations, const std::vector<int>& kernel_shape, const std::vector<int>& pads, const std::vector<int>& strides);
+    Tensor runMaxPool(XnnOperator& pool, const Tensor& input, pthreadpool_t threadpool);
+    void runMaxPool(XnnOperator& pool, const Tensor& input, Tensor& output, pthreadpool_t threadpool);
     Tensor reshape(const Tensor& input, const std::vector<int>& new_shape);
+    void reshape(const Tensor& input, const std::vector<int>& new_shape, Tensor& output);
     Tensor flatten(const Tensor& input, int axis);
+    void flatten(const Tensor& input, int axis, Tensor& output);
+
+private:
+    uint32_t parallel_flags_ = 0;
 };
+
+// Native convolutions (src/conv2d.cpp) on the layouts of Operators::runConv2d(),
+// clamped to [output_min, output_max]; autotuning (autotune.h) weighs them
+// against XNNPACK. pads are top, left, bottom, right.
+void conv2d_general(const Tensor& input, const Tensor& weights, const Tensor& bias,
+                    const std::vector<int>& strides, const std::vector<int>& pads, const std::vector<int>& dilations, int groups,
+                    float output_min, float output_max, Tensor& output, pthreadpool_t threadpool);
+void conv2d_pointwise(const Tensor& input, const Tensor& weights, const Tensor& bias,
+                      const std::vector<int>& strides, float output_min, float output_max, Tensor& output,
+                      pthreadpool_t threadpool);
+void conv2d_depthwise(const Tensor& input, const Tensor& weights, const Tensor& bias,
+                      const std::vector<int>& strides, const std::vector<int>& pads, const std::vector<int>& dilations,
+                      float output_min, float output_max, Tensor& output, pthreadpool_t threadpool);
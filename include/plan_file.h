@@ -0,0 +1,23 @@
+#pragma once
+#include <string>
+#include "graph.h"
+
+// Precompiled execution plan (.tplan).
+//
+// A plan is the output of ONNXModel::parseGraph() frozen to disk: nodes are
+// stored in topological order, Conv weights are already reordered to OHWI and
+// the layout transposes are already inserted. Tensor payloads are 64-byte
+// aligned so loadPlan() can mmap the file and hand out views into it without
+// parsing protobuf or touching the weights.
+//
+// Layout (little-endian):
+//   header   magic "TPLAN\0\0\0", u32 version, u32 tensor count, u32 node count,
+//            u32 reserved, u64 metadata offset, u64 metadata size, u64 data offset
+//   metadata per tensor: name, u32 rank, i32 dims[rank], u64 offset, u64 bytes
+//            per node:   op_type, inputs, outputs, serialized AttributeProtos
+//            then the graph output names
+//   data     tensor payloads, each starting on a 64-byte boundary
+
+bool savePlan(const ComputationGraph& graph, const std::string& path);
+bool isPlanFile(const std::string& path);
+bool loadPlan(const std::string& path, ComputationGraph& graph);
@@ -0,0 +1,61 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "session.h"
+#include "threading_runtime.h"
+
+struct ReplicaOptions {
+    size_t replicas = 0;                     // 0: one per NUMA node; see cpuGroups() for other counts
+    std::vector<std::vector<int>> cpu_groups; // CPUs of each replica; overrides `replicas` when set
+    size_t threads = 0;                      // intra-op threads per replica; 0 uses every CPU of its group
+    bool pin_threads = true;                 // pin each replica's pool threads to the CPUs of its group
+    WaitPolicy wait = WaitPolicy::Spin;
+    size_t workers = 1;                      // requests each replica computes at once
+};
+
+// Several independent copies of a model, one per NUMA node or core group,
+// behind a round-robin dispatcher.
+//
+// A single engine's pool spans every socket, so on a multi-socket machine its
+// threads keep reading activations and weights from the other node's memory.
+// Here each replica is a Session with its own thread pool and workers, all
+// restricted to the CPUs of its group. The replica's copy of the initializers,
+// its packed weights and its activation arenas are first written by those
+// threads, so the kernel's first-touch policy places them on the replica's
+// node, and a request never leaves the node it was dispatched to.
+class ReplicatedSession {
+public:
+    // Copies the initializers of `graph` (sorted, and optimized if wanted)
+    // once per replica, including those that are views of a mapped file.
+    explicit ReplicatedSession(const ComputationGraph& graph, ReplicaOptions options = {},
+                               ExecutionEngine::Backend backend = ExecutionEngine::Backend::Native);
+    // Completes the requests already dispatched, then stops the workers.
+    ~ReplicatedSession();
+    ReplicatedSession(const ReplicatedSession&) = delete;
+    ReplicatedSession& operator=(const ReplicatedSession&) = delete;
+
+    // Runs the request on the next replica in turn and blocks until it is
+    // done; as Session::run(). Safe to call from any number of threads.
+    std::vector<Tensor> run(const Tensor& input, const std::vector<std::string>& outputs = {});
+
+    size_t numReplicas() const { return replicas_.size(); }
+    const std::vector<int>& replicaCpus(size_t replica) const;
+    Session& replica(size_t replica);
+    // Requests dispatched to each replica so far.
+    std::vector<size_t> requestsPerReplica() const;
+
+private:
+    struct Job;
+    struct Replica;
+
+    void workerLoop(Replica& replica);
+
+    std::vector<std::unique_ptr<Replica>> replicas_;
+    std::atomic<size_t> next_{0};
+};
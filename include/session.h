@@ -0,0 +1,67 @@
+#pragma once
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "execution_engine.h"
+#include "graph.h"
+#include "tensor.h"
+
+// A loaded model that many threads can run at once.
+//
+// The nodes and initializers are held once, immutable, and shared by every
+// request. Each run() borrows an execution context from a pool: a graph whose
+// initializers are views of the model's, holding only that context's compiled
+// nodes, memory plans and activations. Contexts are created on demand, so the
+// pool grows to the largest number of concurrent runs and is reused after that.
+// All contexts run on one ExecutionEngine and share its weights cache, so the
+// packed Conv weights are not duplicated either.
+//
+// They also share the engine's intra-op thread pool, which runs one parallel
+// loop at a time: concurrent runs overlap only in their serial parts and take
+// turns on the pool for each kernel. The exception are autotuned Conv layers
+// running on a smaller pool (ThreadingRuntime::threadpool(size_t)): it is
+// pinned to the same first CPUs but does not take turns with the main pool, so
+// such a layer and another run's kernel can oversubscribe those cores. To
+// scale with concurrent requests instead, give the engine a single thread
+// (ThreadingOptions::threads = 1), so each run computes on its caller's
+// thread, or use a ReplicatedSession.
+class Session {
+public:
+    // Takes over `graph` (sorted, and optimized if wanted); any state of earlier
+    // executions is dropped. Only the initializers are kept as tensors.
+    explicit Session(ComputationGraph graph,
+                     ExecutionEngine::Backend backend = ExecutionEngine::Backend::Native);
+    Session(const Session&) = delete;
+    Session& operator=(const Session&) = delete;
+
+    // Runs the model on `input` and returns a copy of each of `outputs`, in
+    // order; the default is outputNames(). Safe to call from any number of
+    // threads. Throws std::runtime_error if an output is not produced by any node.
+    std::vector<Tensor> run(const Tensor& input, const std::vector<std::string>& outputs = {});
+
+    // The model's declared graph outputs; for graphs without any, the tensors
+    // produced by a node and read by none.
+    const std::vector<std::string>& outputNames() const { return output_names_; }
+    const ComputationGraph& model() const { return *model_; }
+
+    // Configures the engine shared by all contexts; only before the first run().
+    ExecutionEngine& engine() { return engine_; }
+    std::shared_ptr<WeightsCache> weightsCache() const { return weights_cache_; }
+
+    // Execution contexts created so far.
+    size_t numContexts() const;
+
+private:
+    std::unique_ptr<ComputationGraph> acquire();
+    void release(std::unique_ptr<ComputationGraph> context);
+
+    std::shared_ptr<const ComputationGraph> model_;
+    std::vector<std::string> output_names_;
+    std::shared_ptr<WeightsCache> weights_cache_;
+    ExecutionEngine engine_;
+
+    mutable std::mutex mutex_;
+    std::vector<std::unique_ptr<ComputationGraph>> idle_;
+    size_t num_contexts_ = 0;
+};
@@ -0,0 +1,32 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "graph.h"
+
+struct NodeCost {
+    const GraphNode* node = nullptr;
+    std::vector<std::vector<int>> output_shapes;
+    uint64_t flops = 0;
+    size_t output_bytes = 0;
+};
+
+// Result of propagating the graph input shape through graph.sorted_nodes.
+struct GraphShapes {
+    std::vector<int> input_shape;
+    std::unordered_map<std::string, std::vector<int>> shapes;  // every node output
+    std::vector<NodeCost> nodes;  // in graph.sorted_nodes order
+    uint64_t total_flops = 0;
+    size_t activation_bytes = 0;  // sum of all node outputs
+    // False if a node's kernel cannot infer shapes; `nodes` stops before it.
+    bool complete = true;
+
+    void print() const;
+};
+
+// Infers every node output shape from the shape of "input", using each kernel's
+// infer() function. Throws std::runtime_error naming the node if the model is
+// invalid for that input shape, e.g. channel or inner-dimension mismatches.
+GraphShapes inferShapes(const ComputationGraph& graph, const std::vector<int>& input_shape);
@@ -1,5 +1,60 @@
 #pragma once
 #include <vector>
+#include <memory>
+#include <cassert>
+#include <cstddef>
+#include <algorithm>
+#include <initializer_list>
+#include <type_traits>
+
+// Contiguous view over a tensor's float storage. Behaves like a fixed-size
+// std::vector for element access, iteration and comparison.
+template <typename T>
+class TensorSpan {
+public:
+    using value_type = std::remove_const_t<T>;
+    using iterator = T*;
+    using const_iterator = const T*;
+
+    TensorSpan(T* data, size_t size) : data_(data), size_(size) {}
+    TensorSpan(const TensorSpan&) = default;
+    TensorSpan& operator=(const TensorSpan&) = delete;
+
+    TensorSpan& operator=(std::initializer_list<value_type> values) {
+        assert(values.size() == size_ && "Value count does not match tensor size");
+        std::copy(values.begin(), values.end(), data_);
+        return *this;
+    }
+
+    TensorSpan& operator=(const std::vector<value_type>& values) {
+        assert(values.size() == size_ && "Value count does not match tensor size");
+        std::copy(values.begin(), values.end(), data_);
+        return *this;
+    }
+
+    operator std::vector<value_type>() const { return {data_, data_ + size_}; }
+
+    T* data() const { return data_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    T& operator[](size_t i) const { return data_[i]; }
+    T* begin() const { return data_; }
+    T* end() const { return data_ + size_; }
+
+private:
+    T* data_;
+    size_t size_;
+};
+
+template <typename T, typename U>
+bool operator==(const TensorSpan<T>& a, const TensorSpan<U>& b) {
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin());
+}
+
+template <typename T>
+bool operator==(const TensorSpan<T>& a, const std::vector<float>& b) {
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin());
+}
 
 class Tensor {
 public:
@@ -7,15 +62,29 @@ public:
     Tensor(const std::vector<int>& shape);
     Tensor(const std::vector<int>& shape, const std::vector<float>& data);
 
+    // Wraps memory owned elsewhere (e.g. an mmapped model file) without copying.
+    // `keepalive` keeps the backing storage valid for as long as any copy of the view exists.
+    static Tensor view(const std::vector<int>& shape, float* data, std::shared_ptr<void> keepalive);
+
+    // Keeps the current storage (owned or view) if it already has `shape`;
+    // otherwise replaces it with zero-initialized owned storage of that shape.
+    void ensureShape(const std::vector<int>& shape);
+
     void fillRandom();
     void reorderOIHWtoOHWI();
     void print() const;
 
-    std::vector<int> shape() const { return shape_; }
-    std::vector<float>& data() { return data_; }
-    const std::vector<float>& data() const { return data_; }
+    const std::vector<int>& shape() const { return shape_; }
+    size_t size() const { return external_ ? external_size_ : data_.size(); }
+    bool isView() const { return external_ != nullptr; }
+
+    TensorSpan<float> data() { return {external_ ? external_ : data_.data(), size()}; }
+    TensorSpan<const float> data() const { return {external_ ? external_ : data_.data(), size()}; }
 
 private:
     std::vector<int> shape_;
     std::vector<float> data_;
+    float* external_ = nullptr;
+    size_t external_size_ = 0;
+    std::shared_ptr<void> keepalive_;
 };
@@ -0,0 +1,150 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <pthreadpool.h>
+
+// How idle pool threads wait for the next parallel loop or task.
+enum class WaitPolicy {
+    Spin,   // poll briefly before sleeping: lowest wake-up latency between back-to-back kernels
+    Sleep,  // give the core back right away: for machines shared with other work
+};
+
+struct ThreadingOptions {
+    size_t threads = 0;         // intra-op threads, caller included; 0 uses every hardware thread
+    bool pin_threads = false;   // pin each pool thread to its own CPU
+    std::vector<int> cpus;      // CPUs to pin to, in order; empty means 0, 1, 2, ...
+    WaitPolicy wait = WaitPolicy::Spin;
+};
+
+// The one set of threads an ExecutionEngine computes on. The pthreadpool it
+// owns is handed to XNNPACK and to the native kernels (KernelContext), and the
+// inter-op workers of the DAG scheduler follow the same pinning and wait
+// policy, so kernels never bring up a thread team of their own that would
+// compete with it for the cores.
+class ThreadingRuntime {
+public:
+    explicit ThreadingRuntime(ThreadingOptions options = {});
+    ~ThreadingRuntime();
+    ThreadingRuntime(const ThreadingRuntime&) = delete;
+    ThreadingRuntime& operator=(const ThreadingRuntime&) = delete;
+
+    pthreadpool_t threadpool() const { return threadpool_; }
+    // A pool of `threads` threads, for layers that run faster on fewer threads
+    // than the runtime has (see autotune.h); threadpool() for 0 or for at least
+    // threads(), null (the calling thread alone) for 1. Created on first use and
+    // pinned like the main pool, i.e. to its first CPUs. Nothing makes the pools
+    // take turns: within one run they are used one after the other, but
+    // concurrent runs (see Session) can compute on a smaller pool and on the
+    // main pool at the same time, sharing those CPUs.
+    pthreadpool_t threadpool(size_t threads) const;
+    size_t threads() const;
+    const ThreadingOptions& options() const { return options_; }
+
+    // pthreadpool flags native kernels pass to their parallel loops.
+    uint32_t parallelFlags() const;
+    // Pool threads pinned at construction. The thread calling into the pool
+    // runs its share of every loop but is never pinned by the runtime.
+    size_t pinnedThreads() const { return pinned_threads_; }
+
+    // Pins the calling thread to the `index`-th CPU of the runtime's list, if
+    // pinning is enabled. Used for every worker thread the engine starts.
+    void setupWorker(size_t index) const;
+
+    // Pins the calling thread to `cpu`; false where unsupported or refused.
+    static bool pinCurrentThread(int cpu);
+    // Restricts the calling thread to `cpus`, letting it move between them.
+    static bool bindCurrentThread(const std::vector<int>& cpus);
+
+private:
+    int cpuFor(size_t index) const;
+    size_t pinPoolThreads(pthreadpool_t pool) const;
+
+    ThreadingOptions options_;
+    pthreadpool_t threadpool_ = nullptr;
+    size_t pinned_threads_ = 0;
+    mutable std::mutex smaller_pools_mutex_;
+    mutable std::map<size_t, pthreadpool_t> smaller_pools_;
+};
+
+// Parses a Linux CPU list such as "0-3,8,10-11".
+std::vector<int> parseCpuList(const std::string& list);
+
+// The CPUs of each NUMA node that has any, from /sys/devices/system/node.
+// Where the kernel exposes no NUMA information, one node holds every CPU.
+std::vector<std::vector<int>> numaNodeCpus();
+
+// Splits the CPUs of `nodes` into `groups` groups that never span two nodes:
+// each node is cut into contiguous core groups of near-equal size. Asking for
+// fewer groups than nodes merges whole nodes instead, so 1 gives one group of
+// every CPU. 0 gives one group per node. No group is left empty, so a machine
+// with fewer CPUs than `groups` gets fewer groups.
+std::vector<std::vector<int>> cpuGroups(const std::vector<std::vector<int>>& nodes, size_t groups);
+
+// Runs fn(i) for every i in [0, range) on `threadpool`, or on the calling
+// thread if it is null.
+template <typename F>
+void parallelFor(pthreadpool_t threadpool, size_t range, const F& fn, uint32_t flags = 0) {
+    if (!threadpool || range <= 1) {
+        for (size_t i = 0; i < range; ++i) fn(i);
+        return;
+    }
+    pthreadpool_parallelize_1d(
+        threadpool, [](void* context, size_t i) { (*static_cast<const F*>(context))(i); },
+        const_cast<void*>(static_cast<const void*>(&fn)), range, flags);
+}
+
+// Tiles each thread gets on average in parallelForTiles(), so that threads
+// finishing early can take over tiles of slower ones.
+constexpr size_t kTilesPerThread = 4;
+
+// Runs fn(begin, end) over tiles covering [0, range). Tiles hold at least
+// `grain` items, so ranges of at most `grain` items run on the calling thread
+// without waking the pool.
+template <typename F>
+void parallelForTiles(pthreadpool_t threadpool, size_t range, size_t grain, const F& fn, uint32_t flags = 0) {
+    const size_t threads = threadpool ? pthreadpool_get_threads_count(threadpool) : 1;
+    grain = std::max<size_t>(grain, 1);
+    if (threads <= 1 || range <= grain) {
+        if (range) fn(size_t(0), range);
+        return;
+    }
+    const size_t tiles = threads * kTilesPerThread;
+    const size_t tile = std::max(grain, (range + tiles - 1) / tiles);
+    pthreadpool_parallelize_1d_tile_1d(
+        threadpool,
+        [](void* context, size_t begin, size_t count) { (*static_cast<const F*>(context))(begin, begin + count); },
+        const_cast<void*>(static_cast<const void*>(&fn)), range, tile, flags);
+}
+
+// 2D form of parallelForTiles() over [0, rows) x [0, cols), running
+// fn(row_begin, row_end, col_begin, col_end) per tile. Rows are split first;
+// columns only as far as needed to give every thread its tiles.
+template <typename F>
+void parallelForTiles2D(pthreadpool_t threadpool, size_t rows, size_t cols, size_t row_grain, size_t col_grain,
+                        const F& fn, uint32_t flags = 0) {
+    const size_t threads = threadpool ? pthreadpool_get_threads_count(threadpool) : 1;
+    row_grain = std::max<size_t>(row_grain, 1);
+    col_grain = std::max<size_t>(col_grain, 1);
+    if (rows == 0 || cols == 0) return;
+    if (threads <= 1 || (rows <= row_grain && cols <= col_grain)) {
+        fn(size_t(0), rows, size_t(0), cols);
+        return;
+    }
+    const size_t tiles = threads * kTilesPerThread;
+    const size_t row_tile = std::max(row_grain, (rows + tiles - 1) / tiles);
+    const size_t row_tiles = (rows + row_tile - 1) / row_tile;
+    const size_t col_splits = (tiles + row_tiles - 1) / row_tiles;
+    const size_t col_tile = std::max(col_grain, (cols + col_splits - 1) / col_splits);
+    pthreadpool_parallelize_2d_tile_2d(
+        threadpool,
+        [](void* context, size_t row, size_t col, size_t row_count, size_t col_count) {
+            (*static_cast<const F*>(context))(row, row + row_count, col, col + col_count);
+        },
+        const_cast<void*>(static_cast<const void*>(&fn)), rows, cols, row_tile, col_tile, flags);
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include "graph.h"
+#include "kernel_registry.h"
+#include "memory_planner.h"
+#include "operators.h"
+
+// One Conv of a TiledChain, with an XNNPACK operator for each vertical padding
+// its tiles need: only the first tile is padded at the top and only the last
+// one at the bottom, so a chain uses up to three operators per Conv.
+struct TiledConv {
+    const GraphNode* node = nullptr;
+    const Tensor* weights = nullptr;  // [M, kH, kW, C/groups]
+    const Tensor* bias = nullptr;
+    std::vector<int> kernel_shape, strides, pads, dilations;  // pads: top, left, bottom, right
+    int groups = 1;
+    float output_min = Operators::kNoMin;
+    float output_max = Operators::kNoMax;
+
+    std::map<std::pair<int, int>, std::unique_ptr<XnnOperator>> operators;  // by (top, bottom) padding
+    std::vector<float> tile;  // this Conv's output rows for the current tile; unused for the last Conv
+};
+
+// Conv nodes where each reads only the previous one's output, run depth first:
+// the last Conv's output is split into bands of rows, and for each band every
+// Conv computes just the rows the next one needs, halo included. Intermediate
+// activations only exist one band at a time, small enough to stay in cache,
+// instead of being streamed through memory in full between the Convs.
+struct TiledChain {
+    std::vector<TiledConv> layers;
+    std::vector<int> input_shape;  // chain input shape the band height was chosen for
+    int tile_rows = 0;             // output rows of the last Conv per band
+    size_t tile_bytes = 0;         // input, intermediate and output bytes touched per band
+};
+
+struct TilePlan {
+    size_t tile_bytes = 0;  // budget of bytes touched per band
+    std::vector<TiledChain> chains;
+    std::unordered_map<const GraphNode*, size_t> chain_of;  // every chained node -> its chain
+    std::unordered_set<std::string> internal;                // activations between chained Convs
+};
+
+// Finds chains of two or more Conv nodes in graph.sorted_nodes whose
+// intermediate outputs have a single reader, the next Conv, and moves the
+// nodes of each chain next to each other in sorted_nodes so that the chain
+// can run as one step. Requested outputs are never made internal.
+std::shared_ptr<TilePlan> planTiles(ComputationGraph& graph, size_t tile_bytes);
+
+// Makes computeLifetimes() results match running each chain as one step at its
+// first node: internal activations are dropped, and the chain's input and
+// output are live across the whole chain so they never share bytes.
+void adjustLifetimes(const TilePlan& plan, const ComputationGraph& graph, std::vector<TensorLifetime>& lifetimes);
+
+// Runs `chain` from `input` (NHWC, the first Conv's input) into `output`. The
+// band height is the largest whose bytes touched per band fit `tile_bytes`.
+void runTiledChain(TiledChain& chain, const Tensor& input, Tensor& output, size_t tile_bytes, const KernelContext& ctx);
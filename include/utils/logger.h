@@ -19,6 +19,7 @@ public:
     }
 
     void setLevel(LogLevel level) { current_level_ = level; }
+    bool isEnabled(LogLevel level) const { return current_level_ <= level; }
 
     template<typename... Args>
     void debug(Args&&... args) const {
@@ -0,0 +1,53 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Private, copy-on-write mapping of a whole file through mmap.
+// Pages are shared with every other process mapping the same file through the
+// page cache until written. They are writable so weights can be reordered to
+// OHWI in place; a written page becomes a private copy and never reaches the file.
+class MappedFile {
+public:
+    static std::shared_ptr<MappedFile> open(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return nullptr;
+
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            ::close(fd);
+            return nullptr;
+        }
+
+        size_t size = static_cast<size_t>(st.st_size);
+        void* addr = nullptr;
+        if (size > 0) {
+            addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+            if (addr == MAP_FAILED) {
+                ::close(fd);
+                return nullptr;
+            }
+        }
+        ::close(fd);  // the mapping stays valid after the descriptor is closed
+        return std::shared_ptr<MappedFile>(new MappedFile(addr, size));
+    }
+
+    ~MappedFile() {
+        if (addr_) munmap(addr_, size_);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    char* data() const { return static_cast<char*>(addr_); }
+    size_t size() const { return size_; }
+
+private:
+    MappedFile(void* addr, size_t size) : addr_(addr), size_(size) {}
+
+    void* addr_;
+    size_t size_;
+};
@@ -5,8 +5,9 @@
 
 class Timer {
 public:
-    Timer(const std::string& label = "") : label_(label) {
+    Timer(const std::string& label = "") {
 #ifdef ENABLE_TIMING
+        label_ = label;
         start_ = std::chrono::high_resolution_clock::now();
 #endif
     }
@@ -20,8 +21,8 @@ public:
     }
 
 private:
-    std::string label_;
 #ifdef ENABLE_TIMING
+    std::string label_;
     std::chrono::high_resolution_clock::time_point start_;
 #endif
 };
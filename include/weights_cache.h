@@ -0,0 +1,58 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+#include <xnnpack.h>
+
+// XNNPACK packed-weights cache shared between ExecutionEngine instances.
+//
+// Operators created against the same cache store identical packed weights only
+// once, so N replicas of a model (or models with a shared backbone) pay for the
+// packed copy a single time. XNNPACK requires the cache to be finalized before
+// operators using it are set up:
+//   - Soft finalization keeps the cache open, so later engines can still create
+//     operators; weights already in the cache are deduplicated against it.
+//   - Hard finalization trims the cache to its final size; creating an
+//     operator with new weights afterwards fails.
+class WeightsCache {
+public:
+    enum class Finalization { Soft, Hard };
+
+    struct Stats {
+        size_t lookups = 0;
+        size_t hits = 0;
+        size_t bytes_saved = 0;  // unpacked weight bytes that did not need a new packed copy
+        double hitRate() const { return lookups ? static_cast<double>(hits) / lookups : 0.0; }
+    };
+
+    // The process-wide instance.
+    static std::shared_ptr<WeightsCache> shared();
+
+    WeightsCache();
+    ~WeightsCache();
+    WeightsCache(const WeightsCache&) = delete;
+    WeightsCache& operator=(const WeightsCache&) = delete;
+
+    xnn_weights_cache_t handle() const { return cache_; }
+
+    // Idempotent for the same kind; a soft-finalized cache cannot be hardened later.
+    bool finalize(Finalization kind);
+    bool isFinalized() const;
+
+    // Accounts for one operator asking for packed weights identified by `fingerprint`.
+    void recordLookup(uint64_t fingerprint, size_t weight_bytes);
+    static uint64_t fingerprint(const void* data, size_t bytes, uint64_t seed);
+
+    Stats stats() const;
+    void printStats() const;
+
+private:
+    xnn_weights_cache_t cache_ = nullptr;
+    mutable std::mutex mutex_;
+    bool finalized_ = false;
+    Finalization finalization_ = Finalization::Soft;
+    std::unordered_set<uint64_t> seen_;
+    Stats stats_;
+};
@@ -0,0 +1,55 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "threading_runtime.h"
+
+// Fixed set of worker threads, each with its own task deque. A worker runs its
+// own tasks newest first and, once out of work, steals the oldest task of
+// another worker, so tasks spawned by a task stay on the thread whose caches
+// hold their inputs unless another thread is idle.
+class WorkStealingPool {
+public:
+    using Task = std::function<void()>;
+
+    // Called on each worker thread, with its index, before it runs any task.
+    using WorkerSetup = std::function<void(size_t index)>;
+
+    // With WaitPolicy::Spin an idle worker keeps looking for tasks for a short
+    // while before it sleeps.
+    explicit WorkStealingPool(size_t threads, WorkerSetup setup = nullptr, WaitPolicy wait = WaitPolicy::Sleep);
+    ~WorkStealingPool();
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    size_t size() const { return threads_.size(); }
+
+    // Queues `task`. Tasks submitted from a worker go to that worker's deque;
+    // other callers spread them over the workers in turn.
+    void submit(Task task);
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void workerLoop(size_t index, const WorkerSetup& setup);
+    bool tryPop(size_t index, Task& task);
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> threads_;
+    std::atomic<size_t> next_queue_{0};
+    WaitPolicy wait_;
+
+    std::mutex wake_mutex_;
+    std::condition_variable wake_;
+    size_t pending_ = 0;  // queued tasks, guarded by wake_mutex_
+    bool stop_ = false;
+};
@@ -0,0 +1,46 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include <xnnpack.h>
+#include <pthreadpool.h>
+#include "graph.h"
+#include "weights_cache.h"
+
+// A run of consecutive nodes lowered into one XNNPACK subgraph and executed
+// through an XNNPACK runtime, so that XNNPACK's operator fusion, memory
+// planning and threading apply across the whole run. Intermediate tensors
+// live inside the runtime and are not written back to graph.tensors.
+struct XnnSegment {
+    XnnSegment() = default;
+    ~XnnSegment();
+    XnnSegment(const XnnSegment&) = delete;
+    XnnSegment& operator=(const XnnSegment&) = delete;
+
+    std::vector<const GraphNode*> nodes;
+    std::vector<std::string> inputs;   // activations produced outside the segment
+    std::vector<std::string> outputs;  // activations read after the segment
+    std::vector<std::vector<int>> input_shapes;   // shapes the runtime is currently reshaped for
+    std::vector<std::vector<int>> output_shapes;
+    xnn_runtime_t runtime = nullptr;
+    bool failed = false;  // XNNPACK rejected the lowering; the nodes run natively
+};
+
+// Execution order of the XNNPACK subgraph backend. Each step is either a
+// lowered segment or a single node left to the native Operators path.
+struct XnnGraphPlan {
+    struct Step {
+        const GraphNode* node = nullptr;
+        std::unique_ptr<XnnSegment> segment;
+    };
+    std::vector<Step> steps;
+};
+
+// Partitions graph.sorted_nodes into maximal runs of nodes XNNPACK can execute.
+std::shared_ptr<XnnGraphPlan> lowerToXnnSubgraphs(const ComputationGraph& graph);
+
+// Runs a segment, building its runtime on first use. When the input shapes
+// change the runtime is reshaped in place, and only rebuilt if XNNPACK rejects
+// the new shapes. Returns false if XNNPACK cannot execute it; the caller must
+// then execute segment.nodes natively.
+bool runXnnSegment(XnnSegment& segment, ComputationGraph& graph, pthreadpool_t threadpool, WeightsCache* weights_cache);
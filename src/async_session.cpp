@@ -0,0 +1,123 @@
+#include "async_session.h"
+#include <algorithm>
+#include <memory>
+#include "utils/logger.h"
+
+AsyncSession::AsyncSession(Session& session, AsyncOptions options) : session_(session), options_(options) {
+    if (options_.max_in_flight == 0) options_.max_in_flight = 1;
+    threads_.emplace_back([this] { stagingLoop(); });
+    for (size_t i = 0; i < std::max<size_t>(options_.workers, 1); ++i) {
+        threads_.emplace_back([this] { computeLoop(); });
+    }
+}
+
+AsyncSession::~AsyncSession() {
+    wait();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    staging_cv_.notify_all();
+    compute_cv_.notify_all();
+    for (auto& thread : threads_) thread.join();
+}
+
+std::future<std::vector<Tensor>> AsyncSession::submit(Stage stage) {
+    auto promise = std::make_shared<std::promise<std::vector<Tensor>>>();
+    std::future<std::vector<Tensor>> result = promise->get_future();
+    submit(std::move(stage), [promise](std::vector<Tensor> outputs, std::exception_ptr error) {
+        if (error) {
+            promise->set_exception(error);
+        } else {
+            promise->set_value(std::move(outputs));
+        }
+    });
+    return result;
+}
+
+std::future<std::vector<Tensor>> AsyncSession::submit(Tensor input) {
+    auto staged = std::make_shared<Tensor>(std::move(input));
+    return submit([staged] { return std::move(*staged); });
+}
+
+void AsyncSession::submit(Stage stage, Callback done) {
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_cv_.wait(lock, [&] { return in_flight_ < options_.max_in_flight; });
+        ++in_flight_;
+        staging_queue_.push_back({std::move(stage), std::move(done), Tensor(), nullptr});
+    }
+    staging_cv_.notify_one();
+}
+
+void AsyncSession::wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_cv_.wait(lock, [&] { return in_flight_ == 0; });
+}
+
+size_t AsyncSession::inFlight() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return in_flight_;
+}
+
+void AsyncSession::stagingLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        staging_cv_.wait(lock, [&] { return stopping_ || !staging_queue_.empty(); });
+        if (staging_queue_.empty()) return;
+        Job job = std::move(staging_queue_.front());
+        staging_queue_.pop_front();
+
+        lock.unlock();
+        try {
+            job.input = job.stage();
+        } catch (...) {
+            job.error = std::current_exception();
+        }
+        job.stage = nullptr;
+        lock.lock();
+
+        compute_queue_.push_back(std::move(job));
+        compute_cv_.notify_one();
+    }
+}
+
+void AsyncSession::computeLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        compute_cv_.wait(lock, [&] { return stopping_ || !compute_queue_.empty(); });
+        if (compute_queue_.empty()) return;
+        Job job = std::move(compute_queue_.front());
+        compute_queue_.pop_front();
+
+        lock.unlock();
+        std::vector<Tensor> outputs;
+        std::exception_ptr error = job.error;
+        if (!error) {
+            try {
+                outputs = session_.run(job.input);
+            } catch (...) {
+                error = std::current_exception();
+            }
+        }
+        job.input = Tensor();
+        complete(job, std::move(outputs), error);
+        lock.lock();
+    }
+}
+
+void AsyncSession::complete(Job& job, std::vector<Tensor> outputs, std::exception_ptr error) {
+    // The slot is released after the callback, so wait() also waits for callbacks.
+    try {
+        job.done(std::move(outputs), error);
+    } catch (const std::exception& e) {
+        Logger::instance().error("AsyncSession: completion callback threw: ", e.what());
+    } catch (...) {
+        Logger::instance().error("AsyncSession: completion callback threw");
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        --in_flight_;
+    }
+    done_cv_.notify_all();
+}
@@ -0,0 +1,243 @@
+#include "autotune.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <unordered_set>
+#include "onnx_utils.h"
+#include "utils/logger.h"
+#include "weights_cache.h"
+
+namespace {
+
+constexpr const char* kFileHeader = "tinyonnx-tuning 1";
+
+ConvAlgorithm algorithmFromName(const std::string& name) {
+    for (ConvAlgorithm algorithm : {ConvAlgorithm::Xnnpack, ConvAlgorithm::General, ConvAlgorithm::Pointwise, ConvAlgorithm::Depthwise}) {
+        if (name == convAlgorithmName(algorithm)) return algorithm;
+    }
+    throw std::runtime_error("unknown Conv algorithm '" + name + "'");
+}
+
+uint64_t fingerprintString(const std::string& text, uint64_t seed) {
+    return WeightsCache::fingerprint(text.data(), text.size(), seed);
+}
+
+} // namespace
+
+const char* convAlgorithmName(ConvAlgorithm algorithm) {
+    switch (algorithm) {
+        case ConvAlgorithm::Xnnpack: return "xnnpack";
+        case ConvAlgorithm::General: return "general";
+        case ConvAlgorithm::Pointwise: return "pointwise";
+        case ConvAlgorithm::Depthwise: return "depthwise";
+    }
+    return "?";
+}
+
+ConvParams convParams(const GraphNode& node) {
+    ConvParams params;
+    params.kernel_shape = getIntListAttr(&node, "kernel_shape");
+    params.strides = getIntListAttr(&node, "strides");
+    params.pads = getIntListAttr(&node, "pads");
+    params.dilations = getIntListAttr(&node, "dilations");
+    if (params.strides.empty()) params.strides = {1, 1};
+    if (params.pads.empty()) params.pads = {0, 0, 0, 0};
+    if (params.dilations.empty()) params.dilations = {1, 1};
+    params.groups = getIntAttr(&node, "group", 1);
+    params.output_min = getFloatAttr(&node, "activation_min", Operators::kNoMin);
+    params.output_max = getFloatAttr(&node, "activation_max", Operators::kNoMax);
+    return params;
+}
+
+std::vector<ConvAlgorithm> convCandidates(const ConvParams& params, const std::vector<int>& weights_shape) {
+    std::vector<ConvAlgorithm> candidates = {ConvAlgorithm::Xnnpack, ConvAlgorithm::General};
+    const bool unpadded = std::all_of(params.pads.begin(), params.pads.end(), [](int pad) { return pad == 0; });
+    if (params.groups == 1 && weights_shape[1] == 1 && weights_shape[2] == 1 && unpadded) {
+        candidates.push_back(ConvAlgorithm::Pointwise);
+    }
+    if (params.groups > 1 && weights_shape[0] == params.groups && weights_shape[3] == 1) {
+        candidates.push_back(ConvAlgorithm::Depthwise);
+    }
+    return candidates;
+}
+
+void runConvWith(ConvAlgorithm algorithm, Operators& ops, XnnOperator& xnn, const ConvParams& params,
+                 const Tensor& input, const Tensor& weights, const Tensor& bias, Tensor& output,
+                 pthreadpool_t threadpool) {
+    switch (algorithm) {
+        case ConvAlgorithm::Xnnpack:
+            ops.runConv2d(xnn, input, output, threadpool);
+            break;
+        case ConvAlgorithm::General:
+            conv2d_general(input, weights, bias, params.strides, params.pads, params.dilations, params.groups,
+                           params.output_min, params.output_max, output, threadpool);
+            break;
+        case ConvAlgorithm::Pointwise:
+            conv2d_pointwise(input, weights, bias, params.strides, params.output_min, params.output_max, output, threadpool);
+            break;
+        case ConvAlgorithm::Depthwise:
+            conv2d_depthwise(input, weights, bias, params.strides, params.pads, params.dilations,
+                             params.output_min, params.output_max, output, threadpool);
+            break;
+    }
+}
+
+TuningChoice autotuneConv(Operators& ops, const ThreadingRuntime& threading, const ConvParams& params,
+                          const Tensor& weights, const Tensor& bias, const std::vector<int>& input_shape) {
+    std::vector<int> kernel_shape = params.kernel_shape;
+    if (kernel_shape.empty()) kernel_shape = {weights.shape()[1], weights.shape()[2]};
+    // Without the engine's weights cache, so that measuring leaves no packed copies behind.
+    auto xnn = ops.createConv2d(weights, bias, kernel_shape, params.strides, params.pads, params.dilations,
+                                params.groups, nullptr, params.output_min, params.output_max);
+    Tensor input(input_shape);
+    input.fillRandom();
+    Tensor output;
+
+    std::vector<size_t> thread_counts;
+    for (size_t threads = 1; threads < threading.threads(); threads *= 2) thread_counts.push_back(threads);
+    thread_counts.push_back(threading.threads());
+
+    TuningChoice best;
+    best.micros = -1;
+    for (ConvAlgorithm algorithm : convCandidates(params, weights.shape())) {
+        for (size_t threads : thread_counts) {
+            pthreadpool_t threadpool = threading.threadpool(threads);
+            xnn->input_shape.clear();  // XNNPACK splits the work for the pool it is reshaped with
+            runConvWith(algorithm, ops, *xnn, params, input, weights, bias, output, threadpool);
+            double micros = -1;
+            for (int run = 0; run < kTuningRuns; ++run) {
+                auto start = std::chrono::steady_clock::now();
+                runConvWith(algorithm, ops, *xnn, params, input, weights, bias, output, threadpool);
+                std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+                if (micros < 0 || elapsed.count() < micros) micros = elapsed.count();
+            }
+            if (best.micros < 0 || micros < best.micros) {
+                best.algorithm = algorithm;
+                best.threads = threads >= threading.threads() ? 0 : threads;
+                best.micros = micros;
+            }
+        }
+    }
+    return best;
+}
+
+uint64_t modelFingerprint(const ComputationGraph& graph) {
+    uint64_t hash = 0;
+    for (const GraphNode& node : graph.nodes) {
+        hash = fingerprintString(node.op_type, hash);
+        for (const auto& name : node.inputs) hash = fingerprintString(name, hash);
+        for (const auto& name : node.outputs) hash = fingerprintString(name, hash);
+        for (const auto& attribute : node.attributes) hash = fingerprintString(attribute.SerializeAsString(), hash);
+    }
+    // Initializers only, not the input or activations of earlier runs, in
+    // name order, which unordered_map does not give.
+    std::unordered_set<std::string> produced = {"input"};
+    for (const GraphNode& node : graph.nodes) produced.insert(node.outputs.begin(), node.outputs.end());
+    std::map<std::string, const Tensor*> initializers;
+    for (const auto& [name, tensor] : graph.tensors) {
+        if (tensor.size() && !produced.count(name)) initializers.emplace(name, &tensor);
+    }
+    for (const auto& [name, tensor] : initializers) {
+        hash = fingerprintString(name, hash);
+        hash = WeightsCache::fingerprint(tensor->shape().data(), tensor->shape().size() * sizeof(int), hash);
+        hash = WeightsCache::fingerprint(tensor->data().data(), tensor->size() * sizeof(float), hash);
+    }
+    return hash;
+}
+
+TuningCache::TuningCache(std::string path, uint64_t model_fingerprint, std::string cpu)
+    : path_(std::move(path)), model_(model_fingerprint), cpu_(std::move(cpu)) {
+    if (path_.empty()) return;
+    std::ifstream file(path_);
+    if (!file) return;
+
+    std::string header, model_line, cpu_line;
+    std::getline(file, header);
+    std::getline(file, model_line);
+    std::getline(file, cpu_line);
+    std::ostringstream expected_model;
+    expected_model << "model " << std::hex << model_;
+    if (header != kFileHeader || model_line != expected_model.str() || cpu_line != "cpu " + cpu_) {
+        Logger::instance().info("Tuning cache ", path_, " is for another model or CPU; tuning again");
+        return;
+    }
+    try {
+        for (std::string line; std::getline(file, line);) {
+            std::istringstream fields(line);
+            std::string key, algorithm;
+            TuningChoice choice;
+            if (!(fields >> key >> algorithm >> choice.threads >> choice.micros)) continue;
+            choice.algorithm = algorithmFromName(algorithm);
+            choices_[key] = choice;
+        }
+    } catch (const std::exception& e) {
+        Logger::instance().warning("Ignoring tuning cache ", path_, ": ", e.what());
+        choices_.clear();
+    }
+    loaded_ = choices_.size();
+}
+
+std::optional<TuningChoice> TuningCache::find(const std::string& key) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = choices_.find(key);
+    if (it == choices_.end()) return std::nullopt;
+    return it->second;
+}
+
+void TuningCache::set(const std::string& key, const TuningChoice& choice) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    choices_[key] = choice;
+}
+
+size_t TuningCache::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return choices_.size();
+}
+
+bool TuningCache::save() const {
+    if (path_.empty()) return true;
+    std::ofstream file(path_, std::ios::trunc);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        file << kFileHeader << "\n" << "model " << std::hex << model_ << std::dec << "\n" << "cpu " << cpu_ << "\n";
+        // Sorted, so that re-saving the same choices writes the same file.
+        std::map<std::string, TuningChoice> sorted(choices_.begin(), choices_.end());
+        for (const auto& [key, choice] : sorted) {
+            file << key << " " << convAlgorithmName(choice.algorithm) << " " << choice.threads << " " << choice.micros << "\n";
+        }
+    }
+    if (!file) {
+        Logger::instance().error("Could not write tuning cache ", path_);
+        return false;
+    }
+    return true;
+}
+
+std::string TuningCache::key(const std::string& node_name, const std::vector<int>& input_shape) {
+    std::string key = node_name + "@";
+    for (size_t i = 0; i < input_shape.size(); ++i) {
+        key += (i ? "x" : "") + std::to_string(input_shape[i]);
+    }
+    return key;
+}
+
+std::string TuningCache::cpuModel() {
+    std::string model, implementer, part;
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    for (std::string line; std::getline(cpuinfo, line);) {
+        size_t colon = line.find(':');
+        if (colon == std::string::npos || colon == 0) continue;
+        std::string field = line.substr(0, line.find_last_not_of(" \t", colon - 1) + 1);
+        std::string value = colon + 2 <= line.size() ? line.substr(colon + 2) : "";
+        if (field == "model name" && model.empty()) model = value;
+        if (field == "CPU implementer" && implementer.empty()) implementer = value;  // Arm
+        if (field == "CPU part" && part.empty()) part = value;
+    }
+    if (model.empty() && !implementer.empty()) model = "arm " + implementer + ":" + part;
+    if (model.empty()) model = "unknown";
+    return model + " x" + std::to_string(std::max(1u, std::thread::hardware_concurrency()));
+}
@@ -0,0 +1,111 @@
+#include "batching_server.h"
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <future>
+#include <stdexcept>
+
+struct BatchingServer::Request {
+    const Tensor* sample;
+    std::chrono::steady_clock::time_point arrival;
+    std::promise<std::vector<Tensor>> result;
+};
+
+BatchingServer::BatchingServer(ComputationGraph graph, BatchingOptions options, ExecutionEngine::Backend backend)
+    : options_(options), session_(std::move(graph), backend) {
+    if (options_.max_batch == 0) throw std::runtime_error("BatchingServer needs a max_batch of at least 1");
+    for (size_t i = 0; i < std::max<size_t>(options_.workers, 1); ++i) {
+        workers_.emplace_back([this] { workerLoop(); });
+    }
+}
+
+BatchingServer::~BatchingServer() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    queue_cv_.notify_all();
+    for (auto& worker : workers_) worker.join();
+}
+
+std::vector<Tensor> BatchingServer::run(const Tensor& sample) {
+    if (sample.shape().empty() || sample.shape()[0] != 1) {
+        throw std::runtime_error("BatchingServer::run expects a single sample with a leading dimension of 1");
+    }
+    Request request{&sample, std::chrono::steady_clock::now(), {}};
+    std::future<std::vector<Tensor>> result = request.result.get_future();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.push_back(&request);
+    }
+    queue_cv_.notify_all();
+    return result.get();
+}
+
+BatchingServer::Stats BatchingServer::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void BatchingServer::workerLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        queue_cv_.wait(lock, [&] { return stopping_ || !queue_.empty(); });
+        if (queue_.empty()) return;
+
+        // Another worker may take the oldest request meanwhile; then wait for the new oldest.
+        auto full = [&] { return stopping_ || queue_.empty() || queue_.size() >= options_.max_batch; };
+        Request* oldest = queue_.front();
+        queue_cv_.wait_until(lock, oldest->arrival + options_.max_wait, full);
+        if (queue_.empty() || queue_.front() != oldest) continue;
+
+        std::vector<Request*> batch;
+        const std::vector<int>& shape = oldest->sample->shape();
+        for (auto it = queue_.begin(); it != queue_.end() && batch.size() < options_.max_batch;) {
+            if ((*it)->sample->shape() == shape) {
+                batch.push_back(*it);
+                it = queue_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        stats_.requests += batch.size();
+        ++stats_.batches;
+        stats_.largest_batch = std::max(stats_.largest_batch, batch.size());
+
+        lock.unlock();
+        runBatch(batch);
+        lock.lock();
+    }
+}
+
+void BatchingServer::runBatch(const std::vector<Request*>& batch) {
+    const int count = static_cast<int>(batch.size());
+    std::vector<std::vector<Tensor>> results(count);
+    try {
+        std::vector<int> shape = batch[0]->sample->shape();
+        const size_t sample_size = batch[0]->sample->size();
+        shape[0] = count;
+        Tensor input(shape);
+        for (int i = 0; i < count; ++i) {
+            std::memcpy(input.data().data() + i * sample_size, batch[i]->sample->data().data(), sample_size * sizeof(float));
+        }
+
+        for (const Tensor& output : session_.run(input)) {
+            if (output.shape().empty() || output.shape()[0] != count) {
+                throw std::runtime_error("BatchingServer: model output does not keep the batch dimension");
+            }
+            std::vector<int> row_shape = output.shape();
+            row_shape[0] = 1;
+            const size_t row_size = output.size() / count;
+            for (int i = 0; i < count; ++i) {
+                const float* row = output.data().data() + i * row_size;
+                results[i].emplace_back(row_shape, std::vector<float>(row, row + row_size));
+            }
+        }
+    } catch (...) {
+        for (Request* request : batch) request->result.set_exception(std::current_exception());
+        return;
+    }
+    for (int i = 0; i < count; ++i) batch[i]->result.set_value(std::move(results[i]));
+}
@@ -0,0 +1,24 @@
+#include "compiled_graph.h"
+
+std::shared_ptr<CompiledGraph> compileGraph(ComputationGraph& graph) {
+    auto compiled = std::make_shared<CompiledGraph>();
+
+    auto slotOf = [&](const std::string& name) {
+        auto [it, inserted] = compiled->slot_index.emplace(name, static_cast<int>(compiled->slots.size()));
+        if (inserted) compiled->slots.push_back(&graph.tensors[name]);
+        return it->second;
+    };
+
+    compiled->input_slot = slotOf("input");
+    for (const GraphNode* node : graph.sorted_nodes) {
+        CompiledNode step;
+        step.node = node;
+        step.kernel = KernelRegistry::instance().find(node->op_type);
+        step.label = "Op: " + node->op_type;
+        for (const auto& name : node->inputs) step.inputs.push_back(slotOf(name));
+        for (const auto& name : node->outputs) step.outputs.push_back(slotOf(name));
+        compiled->node_index[node] = compiled->nodes.size();
+        compiled->nodes.push_back(std::move(step));
+    }
+    return compiled;
+}
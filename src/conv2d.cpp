@@ -1,178 +1,160 @@
 #include "tensor.h"
+#include "threading_runtime.h"
+#include <algorithm>
 #include <iostream>
 #include <cstring>
-#ifdef _OPENMP
-#include <omp.h>
-#endif
 
-Tensor conv2d_general(const Tensor& input, const Tensor& weights, const Tensor& bias,
-                      const std::vector<int>& strides, const std::vector<int>& pads, const std::vector<int>& dilations, int groups) {
+// Native convolutions on the engine's layouts: input [N, H, W, C], weights
+// [OC, KH, KW, IC/groups], output [N, OH, OW, OC], each output clamped to
+// [output_min, output_max]. pads are top, left, bottom, right. Every output
+// row is a task of the thread pool.
+
+void conv2d_general(const Tensor& input, const Tensor& weights, const Tensor& bias,
+                    const std::vector<int>& strides, const std::vector<int>& pads, const std::vector<int>& dilations, int groups,
+                    float output_min, float output_max, Tensor& output, pthreadpool_t threadpool) {
     const int N = input.shape()[0];
-    const int IC = input.shape()[1];
-    const int IH = input.shape()[2];
-    const int IW = input.shape()[3];
+    const int IH = input.shape()[1];
+    const int IW = input.shape()[2];
+    const int IC = input.shape()[3];
 
     const int OC = weights.shape()[0];
-    const int KH = weights.shape()[2];
-    const int KW = weights.shape()[3];
+    const int KH = weights.shape()[1];
+    const int KW = weights.shape()[2];
 
     const int SH = strides[0];
     const int SW = strides[1];
-    const int PH = pads[0];
-    const int PW = pads[1];
+    const int PT = pads[0];
+    const int PL = pads[1];
+    const int PB = pads[2];
+    const int PR = pads[3];
     const int DH = dilations[0];
     const int DW = dilations[1];
 
     const int group_ic = IC / groups;
     const int group_oc = OC / groups;
 
-    const int OH = (IH + 2 * PH - DH * (KH - 1) - 1) / SH + 1;
-    const int OW = (IW + 2 * PW - DW * (KW - 1) - 1) / SW + 1;
-
-    const int in_c_stride = IH * IW;
-    const int out_c_stride = OH * OW;
-    const int w_c_stride = KH * KW;
-
-    Tensor output({N, OC, OH, OW});
-
-    for (int n = 0; n < N; ++n) {
-        #pragma omp parallel for collapse(2)
-        for (int g = 0; g < groups; ++g) {
-            for (int oc = 0; oc < group_oc; ++oc) {
-                int oc_index = g * group_oc + oc;
-                for (int oh = 0; oh < OH; ++oh) {
-                    for (int ow = 0; ow < OW; ++ow) {
-                        float sum = 0.0f;
-                        for (int ic = 0; ic < group_ic; ++ic) {
-                            int ic_index = g * group_ic + ic;
-                            for (int kh = 0; kh < KH; ++kh) {
-                                for (int kw = 0; kw < KW; ++kw) {
-                                    int ih = oh * SH - PH + kh * DH;
-                                    int iw = ow * SW - PW + kw * DW;
-                                    if (ih >= 0 && ih < IH && iw >= 0 && iw < IW) {
-                                        int in_idx = n * IC * in_c_stride + ic_index * in_c_stride + ih * IW + iw;
-                                        int w_idx = oc_index * group_ic * w_c_stride + ic * w_c_stride + kh * KW + kw;
-                                        sum += input.data()[in_idx] * weights.data()[w_idx];
-                                    }
-                                }
-                            }
-                        }
-                        float result = sum;
-                        int out_idx = n * OC * out_c_stride + oc_index * out_c_stride + oh * OW + ow;
-                        output.data()[out_idx] = result + bias.data()[oc_index];
+    const int OH = (IH + PT + PB - DH * (KH - 1) - 1) / SH + 1;
+    const int OW = (IW + PL + PR - DW * (KW - 1) - 1) / SW + 1;
+
+    output.ensureShape({N, OH, OW, OC});
+    const float* in = input.data().data();
+    const float* w = weights.data().data();
+    const float* b = bias.size() ? bias.data().data() : nullptr;
+    float* out = output.data().data();
+
+    parallelFor(threadpool, static_cast<size_t>(N) * OH, [&](size_t task) {
+        const int n = static_cast<int>(task) / OH;
+        const int oh = static_cast<int>(task) % OH;
+        for (int ow = 0; ow < OW; ++ow) {
+            float* out_pixel = out + ((static_cast<size_t>(n) * OH + oh) * OW + ow) * OC;
+            for (int oc = 0; oc < OC; ++oc) {
+                const int g = oc / group_oc;
+                float sum = b ? b[oc] : 0.0f;
+                for (int kh = 0; kh < KH; ++kh) {
+                    const int ih = oh * SH - PT + kh * DH;
+                    if (ih < 0 || ih >= IH) continue;
+                    for (int kw = 0; kw < KW; ++kw) {
+                        const int iw = ow * SW - PL + kw * DW;
+                        if (iw < 0 || iw >= IW) continue;
+                        const float* in_pixel = in + ((static_cast<size_t>(n) * IH + ih) * IW + iw) * IC + g * group_ic;
+                        const float* w_pixel = w + ((static_cast<size_t>(oc) * KH + kh) * KW + kw) * group_ic;
+                        for (int ic = 0; ic < group_ic; ++ic) sum += in_pixel[ic] * w_pixel[ic];
                     }
                 }
+                out_pixel[oc] = std::min(std::max(sum, output_min), output_max);
             }
         }
-    }
-
-    return output;
+    });
 }
 
-Tensor conv2d_pointwise(const Tensor& input, const Tensor& weights, const Tensor& bias,
-                        const std::vector<int>& strides, int pad, int dilation) {
+// 1x1 kernel, one group, no padding.
+void conv2d_pointwise(const Tensor& input, const Tensor& weights, const Tensor& bias,
+                      const std::vector<int>& strides, float output_min, float output_max, Tensor& output,
+                      pthreadpool_t threadpool) {
     const int N = input.shape()[0];
-    const int IC = input.shape()[1];
-    const int IH = input.shape()[2];
-    const int IW = input.shape()[3];
+    const int IH = input.shape()[1];
+    const int IW = input.shape()[2];
+    const int IC = input.shape()[3];
 
     const int OC = weights.shape()[0];
-    const int KH = weights.shape()[2];
-    const int KW = weights.shape()[3];
 
     const int SH = strides[0];
     const int SW = strides[1];
-    const int PH = pad;
-    const int PW = pad;
-
-    const int OH = (IH + 2 * PH - KH) / SH + 1;
-    const int OW = (IW + 2 * PW - KW) / SW + 1;
-
-    const int in_c_stride = IH * IW;
-    const int out_c_stride = OH * OW;
-
-    Tensor output({N, OC, OH, OW});
-
-    for (int n = 0; n < N; ++n) {
-        #pragma omp parallel for
-        for (int oc = 0; oc < OC; ++oc) {
-            for (int oh = 0; oh < OH; ++oh) {
-                for (int ow = 0; ow < OW; ++ow) {
-                    float sum = 0.0f;
-                    for (int ic = 0; ic < IC; ic+=4) {
-                        for (int j = 0; j < 4 && (ic + j) < IC; ++j) {
-                            int ih = oh * SH - PH;
-                            int iw = ow * SW - PW;
-                            if (ih >= 0 && ih < IH && iw >= 0 && iw < IW) {
-                                int in_idx = n * IC * in_c_stride + (ic + j) * in_c_stride + ih * IW + iw;
-                                int w_idx = oc * IC + ic + j;
-                                sum += input.data()[in_idx] * weights.data()[w_idx];
-                            }
-                        }
-                    }
-                    float result = sum;
-                    int out_idx = n * OC * out_c_stride + oc * out_c_stride + oh * OW + ow;
-                    output.data()[out_idx] = result + bias.data()[oc];
-                }
+
+    const int OH = (IH - 1) / SH + 1;
+    const int OW = (IW - 1) / SW + 1;
+
+    output.ensureShape({N, OH, OW, OC});
+    const float* in = input.data().data();
+    const float* w = weights.data().data();
+    const float* b = bias.size() ? bias.data().data() : nullptr;
+    float* out = output.data().data();
+
+    parallelFor(threadpool, static_cast<size_t>(N) * OH, [&](size_t task) {
+        const int n = static_cast<int>(task) / OH;
+        const int oh = static_cast<int>(task) % OH;
+        for (int ow = 0; ow < OW; ++ow) {
+            const float* in_pixel = in + ((static_cast<size_t>(n) * IH + oh * SH) * IW + ow * SW) * IC;
+            float* out_pixel = out + ((static_cast<size_t>(n) * OH + oh) * OW + ow) * OC;
+            for (int oc = 0; oc < OC; ++oc) {
+                const float* w_row = w + static_cast<size_t>(oc) * IC;
+                float sum = b ? b[oc] : 0.0f;
+                for (int ic = 0; ic < IC; ++ic) sum += in_pixel[ic] * w_row[ic];
+                out_pixel[oc] = std::min(std::max(sum, output_min), output_max);
             }
         }
-    }
-
-    return output;
+    });
 }
 
-Tensor conv2d_depthwise(const Tensor& input, const Tensor& weights, const Tensor& bias,
-                        const std::vector<int>& strides,
-                        const std::vector<int>& pads,
-                        const std::vector<int>& dilations) {
+// One group per channel: weights [C, KH, KW, 1].
+void conv2d_depthwise(const Tensor& input, const Tensor& weights, const Tensor& bias,
+                      const std::vector<int>& strides, const std::vector<int>& pads, const std::vector<int>& dilations,
+                      float output_min, float output_max, Tensor& output, pthreadpool_t threadpool) {
     const int N = input.shape()[0];
-    const int C = input.shape()[1]; // depthwise: IC == OC == groups
-    const int IH = input.shape()[2];
-    const int IW = input.shape()[3];
+    const int IH = input.shape()[1];
+    const int IW = input.shape()[2];
+    const int C = input.shape()[3];
 
-    const int KH = weights.shape()[2];
-    const int KW = weights.shape()[3];
+    const int KH = weights.shape()[1];
+    const int KW = weights.shape()[2];
 
     const int SH = strides[0];
     const int SW = strides[1];
-    const int PH = pads[0];
-    const int PW = pads[1];
+    const int PT = pads[0];
+    const int PL = pads[1];
+    const int PB = pads[2];
+    const int PR = pads[3];
     const int DH = dilations[0];
     const int DW = dilations[1];
 
-    const int OH = (IH + 2 * PH - DH * (KH - 1) - 1) / SH + 1;
-    const int OW = (IW + 2 * PW - DW * (KW - 1) - 1) / SW + 1;
-
-    const int in_c_stride = IH * IW;
-    const int out_c_stride = OH * OW;
-    const int w_c_stride = KH * KW;
-
-    Tensor output({N, C, OH, OW});
-
-    for (int n = 0; n < N; ++n) {
-        #pragma omp parallel for
-        for (int c = 0; c < C; ++c) {
-            for (int oh = 0; oh < OH; ++oh) {
-                for (int ow = 0; ow < OW; ++ow) {
-                    float sum = 0.0f;
-                    for (int kh = 0; kh < KH; ++kh) {
-                        for (int kw = 0; kw < KW; ++kw) {
-                            int ih = oh * SH - PH + kh * DH;
-                            int iw = ow * SW - PW + kw * DW;
-                            if (ih >= 0 && ih < IH && iw >= 0 && iw < IW) {
-                                int in_idx = n * C * in_c_stride + c * in_c_stride + ih * IW + iw;
-                                int w_idx = c * w_c_stride + kh * KW + kw;
-                                sum += input.data()[in_idx] * weights.data()[w_idx];
-                            }
-                        }
-                    }
-                    float result = sum;
-                    int out_idx = n * C * out_c_stride + c * out_c_stride + oh * OW + ow;
-                    output.data()[out_idx] = result + bias.data()[c];
+    const int OH = (IH + PT + PB - DH * (KH - 1) - 1) / SH + 1;
+    const int OW = (IW + PL + PR - DW * (KW - 1) - 1) / SW + 1;
+
+    output.ensureShape({N, OH, OW, C});
+    const float* in = input.data().data();
+    const float* w = weights.data().data();
+    const float* b = bias.size() ? bias.data().data() : nullptr;
+    float* out = output.data().data();
+
+    parallelFor(threadpool, static_cast<size_t>(N) * OH, [&](size_t task) {
+        const int n = static_cast<int>(task) / OH;
+        const int oh = static_cast<int>(task) % OH;
+        for (int ow = 0; ow < OW; ++ow) {
+            float* out_pixel = out + ((static_cast<size_t>(n) * OH + oh) * OW + ow) * C;
+            // Accumulate the whole pixel at once, so the channel loops stay contiguous.
+            for (int c = 0; c < C; ++c) out_pixel[c] = b ? b[c] : 0.0f;
+            for (int kh = 0; kh < KH; ++kh) {
+                const int ih = oh * SH - PT + kh * DH;
+                if (ih < 0 || ih >= IH) continue;
+                for (int kw = 0; kw < KW; ++kw) {
+                    const int iw = ow * SW - PL + kw * DW;
+                    if (iw < 0 || iw >= IW) continue;
+                    const float* in_pixel = in + ((static_cast<size_t>(n) * IH + ih) * IW + iw) * C;
+                    const float* w_tap = w + kh * KW + kw;
+                    for (int c = 0; c < C; ++c) out_pixel[c] += in_pixel[c] * w_tap[static_cast<size_t>(c) * KH * KW];
                 }
             }
+            for (int c = 0; c < C; ++c) out_pixel[c] = std::min(std::max(out_pixel[c], output_min), output_max);
         }
-    }
-
-    return output;
+    });
 }
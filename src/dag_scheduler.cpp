@@ -0,0 +1,123 @@
+#include "dag_scheduler.h"
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+
+std::shared_ptr<NodeDependencies> buildDependencies(const CompiledGraph& graph, const MemoryPlan* plan,
+                                                    const TilePlan* tiles) {
+    const size_t count = graph.nodes.size();
+    std::vector<size_t> runs_at(count);  // node doing the work of each node
+    for (size_t i = 0; i < count; ++i) {
+        runs_at[i] = i;
+        if (!tiles) continue;
+        auto chain = tiles->chain_of.find(graph.nodes[i].node);
+        if (chain != tiles->chain_of.end()) runs_at[i] = graph.node_index.at(tiles->chains[chain->second].layers.front().node);
+    }
+    std::vector<std::set<size_t>> edges(count);
+    std::unordered_map<int, size_t> producer;                 // slot -> node writing it
+    std::unordered_map<int, std::vector<size_t>> users;       // slot -> producer and readers, in order
+
+    for (size_t i = 0; i < count; ++i) {
+        const CompiledNode& node = graph.nodes[i];
+        for (int slot : node.inputs) {
+            auto it = producer.find(slot);
+            if (it == producer.end()) continue;  // graph input or initializer
+            if (it->second != i) edges[it->second].insert(i);
+            users[slot].push_back(runs_at[i]);
+        }
+        for (int slot : node.outputs) {
+            if (producer.emplace(slot, runs_at[i]).second) users[slot].push_back(runs_at[i]);
+        }
+    }
+
+    if (plan) {
+        // Tensors sharing arena bytes have disjoint lifetimes in sorted order;
+        // the later one may only be written once every user of the earlier is done.
+        struct Placement {
+            size_t begin, end;
+            size_t producer, last_use;
+            const std::vector<size_t>* users;
+        };
+        std::vector<Placement> placements;
+        for (const auto& [name, offset] : plan->offsets) {
+            auto slot = graph.slot_index.find(name);
+            if (slot == graph.slot_index.end() || !users.count(slot->second)) continue;
+            size_t bytes = sizeof(float);
+            for (int dim : plan->shapes.at(name)) bytes *= dim;
+            const std::vector<size_t>& tensor_users = users.at(slot->second);
+            placements.push_back({offset, offset + bytes, producer.at(slot->second),
+                                  *std::max_element(tensor_users.begin(), tensor_users.end()), &tensor_users});
+        }
+        for (const Placement& earlier : placements) {
+            for (const Placement& later : placements) {
+                if (earlier.last_use >= later.producer) continue;
+                if (earlier.end <= later.begin || later.end <= earlier.begin) continue;
+                for (size_t user : *earlier.users) {
+                    if (user != later.producer) edges[user].insert(later.producer);
+                }
+            }
+        }
+    }
+
+    auto dependencies = std::make_shared<NodeDependencies>();
+    dependencies->successors.resize(count);
+    dependencies->num_predecessors.assign(count, 0);
+    for (size_t i = 0; i < count; ++i) {
+        dependencies->successors[i].assign(edges[i].begin(), edges[i].end());
+        for (size_t successor : edges[i]) ++dependencies->num_predecessors[successor];
+        dependencies->num_edges += edges[i].size();
+    }
+    return dependencies;
+}
+
+void DagScheduler::run(const NodeDependencies& dependencies, const std::function<void(size_t node, bool fan_out)>& fn) {
+    const size_t count = dependencies.successors.size();
+    if (count == 0) return;
+
+    struct RunState {
+        std::unique_ptr<std::atomic<int>[]> waiting;
+        std::atomic<size_t> remaining;
+        std::atomic<bool> failed{false};
+        std::exception_ptr error;
+        std::mutex mutex;
+        std::condition_variable done_cv;
+        bool done = false;
+    } state;
+    state.waiting.reset(new std::atomic<int>[count]);
+    for (size_t i = 0; i < count; ++i) state.waiting[i] = dependencies.num_predecessors[i];
+    state.remaining = count;
+
+    std::function<void(size_t)> dispatch = [&](size_t node) {
+        pool_.submit([&, node] {
+            if (!state.failed) {
+                bool fan_out = !intra_op_busy_.exchange(true);
+                try {
+                    fn(node, fan_out);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(state.mutex);
+                    if (!state.error) state.error = std::current_exception();
+                    state.failed = true;
+                }
+                if (fan_out) intra_op_busy_ = false;
+            }
+            for (size_t successor : dependencies.successors[node]) {
+                if (--state.waiting[successor] == 0) dispatch(successor);
+            }
+            if (--state.remaining == 0) {
+                std::lock_guard<std::mutex> lock(state.mutex);
+                state.done = true;
+                state.done_cv.notify_all();
+            }
+        });
+    };
+    for (size_t i = 0; i < count; ++i) {
+        if (dependencies.num_predecessors[i] == 0) dispatch(i);
+    }
+
+    std::unique_lock<std::mutex> lock(state.mutex);
+    state.done_cv.wait(lock, [&] { return state.done; });
+    if (state.error) std::rethrow_exception(state.error);
+}
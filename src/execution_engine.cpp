@@ -1,142 +1,327 @@
 #include "execution_engine.h"
 #include <xnnpack.h>
 #include "operators.h"
-#include "onnx_utils.h"
 #include "graph.h"
+#include "xnn_subgraph.h"
+#include "memory_planner.h"
+#include "compiled_graph.h"
+#include "shape_inference.h"
+#include "graph_optimizer.h"
+#include "tiled_execution.h"
+#include "autotune.h"
 #include "utils/timer.h"
 #include "utils/logger.h"
 #include "onnx.pb.h"
+#include <algorithm>
 #include <iostream>
 
-ExecutionEngine::ExecutionEngine() : pthreadpool_(nullptr) {
+ExecutionEngine::ExecutionEngine(std::shared_ptr<WeightsCache> weights_cache)
+    : ExecutionEngine(Backend::Native, std::move(weights_cache)) {}
+
+ExecutionEngine::ExecutionEngine(Backend backend, std::shared_ptr<WeightsCache> weights_cache)
+    : backend_(backend), weights_cache_(std::move(weights_cache)),
+      context_{operators_, nullptr, weights_cache_}, serial_context_{operators_, nullptr, weights_cache_} {
     xnn_status status = xnn_initialize(nullptr);
     if (status != xnn_status_success) {
         throw std::runtime_error("XNNPACK initialization failed");
     }
-    pthreadpool_ = pthreadpool_create(0); // Use all hardware threads
+    setThreading({});
 }
 
 ExecutionEngine::~ExecutionEngine() {
+    scheduler_.reset();
+    threading_.reset();
     xnn_deinitialize();
-    if (pthreadpool_) pthreadpool_destroy(pthreadpool_);
 }
 
-void ExecutionEngine::executeGraph(ComputationGraph& graph, const Tensor& input) {
-    graph.tensors["input"] = input;
+void ExecutionEngine::setThreading(const ThreadingOptions& options) {
+    size_t inter_op_threads = interOpThreads();
+    scheduler_.reset();
+    threading_ = std::make_unique<ThreadingRuntime>(options);
+    context_.threadpool = threading_->threadpool();
+    context_.threading = serial_context_.threading = threading_.get();
+    context_.threadpool_flags = serial_context_.threadpool_flags = threading_->parallelFlags();
+    operators_.setParallelFlags(threading_->parallelFlags());
+    if (inter_op_threads > 1) scheduler_ = std::make_unique<DagScheduler>(inter_op_threads, threading_.get());
+}
 
-    for (const GraphNode* node : graph.sorted_nodes) {
-        Timer timer("Op: " + node->op_type);
-
-        if (node->op_type == "Constant") {
-            assert(!node->attributes.empty());
-            const onnx::AttributeProto& attr = node->attributes[0];
-            assert(attr.has_t());
-            const onnx::TensorProto& tensor_proto = attr.t();
-            Tensor tensor({tensor_proto.dims().begin(), tensor_proto.dims().end()});
-            memcpy(tensor.data().data(), tensor_proto.raw_data().data(), tensor_proto.raw_data().size());
-            graph.tensors[node->outputs[0]] = tensor;
-        }
-        else if (node->op_type == "Conv") {
-            auto& in = graph.tensors[node->inputs[0]];
-            auto& weights = graph.tensors[node->inputs[1]];
-            auto& bias = graph.tensors[node->inputs[2]];
-            std::vector<int> kernel_shape = getIntListAttr(node, "kernel_shape");
-            std::vector<int> strides = getIntListAttr(node, "strides");
-            std::vector<int> pads = getIntListAttr(node, "pads");
-            std::vector<int> dilations = getIntListAttr(node, "dilations");
-            int groups = getIntAttr(node, "group", 1);        
-            if (strides.empty()) strides = {1, 1};
-            if (pads.empty()) pads = {0, 0, 0, 0};  // top, left, bottom, right
-            if (dilations.empty()) dilations = {1, 1};
-            graph.tensors[node->outputs[0]] = operators_.conv2d(
-                in, weights, bias, kernel_shape, strides, pads, dilations, groups, pthreadpool_
-            );
-        }
-        else if (node->op_type == "Transpose") {
-            auto& in = graph.tensors[node->inputs[0]];
-            auto perm = getIntListAttr(node, "perm");
-            graph.tensors[node->outputs[0]] = operators_.transpose(in, perm);
+void ExecutionEngine::prepare(ComputationGraph& graph) {
+    std::vector<const GraphNode*> native_nodes;
+    if (backend_ == Backend::XnnpackSubgraph) {
+        // Lowered segments build their runtimes on first execution, once input shapes are known.
+        if (!graph.xnn_plan) graph.xnn_plan = lowerToXnnSubgraphs(graph);
+        for (const auto& step : graph.xnn_plan->steps) {
+            if (step.node) native_nodes.push_back(step.node);
         }
-        else if (node->op_type == "MatMul") {
-            auto& a = graph.tensors[node->inputs[0]];
-            auto& b = graph.tensors[node->inputs[1]];
-            graph.tensors[node->outputs[0]] = operators_.matmul(a, b);
-        }
-        else if (node->op_type == "Gemm") {
-            auto& in = graph.tensors[node->inputs[0]];
-            auto& weights = graph.tensors[node->inputs[1]];
-            auto& bias = graph.tensors[node->inputs[2]];
-            float alpha = getFloatAttr(node, "alpha", 1.0f);
-            float beta = getFloatAttr(node, "beta", 1.0f);
-            bool transB = getIntAttr(node, "transB", 0);
-            Tensor result;
-            if (transB) {
-                result = operators_.gemm_transB(in, weights, bias, alpha, beta);
-            } else {
-                result = operators_.gemm(in, weights, bias, alpha, beta);
+    } else {
+        native_nodes = graph.sorted_nodes;
+    }
+
+    compile(graph);
+    for (const GraphNode* node : native_nodes) {
+        if (graph.tile_plan && graph.tile_plan->chain_of.count(node)) continue;  // run by runTiledChain()
+        CompiledNode& step = graph.compiled->at(node);
+        if (!step.prepared) prepareNode(*graph.compiled, step);
+    }
+    if (weights_cache_) weights_cache_->finalize(WeightsCache::Finalization::Soft);
+}
+
+void ExecutionEngine::prepare(ComputationGraph& graph, const std::vector<int>& input_shape) {
+    prepare(graph);
+    GraphShapes shapes = inferShapes(graph, input_shape);
+    if (backend_ == Backend::Native && shapes.complete) {
+        if (context_.tuning) autotune(graph, shapes.shapes);
+        buildMemoryPlan(graph, input_shape, shapes.shapes);
+    }
+}
+
+void ExecutionEngine::setAutotuning(std::shared_ptr<TuningCache> cache) {
+    context_.tuning = serial_context_.tuning = std::move(cache);
+}
+
+void ExecutionEngine::autotune(const ComputationGraph& graph, const std::unordered_map<std::string, std::vector<int>>& shapes) {
+    TuningCache& cache = *context_.tuning;
+    size_t tuned = 0;
+    for (const GraphNode* node : graph.sorted_nodes) {
+        if (node->op_type != "Conv" || node->inputs.size() < 2) continue;
+        if (graph.tile_plan && graph.tile_plan->chain_of.count(node)) continue;  // run by runTiledChain()
+        auto input_shape = shapes.find(node->inputs[0]);
+        auto weights = graph.tensors.find(node->inputs[1]);
+        if (input_shape == shapes.end() || weights == graph.tensors.end() || weights->second.size() == 0) continue;
+        const std::string key = TuningCache::key(node->outputs[0], input_shape->second);
+        if (cache.find(key)) continue;
+
+        Tensor no_bias;
+        auto bias = node->inputs.size() > 2 ? graph.tensors.find(node->inputs[2]) : graph.tensors.end();
+        TuningChoice choice = autotuneConv(operators_, *threading_, convParams(*node), weights->second,
+                                           bias != graph.tensors.end() ? bias->second : no_bias, input_shape->second);
+        Logger::instance().debug("Autotune ", key, ": ", convAlgorithmName(choice.algorithm), " on ",
+                                 choice.threads ? std::to_string(choice.threads) : std::string("all"),
+                                 " threads, ", choice.micros, " us");
+        cache.set(key, choice);
+        ++tuned;
+    }
+    if (tuned) {
+        Logger::instance().info("Autotuned ", tuned, " Conv nodes");
+        cache.save();
+    }
+}
+
+void ExecutionEngine::prepareNode(const CompiledGraph& graph, CompiledNode& step) {
+    Timer timer("Prepare: " + step.node->op_type);
+    if (step.kernel && step.kernel->prepare) {
+        step.state = step.kernel->prepare(*step.node, context_, KernelArgs(graph, step));
+    }
+    step.prepared = true;
+}
+
+void ExecutionEngine::executeGraph(ComputationGraph& graph, const Tensor& input) {
+    if (backend_ == Backend::XnnpackSubgraph) {
+        // Lower before the input slot is created, so it is not mistaken for an initializer.
+        if (!graph.xnn_plan) graph.xnn_plan = lowerToXnnSubgraphs(graph);
+        if (!graph.compiled) graph.compiled = compileGraph(graph);
+        CompiledGraph& compiled = *graph.compiled;
+        compiled.tensor(compiled.input_slot) = input;
+
+        for (auto& step : graph.xnn_plan->steps) {
+            if (step.node) {
+                executeNode(compiled, compiled.at(step.node));
+            } else if (!runXnnSegment(*step.segment, graph, threading_->threadpool(), weights_cache_.get())) {
+                for (const GraphNode* node : step.segment->nodes) executeNode(compiled, compiled.at(node));
             }
-            graph.tensors[node->outputs[0]] = result;
-        }
-        else if (node->op_type == "Add") {
-            auto& a = graph.tensors[node->inputs[0]];
-            auto& b = graph.tensors[node->inputs[1]];
-            graph.tensors[node->outputs[0]] = operators_.add(a, b);
-        }
-        else if (node->op_type == "Relu") {
-            auto& input_tensor = graph.tensors[node->inputs[0]];
-            graph.tensors[node->outputs[0]] = operators_.relu(input_tensor);
-        }
-        else if (node->op_type == "Clip") {
-            auto& in = graph.tensors[node->inputs[0]];
-            float min_val = getFloatAttr(node, "min", 0.0f);
-            float max_val = getFloatAttr(node, "max", 6.0f);
-            graph.tensors[node->outputs[0]] = operators_.clip(in, min_val, max_val);
-        }
-        else if (node->op_type == "Softmax") {
-            auto& input_tensor = graph.tensors[node->inputs[0]];
-            graph.tensors[node->outputs[0]] = operators_.softmax(input_tensor);
         }
-        else if (node->op_type == "BatchNormalization") {
-            auto& in = graph.tensors[node->inputs[0]];
-            auto& scale = graph.tensors[node->inputs[1]];
-            auto& bias = graph.tensors[node->inputs[2]];
-            auto& mean = graph.tensors[node->inputs[3]];
-            auto& var = graph.tensors[node->inputs[4]];
-            float epsilon = 1e-5f; // TODO: later parse from attributes clearly
-            graph.tensors[node->outputs[0]] = operators_.batchNorm(in, scale, bias, mean, var, epsilon);
-        }
-        else if (node->op_type == "GlobalAveragePool") {
-            auto& in = graph.tensors[node->inputs[0]];
-            graph.tensors[node->outputs[0]] = operators_.globalAveragePool(in);
-        }
-        else if (node->op_type == "MaxPool") {
-            auto& in = graph.tensors[node->inputs[0]];
-            int ceil_mode = getIntAttr(node, "ceil_mode", 0);
-            std::vector<int> dilations = getIntListAttr(node, "dilations");
-            std::vector<int> kernel_shape = getIntListAttr(node, "kernel_shape");
-            std::vector<int> pads = getIntListAttr(node, "pads");
-            std::vector<int> strides = getIntListAttr(node, "strides");
-            if (strides.empty()) strides = {1, 1};
-            if (pads.empty()) pads = {0, 0, 0, 0};  // top, left, bottom, right
-            if (dilations.empty()) dilations = {1, 1};
-            graph.tensors[node->outputs[0]] = operators_.maxPool(
-                in, ceil_mode, dilations, kernel_shape, pads, strides, pthreadpool_
-            );
-        }
-        else if (node->op_type == "Reshape") {
-            auto& in = graph.tensors[node->inputs[0]];
-            auto& shape_tensor = graph.tensors[node->inputs[1]];
-            std::vector<int> new_shape(shape_tensor.data().begin(), shape_tensor.data().end());
-            graph.tensors[node->outputs[0]] = operators_.reshape(in, new_shape);
+        return;
+    }
+
+    compile(graph);
+    CompiledGraph& compiled = *graph.compiled;
+    compiled.tensor(compiled.input_slot) = input;
+
+    if (!graph.memory_plan || graph.memory_plan->input_shape != input.shape()) {
+        std::shared_ptr<MemoryPlan> cached = planCache(graph).find(input.shape());
+        if (cached) {
+            bindMemoryPlan(graph, std::move(cached));
+        } else {
+            GraphShapes shapes = inferShapes(graph, input.shape());
+            if (!shapes.complete) {
+                profileAndPlan(graph, input.shape());
+                return;
+            }
+            buildMemoryPlan(graph, input.shape(), shapes.shapes);
         }
-        else if (node->op_type == "Flatten") {
-            auto& in = graph.tensors[node->inputs[0]];
-            int axis = getIntAttr(node, "axis", 0);
-            graph.tensors[node->outputs[0]] = operators_.flatten(in, axis);
+    }
+
+    if (scheduler_) {
+        executeParallel(graph);
+        return;
+    }
+    for (CompiledNode& node : compiled.nodes) {
+        runStep(graph, node, context_);
+    }
+}
+
+void ExecutionEngine::compile(ComputationGraph& graph) {
+    if (graph.compiled) return;
+    // Chains are planned first: their nodes are moved next to each other.
+    if (backend_ == Backend::Native && tile_bytes_) {
+        graph.tile_plan = planTiles(graph, tile_bytes_);
+        Logger::instance().debug("Tiled execution: ", graph.tile_plan->chains.size(), " Conv chains");
+    }
+    graph.compiled = compileGraph(graph);
+}
+
+void ExecutionEngine::runStep(ComputationGraph& graph, CompiledNode& step, const KernelContext& context) {
+    CompiledGraph& compiled = *graph.compiled;
+    TiledChain* chain = nullptr;
+    if (graph.tile_plan) {
+        auto it = graph.tile_plan->chain_of.find(step.node);
+        if (it != graph.tile_plan->chain_of.end()) chain = &graph.tile_plan->chains[it->second];
+    }
+    if (!chain) {
+        executeNode(compiled, step, context);
+        return;
+    }
+    // The whole chain runs with its first node.
+    if (chain->layers.front().node != step.node) return;
+    Timer timer("Op: Conv chain (tiled)");
+    const CompiledNode& last = compiled.at(chain->layers.back().node);
+    runTiledChain(*chain, compiled.tensor(step.inputs[0]), compiled.tensor(last.outputs[0]), graph.tile_plan->tile_bytes, context);
+}
+
+void ExecutionEngine::setInterOpThreads(size_t threads) {
+    if (threads == interOpThreads()) return;
+    scheduler_ = threads > 1 ? std::make_unique<DagScheduler>(threads, threading_.get()) : nullptr;
+}
+
+void ExecutionEngine::executeParallel(ComputationGraph& graph) {
+    CompiledGraph& compiled = *graph.compiled;
+    // Kernels are prepared up front: prepare() may touch the shared weights cache.
+    for (CompiledNode& node : compiled.nodes) {
+        if (graph.tile_plan && graph.tile_plan->chain_of.count(node.node)) continue;
+        if (!node.prepared) prepareNode(compiled, node);
+    }
+    std::shared_ptr<NodeDependencies>& dependencies = graph.memory_plan->dependencies;
+    if (!dependencies) {
+        dependencies = buildDependencies(compiled, graph.memory_plan.get(), graph.tile_plan.get());
+        Logger::instance().debug("Parallel schedule: ", compiled.nodes.size(), " nodes, ",
+                                 dependencies->num_edges, " dependencies");
+    }
+    scheduler_->run(*dependencies, [&](size_t index, bool fan_out) {
+        runStep(graph, compiled.nodes[index], fan_out ? context_ : serial_context_);
+    });
+}
+
+void ExecutionEngine::executeGraph(ComputationGraph& graph, const Tensor& input, const std::vector<std::string>& outputs) {
+    selectOutputs(graph, outputs);
+    executeGraph(graph, input);
+}
+
+void ExecutionEngine::selectOutputs(ComputationGraph& graph, std::vector<std::string> outputs) {
+    std::sort(outputs.begin(), outputs.end());
+    outputs.erase(std::unique(outputs.begin(), outputs.end()), outputs.end());
+    if (outputs == graph.requested_outputs) return;
+
+    // Views into the current arena are dropped; its plans stay in the stashed plan cache.
+    if (graph.memory_plan) {
+        for (const auto& [name, offset] : graph.memory_plan->offsets) graph.tensors[name] = Tensor();
+        graph.memory_plan.reset();
+    }
+    graph.output_selections[graph.requested_outputs] = {graph.sorted_nodes, graph.xnn_plan, graph.compiled,
+                                                         graph.plan_cache, graph.tile_plan};
+
+    auto selection = graph.output_selections.find(outputs);
+    if (selection != graph.output_selections.end()) {
+        graph.sorted_nodes = selection->second.sorted_nodes;
+        graph.xnn_plan = selection->second.xnn_plan;
+        graph.compiled = selection->second.compiled;
+        graph.plan_cache = selection->second.plan_cache;
+        graph.tile_plan = selection->second.tile_plan;
+    } else {
+        // The whole graph was stashed above or by an earlier switch.
+        const auto& all_nodes = graph.output_selections.at({}).sorted_nodes;
+        graph.sorted_nodes = outputs.empty() ? all_nodes : pruneToOutputs(all_nodes, outputs);
+        graph.xnn_plan.reset();
+        graph.compiled.reset();
+        graph.plan_cache.reset();
+        graph.tile_plan.reset();
+        Logger::instance().debug("Serving ", outputs.size(), " outputs with ", graph.sorted_nodes.size(),
+                                 " of ", all_nodes.size(), " nodes");
+    }
+    graph.requested_outputs = std::move(outputs);
+}
+
+void ExecutionEngine::buildMemoryPlan(ComputationGraph& graph, const std::vector<int>& input_shape,
+                                      const std::unordered_map<std::string, std::vector<int>>& shapes) {
+    std::shared_ptr<MemoryPlan> plan = planMemory(lifetimes(graph), shapes);
+    plan->input_shape = input_shape;
+    // Outputs outside the arena (graph outputs) are allocated up front too.
+    for (const GraphNode* node : graph.sorted_nodes) {
+        if (node->op_type == "Constant") continue;
+        for (const auto& name : node->outputs) {
+            if (graph.tile_plan && graph.tile_plan->internal.count(name)) continue;
+            auto shape = shapes.find(name);
+            if (shape != shapes.end() && !plan->offsets.count(name)) plan->output_shapes[name] = shape->second;
         }
-        else {
-            std::cerr << "Operator not supported yet: " << node->op_type << std::endl;
+    }
+    Logger::instance().debug("Activation arena: ", plan->offsets.size(), " tensors in ",
+                             plan->arena_bytes / 1024.0, " KB (",
+                             plan->unplanned_bytes / 1024.0, " KB without reuse)");
+    planCache(graph).insert(plan);
+    bindMemoryPlan(graph, std::move(plan));
+}
+
+void ExecutionEngine::bindMemoryPlan(ComputationGraph& graph, std::shared_ptr<MemoryPlan> plan) {
+    if (graph.memory_plan) {
+        for (const auto& [name, offset] : graph.memory_plan->offsets) graph.tensors[name] = Tensor();
+    }
+    graph.memory_plan = std::move(plan);
+    graph.memory_plan->bind(graph);
+    for (const auto& [name, shape] : graph.memory_plan->output_shapes) graph.tensors[name].ensureShape(shape);
+}
+
+std::vector<TensorLifetime> ExecutionEngine::lifetimes(const ComputationGraph& graph) {
+    std::vector<TensorLifetime> result = computeLifetimes(graph);
+    if (graph.tile_plan) adjustLifetimes(*graph.tile_plan, graph, result);
+    return result;
+}
+
+PlanCache& ExecutionEngine::planCache(ComputationGraph& graph) {
+    if (!graph.plan_cache) graph.plan_cache = std::make_shared<PlanCache>(plan_cache_capacity_);
+    if (graph.plan_cache->capacity() != plan_cache_capacity_) graph.plan_cache->setCapacity(plan_cache_capacity_);
+    return *graph.plan_cache;
+}
+
+void ExecutionEngine::profileAndPlan(ComputationGraph& graph, const std::vector<int>& input_shape) {
+    // Shapes cannot be inferred ahead of time: let the operators allocate, but
+    // release each activation after its last reader, and record the shapes to plan the arena.
+    CompiledGraph& compiled = *graph.compiled;
+    if (graph.memory_plan) {
+        for (const auto& [name, offset] : graph.memory_plan->offsets) graph.tensors[name] = Tensor();
+        graph.memory_plan.reset();
+    }
+    std::vector<std::vector<int>> released_after(compiled.nodes.size());
+    for (const auto& lifetime : lifetimes(graph)) {
+        released_after[lifetime.last_use].push_back(compiled.slot_index.at(lifetime.name));
+    }
+
+    std::unordered_map<std::string, std::vector<int>> shapes;
+    for (size_t i = 0; i < compiled.nodes.size(); ++i) {
+        CompiledNode& node = compiled.nodes[i];
+        runStep(graph, node, context_);
+        for (size_t j = 0; j < node.outputs.size(); ++j) {
+            shapes[node.node->outputs[j]] = compiled.tensor(node.outputs[j]).shape();
         }
+        for (int slot : released_after[i]) compiled.tensor(slot) = Tensor();
+    }
+    buildMemoryPlan(graph, input_shape, shapes);
+}
+
+void ExecutionEngine::executeNode(const CompiledGraph& graph, CompiledNode& step, const KernelContext& context) {
+    if (!step.prepared) prepareNode(graph, step);
+    Timer timer(step.label);
+    if (!step.kernel) {
+        std::cerr << "Operator not supported yet: " << step.node->op_type << std::endl;
+        return;
     }
-    
+    step.kernel->run(step.state.get(), context, KernelArgs(graph, step));
 }
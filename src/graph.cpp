@@ -1,10 +1,12 @@
 #include "graph.h"
+#include <algorithm>
 #include <unordered_map>
 #include <unordered_set>
 #include <queue>
 #include <iostream>
 
 void ComputationGraph::topologicalSort() {
+    sorted_nodes.clear();
     std::unordered_set<std::string> available;
     std::unordered_map<const GraphNode*, int> dependency_count;
     std::unordered_map<std::string, std::vector<const GraphNode*>> tensor_consumers;
@@ -58,6 +60,11 @@ void ComputationGraph::topologicalSort() {
 
 }
 
+bool ComputationGraph::keepsOutput(const std::string& name) const {
+    return std::binary_search(requested_outputs.begin(), requested_outputs.end(), name) ||
+           std::find(outputs.begin(), outputs.end(), name) != outputs.end();
+}
+
 void ComputationGraph::printNodes() {
     std::cout << "🔁 Graph Order:\n";
     for (const auto node : nodes) {
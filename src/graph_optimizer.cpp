@@ -0,0 +1,476 @@
+#include "graph_optimizer.h"
+#include "compiled_graph.h"
+#include "kernel_registry.h"
+#include "onnx_utils.h"
+#include "utils/logger.h"
+#include "operators.h"
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+#include <unordered_set>
+#include <xnnpack.h>
+
+namespace {
+
+bool isInitializer(const ComputationGraph& graph, const std::string& name) {
+    auto it = graph.tensors.find(name);
+    return it != graph.tensors.end() && it->second.size();
+}
+
+// Drops the nodes flagged in `removed` and re-sorts the graph.
+void eraseNodes(ComputationGraph& graph, const std::vector<bool>& removed) {
+    std::vector<GraphNode> kept;
+    for (size_t i = 0; i < graph.nodes.size(); ++i) {
+        if (!removed[i]) kept.push_back(std::move(graph.nodes[i]));
+    }
+    graph.nodes = std::move(kept);
+    graph.topologicalSort();
+}
+
+// Number of nodes reading each tensor, and the node producing it.
+struct TensorUses {
+    std::unordered_map<std::string, int> readers;
+    std::unordered_map<std::string, GraphNode*> producers;
+
+    explicit TensorUses(ComputationGraph& graph) {
+        for (GraphNode& node : graph.nodes) {
+            for (const auto& name : node.inputs) ++readers[name];
+            for (const auto& name : node.outputs) producers[name] = &node;
+        }
+        // The caller reads graph outputs too.
+        for (const auto& name : graph.outputs) ++readers[name];
+    }
+
+    // The node producing `name` if it has the given op type and `name` has no other reader.
+    GraphNode* soleProducer(const std::string& name, const std::string& op_type) {
+        auto it = producers.find(name);
+        if (it == producers.end() || it->second->op_type != op_type || readers[name] != 1) return nullptr;
+        return it->second;
+    }
+
+    // Drops a reader of an initializer, erasing it once nothing reads it.
+    void release(ComputationGraph& graph, const std::string& name) {
+        if (--readers[name] == 0) graph.tensors.erase(name);
+    }
+};
+
+void setFloatAttr(GraphNode& node, const std::string& name, float value) {
+    for (auto& attr : node.attributes) {
+        if (attr.name() == name) {
+            attr.set_f(value);
+            return;
+        }
+    }
+    onnx::AttributeProto attr;
+    attr.set_name(name);
+    attr.set_type(onnx::AttributeProto::FLOAT);
+    attr.set_f(value);
+    node.attributes.push_back(attr);
+}
+
+// Bound inputs of `node` that are initializers, the only ones known before running.
+std::function<const Tensor*(size_t)> initializerInputs(const ComputationGraph& graph, const GraphNode& node) {
+    return [&graph, &node](size_t i) { return isInitializer(graph, node.inputs[i]) ? &graph.tensors.at(node.inputs[i]) : nullptr; };
+}
+
+const std::vector<int> kToNHWC = {0, 2, 3, 1};
+const std::vector<int> kToNCHW = {0, 3, 1, 2};
+// Where each NCHW axis lives in the NHWC layout.
+const int kToNHWCAxis[] = {0, 3, 1, 2};
+
+// Ops whose first input is an image their kernels read as NHWC.
+bool isSpatial(const std::string& op) {
+    return op == "Conv" || op == "MaxPool" || op == "AveragePool" || op == "GlobalAveragePool" ||
+           op == "BatchNormalization";
+}
+
+// Ops computing each output element from the same element of their first input.
+bool isElementwise(const std::string& op) {
+    return op == "Relu" || op == "Clip" || op == "Sigmoid" || op == "Tanh" ||
+           op == "LeakyRelu" || op == "Identity" || op == "Dropout";
+}
+
+// Points a Softmax over an NCHW tensor at the same dims of its NHWC copy.
+// False if those dims are not expressible on the NHWC tensor: a pre-opset-13
+// Softmax spanning H and W but not C.
+bool softmaxOnNHWC(GraphNode& node) {
+    int64_t axis = getIntAttr(&node, "axis", -1);
+    if (axis < 0) axis += 4;
+    if (axis < 0 || axis >= 4) return false;
+    if (getIntAttr(&node, "coerce_2d", 0)) return axis <= 1;  // all dims, or C, H and W: the same in both layouts
+    for (auto& attr : node.attributes) {
+        if (attr.name() == "axis") {
+            attr.set_i(kToNHWCAxis[axis]);
+            return true;
+        }
+    }
+    onnx::AttributeProto attr;
+    attr.set_name("axis");
+    attr.set_type(onnx::AttributeProto::INT);
+    attr.set_i(kToNHWCAxis[axis]);
+    node.attributes.push_back(attr);
+    return true;
+}
+
+bool isBinaryElementwise(const std::string& op) {
+    return op == "Add" || op == "Sub" || op == "Mul" || op == "Div";
+}
+
+GraphNode makeTranspose(const std::string& input, const std::string& output, const std::vector<int>& perm) {
+    GraphNode node;
+    node.op_type = "Transpose";
+    node.inputs = {input};
+    node.outputs = {output};
+    onnx::AttributeProto attr;
+    attr.set_name("perm");
+    attr.set_type(onnx::AttributeProto::INTS);
+    for (int axis : perm) attr.add_ints(axis);
+    node.attributes.push_back(attr);
+    return node;
+}
+
+void setPerm(GraphNode& node, const std::vector<int>& perm) {
+    for (auto& attr : node.attributes) {
+        if (attr.name() != "perm") continue;
+        attr.clear_ints();
+        for (int axis : perm) attr.add_ints(axis);
+    }
+}
+
+bool isGraphOutput(const std::vector<std::string>& outputs, const std::string& name) {
+    return std::find(outputs.begin(), outputs.end(), name) != outputs.end();
+}
+
+// Folds the first Transpose reading another Transpose's output into it.
+// Returns false once no such pair is left.
+bool cancelTransposePair(ComputationGraph& graph, const std::vector<std::string>& outputs) {
+    TensorUses uses(graph);
+    for (size_t i = 0; i < graph.nodes.size(); ++i) {
+        GraphNode& second = graph.nodes[i];
+        if (second.op_type != "Transpose") continue;
+        auto producer = uses.producers.find(second.inputs[0]);
+        if (producer == uses.producers.end() || producer->second->op_type != "Transpose") continue;
+        const GraphNode& first = *producer->second;
+        std::vector<int> first_perm = getIntListAttr(&first, "perm");
+        std::vector<int> second_perm = getIntListAttr(&second, "perm");
+        if (first_perm.empty() || first_perm.size() != second_perm.size()) continue;
+
+        std::vector<int> perm(second_perm.size());
+        bool identity = true;
+        for (size_t axis = 0; axis < perm.size(); ++axis) {
+            perm[axis] = first_perm[second_perm[axis]];
+            identity &= perm[axis] == static_cast<int>(axis);
+        }
+
+        std::vector<bool> removed(graph.nodes.size(), false);
+        const std::string source = first.inputs[0];
+        const std::string middle = second.inputs[0];
+        if (identity && !isGraphOutput(outputs, second.outputs[0])) {
+            // Readers of the second transpose read the source directly.
+            const std::string result = second.outputs[0];
+            for (GraphNode& node : graph.nodes) {
+                for (auto& name : node.inputs) {
+                    if (name == result) name = source;
+                }
+            }
+            removed[i] = true;
+        } else {
+            second.inputs[0] = source;
+            setPerm(second, perm);
+        }
+        if (uses.readers[middle] == 1 && !isGraphOutput(outputs, middle)) {
+            removed[producer->second - graph.nodes.data()] = true;
+        }
+        eraseNodes(graph, removed);
+        return true;
+    }
+    return false;
+}
+
+} // namespace
+
+void assignLayouts(ComputationGraph& graph, const std::vector<std::string>& outputs) {
+    graph.topologicalSort();
+    Operators ops;
+
+    std::unordered_set<std::string> nhwc;          // tensors stored channels-last
+    std::unordered_set<std::string> unit_spatial;  // NHWC tensors with H = W = 1
+    std::unordered_map<std::string, std::string> nhwc_copies;
+    std::unordered_map<std::string, std::string> nchw_copies;
+    std::unordered_set<std::string> reordered_weights;
+    std::unordered_set<std::string> permuted_constants;
+    std::vector<GraphNode> nodes;
+
+    // Name of `name` converted to the other layout, adding the Transpose on first use.
+    auto convert = [&](const std::string& name, bool to_nhwc) {
+        auto& copies = to_nhwc ? nhwc_copies : nchw_copies;
+        auto it = copies.find(name);
+        if (it != copies.end()) return it->second;
+        std::string converted = name + (to_nhwc ? "_nhwc" : "_nchw");
+        nodes.push_back(makeTranspose(name, converted, to_nhwc ? kToNHWC : kToNCHW));
+        if (to_nhwc) nhwc.insert(converted);
+        return copies[name] = converted;
+    };
+
+    for (const GraphNode* sorted : graph.sorted_nodes) {
+        GraphNode node = *sorted;
+        const std::string& op = node.op_type;
+        bool nhwc_output = false;
+        bool unit_output = false;
+
+        if (isSpatial(op)) {
+            if (!nhwc.count(node.inputs[0])) node.inputs[0] = convert(node.inputs[0], true);
+            if (op == "Conv" && isInitializer(graph, node.inputs[1])) {
+                if (reordered_weights.insert(node.inputs[1]).second) graph.tensors[node.inputs[1]].reorderOIHWtoOHWI();
+            } else if (op == "Conv") {
+                // Computed weights, e.g. of a Constant node: the [0,2,3,1] Transpose gives OHWI,
+                // and foldConstants() turns it into an initializer.
+                node.inputs[1] = convert(node.inputs[1], true);
+            }
+            nhwc_output = true;
+            unit_output = op == "GlobalAveragePool";
+        } else if (op == "Softmax" && nhwc.count(node.inputs[0]) && softmaxOnNHWC(node)) {
+            nhwc_output = true;
+            unit_output = unit_spatial.count(node.inputs[0]);
+        } else if (isElementwise(op)) {
+            nhwc_output = nhwc.count(node.inputs[0]);
+            unit_output = unit_spatial.count(node.inputs[0]);
+        } else if (isBinaryElementwise(op)) {
+            for (const auto& name : node.inputs) nhwc_output |= nhwc.count(name) > 0;
+            for (auto& name : node.inputs) {
+                if (!nhwc_output || nhwc.count(name)) continue;
+                if (!isInitializer(graph, name)) {
+                    name = convert(name, true);
+                } else if (graph.tensors.at(name).shape().size() == 4) {
+                    // Constant operands are permuted once, ahead of time.
+                    std::string converted = name + "_nhwc";
+                    if (permuted_constants.insert(name).second) graph.tensors[converted] = ops.transpose(graph.tensors.at(name), kToNHWC);
+                    name = converted;
+                }
+            }
+        } else {
+            // Everything else sees the model's layout. Flattening [N,1,1,C] or
+            // [N,C,1,1] gives the same values, so those tensors need no transpose.
+            for (size_t i = 0; i < node.inputs.size(); ++i) {
+                const std::string& name = node.inputs[i];
+                bool same_either_way = i == 0 && (op == "Flatten" || op == "Reshape") && unit_spatial.count(name);
+                if (nhwc.count(name) && !same_either_way) node.inputs[i] = convert(name, false);
+            }
+        }
+
+        for (const auto& name : node.outputs) {
+            if (nhwc_output) nhwc.insert(name);
+            if (unit_output) unit_spatial.insert(name);
+        }
+        nodes.push_back(std::move(node));
+    }
+
+    // Graph outputs are returned in the model's layout.
+    for (const auto& output : outputs) {
+        if (!nhwc.count(output)) continue;
+        const std::string stored = output + "_nhwc";
+        for (GraphNode& node : nodes) {
+            for (auto& name : node.inputs) {
+                if (name == output) name = stored;
+            }
+            for (auto& name : node.outputs) {
+                if (name == output) name = stored;
+            }
+        }
+        nodes.push_back(makeTranspose(stored, output, kToNCHW));
+    }
+
+    // Drop constants whose permuted copy replaced every use.
+    std::unordered_set<std::string> read;
+    for (const GraphNode& node : nodes) read.insert(node.inputs.begin(), node.inputs.end());
+    for (const auto& name : permuted_constants) {
+        if (!read.count(name)) graph.tensors.erase(name);
+    }
+
+    graph.nodes = std::move(nodes);
+    graph.topologicalSort();
+    cancelTransposes(graph, outputs);
+}
+
+size_t cancelTransposes(ComputationGraph& graph, const std::vector<std::string>& outputs) {
+    size_t folded = 0;
+    while (cancelTransposePair(graph, outputs)) ++folded;
+    if (folded) Logger::instance().debug("Folded ", folded, " pairs of consecutive Transpose nodes");
+    return folded;
+}
+
+size_t foldConstants(ComputationGraph& graph) {
+    std::unordered_set<std::string> known;  // initializers and outputs of folded nodes
+    for (const auto& [name, tensor] : graph.tensors) {
+        if (tensor.size()) known.insert(name);
+    }
+
+    ComputationGraph scratch;  // the foldable nodes and the initializers they read
+    std::vector<bool> removed(graph.nodes.size(), false);
+    for (const GraphNode* node : graph.sorted_nodes) {
+        const Kernel* kernel = KernelRegistry::instance().find(node->op_type);
+        // Nodes without inputs are only deterministic if they are Constants.
+        if (!kernel || !kernel->run || (node->inputs.empty() && node->op_type != "Constant")) continue;
+        bool constant = true;
+        for (const auto& name : node->inputs) constant &= name.empty() || known.count(name) > 0;
+        if (!constant) continue;
+
+        for (const auto& name : node->inputs) {
+            if (graph.tensors.count(name) && !scratch.tensors.count(name)) scratch.tensors[name] = graph.tensors.at(name);
+        }
+        known.insert(node->outputs.begin(), node->outputs.end());
+        scratch.sorted_nodes.push_back(node);
+        removed[node - graph.nodes.data()] = true;
+    }
+    if (scratch.sorted_nodes.empty()) return 0;
+
+    // Evaluate them once with the regular kernels; Conv and MaxPool need XNNPACK.
+    if (xnn_initialize(nullptr) != xnn_status_success) {
+        throw std::runtime_error("XNNPACK initialization failed");
+    }
+    Operators ops;
+    KernelContext context{ops, nullptr, nullptr};
+    std::shared_ptr<CompiledGraph> compiled = compileGraph(scratch);
+    for (CompiledNode& step : compiled->nodes) {
+        KernelArgs args(*compiled, step);
+        std::unique_ptr<KernelState> state;
+        if (step.kernel->prepare) state = step.kernel->prepare(*step.node, context, args);
+        step.kernel->run(state.get(), context, args);
+    }
+
+    TensorUses uses(graph);
+    for (const GraphNode* node : scratch.sorted_nodes) {
+        for (const auto& name : node->outputs) graph.tensors[name] = std::move(scratch.tensors.at(name));
+        for (const auto& name : node->inputs) {
+            if (!name.empty() && graph.tensors.count(name)) uses.release(graph, name);
+        }
+    }
+    const size_t folded = scratch.sorted_nodes.size();
+    eraseNodes(graph, removed);
+    Logger::instance().debug("Folded ", folded, " nodes computing constants");
+    return folded;
+}
+
+size_t foldBatchNorms(ComputationGraph& graph) {
+    TensorUses uses(graph);
+    std::vector<bool> removed(graph.nodes.size(), false);
+    size_t folded = 0;
+    for (size_t i = 0; i < graph.nodes.size(); ++i) {
+        const GraphNode& bn = graph.nodes[i];
+        if (bn.op_type != "BatchNormalization" || bn.inputs.size() != 5 || bn.outputs.empty()) continue;
+        GraphNode* producer = uses.soleProducer(bn.inputs[0], "Conv");
+        if (!producer || producer->inputs.size() < 2) continue;
+        GraphNode& conv = *producer;
+
+        // The Conv's own weights and bias are rewritten, so they must not be shared.
+        const std::string& weights_name = conv.inputs[1];
+        const bool has_bias = conv.inputs.size() > 2;
+        if (!isInitializer(graph, weights_name) || uses.readers[weights_name] != 1) continue;
+        if (has_bias && (!isInitializer(graph, conv.inputs[2]) || uses.readers[conv.inputs[2]] != 1)) continue;
+
+        const Tensor& weights = graph.tensors.at(weights_name);
+        const size_t channels = weights.shape()[0];  // OIHW or OHWI: output channels first
+        bool params_known = true;
+        for (size_t j = 1; j < 5; ++j) {
+            params_known &= isInitializer(graph, bn.inputs[j]) && graph.tensors.at(bn.inputs[j]).size() == channels;
+        }
+        if (!params_known) continue;
+
+        const auto scale = graph.tensors.at(bn.inputs[1]).data();
+        const auto shift = graph.tensors.at(bn.inputs[2]).data();
+        const auto mean = graph.tensors.at(bn.inputs[3]).data();
+        const auto var = graph.tensors.at(bn.inputs[4]).data();
+        const double epsilon = getFloatAttr(&bn, "epsilon", 1e-5f);
+
+        std::vector<float> new_weights = weights.data();
+        std::vector<float> new_bias(channels, 0.0f);
+        if (has_bias) new_bias = graph.tensors.at(conv.inputs[2]).data();
+        const size_t per_channel = weights.size() / channels;
+        for (size_t c = 0; c < channels; ++c) {
+            const double factor = scale[c] / std::sqrt(static_cast<double>(var[c]) + epsilon);
+            for (size_t k = 0; k < per_channel; ++k) new_weights[c * per_channel + k] *= factor;
+            new_bias[c] = static_cast<float>((new_bias[c] - mean[c]) * factor + shift[c]);
+        }
+
+        // Replace rather than modify: the originals may be views into a mapped model file.
+        graph.tensors[weights_name] = Tensor(weights.shape(), new_weights);
+        if (!has_bias) conv.inputs.push_back(bn.outputs[0] + "_folded_bias");
+        graph.tensors[conv.inputs[2]] = Tensor({static_cast<int>(channels)}, new_bias);
+
+        for (size_t j = 1; j < 5; ++j) uses.release(graph, bn.inputs[j]);
+        conv.outputs[0] = bn.outputs[0];
+        uses.producers[bn.outputs[0]] = &conv;
+        removed[i] = true;
+        ++folded;
+    }
+
+    if (folded) {
+        eraseNodes(graph, removed);
+        Logger::instance().debug("Folded ", folded, " BatchNormalization nodes into Conv");
+    }
+    return folded;
+}
+
+size_t fuseActivations(ComputationGraph& graph) {
+    TensorUses uses(graph);
+    std::vector<bool> removed(graph.nodes.size(), false);
+    size_t fused = 0;
+    for (size_t i = 0; i < graph.nodes.size(); ++i) {
+        const GraphNode& activation = graph.nodes[i];
+        if (activation.inputs.empty() || activation.outputs.empty()) continue;
+        float min_val = 0.0f, max_val = 0.0f;
+        if (!activationRange(activation, initializerInputs(graph, activation), min_val, max_val)) continue;
+        GraphNode* producer = uses.soleProducer(activation.inputs[0], "Conv");
+        if (!producer) producer = uses.soleProducer(activation.inputs[0], "Gemm");
+        if (!producer) continue;
+
+        // Clamping twice is one clamp to the intersection of both ranges.
+        min_val = std::max(min_val, getFloatAttr(producer, "activation_min", Operators::kNoMin));
+        max_val = std::min(max_val, getFloatAttr(producer, "activation_max", Operators::kNoMax));
+        if (min_val > max_val) continue;
+        setFloatAttr(*producer, "activation_min", min_val);
+        setFloatAttr(*producer, "activation_max", max_val);
+
+        for (size_t j = 1; j < activation.inputs.size(); ++j) {
+            if (!activation.inputs[j].empty()) uses.release(graph, activation.inputs[j]);
+        }
+        producer->outputs[0] = activation.outputs[0];
+        uses.producers[activation.outputs[0]] = producer;
+        removed[i] = true;
+        ++fused;
+    }
+
+    if (fused) {
+        eraseNodes(graph, removed);
+        Logger::instance().debug("Fused ", fused, " Relu/Clip nodes into Conv/Gemm");
+    }
+    return fused;
+}
+
+std::vector<const GraphNode*> pruneToOutputs(const std::vector<const GraphNode*>& sorted_nodes,
+                                             const std::vector<std::string>& outputs) {
+    std::unordered_set<std::string> produced;
+    for (const GraphNode* node : sorted_nodes) produced.insert(node->outputs.begin(), node->outputs.end());
+    for (const auto& name : outputs) {
+        if (!produced.count(name)) throw std::runtime_error("Requested output '" + name + "' is not produced by any node");
+    }
+
+    std::unordered_set<std::string> needed(outputs.begin(), outputs.end());
+    std::vector<const GraphNode*> kept;
+    for (auto it = sorted_nodes.rbegin(); it != sorted_nodes.rend(); ++it) {
+        const GraphNode* node = *it;
+        bool contributes = false;
+        for (const auto& name : node->outputs) contributes |= needed.count(name) > 0;
+        if (!contributes) continue;
+        needed.insert(node->inputs.begin(), node->inputs.end());
+        kept.push_back(node);
+    }
+    std::reverse(kept.begin(), kept.end());
+    return kept;
+}
+
+void optimizeGraph(ComputationGraph& graph) {
+    foldConstants(graph);
+    foldBatchNorms(graph);
+    fuseActivations(graph);
+}
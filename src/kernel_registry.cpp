@@ -0,0 +1,32 @@
+#include "kernel_registry.h"
+#include "compiled_graph.h"
+
+size_t KernelArgs::numInputs() const {
+    return node_.inputs.size();
+}
+
+const Tensor& KernelArgs::input(size_t i) const {
+    return graph_.tensor(node_.inputs[i]);
+}
+
+Tensor& KernelArgs::output(size_t i) const {
+    return graph_.tensor(node_.outputs[i]);
+}
+
+KernelRegistry& KernelRegistry::instance() {
+    static KernelRegistry registry;
+    return registry;
+}
+
+KernelRegistry::KernelRegistry() {
+    registerBuiltinKernels(*this);
+}
+
+void KernelRegistry::add(const std::string& op_type, Kernel kernel) {
+    kernels_[op_type] = kernel;
+}
+
+const Kernel* KernelRegistry::find(const std::string& op_type) const {
+    auto it = kernels_.find(op_type);
+    return it != kernels_.end() ? &it->second : nullptr;
+}
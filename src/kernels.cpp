@@ -0,0 +1,459 @@
+#include "kernel_registry.h"
+#include "autotune.h"
+#include "onnx_utils.h"
+#include "onnx.pb.h"
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+template <typename State>
+State& stateOf(KernelState* state) {
+    return *static_cast<State*>(state);
+}
+
+// --- Constant -------------------------------------------------------------
+
+struct ConstantState : KernelState {
+    Tensor value;
+};
+
+Tensor decodeConstant(const GraphNode& node) {
+    assert(!node.attributes.empty());
+    const onnx::AttributeProto& attr = node.attributes[0];
+    assert(attr.has_t());
+    const onnx::TensorProto& tensor_proto = attr.t();
+    Tensor value({tensor_proto.dims().begin(), tensor_proto.dims().end()});
+    memcpy(value.data().data(), tensor_proto.raw_data().data(), tensor_proto.raw_data().size());
+    return value;
+}
+
+std::unique_ptr<KernelState> prepareConstant(const GraphNode& node, const KernelContext&, const KernelArgs&) {
+    auto state = std::make_unique<ConstantState>();
+    state->value = decodeConstant(node);
+    return state;
+}
+
+void runConstant(KernelState* state, const KernelContext&, const KernelArgs& args) {
+    args.output() = stateOf<ConstantState>(state).value;
+}
+
+// --- Conv -----------------------------------------------------------------
+
+// Attributes shared by Conv and MaxPool.
+struct WindowAttrs {
+    std::vector<int> kernel_shape;
+    std::vector<int> strides;
+    std::vector<int> pads;
+    std::vector<int> dilations;
+};
+
+WindowAttrs parseWindowAttrs(const GraphNode& node) {
+    WindowAttrs attrs;
+    attrs.kernel_shape = getIntListAttr(&node, "kernel_shape");
+    attrs.strides = getIntListAttr(&node, "strides");
+    attrs.pads = getIntListAttr(&node, "pads");
+    attrs.dilations = getIntListAttr(&node, "dilations");
+    if (attrs.strides.empty()) attrs.strides = {1, 1};
+    if (attrs.pads.empty()) attrs.pads = {0, 0, 0, 0};  // top, left, bottom, right
+    if (attrs.dilations.empty()) attrs.dilations = {1, 1};
+    return attrs;
+}
+
+// Output clamp of a Conv or Gemm with a fused Relu/Clip (see fuseActivations()).
+struct ClampAttrs {
+    float min = Operators::kNoMin;
+    float max = Operators::kNoMax;
+};
+
+ClampAttrs parseClampAttrs(const GraphNode& node) {
+    return {getFloatAttr(&node, "activation_min", Operators::kNoMin),
+            getFloatAttr(&node, "activation_max", Operators::kNoMax)};
+}
+
+struct ConvState : KernelState {
+    ConvParams params;
+    std::string name;              // the node's output, which names it in the tuning cache
+    std::vector<int> tuned_shape;  // input shape `choice` was looked up for
+    TuningChoice choice;
+    std::unique_ptr<XnnOperator> op;
+};
+
+void createConv(ConvState& conv, const KernelContext& ctx, const KernelArgs& args) {
+    const ConvParams& p = conv.params;
+    conv.op = ctx.ops.createConv2d(args.input(1), args.input(2), p.kernel_shape, p.strides, p.pads,
+                                   p.dilations, p.groups, ctx.weights_cache, p.output_min, p.output_max);
+}
+
+std::unique_ptr<KernelState> prepareConv(const GraphNode& node, const KernelContext& ctx, const KernelArgs& args) {
+    auto state = std::make_unique<ConvState>();
+    state->params = convParams(node);
+    state->name = node.outputs[0];
+
+    // Weights produced at run time (e.g. by a Constant node) are picked up on first execution.
+    if (args.input(1).size()) createConv(*state, ctx, args);
+    return state;
+}
+
+void runConv(KernelState* state, const KernelContext& ctx, const KernelArgs& args) {
+    ConvState& conv = stateOf<ConvState>(state);
+    if (!conv.op) {
+        createConv(conv, ctx, args);
+        // XNNPACK only sets up operators whose weights cache is finalized.
+        if (ctx.weights_cache) ctx.weights_cache->finalize(WeightsCache::Finalization::Soft);
+    }
+    // Autotuned kernel and thread count (ExecutionEngine::setAutotuning), looked up once per input shape.
+    const Tensor& input = args.input(0);
+    if (ctx.tuning && input.shape() != conv.tuned_shape) {
+        conv.choice = ctx.tuning->find(TuningCache::key(conv.name, input.shape())).value_or(TuningChoice{});
+        conv.tuned_shape = input.shape();
+    }
+    pthreadpool_t threadpool = ctx.threadpool;
+    if (threadpool && conv.choice.threads && ctx.threading) threadpool = ctx.threading->threadpool(conv.choice.threads);
+    runConvWith(conv.choice.algorithm, ctx.ops, *conv.op, conv.params, input, args.input(1), args.input(2),
+                args.output(), threadpool);
+}
+
+// --- MaxPool --------------------------------------------------------------
+
+struct MaxPoolState : KernelState {
+    std::unique_ptr<XnnOperator> op;
+};
+
+std::unique_ptr<KernelState> prepareMaxPool(const GraphNode& node, const KernelContext& ctx, const KernelArgs&) {
+    int ceil_mode = getIntAttr(&node, "ceil_mode", 0);
+    WindowAttrs w = parseWindowAttrs(node);
+    auto state = std::make_unique<MaxPoolState>();
+    state->op = ctx.ops.createMaxPool(ceil_mode, w.dilations, w.kernel_shape, w.pads, w.strides);
+    return state;
+}
+
+void runMaxPool(KernelState* state, const KernelContext& ctx, const KernelArgs& args) {
+    ctx.ops.runMaxPool(*stateOf<MaxPoolState>(state).op, args.input(0), args.output(), ctx.threadpool);
+}
+
+// --- Gemm / MatMul --------------------------------------------------------
+
+struct GemmState : KernelState {
+    float alpha = 1.0f;
+    float beta = 1.0f;
+    bool transB = false;
+    ClampAttrs clamp;
+};
+
+std::unique_ptr<KernelState> prepareGemm(const GraphNode& node, const KernelContext&, const KernelArgs&) {
+    auto state = std::make_unique<GemmState>();
+    state->alpha = getFloatAttr(&node, "alpha", 1.0f);
+    state->beta = getFloatAttr(&node, "beta", 1.0f);
+    state->transB = getIntAttr(&node, "transB", 0);
+    state->clamp = parseClampAttrs(node);
+    return state;
+}
+
+void runGemm(KernelState* state, const KernelContext& ctx, const KernelArgs& args) {
+    const GemmState& gemm = stateOf<GemmState>(state);
+    if (gemm.transB) {
+        ctx.ops.gemm_transB(args.input(0), args.input(1), args.input(2), gemm.alpha, gemm.beta, args.output(),
+                            gemm.clamp.min, gemm.clamp.max, ctx.threadpool);
+    } else {
+        ctx.ops.gemm(args.input(0), args.input(1), args.input(2), gemm.alpha, gemm.beta, args.output(),
+                     gemm.clamp.min, gemm.clamp.max, ctx.threadpool);
+    }
+}
+
+void runMatMul(KernelState*, const KernelContext& ctx, const KernelArgs& args) {
+    ctx.ops.matmul(args.input(0), args.input(1), args.output(), ctx.threadpool);
+}
+
+// --- Elementwise ----------------------------------------------------------
+
+void runAdd(KernelState*, const KernelContext& ctx, const KernelArgs& args) {
+    ctx.ops.add(args.input(0), args.input(1), args.output(), ctx.threadpool);
+}
+
+void runRelu(KernelState*, const KernelContext& ctx, const KernelArgs& args) {
+    ctx.ops.relu(args.input(0), args.output(), ctx.threadpool);
+}
+
+struct ClipState : KernelState {
+    const GraphNode* node = nullptr;  // bounds may be inputs produced at run time
+};
+
+std::unique_ptr<KernelState> prepareClip(const GraphNode& node, const KernelContext&, const KernelArgs&) {
+    auto state = std::make_unique<ClipState>();
+    state->node = &node;
+    return state;
+}
+
+void runClip(KernelState* state, const KernelContext& ctx, const KernelArgs& args) {
+    const GraphNode& node = *stateOf<ClipState>(state).node;
+    float min_val = 0.0f, max_val = 0.0f;
+    if (!activationRange(node, [&](size_t i) { return &args.input(i); }, min_val, max_val)) {
+        throw std::runtime_error("Clip bound input is empty: " + node.outputs[0]);
+    }
+    ctx.ops.clip(args.input(0), min_val, max_val, args.output(), ctx.threadpool);
+}
+
+struct SoftmaxState : KernelState {
+    int axis = -1;
+    bool coerce_2d = false;
+};
+
+// "coerce_2d" is set by the loader on Softmax nodes of models before opset 13.
+std::unique_ptr<KernelState> prepareSoftmax(const GraphNode& node, const KernelContext&, const KernelArgs&) {
+    auto state = std::make_unique<SoftmaxState>();
+    state->axis = getIntAttr(&node, "axis", -1);
+    state->coerce_2d = getIntAttr(&node, "coerce_2d", 0) != 0;
+    return state;
+}
+
+void runSoftmax(KernelState* state, const KernelContext& ctx, const KernelArgs& args) {
+    const SoftmaxState& softmax = stateOf<SoftmaxState>(state);
+    ctx.ops.softmax(args.input(0), softmax.axis, softmax.coerce_2d, args.output(), ctx.threadpool);
+}
+
+struct BatchNormState : KernelState {
+    float epsilon = 1e-5f;
+};
+
+std::unique_ptr<KernelState> prepareBatchNorm(const GraphNode& node, const KernelContext&, const KernelArgs&) {
+    auto state = std::make_unique<BatchNormState>();
+    state->epsilon = getFloatAttr(&node, "epsilon", 1e-5f);
+    return state;
+}
+
+void runBatchNorm(KernelState* state, const KernelContext& ctx, const KernelArgs& args) {
+    ctx.ops.batchNorm(args.input(0), args.input(1), args.input(2), args.input(3), args.input(4),
+                      stateOf<BatchNormState>(state).epsilon, args.output(), ctx.threadpool);
+}
+
+// --- Layout ---------------------------------------------------------------
+
+void runGlobalAveragePool(KernelState*, const KernelContext& ctx, const KernelArgs& args) {
+    ctx.ops.globalAveragePool(args.input(0), args.output(), ctx.threadpool);
+}
+
+struct TransposeState : KernelState {
+    std::vector<int> perm;
+};
+
+std::unique_ptr<KernelState> prepareTranspose(const GraphNode& node, const KernelContext&, const KernelArgs&) {
+    auto state = std::make_unique<TransposeState>();
+    state->perm = getIntListAttr(&node, "perm");
+    return state;
+}
+
+void runTranspose(KernelState* state, const KernelContext& ctx, const KernelArgs& args) {
+    ctx.ops.transpose(args.input(0), stateOf<TransposeState>(state).perm, args.output(), ctx.threadpool);
+}
+
+struct ReshapeState : KernelState {
+    std::vector<int> new_shape;  // reused buffer for the shape input
+};
+
+std::unique_ptr<KernelState> prepareReshape(const GraphNode&, const KernelContext&, const KernelArgs&) {
+    return std::make_unique<ReshapeState>();
+}
+
+void runReshape(KernelState* state, const KernelContext& ctx, const KernelArgs& args) {
+    std::vector<int>& new_shape = stateOf<ReshapeState>(state).new_shape;
+    const Tensor& shape_tensor = args.input(1);
+    new_shape.assign(shape_tensor.data().begin(), shape_tensor.data().end());
+    ctx.ops.reshape(args.input(0), new_shape, args.output());
+}
+
+struct FlattenState : KernelState {
+    int axis = 0;
+};
+
+std::unique_ptr<KernelState> prepareFlatten(const GraphNode& node, const KernelContext&, const KernelArgs&) {
+    auto state = std::make_unique<FlattenState>();
+    state->axis = getIntAttr(&node, "axis", 0);
+    return state;
+}
+
+void runFlatten(KernelState* state, const KernelContext& ctx, const KernelArgs& args) {
+    ctx.ops.flatten(args.input(0), stateOf<FlattenState>(state).axis, args.output());
+}
+
+// --- Shape inference ------------------------------------------------------
+
+size_t numel(const std::vector<int>& shape) {
+    size_t count = 1;
+    for (int dim : shape) count *= dim;
+    return count;
+}
+
+[[noreturn]] void shapeError(const GraphNode& node, const std::string& message) {
+    std::string name = node.outputs.empty() ? std::string() : node.outputs[0];
+    throw std::runtime_error(node.op_type + " node '" + name + "': " + message);
+}
+
+void expectRank(const GraphNode& node, const std::vector<int>& shape, size_t rank, const char* what) {
+    if (shape.size() != rank) {
+        shapeError(node, std::string(what) + " must have rank " + std::to_string(rank) +
+                         ", got rank " + std::to_string(shape.size()));
+    }
+}
+
+void inferConstant(const GraphNode& node, ShapeArgs& shapes) {
+    Tensor value = decodeConstant(node);
+    shapes.outputs = {value.shape()};
+    shapes.output_values.push_back(std::move(value));
+}
+
+// NHWC output shape of a sliding window, as computed by XNNPACK (floor rounding).
+std::vector<int> windowOutputShape(const GraphNode& node, const std::vector<int>& in, const WindowAttrs& w, int channels) {
+    std::vector<int> out = {in[0], 0, 0, channels};
+    for (int axis = 0; axis < 2; ++axis) {
+        int effective = w.dilations[axis] * (w.kernel_shape[axis] - 1) + 1;
+        int padded = in[1 + axis] + w.pads[axis] + w.pads[axis + 2];
+        if (padded < effective) shapeError(node, "kernel is larger than the padded input");
+        out[1 + axis] = (padded - effective) / w.strides[axis] + 1;
+    }
+    return out;
+}
+
+void inferConv(const GraphNode& node, ShapeArgs& shapes) {
+    const auto& in = shapes.inputs[0];
+    const auto& w = shapes.inputs[1];
+    expectRank(node, in, 4, "input");
+    expectRank(node, w, 4, "weights");  // [OC, KH, KW, IC/groups]
+    WindowAttrs window = parseWindowAttrs(node);
+    int groups = getIntAttr(&node, "group", 1);
+    if (window.kernel_shape.empty()) window.kernel_shape = {w[1], w[2]};
+    if (w[3] * groups != in[3]) {
+        shapeError(node, "input has " + std::to_string(in[3]) + " channels, weights expect " +
+                         std::to_string(w[3] * groups));
+    }
+    if (shapes.inputs.size() > 2 && numel(shapes.inputs[2]) != static_cast<size_t>(w[0])) {
+        shapeError(node, "bias size does not match the output channels");
+    }
+
+    shapes.outputs = {windowOutputShape(node, in, window, w[0])};
+    shapes.flops = 2ull * numel(shapes.outputs[0]) * w[1] * w[2] * w[3];
+}
+
+void inferMaxPool(const GraphNode& node, ShapeArgs& shapes) {
+    const auto& in = shapes.inputs[0];
+    expectRank(node, in, 4, "input");
+    WindowAttrs window = parseWindowAttrs(node);
+    if (window.kernel_shape.size() != 2) shapeError(node, "kernel_shape must have 2 values");
+    shapes.outputs = {windowOutputShape(node, in, window, in[3])};
+    shapes.flops = numel(shapes.outputs[0]) * window.kernel_shape[0] * window.kernel_shape[1];
+}
+
+void inferGemm(const GraphNode& node, ShapeArgs& shapes) {
+    const auto& a = shapes.inputs[0];
+    const auto& b = shapes.inputs[1];
+    expectRank(node, a, 2, "A");
+    expectRank(node, b, 2, "B");
+    bool transB = getIntAttr(&node, "transB", 0);
+    int k = transB ? b[1] : b[0];
+    int n = transB ? b[0] : b[1];
+    if (a[1] != k) shapeError(node, "inner dimensions do not match");
+    if (shapes.inputs.size() > 2 && numel(shapes.inputs[2]) != static_cast<size_t>(n)) {
+        shapeError(node, "bias size does not match the output features");
+    }
+    shapes.outputs = {{a[0], n}};
+    shapes.flops = 2ull * a[0] * n * k;
+}
+
+void inferMatMul(const GraphNode& node, ShapeArgs& shapes) {
+    const auto& a = shapes.inputs[0];
+    const auto& b = shapes.inputs[1];
+    expectRank(node, a, 2, "A");
+    expectRank(node, b, 2, "B");
+    if (a[1] != b[0]) shapeError(node, "inner dimensions do not match");
+    shapes.outputs = {{a[0], b[1]}};
+    shapes.flops = 2ull * a[0] * b[1] * a[1];
+}
+
+void inferAdd(const GraphNode& node, ShapeArgs& shapes) {
+    if (shapes.inputs[0] != shapes.inputs[1]) shapeError(node, "operands must have identical shapes");
+    shapes.outputs = {shapes.inputs[0]};
+    shapes.flops = numel(shapes.inputs[0]);
+}
+
+// Output has the input's shape; `flops_per_element` operations per element.
+template <int flops_per_element>
+void inferElementwise(const GraphNode&, ShapeArgs& shapes) {
+    shapes.outputs = {shapes.inputs[0]};
+    shapes.flops = flops_per_element * numel(shapes.inputs[0]);
+}
+
+void inferSoftmax(const GraphNode& node, ShapeArgs& shapes) {
+    const int rank = static_cast<int>(shapes.inputs[0].size());
+    const int64_t axis = getIntAttr(&node, "axis", -1);
+    if (axis < -rank || axis >= rank) {
+        shapeError(node, "axis " + std::to_string(axis) + " is out of range for a rank " + std::to_string(rank) + " input");
+    }
+    inferElementwise<3>(node, shapes);
+}
+
+void inferBatchNorm(const GraphNode& node, ShapeArgs& shapes) {
+    expectRank(node, shapes.inputs[0], 4, "input");
+    inferElementwise<2>(node, shapes);
+}
+
+void inferGlobalAveragePool(const GraphNode& node, ShapeArgs& shapes) {
+    const auto& in = shapes.inputs[0];
+    expectRank(node, in, 4, "input");
+    shapes.outputs = {{in[0], 1, 1, in[3]}};
+    shapes.flops = numel(in);
+}
+
+void inferTranspose(const GraphNode& node, ShapeArgs& shapes) {
+    const auto& in = shapes.inputs[0];
+    std::vector<int> perm = getIntListAttr(&node, "perm");
+    if (perm.size() != in.size()) shapeError(node, "perm does not match the input rank");
+    std::vector<int> out(in.size());
+    for (size_t i = 0; i < perm.size(); ++i) out[i] = in[perm[i]];
+    shapes.outputs = {out};
+}
+
+void inferReshape(const GraphNode& node, ShapeArgs& shapes) {
+    const Tensor* shape_tensor = shapes.values[1];
+    if (!shape_tensor) shapeError(node, "shape input is not known ahead of time");
+    std::vector<int> out(shape_tensor->data().begin(), shape_tensor->data().end());
+    size_t known = 1;
+    int infer_dim = -1;
+    for (size_t i = 0; i < out.size(); ++i) {
+        if (out[i] == -1) {
+            infer_dim = static_cast<int>(i);
+        } else {
+            known *= out[i];
+        }
+    }
+    size_t count = numel(shapes.inputs[0]);
+    if (infer_dim != -1 && known) out[infer_dim] = static_cast<int>(count / known);
+    if (numel(out) != count) shapeError(node, "target shape has a different number of elements");
+    shapes.outputs = {out};
+}
+
+void inferFlatten(const GraphNode& node, ShapeArgs& shapes) {
+    const auto& in = shapes.inputs[0];
+    if (in.size() < 2) shapeError(node, "input must have rank >= 2");
+    shapes.outputs = {{in[0], static_cast<int>(numel(in) / in[0])}};
+}
+
+} // namespace
+
+void registerBuiltinKernels(KernelRegistry& registry) {
+    registry.add("Constant", {prepareConstant, runConstant, inferConstant});
+    registry.add("Conv", {prepareConv, runConv, inferConv});
+    registry.add("MaxPool", {prepareMaxPool, runMaxPool, inferMaxPool});
+    registry.add("Gemm", {prepareGemm, runGemm, inferGemm});
+    registry.add("MatMul", {nullptr, runMatMul, inferMatMul});
+    registry.add("Add", {nullptr, runAdd, inferAdd});
+    registry.add("Relu", {nullptr, runRelu, inferElementwise<1>});
+    registry.add("Clip", {prepareClip, runClip, inferElementwise<2>});
+    registry.add("Softmax", {prepareSoftmax, runSoftmax, inferSoftmax});
+    registry.add("BatchNormalization", {prepareBatchNorm, runBatchNorm, inferBatchNorm});
+    registry.add("GlobalAveragePool", {nullptr, runGlobalAveragePool, inferGlobalAveragePool});
+    registry.add("Transpose", {prepareTranspose, runTranspose, inferTranspose});
+    registry.add("Reshape", {prepareReshape, runReshape, inferReshape});
+    registry.add("Flatten", {prepareFlatten, runFlatten, inferFlatten});
+}
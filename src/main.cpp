@@ -1,33 +1,109 @@
 #include <iostream>
 #include "onnx_loader.h"
 #include "execution_engine.h"
+#include "autotune.h"
+#include "graph_optimizer.h"
+#include "memory_planner.h"
+#include "shape_inference.h"
+#include "plan_file.h"
 #include "tensor.h"
 #include "utils/timer.h"
 #include "utils/meminfo.h"
 #include "utils/logger.h"
 #include <fstream>
+#include <sstream>
 
+// Reads a little-endian float32, C-ordered .npy file of any shape.
 Tensor loadNumpyInput(const std::string& filename) {
     std::ifstream file(filename, std::ios::binary);
     if (!file) {
-        throw std::runtime_error("Cannot open input_tensor.npy");
+        throw std::runtime_error("Cannot open " + filename);
     }
-    file.seekg(128); // Skip numpy header (assume standard header size for simplicity)
-    std::vector<float> data(1 * 3 * 224 * 224);
+    char magic[8];
+    file.read(magic, sizeof(magic));
+    if (!file || std::string(magic, 6) != "\x93NUMPY") {
+        throw std::runtime_error(filename + " is not a .npy file");
+    }
+    // Version 1 stores the header length in 2 bytes, versions 2 and 3 in 4.
+    const int major_version = static_cast<unsigned char>(magic[6]);
+    unsigned char length_bytes[4] = {0, 0, 0, 0};
+    file.read(reinterpret_cast<char*>(length_bytes), major_version == 1 ? 2 : 4);
+    const size_t header_len = length_bytes[0] | length_bytes[1] << 8 | length_bytes[2] << 16 | length_bytes[3] << 24;
+    std::string header(header_len, '\0');
+    file.read(&header[0], header_len);
+    if (!file) {
+        throw std::runtime_error(filename + ": truncated .npy header");
+    }
+
+    if (header.find("'descr': '<f4'") == std::string::npos || header.find("'fortran_order': False") == std::string::npos) {
+        throw std::runtime_error(filename + ": only C-ordered little-endian float32 arrays are supported");
+    }
+    size_t open = header.find('(', header.find("'shape'"));
+    size_t close = header.find(')', open);
+    if (open == std::string::npos || close == std::string::npos) {
+        throw std::runtime_error(filename + ": .npy header has no shape");
+    }
+    std::vector<int> shape;
+    std::istringstream dims(header.substr(open + 1, close - open - 1));
+    for (std::string dim; std::getline(dims, dim, ',');) {
+        if (dim.find_first_not_of(" ") != std::string::npos) shape.push_back(std::stoi(dim));
+    }
+
+    size_t count = 1;
+    for (int dim : shape) count *= dim;
+    std::vector<float> data(count);
     file.read(reinterpret_cast<char*>(data.data()), data.size() * sizeof(float));
-    return Tensor({1, 3, 224, 224}, data);
+    if (!file) {
+        throw std::runtime_error(filename + ": expected " + std::to_string(count) + " floats");
+    }
+    return Tensor(shape, data);
 }
 
 int main(int argc, char* argv[]) {
     std::vector<std::string> args(argv + 1, argv + argc);
 
-    // Check for --debug flag
+    // Check for --debug, --mmap, --xnn-subgraph, --report, --output, --inter-op-threads, --threads, --pin-threads, --sleep-workers, --autotune, --memory-order, --tile-kb and -o flags
     bool debug_enabled = false;
+    bool use_mmap = false;
+    bool xnn_subgraph = false;
+    bool report = false;
+    bool memory_order = false;
+    std::vector<std::string> requested_outputs;
+    size_t inter_op_threads = 1;
+    ThreadingOptions threading;
+    size_t tile_kb = 0;
+    std::string tuning_path;
+    std::string output_path;
     std::vector<std::string> positional_args;
 
-    for (const auto& arg : args) {
+    for (size_t i = 0; i < args.size(); ++i) {
+        const auto& arg = args[i];
         if (arg == "--debug") {
             debug_enabled = true;
+        } else if (arg == "--mmap") {
+            use_mmap = true;
+        } else if (arg == "--xnn-subgraph") {
+            xnn_subgraph = true;
+        } else if (arg == "--report") {
+            report = true;
+        } else if (arg == "--memory-order") {
+            memory_order = true;
+        } else if (arg == "--output" && i + 1 < args.size()) {
+            requested_outputs.push_back(args[++i]);
+        } else if (arg == "--inter-op-threads" && i + 1 < args.size()) {
+            inter_op_threads = std::stoul(args[++i]);
+        } else if (arg == "--threads" && i + 1 < args.size()) {
+            threading.threads = std::stoul(args[++i]);
+        } else if (arg == "--pin-threads") {
+            threading.pin_threads = true;
+        } else if (arg == "--sleep-workers") {
+            threading.wait = WaitPolicy::Sleep;
+        } else if (arg == "--autotune" && i + 1 < args.size()) {
+            tuning_path = args[++i];
+        } else if (arg == "--tile-kb" && i + 1 < args.size()) {
+            tile_kb = std::stoul(args[++i]);
+        } else if (arg == "-o" && i + 1 < args.size()) {
+            output_path = args[++i];
         } else {
             positional_args.push_back(arg);
         }
@@ -36,10 +112,28 @@ int main(int argc, char* argv[]) {
     // Set logging level
     Logger::instance().setLevel(debug_enabled ? LOG_LEVEL_DEBUG : LOG_LEVEL_INFO);
     Logger::instance().debug("Debugging is enabled");
-    
-    // Expect exactly 2 positional arguments: model and input file
+
+    // compile <onnx_model> -o <plan.tplan>: freeze the parsed graph to disk
+    if (!positional_args.empty() && positional_args[0] == "compile") {
+        if (positional_args.size() != 2 || output_path.empty()) {
+            Logger::instance().error("Usage: <program> compile [--mmap] <onnx_model> -o <model.tplan>");
+            return 1;
+        }
+        ONNXModel model;
+        if (!model.load(positional_args[1], use_mmap)) {
+            Logger::instance().error("Error: Unable to load ONNX model.");
+            return 1;
+        }
+        ComputationGraph graph = model.parseGraph();
+        optimizeGraph(graph);
+        if (!savePlan(graph, output_path)) return 1;
+        Logger::instance().info("Execution plan written to ", output_path);
+        return 0;
+    }
+
+    // Expect exactly 2 positional arguments: model (.onnx or .tplan) and input file
     if (positional_args.size() != 2) {
-        Logger::instance().error("Usage: <program> [--debug] <onnx_model> <input_tensor.npy>");
+        Logger::instance().error("Usage: <program> [--debug] [--mmap] [--xnn-subgraph] [--report] [--memory-order] [--output <name>]... [--inter-op-threads <n>] [--threads <n>] [--pin-threads] [--sleep-workers] [--autotune <file>] [--tile-kb <n>] <onnx_model|model.tplan> <input_tensor.npy>");
         return 1;
     }
     
@@ -48,34 +142,63 @@ int main(int argc, char* argv[]) {
 
     Logger::instance().info("Program started");
 
-    ONNXModel model;
-    if (!model.load(model_path)) {
-        Logger::instance().error("Error: Unable to load ONNX model.");
-        return 1;
+    ComputationGraph graph;
+    if (isPlanFile(model_path)) {
+        if (!loadPlan(model_path, graph)) {
+            Logger::instance().error("Error: Unable to load execution plan.");
+            return 1;
+        }
+    } else {
+        ONNXModel model;
+        if (!model.load(model_path, use_mmap)) {
+            Logger::instance().error("Error: Unable to load ONNX model.");
+            return 1;
+        }
+        graph = model.parseGraph();
+        optimizeGraph(graph);
     }
-
-    ComputationGraph graph = model.parseGraph();
     Tensor input = loadNumpyInput(input_path);
 
     Timer total_timer("Total Graph Execution");
-    ExecutionEngine engine;
+    ExecutionEngine engine(xnn_subgraph ? ExecutionEngine::Backend::XnnpackSubgraph : ExecutionEngine::Backend::Native);
+    engine.setThreading(threading);
+    engine.setInterOpThreads(inter_op_threads);
+    engine.setTiledExecution(tile_kb * 1024);
+    if (!tuning_path.empty()) engine.setAutotuning(std::make_shared<TuningCache>(tuning_path, modelFingerprint(graph)));
+    try {
+        if (memory_order) {
+            MemoryOrdering ordering = orderForMemory(graph, inferShapes(graph, input.shape()).shapes);
+            Logger::instance().info("Peak live activations: ", ordering.peak_bytes / 1024.0, " KB (",
+                                    ordering.fifo_peak_bytes / 1024.0, " KB in FIFO order)");
+        }
+        // Only the nodes the requested outputs depend on are run.
+        engine.selectOutputs(graph, requested_outputs);
+        if (report) inferShapes(graph, input.shape()).print();
+        engine.prepare(graph, input.shape());
+    } catch (const std::runtime_error& e) {
+        Logger::instance().error("Error: Invalid model for this input: ", e.what());
+        return 1;
+    }
     engine.executeGraph(graph, input);
 
     #ifdef ENABLE_MEM_USAGE
     printPeakRSS();
     #endif
 
-    // Show final output tensor (assuming named 'output')
-    if (graph.tensors.count("output")) {
-        graph.tensors["output"].print();
-        std::ofstream fout("tinyonnx_output.txt");
-        for (float val : graph.tensors["output"].data()) {
+    // Show the requested output tensors (by default the one named 'output')
+    if (requested_outputs.empty()) requested_outputs = {"output"};
+    std::ofstream fout("tinyonnx_output.txt");
+    for (const auto& name : requested_outputs) {
+        if (!graph.tensors.count(name)) {
+            std::cerr << "Output tensor not found: " << name << std::endl;
+            continue;
+        }
+        graph.tensors[name].print();
+        for (float val : graph.tensors[name].data()) {
             fout << val << "\n";
         }
-        fout.close();
-    } else {
-        std::cerr << "Output tensor not found!" << std::endl;
     }
+    fout.close();
 
     std::cout << "ONNX Model execution completed!" << std::endl;
     return 0;
@@ -0,0 +1,247 @@
+#include "memory_planner.h"
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+
+namespace {
+
+size_t alignUp(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+size_t tensorBytes(const std::vector<int>& shape) {
+    size_t count = 1;
+    for (int dim : shape) count *= dim;
+    return count * sizeof(float);
+}
+
+} // namespace
+
+void MemoryPlan::bind(ComputationGraph& graph) {
+    char* base = reinterpret_cast<char*>(arena.get());
+    for (const auto& [name, offset] : offsets) {
+        graph.tensors[name] = Tensor::view(shapes.at(name), reinterpret_cast<float*>(base + offset), arena);
+    }
+}
+
+std::vector<TensorLifetime> computeLifetimes(const ComputationGraph& graph) {
+    std::unordered_map<std::string, TensorLifetime> ranges;
+    std::vector<std::string> order;
+
+    for (size_t i = 0; i < graph.sorted_nodes.size(); ++i) {
+        const GraphNode* node = graph.sorted_nodes[i];
+        for (const auto& name : node->inputs) {
+            auto it = ranges.find(name);
+            if (it != ranges.end()) it->second.last_use = i;
+        }
+        for (const auto& name : node->outputs) {
+            if (node->op_type == "Constant" || ranges.count(name)) continue;
+            TensorLifetime& range = ranges[name];
+            range.name = name;
+            range.first_use = range.last_use = i;
+            order.push_back(name);
+        }
+    }
+
+    std::vector<TensorLifetime> lifetimes;
+    for (const auto& name : order) {
+        const TensorLifetime& range = ranges.at(name);
+        if (range.last_use == range.first_use) continue;  // graph output
+        if (graph.keepsOutput(name)) continue;
+        lifetimes.push_back(range);
+    }
+    return lifetimes;
+}
+
+std::shared_ptr<MemoryPlan> planMemory(const std::vector<TensorLifetime>& lifetimes,
+                                       const std::unordered_map<std::string, std::vector<int>>& shapes) {
+    auto plan = std::make_shared<MemoryPlan>();
+
+    std::vector<TensorLifetime> sized;
+    for (const auto& lifetime : lifetimes) {
+        auto it = shapes.find(lifetime.name);
+        if (it == shapes.end()) continue;
+        sized.push_back(lifetime);
+        sized.back().bytes = tensorBytes(it->second);
+    }
+
+    std::vector<const TensorLifetime*> by_size;
+    for (const auto& lifetime : sized) by_size.push_back(&lifetime);
+    std::stable_sort(by_size.begin(), by_size.end(), [](const TensorLifetime* a, const TensorLifetime* b) {
+        return a->bytes > b->bytes;
+    });
+
+    struct Placement {
+        const TensorLifetime* tensor;
+        size_t offset;
+        size_t size;
+    };
+    std::vector<Placement> placed;  // sorted by offset
+
+    for (const TensorLifetime* tensor : by_size) {
+        size_t size = alignUp(tensor->bytes, MemoryPlan::kAlignment);
+
+        // Take the smallest gap between live-overlapping tensors that fits.
+        size_t best_offset = 0;
+        size_t best_gap = SIZE_MAX;
+        size_t cursor = 0;
+        for (const Placement& other : placed) {
+            if (other.tensor->last_use < tensor->first_use || tensor->last_use < other.tensor->first_use) continue;
+            if (other.offset >= cursor) {
+                size_t gap = other.offset - cursor;
+                if (gap >= size && gap < best_gap) {
+                    best_gap = gap;
+                    best_offset = cursor;
+                }
+            }
+            cursor = std::max(cursor, other.offset + other.size);
+        }
+        if (best_gap == SIZE_MAX) best_offset = cursor;
+
+        auto pos = std::upper_bound(placed.begin(), placed.end(), best_offset,
+                                    [](size_t offset, const Placement& p) { return offset < p.offset; });
+        placed.insert(pos, {tensor, best_offset, size});
+
+        plan->offsets[tensor->name] = best_offset;
+        plan->shapes[tensor->name] = shapes.at(tensor->name);
+        plan->arena_bytes = std::max(plan->arena_bytes, best_offset + size);
+        plan->unplanned_bytes += size;
+    }
+
+    if (plan->arena_bytes > 0) {
+        void* memory = std::aligned_alloc(MemoryPlan::kAlignment, plan->arena_bytes);
+        if (!memory) {
+            throw std::runtime_error("Failed to allocate activation arena");
+        }
+        plan->arena = std::shared_ptr<float>(static_cast<float*>(memory), [](float* p) { std::free(p); });
+    }
+    return plan;
+}
+
+size_t peakLiveBytes(const ComputationGraph& graph, const std::unordered_map<std::string, std::vector<int>>& shapes) {
+    // live[i] - live[i - 1], accumulated below
+    std::vector<long long> delta(graph.sorted_nodes.size() + 1, 0);
+    for (const auto& lifetime : computeLifetimes(graph)) {
+        auto shape = shapes.find(lifetime.name);
+        if (shape == shapes.end()) continue;
+        long long bytes = static_cast<long long>(tensorBytes(shape->second));
+        delta[lifetime.first_use] += bytes;
+        delta[lifetime.last_use + 1] -= bytes;
+    }
+    long long live = 0;
+    long long peak = 0;
+    for (long long change : delta) {
+        live += change;
+        peak = std::max(peak, live);
+    }
+    return static_cast<size_t>(peak);
+}
+
+MemoryOrdering orderForMemory(ComputationGraph& graph, const std::unordered_map<std::string, std::vector<int>>& shapes) {
+    if (graph.compiled || graph.xnn_plan || !graph.output_selections.empty()) {
+        throw std::runtime_error("Nodes can only be reordered before the graph is first executed");
+    }
+    MemoryOrdering result;
+    result.fifo_peak_bytes = result.peak_bytes = peakLiveBytes(graph, shapes);
+
+    const std::vector<const GraphNode*> fifo_order = graph.sorted_nodes;
+    const size_t count = fifo_order.size();
+    std::unordered_map<std::string, size_t> producer;
+    for (size_t i = 0; i < count; ++i) {
+        for (const auto& name : fifo_order[i]->outputs) producer.emplace(name, i);
+    }
+
+    // Inputs produced by other nodes, each listed once per node.
+    std::vector<std::vector<std::string>> produced_inputs(count);
+    std::vector<std::vector<size_t>> consumers(count);
+    std::vector<int> waiting(count, 0);
+    std::unordered_map<std::string, int> readers;  // nodes still to read each tensor
+    for (size_t i = 0; i < count; ++i) {
+        std::vector<std::string>& inputs = produced_inputs[i];
+        for (const auto& name : fifo_order[i]->inputs) {
+            auto it = producer.find(name);
+            if (it == producer.end() || it->second == i) continue;
+            if (std::find(inputs.begin(), inputs.end(), name) != inputs.end()) continue;
+            inputs.push_back(name);
+            consumers[it->second].push_back(i);
+            ++waiting[i];
+            ++readers[name];
+        }
+    }
+
+    // Bytes a tensor takes in the arena, 0 if it is kept outside (see computeLifetimes()).
+    auto plannedBytes = [&](const std::string& name) -> size_t {
+        auto shape = shapes.find(name);
+        if (shape == shapes.end() || !readers.count(name)) return 0;
+        if (fifo_order[producer.at(name)]->op_type == "Constant") return 0;
+        if (graph.keepsOutput(name)) return 0;
+        return tensorBytes(shape->second);
+    };
+    auto growth = [&](size_t i) {
+        long long bytes = 0;
+        for (const auto& name : fifo_order[i]->outputs) bytes += plannedBytes(name);
+        for (const auto& name : produced_inputs[i]) {
+            if (readers.at(name) == 1) bytes -= plannedBytes(name);
+        }
+        return bytes;
+    };
+
+    std::vector<size_t> ready;
+    for (size_t i = 0; i < count; ++i) {
+        if (waiting[i] == 0) ready.push_back(i);
+    }
+    std::vector<const GraphNode*> order;
+    while (!ready.empty()) {
+        // Least growth first; ties keep the original order.
+        auto best = ready.begin();
+        long long best_growth = growth(*best);
+        for (auto it = ready.begin() + 1; it != ready.end(); ++it) {
+            long long g = growth(*it);
+            if (g < best_growth || (g == best_growth && *it < *best)) {
+                best = it;
+                best_growth = g;
+            }
+        }
+        size_t node = *best;
+        ready.erase(best);
+        order.push_back(fifo_order[node]);
+        for (const auto& name : produced_inputs[node]) --readers.at(name);
+        for (size_t consumer : consumers[node]) {
+            if (--waiting[consumer] == 0) ready.push_back(consumer);
+        }
+    }
+
+    graph.sorted_nodes = std::move(order);
+    result.peak_bytes = peakLiveBytes(graph, shapes);
+    if (result.peak_bytes > result.fifo_peak_bytes) {
+        graph.sorted_nodes = fifo_order;
+        result.peak_bytes = result.fifo_peak_bytes;
+    }
+    return result;
+}
+
+std::shared_ptr<MemoryPlan> PlanCache::find(const std::vector<int>& input_shape) {
+    for (auto it = plans_.begin(); it != plans_.end(); ++it) {
+        if ((*it)->input_shape != input_shape) continue;
+        plans_.splice(plans_.begin(), plans_, it);
+        ++hits_;
+        return plans_.front();
+    }
+    ++misses_;
+    return nullptr;
+}
+
+void PlanCache::insert(std::shared_ptr<MemoryPlan> plan) {
+    plans_.remove_if([&](const std::shared_ptr<MemoryPlan>& p) { return p->input_shape == plan->input_shape; });
+    plans_.push_front(std::move(plan));
+    evict();
+}
+
+void PlanCache::setCapacity(size_t capacity) {
+    capacity_ = capacity;
+    evict();
+}
+
+void PlanCache::evict() {
+    while (plans_.size() > capacity_) plans_.pop_back();
+}
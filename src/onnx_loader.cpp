@@ -1,12 +1,177 @@
 #include "onnx_loader.h"
+#include "graph_optimizer.h"
 #include "graph.h"
 #include "utils/logger.h"
 #include <iostream>
 #include <fstream>
+#include <cstring>
+#include <cstdint>
+
+namespace {
+
+// Minimal protobuf wire-format walker for the mmap loader. It rebuilds the
+// ModelProto without initializer raw_data payloads, so protobuf never copies
+// the weights, and records where each payload lives inside the mapping.
+constexpr uint32_t kModelGraphField = 7;
+constexpr uint32_t kGraphInitializerField = 5;
+constexpr uint32_t kTensorRawDataField = 9;
+constexpr int kWireLengthDelimited = 2;
+
+using Payload = std::pair<char*, size_t>;
+
+void addIntAttrIfMissing(GraphNode& node, const std::string& name, int64_t value) {
+    for (const auto& attr : node.attributes) {
+        if (attr.name() == name) return;
+    }
+    onnx::AttributeProto attr;
+    attr.set_name(name);
+    attr.set_type(onnx::AttributeProto::INT);
+    attr.set_i(value);
+    node.attributes.push_back(attr);
+}
+
+bool readVarint(char*& p, const char* end, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && p < end; shift += 7) {
+        uint8_t byte = static_cast<uint8_t>(*p++);
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+void writeVarint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+// Calls fn(field, wire_type, field_begin, payload_begin, field_end) for each field in [p, end).
+template <typename Fn>
+bool forEachField(char* p, char* end, Fn&& fn) {
+    while (p < end) {
+        char* field_begin = p;
+        uint64_t tag;
+        if (!readVarint(p, end, tag)) return false;
+        uint32_t field = static_cast<uint32_t>(tag >> 3);
+        int wire = static_cast<int>(tag & 7);
+        char* payload = p;
+        uint64_t value;
+        switch (wire) {
+            case 0: if (!readVarint(p, end, value)) return false; break;
+            case 1: p += 8; break;
+            case 2:
+                if (!readVarint(p, end, value) || value > static_cast<uint64_t>(end - p)) return false;
+                payload = p;
+                p += value;
+                break;
+            case 5: p += 4; break;
+            default: return false;  // groups are not used by ONNX
+        }
+        if (p > end || !fn(field, wire, field_begin, payload, p)) return false;
+    }
+    return true;
+}
+
+void appendMessage(std::string& out, uint32_t field, const std::string& body) {
+    writeVarint(out, (static_cast<uint64_t>(field) << 3) | kWireLengthDelimited);
+    writeVarint(out, body.size());
+    out += body;
+}
+
+bool stripTensor(char* begin, char* end, std::string& out, Payload& raw_data) {
+    raw_data = {nullptr, 0};
+    return forEachField(begin, end, [&](uint32_t field, int wire, char* field_begin, char* payload, char* field_end) {
+        if (field == kTensorRawDataField && wire == kWireLengthDelimited)
+            raw_data = {payload, static_cast<size_t>(field_end - payload)};
+        else
+            out.append(field_begin, field_end);
+        return true;
+    });
+}
+
+bool stripGraph(char* begin, char* end, std::string& out, std::vector<Payload>& raw_data) {
+    return forEachField(begin, end, [&](uint32_t field, int wire, char* field_begin, char* payload, char* field_end) {
+        if (field != kGraphInitializerField || wire != kWireLengthDelimited) {
+            out.append(field_begin, field_end);
+            return true;
+        }
+        std::string tensor;
+        Payload tensor_data;
+        if (!stripTensor(payload, field_end, tensor, tensor_data)) return false;
+        appendMessage(out, field, tensor);
+        raw_data.push_back(tensor_data);
+        return true;
+    });
+}
+
+bool stripModel(char* begin, char* end, std::string& out, std::vector<Payload>& raw_data) {
+    return forEachField(begin, end, [&](uint32_t field, int wire, char* field_begin, char* payload, char* field_end) {
+        if (field != kModelGraphField || wire != kWireLengthDelimited) {
+            out.append(field_begin, field_end);
+            return true;
+        }
+        std::string graph;
+        if (!stripGraph(payload, field_end, graph, raw_data)) return false;
+        appendMessage(out, field, graph);
+        return true;
+    });
+}
+
+// Builds a tensor over raw little-endian bytes. When `keepalive` owns the bytes
+// (a private, copy-on-write mapping) and they hold suitably aligned float data
+// the tensor aliases them; anything else is copied. Throws if the byte count
+// disagrees with the shape.
+Tensor tensorFromBytes(const std::string& name, const std::vector<int>& dims, int data_type, const char* bytes,
+                       size_t size, std::shared_ptr<void> keepalive) {
+    size_t count = 1;
+    for (int dim : dims) count *= static_cast<size_t>(dim);
+    if (size != count * sizeof(float)) {
+        throw std::runtime_error("Initializer " + name + " has " + std::to_string(size) + " bytes of data, expected " +
+                                 std::to_string(count * sizeof(float)));
+    }
+    if (keepalive && data_type == onnx::TensorProto::FLOAT &&
+        reinterpret_cast<uintptr_t>(bytes) % alignof(float) == 0) {
+        float* data = reinterpret_cast<float*>(const_cast<char*>(bytes));
+        return Tensor::view(dims, data, std::move(keepalive));
+    }
+    Tensor tensor(dims);
+    memcpy(tensor.data().data(), bytes, size);
+    return tensor;
+}
+
+} // namespace
 
 ONNXModel::ONNXModel() {}
 
-bool ONNXModel::load(const std::string& model_path) {
+bool ONNXModel::load(const std::string& model_path, bool use_mmap) {
+    use_mmap_ = use_mmap;
+    size_t slash = model_path.find_last_of('/');
+    model_dir_ = (slash == std::string::npos) ? "" : model_path.substr(0, slash + 1);
+    raw_data_.clear();
+    external_files_.clear();
+
+    if (use_mmap) {
+        model_file_ = MappedFile::open(model_path);
+        if (!model_file_) {
+            Logger::instance().error("Error: Unable to map model file.");
+            return false;
+        }
+
+        std::string skeleton;
+        char* begin = model_file_->data();
+        if (!stripModel(begin, begin + model_file_->size(), skeleton, raw_data_) ||
+            !model_proto_.ParseFromString(skeleton)) {
+            Logger::instance().error("Error: Failed to parse ONNX model.");
+            return false;
+        }
+
+        Logger::instance().info("ONNX Model successfully mapped.");
+        return true;
+    }
+
     std::ifstream input(model_path, std::ios::binary);
     if (!input) {
         Logger::instance().error("Error: Unable to open model file.");
@@ -26,46 +191,17 @@ ComputationGraph ONNXModel::parseGraph() {
     ComputationGraph graph;
 
     const auto& graph_proto = model_proto_.graph();
-    std::string input_name = graph_proto.input(0).name();
-    std::string output_name = graph_proto.output(0).name();
-
-    // Check if model contains ops sensitive to channels-last
-    const auto& input_shape_proto = graph_proto.input(0).type().tensor_type().shape();
-    bool is_input_4d = (input_shape_proto.dim_size() == 4);
-    bool requires_channel_last = false;
-    for (const auto& node_proto : graph_proto.node()) {
-        if (node_proto.op_type() == "Conv" || 
-            node_proto.op_type() == "MaxPool" || 
-            node_proto.op_type() == "AveragePool" || 
-            node_proto.op_type() == "BatchNormalization") {
-            requires_channel_last = true;
-            break;
-        }
-    }
-    bool insert_global_transpose  = (input_shape_proto.dim_size() == 4);
+    for (const auto& output : graph_proto.output()) graph.outputs.push_back(output.name());
 
     // Parse initializers (constants: weights, biases)
-    for (const auto& initializer : graph_proto.initializer()) {
-        Tensor tensor({initializer.dims().begin(), initializer.dims().end()});
-        memcpy(tensor.data().data(), initializer.raw_data().data(), initializer.raw_data().size());
-        graph.tensors[initializer.name()] = tensor;
+    for (int i = 0; i < graph_proto.initializer_size(); ++i) {
+        const auto& initializer = graph_proto.initializer(i);
+        graph.tensors[initializer.name()] = loadInitializer(i, initializer);
     }
 
-    if(insert_global_transpose){
-        // Insert global input transpose (NCHW -> NHWC)
-        GraphNode preTranspose;
-        preTranspose.op_type = "Transpose";
-        preTranspose.inputs = {input_name};
-        preTranspose.outputs = {input_name + "_nhwc"};
-        onnx::AttributeProto perm_attr;
-        perm_attr.set_name("perm");
-        perm_attr.set_type(onnx::AttributeProto::INTS);
-        perm_attr.add_ints(0);
-        perm_attr.add_ints(2);
-        perm_attr.add_ints(3);
-        perm_attr.add_ints(1);
-        preTranspose.attributes.push_back(perm_attr);
-        graph.nodes.push_back(preTranspose);
+    int64_t opset = 0;
+    for (const auto& import : model_proto_.opset_import()) {
+        if (import.domain().empty() || import.domain() == "ai.onnx") opset = import.version();
     }
 
     // Parse graph nodes
@@ -75,46 +211,84 @@ ComputationGraph ONNXModel::parseGraph() {
         node.inputs.assign(node_proto.input().begin(), node_proto.input().end());
         node.outputs.assign(node_proto.output().begin(), node_proto.output().end());
         node.attributes.assign(node_proto.attribute().begin(), node_proto.attribute().end());
-
-        if(requires_channel_last){
-            for(auto& input : node.inputs) {
-                if(input == input_name)
-                    input += "_nhwc";
-            }
-            // TODO: Output transpose is needed for unet type net?
-            // for (auto& output : node.outputs) {
-            //     if(output == output_name)
-            //         output += "_nhwc";
-            // }
-            if(node.op_type == "Conv") {
-                // Transpose weights for NHWC compatibility
-                graph.tensors[node.inputs[1]].reorderOIHWtoOHWI();
-            }    
-        } 
+        if (node.op_type == "Softmax" && opset && opset < 13) {
+            // Before opset 13 Softmax flattens the input into [outer, all dims from axis on],
+            // and axis defaults to 1.
+            addIntAttrIfMissing(node, "axis", 1);
+            addIntAttrIfMissing(node, "coerce_2d", 1);
+        }
         graph.nodes.push_back(node);
     }
 
-    // TODO: Output transpose is needed for unet type net?
-    // if(insert_global_transpose){
-    //     // Insert global output transpose (NHWC -> NCHW)
-    //     GraphNode postTranspose;
-    //     postTranspose.op_type = "Transpose";
-    //     postTranspose.inputs = {output_name + "_nhwc"};
-    //     postTranspose.outputs = {output_name};
-    //     onnx::AttributeProto perm_attr_out;
-    //     perm_attr_out.set_name("perm");
-    //     perm_attr_out.set_type(onnx::AttributeProto::INTS);
-    //     perm_attr_out.add_ints(0);
-    //     perm_attr_out.add_ints(3);
-    //     perm_attr_out.add_ints(1);
-    //     perm_attr_out.add_ints(2);
-    //     postTranspose.attributes.push_back(perm_attr_out);
-    //     graph.nodes.push_back(postTranspose);
-    // }
-
-    //graph.printNodes();
-    graph.topologicalSort();
+    // Spatial kernels run channels-last; transposes are added only where needed.
+    assignLayouts(graph, graph.outputs);
     //graph.printSortedNodes();
 
     return graph;
 }
+
+Tensor ONNXModel::loadInitializer(int index, const onnx::TensorProto& initializer) {
+    if (initializer.data_location() == onnx::TensorProto::EXTERNAL)
+        return loadExternalInitializer(initializer);
+
+    std::vector<int> dims(initializer.dims().begin(), initializer.dims().end());
+    if (index < static_cast<int>(raw_data_.size()) && raw_data_[index].first) {
+        const auto& [bytes, size] = raw_data_[index];
+        return tensorFromBytes(initializer.name(), dims, initializer.data_type(), bytes, size, model_file_);
+    }
+    const std::string& bytes = initializer.raw_data();
+    return tensorFromBytes(initializer.name(), dims, initializer.data_type(), bytes.data(), bytes.size(), nullptr);
+}
+
+// Resolves the location/offset/length triple of an initializer stored outside
+// the model file, as written by onnx.save(..., save_as_external_data=True).
+Tensor ONNXModel::loadExternalInitializer(const onnx::TensorProto& initializer) {
+    std::string location;
+    size_t offset = 0;
+    size_t length = 0;
+    bool has_length = false;
+    for (const auto& entry : initializer.external_data()) {
+        if (entry.key() == "location") location = entry.value();
+        else if (entry.key() == "offset") offset = std::stoull(entry.value());
+        else if (entry.key() == "length") {
+            length = std::stoull(entry.value());
+            has_length = true;
+        }
+    }
+    if (location.empty())
+        throw std::runtime_error("External initializer without location: " + initializer.name());
+
+    std::vector<int> dims(initializer.dims().begin(), initializer.dims().end());
+
+    if (use_mmap_) {
+        auto file = mapExternalFile(location);
+        if (!file || offset > file->size())
+            throw std::runtime_error("Unable to map external data for initializer: " + initializer.name());
+        if (!has_length) length = file->size() - offset;
+        if (length > file->size() - offset)
+            throw std::runtime_error("External data out of range for initializer: " + initializer.name());
+        return tensorFromBytes(initializer.name(), dims, initializer.data_type(), file->data() + offset, length, file);
+    }
+
+    std::ifstream input(model_dir_ + location, std::ios::binary | std::ios::ate);
+    if (!input)
+        throw std::runtime_error("Unable to open external data file: " + location);
+    size_t file_size = static_cast<size_t>(input.tellg());
+    if (!has_length) length = file_size - std::min(offset, file_size);
+    if (offset + length > file_size)
+        throw std::runtime_error("External data out of range for initializer: " + initializer.name());
+
+    std::string bytes(length, '\0');
+    input.seekg(offset);
+    input.read(bytes.data(), length);
+    return tensorFromBytes(initializer.name(), dims, initializer.data_type(), bytes.data(), bytes.size(), nullptr);
+}
+
+std::shared_ptr<MappedFile> ONNXModel::mapExternalFile(const std::string& location) {
+    auto it = external_files_.find(location);
+    if (it != external_files_.end()) return it->second;
+
+    auto file = MappedFile::open(model_dir_ + location);
+    if (file) external_files_[location] = file;
+    return file;
+}
@@ -1,4 +1,5 @@
 #include "onnx_utils.h"
+#include <limits>
 
 float getFloatAttr(const GraphNode* node, const std::string& name, float default_value) {
     for (const auto& attr : node->attributes) {
@@ -25,3 +26,22 @@ std::vector<int> getIntListAttr(const GraphNode* node, const std::string& name)
     }
     return {};
 }
+
+bool activationRange(const GraphNode& node, const std::function<const Tensor*(size_t)>& bound,
+                     float& min_val, float& max_val) {
+    if (node.op_type == "Relu") {
+        min_val = 0.0f;
+        max_val = std::numeric_limits<float>::infinity();
+        return true;
+    }
+    if (node.op_type != "Clip") return false;
+    min_val = getFloatAttr(&node, "min", 0.0f);
+    max_val = getFloatAttr(&node, "max", 6.0f);
+    for (size_t i = 1; i < node.inputs.size() && i < 3; ++i) {
+        if (node.inputs[i].empty()) continue;
+        const Tensor* value = bound(i);
+        if (!value || value->size() == 0) return false;
+        (i == 1 ? min_val : max_val) = value->data()[0];
+    }
+    return true;
+}
@@ -6,11 +6,28 @@
 #include <cassert>
 #include <algorithm>
 #include <sstream>
+#include "threading_runtime.h"
 #include "conv2d.cpp"
 
+namespace {
+
+// Smallest share of an elementwise loop worth handing to another thread.
+constexpr size_t kElementwiseGrain = 16384;
+// Multiply-adds per tile below which matmul and Gemm tiles are not split further.
+constexpr size_t kMatmulTileWork = 32768;
+
+} // namespace
+
 Tensor Operators::transpose(const Tensor& input, const std::vector<int>& perm) {
+    Tensor output;
+    transpose(input, perm, output);
+    return output;
+}
+
+void Operators::transpose(const Tensor& input, const std::vector<int>& perm, Tensor& output, pthreadpool_t threadpool) {
+    const bool log_shapes = Logger::instance().isEnabled(LOG_LEVEL_DEBUG);
     std::ostringstream shape_log;
-    shape_log << "TRANSPOSE: input: [" << input.shape().size() << "](" << input.shape()[0] << ", " << input.shape()[1] << ", " << input.shape()[2] << ", " << input.shape()[3] << ")";
+    if (log_shapes) shape_log << "TRANSPOSE: input: [" << input.shape().size() << "](" << input.shape()[0] << ", " << input.shape()[1] << ", " << input.shape()[2] << ", " << input.shape()[3] << ")";
     std::vector<int> old_shape = input.shape();
     if (perm.size() != old_shape.size())
         throw std::runtime_error("Permutation size mismatch.");
@@ -19,9 +36,9 @@ Tensor Operators::transpose(const Tensor& input, const std::vector<int>& perm) {
     for (size_t i = 0; i < perm.size(); ++i)
         new_shape[i] = old_shape[perm[i]];
 
-    Tensor output(new_shape);
-    const std::vector<float>& in_data = input.data();
-    std::vector<float>& out_data = output.data();
+    output.ensureShape(new_shape);
+    auto in_data = input.data();
+    auto out_data = output.data();
 
     // Compute input strides
     std::vector<int> old_strides(old_shape.size(), 1);
@@ -36,60 +53,76 @@ Tensor Operators::transpose(const Tensor& input, const std::vector<int>& perm) {
     }
 
     // Transpose data correctly
-    for (size_t idx = 0; idx < in_data.size(); ++idx) {
-        int old_idx = idx;
+    parallelForTiles(threadpool, in_data.size(), kElementwiseGrain, [&](size_t begin, size_t end) {
         std::vector<int> old_pos(old_shape.size());
+        std::vector<int> new_pos(new_shape.size());
+        for (size_t idx = begin; idx < end; ++idx) {
+            int old_idx = idx;
 
-        // Find the coordinate in old shape
-        for (size_t i = 0; i < old_shape.size(); ++i) {
-            old_pos[i] = old_idx / old_strides[i];
-            old_idx %= old_strides[i];
-        }
+            // Find the coordinate in old shape
+            for (size_t i = 0; i < old_shape.size(); ++i) {
+                old_pos[i] = old_idx / old_strides[i];
+                old_idx %= old_strides[i];
+            }
 
-        // Permute the coordinate
-        std::vector<int> new_pos(new_shape.size());
-        for (size_t i = 0; i < perm.size(); ++i) {
-            new_pos[i] = old_pos[perm[i]];
-        }
+            // Permute the coordinate
+            for (size_t i = 0; i < perm.size(); ++i) {
+                new_pos[i] = old_pos[perm[i]];
+            }
 
-        // Compute new index
-        int new_idx = 0;
-        for (size_t i = 0; i < new_shape.size(); ++i) {
-            new_idx += new_pos[i] * new_strides[i];
+            // Compute new index
+            int new_idx = 0;
+            for (size_t i = 0; i < new_shape.size(); ++i) {
+                new_idx += new_pos[i] * new_strides[i];
+            }
+
+            out_data[new_idx] = in_data[idx];
         }
+    }, parallel_flags_);
+    if (log_shapes) shape_log << "         :output: [" << output.shape().size() << "](" << output.shape()[0] << ", " << output.shape()[1] << ", " << output.shape()[2] << ", " << output.shape()[3] << ")";
+    if (log_shapes) Logger::instance().debug(shape_log.str());
+}
 
-        out_data[new_idx] = in_data[idx];
-    }
-    shape_log << "         :output: [" << output.shape().size() << "](" << output.shape()[0] << ", " << output.shape()[1] << ", " << output.shape()[2] << ", " << output.shape()[3] << ")";
-    Logger::instance().debug(shape_log.str());
-    return output;
+XnnOperator::~XnnOperator() {
+    if (op) xnn_delete_operator(op);
+}
+
+float* XnnOperator::workspaceData() {
+    if (workspace.empty()) return nullptr;
+    uintptr_t base = reinterpret_cast<uintptr_t>(workspace.data());
+    uintptr_t aligned = (base + workspace_alignment - 1) / workspace_alignment * workspace_alignment;
+    return reinterpret_cast<float*>(aligned);
 }
 
 Tensor Operators::conv2d(const Tensor& input, const Tensor& weights, const Tensor& bias, 
                          const std::vector<int>& kernel_shape, const std::vector<int>& strides, const std::vector<int>& pads, const std::vector<int>& dilations, int groups, pthreadpool_t threadpool) {
-    assert(input.shape().size() == 4);   // [N, H, W, C]
+    auto conv = createConv2d(weights, bias, kernel_shape, strides, pads, dilations, groups);
+    return runConv2d(*conv, input, threadpool);
+}
+
+std::unique_ptr<XnnOperator> Operators::createConv2d(const Tensor& weights, const Tensor& bias,
+                                                     const std::vector<int>& kernel_shape, const std::vector<int>& strides, const std::vector<int>& pads, const std::vector<int>& dilations, int groups, std::shared_ptr<WeightsCache> weights_cache,
+                                                     float output_min, float output_max) {
     assert(weights.shape().size() == 4); // [M, kH, kW, C/groups]
     assert(bias.shape().size() == 1);    // [M]
-    std::ostringstream shape_log;
-    shape_log << "CONV2D: input: [" << input.shape().size() << "](" << input.shape()[0] << ", " << input.shape()[1] << ", " << input.shape()[2] << ", " << input.shape()[3] << ")";
-
-    const int N = input.shape()[0];
-    const int IH = input.shape()[1];
-    const int IW = input.shape()[2];
-    const int IC = input.shape()[3];
 
     const int OC = weights.shape()[0];
-    const int KH = weights.shape()[1];
-    const int KW = weights.shape()[2];
-
-    const int OH = (IH + 2 * pads[0] - KH) / strides[0] + 1;
-    const int OW = (IW + 2 * pads[1] - KW) / strides[1] + 1;
-
-    Tensor output({N, OH, OW, OC});
-
-    xnn_operator_t conv_op = nullptr;
+    const int IC = weights.shape()[3] * groups;
+
+    auto conv = std::make_unique<XnnOperator>();
+    conv->channels = OC;
+    if (weights_cache) {
+        // Packing depends on the weight values, their shape and the grouping.
+        std::vector<int> key_shape = weights.shape();
+        key_shape.push_back(groups);
+        uint64_t key = WeightsCache::fingerprint(key_shape.data(), key_shape.size() * sizeof(int), 0);
+        key = WeightsCache::fingerprint(weights.data().data(), weights.size() * sizeof(float), key);
+        key = WeightsCache::fingerprint(bias.data().data(), bias.size() * sizeof(float), key);
+        weights_cache->recordLookup(key, (weights.size() + bias.size()) * sizeof(float));
+        conv->weights_cache = weights_cache;
+    }
     xnn_status status = xnn_create_convolution2d_nhwc_f32(
-        pads[0], pads[1], pads[2], pads[3], // top, right, bottom, left
+        pads[0], pads[3], pads[2], pads[1], // ONNX top, left, bottom, right as XNNPACK's top, right, bottom, left
         kernel_shape[0], kernel_shape[1],
         strides[0], strides[1],
         dilations[0], dilations[1],
@@ -99,37 +132,62 @@ Tensor Operators::conv2d(const Tensor& input, const Tensor& weights, const Tenso
         OC, // output_channel_stride
         weights.data().data(),
         bias.data().data(),
-        -std::numeric_limits<float>::infinity(),
-        +std::numeric_limits<float>::infinity(),
+        output_min,
+        output_max,
         0,
-        nullptr, // code_cache
-        nullptr, // weights_cache
-        &conv_op
+        nullptr, // code_cache (JIT is not built)
+        weights_cache ? weights_cache->handle() : nullptr,
+        &conv->op
     );
     if (status != xnn_status_success) {
         std::cout << status << std::endl;
         throw std::runtime_error("Failed to create XNNPACK convolution operator");
     }
+    return conv;
+}
 
-    size_t workspace_size = 0;
-    size_t workspace_alignment = 0;
-    status = xnn_reshape_convolution2d_nhwc_f32(
-        conv_op,
-        1, //batch_size
-        IH, IW,
-        &workspace_size, &workspace_alignment,
-        nullptr, // output_height_out
-        nullptr, // output_width_out
-        threadpool
-    );
-    if (status != xnn_status_success) {
-        throw std::runtime_error("Failed to reshape XNNPACK convolution operator");
+Tensor Operators::runConv2d(XnnOperator& conv, const Tensor& input, pthreadpool_t threadpool) {
+    Tensor output;
+    runConv2d(conv, input, output, threadpool);
+    return output;
+}
+
+void Operators::runConv2d(XnnOperator& conv, const Tensor& input, Tensor& output, pthreadpool_t threadpool) {
+    assert(input.shape().size() == 4);   // [N, H, W, C]
+    const bool log_shapes = Logger::instance().isEnabled(LOG_LEVEL_DEBUG);
+    std::ostringstream shape_log;
+    if (log_shapes) shape_log << "CONV2D: input: [" << input.shape().size() << "](" << input.shape()[0] << ", " << input.shape()[1] << ", " << input.shape()[2] << ", " << input.shape()[3] << ")";
+
+    if (input.shape() != conv.input_shape) {
+        const int N = input.shape()[0];
+        const int IH = input.shape()[1];
+        const int IW = input.shape()[2];
+
+        size_t workspace_size = 0;
+        size_t workspace_alignment = 0;
+        size_t output_height = 0;
+        size_t output_width = 0;
+        xnn_status status = xnn_reshape_convolution2d_nhwc_f32(
+            conv.op,
+            N, IH, IW,
+            &workspace_size, &workspace_alignment,
+            &output_height, &output_width,
+            threadpool
+        );
+        if (status != xnn_status_success) {
+            throw std::runtime_error("Failed to reshape XNNPACK convolution operator");
+        }
+
+        conv.workspace_alignment = std::max<size_t>(workspace_alignment, 1);
+        conv.workspace.resize(workspace_size ? workspace_size + conv.workspace_alignment : 0);
+        conv.input_shape = input.shape();
+        conv.output_shape = {N, static_cast<int>(output_height), static_cast<int>(output_width), conv.channels};
     }
 
-    std::vector<char> workspace(workspace_size);
-    status = xnn_setup_convolution2d_nhwc_f32(
-        conv_op,
-        workspace.data(),
+    output.ensureShape(conv.output_shape);
+    xnn_status status = xnn_setup_convolution2d_nhwc_f32(
+        conv.op,
+        conv.workspaceData(),
         input.data().data(),
         output.data().data()
     );
@@ -138,47 +196,51 @@ Tensor Operators::conv2d(const Tensor& input, const Tensor& weights, const Tenso
         throw std::runtime_error("Failed to set up XNNPACK convolution operator");
     }
 
-    status = xnn_run_operator(conv_op, threadpool);
+    status = xnn_run_operator(conv.op, threadpool);
     if (status != xnn_status_success) {
         throw std::runtime_error("Failed to run XNNPACK convolution operator");
     }
 
-    status = xnn_delete_operator(conv_op);
-    if (status != xnn_status_success) {
-        throw std::runtime_error("Failed to delete XNNPACK convolution operator");
-    }
-
-    conv_op = nullptr;
-
-    shape_log << "      :output: [" << output.shape().size() << "](" << output.shape()[0] << ", " << output.shape()[1] << ", " << output.shape()[2] << ", " << output.shape()[3] << ")";
-    Logger::instance().debug(shape_log.str());
+    if (log_shapes) shape_log << "      :output: [" << output.shape().size() << "](" << output.shape()[0] << ", " << output.shape()[1] << ", " << output.shape()[2] << ", " << output.shape()[3] << ")";
+    if (log_shapes) Logger::instance().debug(shape_log.str());
+}
 
+Tensor Operators::matmul(const Tensor& a, const Tensor& b) {
+    Tensor output;
+    matmul(a, b, output);
     return output;
 }
 
-Tensor Operators::matmul(const Tensor& a, const Tensor& b) {
+void Operators::matmul(const Tensor& a, const Tensor& b, Tensor& output, pthreadpool_t threadpool) {
     assert(a.shape().size() == 2 && b.shape().size() == 2);
     int m = a.shape()[0];
     int k = a.shape()[1];
     int n = b.shape()[1];
     assert(k == b.shape()[0]);
 
-    Tensor output({m, n});
+    output.ensureShape({m, n});
 
-    for (int i = 0; i < m; ++i) {
-        for (int j = 0; j < n; ++j) {
-            float sum = 0.0f;
-            for (int l = 0; l < k; ++l) {
-                sum += a.data()[i * k + l] * b.data()[l * n + j];
+    const size_t col_grain = std::max<size_t>(1, kMatmulTileWork / std::max(k, 1));
+    parallelForTiles2D(threadpool, m, n, 1, col_grain, [&](size_t row_begin, size_t row_end, size_t col_begin, size_t col_end) {
+        for (size_t i = row_begin; i < row_end; ++i) {
+            for (size_t j = col_begin; j < col_end; ++j) {
+                float sum = 0.0f;
+                for (int l = 0; l < k; ++l) {
+                    sum += a.data()[i * k + l] * b.data()[l * n + j];
+                }
+                output.data()[i * n + j] = sum;
             }
-            output.data()[i * n + j] = sum;
         }
-    }
+    }, parallel_flags_);
+}
 
+Tensor Operators::gemm(const Tensor& a, const Tensor& b, const Tensor& c, float alpha, float beta) {
+    Tensor output;
+    gemm(a, b, c, alpha, beta, output);
     return output;
 }
 
-Tensor Operators::gemm(const Tensor& a, const Tensor& b, const Tensor& c, float alpha, float beta) {
+void Operators::gemm(const Tensor& a, const Tensor& b, const Tensor& c, float alpha, float beta, Tensor& output, float output_min, float output_max, pthreadpool_t threadpool) {
     assert(a.shape().size() == 2 && b.shape().size() == 2);
     int M = a.shape()[0];
     int K = a.shape()[1];
@@ -186,23 +248,32 @@ Tensor Operators::gemm(const Tensor& a, const Tensor& b, const Tensor& c, float
     assert(K == b.shape()[0]);
     assert(c.data().size() == N);
 
-    Tensor result({M, N});
+    output.ensureShape({M, N});
 
-    for (int m = 0; m < M; ++m) {
-        for (int n = 0; n < N; ++n) {
-            float sum = c.data()[n]; // Add bias initially
-            for (int k = 0; k < K; ++k) {
-                sum += a.data()[m * K + k] * b.data()[k * N + n];
+    const size_t col_grain = std::max<size_t>(1, kMatmulTileWork / std::max(K, 1));
+    parallelForTiles2D(threadpool, M, N, 1, col_grain, [&](size_t row_begin, size_t row_end, size_t col_begin, size_t col_end) {
+        for (size_t m = row_begin; m < row_end; ++m) {
+            for (size_t n = col_begin; n < col_end; ++n) {
+                float sum = c.data()[n]; // Add bias initially
+                for (int k = 0; k < K; ++k) {
+                    sum += a.data()[m * K + k] * b.data()[k * N + n];
+                }
+                output.data()[m * N + n] = std::min(std::max(sum, output_min), output_max);
             }
-            result.data()[m * N + n] = sum;
         }
-    }
-    return result;
+    }, parallel_flags_);
 }
 
 Tensor Operators::gemm_transB(const Tensor& a, const Tensor& b, const Tensor& c, float alpha, float beta) {
+    Tensor output;
+    gemm_transB(a, b, c, alpha, beta, output);
+    return output;
+}
+
+void Operators::gemm_transB(const Tensor& a, const Tensor& b, const Tensor& c, float alpha, float beta, Tensor& output, float output_min, float output_max, pthreadpool_t threadpool) {
+    const bool log_shapes = Logger::instance().isEnabled(LOG_LEVEL_DEBUG);
     std::ostringstream shape_log;
-    shape_log << "GEMM_TRANSB A: (" << a.shape()[0] << ", " << a.shape()[1] << "), B: (" << b.shape()[0] << ", " << b.shape()[1] <<")";
+    if (log_shapes) shape_log << "GEMM_TRANSB A: (" << a.shape()[0] << ", " << a.shape()[1] << "), B: (" << b.shape()[0] << ", " << b.shape()[1] <<")";
     int M = a.shape()[0];
     int K = a.shape()[1];
     int N = b.shape()[0];  // B shape is [N, K], so B^T is [K, N]
@@ -210,181 +281,251 @@ Tensor Operators::gemm_transB(const Tensor& a, const Tensor& b, const Tensor& c,
     assert(K == b.shape()[1]);
     assert(c.data().size() == N);
 
-    Tensor result({M, N});
+    output.ensureShape({M, N});
 
-    for (int m = 0; m < M; ++m) {
-        for (int n = 0; n < N; ++n) {
-            float sum = 0.0f;
-            for (int k = 0; k < K; ++k) {
-                sum += a.data()[m * K + k] * b.data()[n * K + k];  // B^T
+    const size_t col_grain = std::max<size_t>(1, kMatmulTileWork / std::max(K, 1));
+    parallelForTiles2D(threadpool, M, N, 1, col_grain, [&](size_t row_begin, size_t row_end, size_t col_begin, size_t col_end) {
+        for (size_t m = row_begin; m < row_end; ++m) {
+            for (size_t n = col_begin; n < col_end; ++n) {
+                float sum = 0.0f;
+                for (int k = 0; k < K; ++k) {
+                    sum += a.data()[m * K + k] * b.data()[n * K + k];  // B^T
+                }
+                output.data()[m * N + n] = std::min(std::max(alpha * sum + beta * c.data()[n], output_min), output_max);
             }
-            result.data()[m * N + n] = alpha * sum + beta * c.data()[n];
         }
-    }
-    Logger::instance().debug(shape_log.str());
-    return result;
+    }, parallel_flags_);
+    if (log_shapes) Logger::instance().debug(shape_log.str());
 }
 
 Tensor Operators::add(const Tensor& a, const Tensor& b) {
+    Tensor output;
+    add(a, b, output);
+    return output;
+}
+
+void Operators::add(const Tensor& a, const Tensor& b, Tensor& output, pthreadpool_t threadpool) {
     assert(a.shape() == b.shape()); // Ensure tensors have identical shapes
 
-    Tensor output(a.shape());
+    output.ensureShape(a.shape());
 
     size_t total_elements = a.data().size();
-    for (size_t i = 0; i < total_elements; ++i) {
-        output.data()[i] = a.data()[i] + b.data()[i];
-    }
-
-    return output;
+    parallelForTiles(threadpool, total_elements, kElementwiseGrain, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            output.data()[i] = a.data()[i] + b.data()[i];
+        }
+    }, parallel_flags_);
 }
 
 Tensor Operators::relu(const Tensor& input) {
-    Tensor output(input.shape());
+    Tensor output;
+    relu(input, output);
+    return output;
+}
 
-    for (size_t i = 0; i < input.data().size(); ++i) {
-        output.data()[i] = std::max(0.0f, input.data()[i]);
-    }
+void Operators::relu(const Tensor& input, Tensor& output, pthreadpool_t threadpool) {
+    output.ensureShape(input.shape());
 
-    return output;
+    parallelForTiles(threadpool, input.data().size(), kElementwiseGrain, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            output.data()[i] = std::max(0.0f, input.data()[i]);
+        }
+    }, parallel_flags_);
 }
 
 Tensor Operators::clip(const Tensor& input, float min_val, float max_val) {
-    Tensor output(input.shape());
-    for (size_t i = 0; i < input.data().size(); ++i)
-        output.data()[i] = std::max(min_val, std::min(max_val, input.data()[i]));
+    Tensor output;
+    clip(input, min_val, max_val, output);
     return output;
 }
 
-Tensor Operators::softmax(const Tensor& input) {
-    Tensor output(input.shape());
-    size_t total_elements = input.data().size();
+void Operators::clip(const Tensor& input, float min_val, float max_val, Tensor& output, pthreadpool_t threadpool) {
+    output.ensureShape(input.shape());
+    parallelForTiles(threadpool, input.data().size(), kElementwiseGrain, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+            output.data()[i] = std::max(min_val, std::min(max_val, input.data()[i]));
+    }, parallel_flags_);
+}
 
-    // Find max for numerical stability
-    float max_val = *std::max_element(input.data().begin(), input.data().end());
+Tensor Operators::softmax(const Tensor& input, int axis, bool coerce_2d) {
+    Tensor output;
+    softmax(input, axis, coerce_2d, output);
+    return output;
+}
 
-    float sum_exp = 0.0f;
-    for (size_t i = 0; i < total_elements; ++i) {
-        output.data()[i] = std::exp(input.data()[i] - max_val);
-        sum_exp += output.data()[i];
+void Operators::softmax(const Tensor& input, int axis, bool coerce_2d, Tensor& output, pthreadpool_t threadpool) {
+    const auto& shape = input.shape();
+    const int rank = static_cast<int>(shape.size());
+    if (axis < 0) axis += rank;
+    if (rank == 0 || axis < 0 || axis >= rank) {
+        throw std::runtime_error("Softmax axis " + std::to_string(axis) + " out of range for rank " + std::to_string(rank));
     }
-
-    for (size_t i = 0; i < total_elements; ++i) {
-        output.data()[i] /= sum_exp;
+    output.ensureShape(shape);
+
+    // The tensor as [outer, extent, inner]; each (outer, inner) pair is one slice.
+    size_t outer = 1, extent = 1, inner = 1;
+    for (int i = 0; i < rank; ++i) {
+        if (i < axis) outer *= shape[i];
+        else if (i == axis || coerce_2d) extent *= shape[i];
+        else inner *= shape[i];
     }
+    if (outer * extent * inner == 0) return;
+
+    const float* in = input.data().data();
+    float* out = output.data().data();
+    // Every slice is reduced on one thread, so results do not depend on the thread count.
+    const size_t grain = std::max<size_t>(1, kElementwiseGrain / extent);
+    parallelForTiles(threadpool, outer * inner, grain, [&](size_t begin, size_t end) {
+        for (size_t slice = begin; slice < end; ++slice) {
+            const size_t base = slice / inner * extent * inner + slice % inner;
+            // Subtract the max for numerical stability
+            float max_val = in[base];
+            for (size_t j = 1; j < extent; ++j) max_val = std::max(max_val, in[base + j * inner]);
+            float sum_exp = 0.0f;
+            for (size_t j = 0; j < extent; ++j) {
+                out[base + j * inner] = std::exp(in[base + j * inner] - max_val);
+                sum_exp += out[base + j * inner];
+            }
+            for (size_t j = 0; j < extent; ++j) out[base + j * inner] /= sum_exp;
+        }
+    }, parallel_flags_);
+}
 
+Tensor Operators::batchNorm(const Tensor& input, const Tensor& scale, const Tensor& bias, const Tensor& mean, const Tensor& var, float epsilon) {
+    Tensor output;
+    batchNorm(input, scale, bias, mean, var, epsilon, output);
     return output;
 }
 
-Tensor Operators::batchNorm(const Tensor& input, const Tensor& scale, const Tensor& bias, const Tensor& mean, const Tensor& var, float epsilon) {
-    assert(input.shape().size() == 4);  // [batch, channels, height, width]
+void Operators::batchNorm(const Tensor& input, const Tensor& scale, const Tensor& bias, const Tensor& mean, const Tensor& var, float epsilon, Tensor& output, pthreadpool_t threadpool) {
+    assert(input.shape().size() == 4);  // [batch, height, width, channels]
 
-    Tensor output(input.shape());
+    output.ensureShape(input.shape());
 
-    int batch = input.shape()[0];
-    int channels = input.shape()[1];
-    int height = input.shape()[2];
-    int width = input.shape()[3];
-
-    for (int b = 0; b < batch; ++b) {
-        for (int c = 0; c < channels; ++c) {
-            float s = scale.data()[c];
-            float b_ = bias.data()[c];
-            float m = mean.data()[c];
-            float v = var.data()[c];
-
-            float denom = 1.0f / sqrt(v + epsilon);
-
-            for (int h = 0; h < height; ++h) {
-                for (int w = 0; w < width; ++w) {
-                    int idx = ((b * channels + c) * height + h) * width + w;
-                    output.data()[idx] = s * (input.data()[idx] - m) * denom + b_;
-                }
+    const int channels = input.shape()[3];
+    const size_t pixels = input.size() / channels;
+
+    // y = x * factor + offset, with the per-channel terms computed once.
+    std::vector<float> factor(channels);
+    std::vector<float> offset(channels);
+    for (int c = 0; c < channels; ++c) {
+        factor[c] = scale.data()[c] / std::sqrt(var.data()[c] + epsilon);
+        offset[c] = bias.data()[c] - mean.data()[c] * factor[c];
+    }
+
+    const float* in = input.data().data();
+    float* out = output.data().data();
+    parallelForTiles(threadpool, pixels, kElementwiseGrain / std::max(channels, 1), [&](size_t begin, size_t end) {
+        for (size_t p = begin; p < end; ++p) {
+            for (int c = 0; c < channels; ++c) {
+                out[p * channels + c] = in[p * channels + c] * factor[c] + offset[c];
             }
         }
-    }
+    }, parallel_flags_);
+}
 
+Tensor Operators::globalAveragePool(const Tensor& input) {
+    Tensor output;
+    globalAveragePool(input, output);
     return output;
 }
 
-Tensor Operators::globalAveragePool(const Tensor& input) {
+void Operators::globalAveragePool(const Tensor& input, Tensor& output, pthreadpool_t threadpool) {
     assert(input.shape().size() == 4); // [batch, height, width, channels]
+    const bool log_shapes = Logger::instance().isEnabled(LOG_LEVEL_DEBUG);
     std::ostringstream shape_log;
-    shape_log << "GLOBALAVGPOOL: input: [" << input.shape().size() << "](" << input.shape()[0] << ", " << input.shape()[1] << ", " << input.shape()[2] << ", " << input.shape()[3] << ")";
+    if (log_shapes) shape_log << "GLOBALAVGPOOL: input: [" << input.shape().size() << "](" << input.shape()[0] << ", " << input.shape()[1] << ", " << input.shape()[2] << ", " << input.shape()[3] << ")";
 
     int batch = input.shape()[0];
     int height = input.shape()[1];
     int width = input.shape()[2];
     int channels = input.shape()[3];
 
-    Tensor output({batch, 1, 1, channels});
+    output.ensureShape({batch, 1, 1, channels});
     int spatial_size = height * width;
 
-    for (int b = 0; b < batch; ++b) {
-        for (int c = 0; c < channels; ++c) {
-            float sum = 0.0f;
-            for (int h = 0; h < height; ++h) {
-                for (int w = 0; w < width; ++w) {
-                    int idx = ((b * height + h) * width + w) * channels + c;
-                    sum += input.data()[idx];
-                }
+    // Tiles of (images, channels); each tile sums its channels pixel by pixel,
+    // reading along the rows of the NHWC input.
+    const size_t channel_grain = std::max<size_t>(1, kElementwiseGrain / std::max(spatial_size, 1));
+    parallelForTiles2D(threadpool, batch, channels, 1, channel_grain, [&](size_t b_begin, size_t b_end, size_t c_begin, size_t c_end) {
+        std::vector<float> sums(c_end - c_begin);
+        for (size_t b = b_begin; b < b_end; ++b) {
+            std::fill(sums.begin(), sums.end(), 0.0f);
+            for (int p = 0; p < spatial_size; ++p) {
+                const float* pixel = input.data().data() + (b * spatial_size + p) * channels;
+                for (size_t c = c_begin; c < c_end; ++c) sums[c - c_begin] += pixel[c];
             }
-            int out_idx = (b * channels + c);
-            output.data()[out_idx] = sum / spatial_size;
+            for (size_t c = c_begin; c < c_end; ++c) output.data()[b * channels + c] = sums[c - c_begin] / spatial_size;
         }
-    }
+    }, parallel_flags_);
 
-    shape_log << "      :output: [" << output.shape().size() << "](" << output.shape()[0] << ", " << output.shape()[1] << ", " << output.shape()[2] << ", " << output.shape()[3] << ")";
-    Logger::instance().debug(shape_log.str());
-    return output;
+    if (log_shapes) shape_log << "      :output: [" << output.shape().size() << "](" << output.shape()[0] << ", " << output.shape()[1] << ", " << output.shape()[2] << ", " << output.shape()[3] << ")";
+    if (log_shapes) Logger::instance().debug(shape_log.str());
 }
 
 Tensor Operators::maxPool(const Tensor& input, int ceil_mode, const std::vector<int>& dilations, const std::vector<int>& kernel_shape, const std::vector<int>& pads, const std::vector<int>& strides, pthreadpool_t threadpool) {
-    assert(input.shape().size() == 4);   // [N, H, W, C]
-    std::ostringstream shape_log;
-    shape_log << "MAXPOOL: input: [" << input.shape().size() << "](" << input.shape()[0] << ", " << input.shape()[1] << ", " << input.shape()[2] << ", " << input.shape()[3] << ")";
-
-    const int N = input.shape()[0];
-    const int H = input.shape()[1];
-    const int W = input.shape()[2];
-    const int C = input.shape()[3];
-
-    int out_h = (H + pads[0] + pads[2] - kernel_shape[0]) / strides[0] + 1;
-    int out_w = (W + pads[1] + pads[3] - kernel_shape[1]) / strides[1] + 1;
-
-    Tensor output({N, out_h, out_w, C});
+    auto pool = createMaxPool(ceil_mode, dilations, kernel_shape, pads, strides);
+    return runMaxPool(*pool, input, threadpool);
+}
 
-    xnn_operator_t maxpool_op = nullptr;
+std::unique_ptr<XnnOperator> Operators::createMaxPool(int ceil_mode, const std::vector<int>& dilations, const std::vector<int>& kernel_shape, const std::vector<int>& pads, const std::vector<int>& strides) {
+    auto pool = std::make_unique<XnnOperator>();
     xnn_status status = xnn_create_max_pooling2d_nhwc_f32(
-        pads[0], pads[1], pads[2], pads[3], // top, right, bottom, left
+        pads[0], pads[3], pads[2], pads[1], // ONNX top, left, bottom, right as XNNPACK's top, right, bottom, left
         kernel_shape[0], kernel_shape[1],
         strides[0], strides[1],
         dilations[0], dilations[1],
         -std::numeric_limits<float>::infinity(),
         +std::numeric_limits<float>::infinity(),
         0,
-        &maxpool_op
+        &pool->op
     );
     if (status != xnn_status_success) {
         std::cout << status << std::endl;
         throw std::runtime_error("Failed to create XNNPACK max pooling operator");
     }
+    return pool;
+}
 
-    size_t output_height, output_width;
-    status = xnn_reshape_max_pooling2d_nhwc_f32(
-        maxpool_op,
-        1, //batch_size
-        H, W, C,
-        C, C,
-        &output_height, &output_width,
-        threadpool
-    );
-    if (status != xnn_status_success) {
-        std::cout << status << std::endl;
-        throw std::runtime_error("Failed to reshape XNNPACK max pooling operator");
+Tensor Operators::runMaxPool(XnnOperator& pool, const Tensor& input, pthreadpool_t threadpool) {
+    Tensor output;
+    runMaxPool(pool, input, output, threadpool);
+    return output;
+}
+
+void Operators::runMaxPool(XnnOperator& pool, const Tensor& input, Tensor& output, pthreadpool_t threadpool) {
+    assert(input.shape().size() == 4);   // [N, H, W, C]
+    const bool log_shapes = Logger::instance().isEnabled(LOG_LEVEL_DEBUG);
+    std::ostringstream shape_log;
+    if (log_shapes) shape_log << "MAXPOOL: input: [" << input.shape().size() << "](" << input.shape()[0] << ", " << input.shape()[1] << ", " << input.shape()[2] << ", " << input.shape()[3] << ")";
+
+    if (input.shape() != pool.input_shape) {
+        const int N = input.shape()[0];
+        const int H = input.shape()[1];
+        const int W = input.shape()[2];
+        const int C = input.shape()[3];
+
+        size_t output_height, output_width;
+        xnn_status status = xnn_reshape_max_pooling2d_nhwc_f32(
+            pool.op,
+            N, H, W, C,
+            C, C,
+            &output_height, &output_width,
+            threadpool
+        );
+        if (status != xnn_status_success) {
+            std::cout << status << std::endl;
+            throw std::runtime_error("Failed to reshape XNNPACK max pooling operator");
+        }
+
+        pool.channels = C;
+        pool.input_shape = input.shape();
+        pool.output_shape = {N, static_cast<int>(output_height), static_cast<int>(output_width), C};
     }
 
-    status = xnn_setup_max_pooling2d_nhwc_f32(
-        maxpool_op,
+    output.ensureShape(pool.output_shape);
+    xnn_status status = xnn_setup_max_pooling2d_nhwc_f32(
+        pool.op,
         input.data().data(),
         output.data().data()
     );
@@ -393,25 +534,22 @@ Tensor Operators::maxPool(const Tensor& input, int ceil_mode, const std::vector<
         throw std::runtime_error("Failed to set up XNNPACK max pooling operator");
     }
 
-    status = xnn_run_operator(maxpool_op, threadpool);
+    status = xnn_run_operator(pool.op, threadpool);
     if (status != xnn_status_success) {
         throw std::runtime_error("Failed to run XNNPACK max pooling operator");
     }
 
-    status = xnn_delete_operator(maxpool_op);
-    if (status != xnn_status_success) {
-        throw std::runtime_error("Failed to delete XNNPACK max pooling operator");
-    }
-
-    maxpool_op = nullptr;
-
-    shape_log << "       :output: [" << output.shape().size() << "](" << output.shape()[0] << ", " << output.shape()[1] << ", " << output.shape()[2] << ", " << output.shape()[3] << ")";
-    Logger::instance().debug(shape_log.str());
+    if (log_shapes) shape_log << "       :output: [" << output.shape().size() << "](" << output.shape()[0] << ", " << output.shape()[1] << ", " << output.shape()[2] << ", " << output.shape()[3] << ")";
+    if (log_shapes) Logger::instance().debug(shape_log.str());
+}
 
+Tensor Operators::reshape(const Tensor& input, const std::vector<int>& new_shape) {
+    Tensor output;
+    reshape(input, new_shape, output);
     return output;
 }
 
-Tensor Operators::reshape(const Tensor& input, const std::vector<int>& new_shape) {
+void Operators::reshape(const Tensor& input, const std::vector<int>& new_shape, Tensor& output) {
     size_t input_size = input.data().size();
 
     // Calculate new shape size
@@ -433,23 +571,26 @@ Tensor Operators::reshape(const Tensor& input, const std::vector<int>& new_shape
 
     assert(input_size == new_size);
 
-    Tensor output(final_shape);
-    output.data() = input.data(); // Just copy data, no change
+    output.ensureShape(final_shape);
+    std::copy(input.data().begin(), input.data().end(), output.data().begin()); // Just copy data, no change
+}
 
+Tensor Operators::flatten(const Tensor& input, int axis) {
+    Tensor output;
+    flatten(input, axis, output);
     return output;
 }
 
-Tensor Operators::flatten(const Tensor& input, int axis) {
+void Operators::flatten(const Tensor& input, int axis, Tensor& output) {
     // TODO: support axis
     assert(input.shape().size() >= 2);
+    const bool log_shapes = Logger::instance().isEnabled(LOG_LEVEL_DEBUG);
     std::ostringstream shape_log;
-    shape_log << "FLATTEN: input: [" << input.shape().size() << "](" << input.shape()[0] << ", " << input.shape()[1] << ", " << input.shape()[2] << ", " << input.shape()[3] << ")";
+    if (log_shapes) shape_log << "FLATTEN: input: [" << input.shape().size() << "](" << input.shape()[0] << ", " << input.shape()[1] << ", " << input.shape()[2] << ", " << input.shape()[3] << ")";
     int batch = input.shape()[0];
     int features = input.data().size() / batch;
 
-    Tensor output = reshape(input, {batch, features});
-    shape_log << "       : output: [" << output.shape().size() << "](" << output.shape()[0] << ", " << output.shape()[1] << ")";
-    Logger::instance().debug(shape_log.str());
-
-    return output;
+    reshape(input, {batch, features}, output);
+    if (log_shapes) shape_log << "       : output: [" << output.shape().size() << "](" << output.shape()[0] << ", " << output.shape()[1] << ")";
+    if (log_shapes) Logger::instance().debug(shape_log.str());
 }
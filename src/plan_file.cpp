@@ -0,0 +1,220 @@
+#include "plan_file.h"
+#include "utils/logger.h"
+#include "utils/mapped_file.h"
+#include <cstring>
+#include <cstdint>
+#include <fstream>
+#include <map>
+
+namespace {
+
+constexpr char kPlanMagic[8] = {'T', 'P', 'L', 'A', 'N', 0, 0, 0};
+constexpr uint32_t kPlanVersion = 2;
+constexpr size_t kPlanAlignment = 64;
+
+struct PlanHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t tensor_count;
+    uint32_t node_count;
+    uint32_t reserved;
+    uint64_t metadata_offset;
+    uint64_t metadata_size;
+    uint64_t data_offset;
+};
+
+size_t alignUp(size_t value) {
+    return (value + kPlanAlignment - 1) / kPlanAlignment * kPlanAlignment;
+}
+
+class PlanWriter {
+public:
+    template <typename T>
+    void put(T value) { out_.append(reinterpret_cast<const char*>(&value), sizeof(T)); }
+
+    void putString(const std::string& value) {
+        put<uint32_t>(value.size());
+        out_ += value;
+    }
+
+    void putStrings(const std::vector<std::string>& values) {
+        put<uint32_t>(values.size());
+        for (const auto& value : values) putString(value);
+    }
+
+    const std::string& bytes() const { return out_; }
+
+private:
+    std::string out_;
+};
+
+// Bounds-checked cursor over the metadata section.
+class PlanReader {
+public:
+    PlanReader(const char* begin, const char* end) : p_(begin), end_(end) {}
+
+    template <typename T>
+    T get() {
+        T value{};
+        if (static_cast<size_t>(end_ - p_) < sizeof(T))
+            throw std::runtime_error("Truncated plan metadata");
+        memcpy(&value, p_, sizeof(T));
+        p_ += sizeof(T);
+        return value;
+    }
+
+    std::string getString() {
+        uint32_t size = get<uint32_t>();
+        if (static_cast<size_t>(end_ - p_) < size)
+            throw std::runtime_error("Truncated plan metadata");
+        std::string value(p_, size);
+        p_ += size;
+        return value;
+    }
+
+    std::vector<std::string> getStrings() {
+        std::vector<std::string> values(get<uint32_t>());
+        for (auto& value : values) value = getString();
+        return values;
+    }
+
+private:
+    const char* p_;
+    const char* end_;
+};
+
+} // namespace
+
+bool savePlan(const ComputationGraph& graph, const std::string& path) {
+    // Sort tensors by name so the same model always compiles to the same bytes.
+    std::map<std::string, const Tensor*> tensors;
+    for (const auto& [name, tensor] : graph.tensors) tensors[name] = &tensor;
+
+    PlanWriter metadata;
+    size_t data_size = 0;
+    for (const auto& [name, tensor] : tensors) {
+        std::vector<int> shape = tensor->shape();
+        metadata.putString(name);
+        metadata.put<uint32_t>(shape.size());
+        for (int dim : shape) metadata.put<int32_t>(dim);
+        metadata.put<uint64_t>(data_size);
+        metadata.put<uint64_t>(tensor->size() * sizeof(float));
+        data_size = alignUp(data_size + tensor->size() * sizeof(float));
+    }
+    for (const GraphNode* node : graph.sorted_nodes) {
+        metadata.putString(node->op_type);
+        metadata.putStrings(node->inputs);
+        metadata.putStrings(node->outputs);
+        metadata.put<uint32_t>(node->attributes.size());
+        for (const auto& attr : node->attributes) metadata.putString(attr.SerializeAsString());
+    }
+    metadata.putStrings(graph.outputs);
+
+    PlanHeader header{};
+    memcpy(header.magic, kPlanMagic, sizeof(kPlanMagic));
+    header.version = kPlanVersion;
+    header.tensor_count = tensors.size();
+    header.node_count = graph.sorted_nodes.size();
+    header.metadata_offset = sizeof(PlanHeader);
+    header.metadata_size = metadata.bytes().size();
+    header.data_offset = alignUp(header.metadata_offset + header.metadata_size);
+
+    std::ofstream out(path, std::ios::binary);
+    if (!out) {
+        Logger::instance().error("Error: Unable to open plan file for writing: ", path);
+        return false;
+    }
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(metadata.bytes().data(), metadata.bytes().size());
+
+    size_t written = header.metadata_offset + header.metadata_size;
+    const std::string padding(kPlanAlignment, '\0');
+    for (const auto& [name, tensor] : tensors) {
+        size_t target = alignUp(written);
+        out.write(padding.data(), target - written);
+        out.write(reinterpret_cast<const char*>(tensor->data().data()), tensor->size() * sizeof(float));
+        written = target + tensor->size() * sizeof(float);
+    }
+
+    if (!out) {
+        Logger::instance().error("Error: Failed to write plan file: ", path);
+        return false;
+    }
+    return true;
+}
+
+bool isPlanFile(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    char magic[sizeof(kPlanMagic)] = {};
+    in.read(magic, sizeof(magic));
+    return in && memcmp(magic, kPlanMagic, sizeof(kPlanMagic)) == 0;
+}
+
+bool loadPlan(const std::string& path, ComputationGraph& graph) {
+    auto file = MappedFile::open(path);
+    if (!file || file->size() < sizeof(PlanHeader)) {
+        Logger::instance().error("Error: Unable to map plan file: ", path);
+        return false;
+    }
+
+    PlanHeader header;
+    memcpy(&header, file->data(), sizeof(header));
+    if (memcmp(header.magic, kPlanMagic, sizeof(kPlanMagic)) != 0 || header.version != kPlanVersion) {
+        Logger::instance().error("Error: Unsupported plan file: ", path);
+        return false;
+    }
+    if (header.metadata_offset + header.metadata_size > file->size() || header.data_offset > file->size()) {
+        Logger::instance().error("Error: Corrupt plan file: ", path);
+        return false;
+    }
+
+    try {
+        const char* metadata = file->data() + header.metadata_offset;
+        PlanReader reader(metadata, metadata + header.metadata_size);
+
+        for (uint32_t i = 0; i < header.tensor_count; ++i) {
+            std::string name = reader.getString();
+            std::vector<int> shape(reader.get<uint32_t>());
+            uint64_t elements = 1;
+            for (auto& dim : shape) {
+                dim = reader.get<int32_t>();
+                if (dim < 0) throw std::runtime_error("Negative dimension in tensor: " + name);
+                if (dim && elements > file->size() / dim)
+                    throw std::runtime_error("Tensor larger than the plan file: " + name);
+                elements *= dim;
+            }
+            uint64_t offset = header.data_offset + reader.get<uint64_t>();
+            uint64_t bytes = reader.get<uint64_t>();
+            if (bytes != elements * sizeof(float))
+                throw std::runtime_error("Tensor size does not match its shape: " + name);
+            if (offset < header.data_offset || bytes > file->size() || offset > file->size() - bytes)
+                throw std::runtime_error("Tensor data out of range: " + name);
+
+            float* data = reinterpret_cast<float*>(file->data() + offset);
+            graph.tensors[name] = Tensor::view(shape, data, file);
+        }
+
+        graph.nodes.resize(header.node_count);
+        for (auto& node : graph.nodes) {
+            node.op_type = reader.getString();
+            node.inputs = reader.getStrings();
+            node.outputs = reader.getStrings();
+            node.attributes.resize(reader.get<uint32_t>());
+            for (auto& attr : node.attributes) {
+                if (!attr.ParseFromString(reader.getString()))
+                    throw std::runtime_error("Invalid attribute in node: " + node.op_type);
+            }
+        }
+        graph.outputs = reader.getStrings();
+    } catch (const std::exception& e) {
+        Logger::instance().error("Error: Corrupt plan file: ", path, " (", e.what(), ")");
+        return false;
+    }
+
+    // Nodes were written in execution order, so no sort is needed.
+    graph.sorted_nodes.clear();
+    for (const auto& node : graph.nodes) graph.sorted_nodes.push_back(&node);
+
+    Logger::instance().info("Execution plan successfully mapped.");
+    return true;
+}
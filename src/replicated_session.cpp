@@ -0,0 +1,148 @@
+#include "replicated_session.h"
+#include <exception>
+#include <future>
+#include <stdexcept>
+#include "utils/logger.h"
+
+struct ReplicatedSession::Job {
+    const Tensor* input;
+    const std::vector<std::string>* outputs;
+    std::promise<std::vector<Tensor>> result;
+};
+
+struct ReplicatedSession::Replica {
+    std::vector<int> cpus;
+    std::unique_ptr<Session> session;
+
+    std::mutex mutex;
+    std::condition_variable queue_cv;
+    std::deque<Job*> queue;
+    size_t requests = 0;
+    bool stopping = false;
+    std::vector<std::thread> workers;
+};
+
+namespace {
+
+// A copy of `graph` whose initializers are owned and written by the calling
+// thread, so that they are allocated on its NUMA node.
+ComputationGraph localCopy(const ComputationGraph& graph) {
+    ComputationGraph copy;
+    copy.nodes = graph.nodes;
+    copy.outputs = graph.outputs;
+    for (const auto& [name, tensor] : graph.tensors) {
+        if (tensor.size() == 0) continue;
+        copy.tensors.emplace(name, Tensor(tensor.shape(), std::vector<float>(tensor.data().begin(), tensor.data().end())));
+    }
+    copy.topologicalSort();
+    return copy;
+}
+
+} // namespace
+
+ReplicatedSession::ReplicatedSession(const ComputationGraph& graph, ReplicaOptions options,
+                                     ExecutionEngine::Backend backend) {
+    std::vector<std::vector<int>> groups =
+        options.cpu_groups.empty() ? cpuGroups(numaNodeCpus(), options.replicas) : options.cpu_groups;
+    if (groups.empty()) throw std::runtime_error("ReplicatedSession needs at least one CPU group");
+
+    // Each replica is built on a thread already confined to its CPUs: the
+    // weight copies and the pool threads it starts stay on that node.
+    std::vector<std::exception_ptr> errors(groups.size());
+    std::vector<std::thread> builders;
+    for (size_t i = 0; i < groups.size(); ++i) {
+        replicas_.push_back(std::make_unique<Replica>());
+        replicas_[i]->cpus = groups[i];
+        builders.emplace_back([&, i] {
+            Replica& replica = *replicas_[i];
+            try {
+                if (options.pin_threads) ThreadingRuntime::bindCurrentThread(replica.cpus);
+                replica.session = std::make_unique<Session>(localCopy(graph), backend);
+                ThreadingOptions threading;
+                threading.threads = options.threads ? options.threads : replica.cpus.size();
+                threading.pin_threads = options.pin_threads;
+                threading.cpus = replica.cpus;
+                threading.wait = options.wait;
+                replica.session->engine().setThreading(threading);
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+        });
+    }
+    for (auto& builder : builders) builder.join();
+    for (const auto& error : errors) {
+        if (error) std::rethrow_exception(error);
+    }
+
+    for (auto& replica : replicas_) {
+        for (size_t i = 0; i < std::max<size_t>(options.workers, 1); ++i) {
+            replica->workers.emplace_back([this, &replica = *replica, pin = options.pin_threads] {
+                if (pin && !ThreadingRuntime::bindCurrentThread(replica.cpus)) {
+                    Logger::instance().warning("Could not bind a replica worker to its CPUs");
+                }
+                workerLoop(replica);
+            });
+        }
+    }
+}
+
+ReplicatedSession::~ReplicatedSession() {
+    for (auto& replica : replicas_) {
+        {
+            std::lock_guard<std::mutex> lock(replica->mutex);
+            replica->stopping = true;
+        }
+        replica->queue_cv.notify_all();
+    }
+    for (auto& replica : replicas_) {
+        for (auto& worker : replica->workers) worker.join();
+    }
+}
+
+std::vector<Tensor> ReplicatedSession::run(const Tensor& input, const std::vector<std::string>& outputs) {
+    Replica& replica = *replicas_[next_.fetch_add(1, std::memory_order_relaxed) % replicas_.size()];
+    Job job{&input, &outputs, {}};
+    std::future<std::vector<Tensor>> result = job.result.get_future();
+    {
+        std::lock_guard<std::mutex> lock(replica.mutex);
+        replica.queue.push_back(&job);
+        ++replica.requests;
+    }
+    replica.queue_cv.notify_one();
+    return result.get();
+}
+
+const std::vector<int>& ReplicatedSession::replicaCpus(size_t replica) const {
+    return replicas_.at(replica)->cpus;
+}
+
+Session& ReplicatedSession::replica(size_t replica) {
+    return *replicas_.at(replica)->session;
+}
+
+std::vector<size_t> ReplicatedSession::requestsPerReplica() const {
+    std::vector<size_t> requests;
+    for (const auto& replica : replicas_) {
+        std::lock_guard<std::mutex> lock(replica->mutex);
+        requests.push_back(replica->requests);
+    }
+    return requests;
+}
+
+void ReplicatedSession::workerLoop(Replica& replica) {
+    for (;;) {
+        Job* job;
+        {
+            std::unique_lock<std::mutex> lock(replica.mutex);
+            replica.queue_cv.wait(lock, [&] { return replica.stopping || !replica.queue.empty(); });
+            if (replica.queue.empty()) return;
+            job = replica.queue.front();
+            replica.queue.pop_front();
+        }
+        try {
+            job->result.set_value(replica.session->run(*job->input, *job->outputs));
+        } catch (...) {
+            job->result.set_exception(std::current_exception());
+        }
+    }
+}
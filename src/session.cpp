@@ -0,0 +1,95 @@
+#include "session.h"
+#include <unordered_set>
+
+namespace {
+
+// True if `graph.sorted_nodes` points into its own `nodes`, which a copy of a
+// sorted graph does not.
+bool sortedInPlace(const ComputationGraph& graph) {
+    for (const GraphNode* node : graph.sorted_nodes) {
+        if (node < graph.nodes.data() || node >= graph.nodes.data() + graph.nodes.size()) return false;
+    }
+    return graph.sorted_nodes.size() == graph.nodes.size();
+}
+
+} // namespace
+
+Session::Session(ComputationGraph graph, ExecutionEngine::Backend backend)
+    : weights_cache_(std::make_shared<WeightsCache>()), engine_(backend, weights_cache_) {
+    if (!sortedInPlace(graph)) graph.topologicalSort();
+
+    std::unordered_set<std::string> produced, read;
+    for (const GraphNode* node : graph.sorted_nodes) {
+        for (const auto& name : node->inputs) read.insert(name);
+        for (const auto& name : node->outputs) produced.insert(name);
+    }
+    output_names_ = graph.outputs;
+    if (output_names_.empty()) {
+        for (const GraphNode* node : graph.sorted_nodes) {
+            for (const auto& name : node->outputs) {
+                if (!read.count(name)) output_names_.push_back(name);
+            }
+        }
+    }
+    for (auto it = graph.tensors.begin(); it != graph.tensors.end();) {
+        it = produced.count(it->first) || it->second.size() == 0 ? graph.tensors.erase(it) : std::next(it);
+    }
+
+    graph.xnn_plan.reset();
+    graph.compiled.reset();
+    graph.tile_plan.reset();
+    graph.memory_plan.reset();
+    graph.plan_cache.reset();
+    graph.requested_outputs.clear();
+    graph.output_selections.clear();
+    model_ = std::make_shared<const ComputationGraph>(std::move(graph));
+}
+
+std::vector<Tensor> Session::run(const Tensor& input, const std::vector<std::string>& outputs) {
+    std::unique_ptr<ComputationGraph> context = acquire();
+    const std::vector<std::string>& names = outputs.empty() ? output_names_ : outputs;
+    std::vector<Tensor> results;
+    try {
+        engine_.executeGraph(*context, input, outputs);
+        for (const auto& name : names) {
+            const Tensor& tensor = context->tensors.at(name);
+            // Outputs may be views into the context's arena; hand out owned copies.
+            results.emplace_back(tensor.shape(), std::vector<float>(tensor.data().begin(), tensor.data().end()));
+        }
+    } catch (...) {
+        release(std::move(context));
+        throw;
+    }
+    release(std::move(context));
+    return results;
+}
+
+size_t Session::numContexts() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return num_contexts_;
+}
+
+std::unique_ptr<ComputationGraph> Session::acquire() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!idle_.empty()) {
+            std::unique_ptr<ComputationGraph> context = std::move(idle_.back());
+            idle_.pop_back();
+            return context;
+        }
+        ++num_contexts_;
+    }
+    // Nodes are shared through sorted_nodes; initializers are views kept alive by the model.
+    auto context = std::make_unique<ComputationGraph>();
+    context->sorted_nodes = model_->sorted_nodes;
+    context->outputs = model_->outputs;
+    for (const auto& [name, tensor] : model_->tensors) {
+        context->tensors.emplace(name, Tensor::view(tensor.shape(), const_cast<float*>(tensor.data().data()), std::const_pointer_cast<ComputationGraph>(model_)));
+    }
+    return context;
+}
+
+void Session::release(std::unique_ptr<ComputationGraph> context) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    idle_.push_back(std::move(context));
+}
@@ -0,0 +1,87 @@
+#include "shape_inference.h"
+#include "kernel_registry.h"
+#include "utils/logger.h"
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+
+namespace {
+
+std::string formatShape(const std::vector<int>& shape) {
+    std::string text = "[";
+    for (size_t i = 0; i < shape.size(); ++i) {
+        if (i) text += ", ";
+        text += std::to_string(shape[i]);
+    }
+    return text + "]";
+}
+
+} // namespace
+
+GraphShapes inferShapes(const ComputationGraph& graph, const std::vector<int>& input_shape) {
+    GraphShapes result;
+    result.input_shape = input_shape;
+    result.shapes["input"] = input_shape;
+
+    // Tensors produced at inference time by Constant nodes, needed by e.g. Reshape.
+    std::unordered_map<std::string, Tensor> constants;
+
+    for (const GraphNode* node : graph.sorted_nodes) {
+        const Kernel* kernel = KernelRegistry::instance().find(node->op_type);
+        if (!kernel || !kernel->infer) {
+            Logger::instance().debug("Shape inference stops at ", node->op_type, ": no shape function");
+            result.complete = false;
+            return result;
+        }
+
+        ShapeArgs args;
+        for (const auto& name : node->inputs) {
+            auto shape = result.shapes.find(name);
+            auto constant = constants.find(name);
+            auto initializer = graph.tensors.find(name);
+            if (shape != result.shapes.end()) {
+                args.inputs.push_back(shape->second);
+                args.values.push_back(constant != constants.end() ? &constant->second : nullptr);
+            } else if (initializer != graph.tensors.end() && initializer->second.size()) {
+                args.inputs.push_back(initializer->second.shape());
+                args.values.push_back(&initializer->second);
+            } else {
+                throw std::runtime_error(node->op_type + " node reads unknown tensor '" + name + "'");
+            }
+        }
+        kernel->infer(*node, args);
+        if (args.outputs.size() != node->outputs.size()) {
+            throw std::runtime_error(node->op_type + " node: shape function returned " +
+                                     std::to_string(args.outputs.size()) + " outputs");
+        }
+
+        NodeCost cost;
+        cost.node = node;
+        cost.flops = args.flops;
+        for (size_t i = 0; i < node->outputs.size(); ++i) {
+            size_t count = 1;
+            for (int dim : args.outputs[i]) count *= dim;
+            cost.output_bytes += count * sizeof(float);
+            result.shapes[node->outputs[i]] = args.outputs[i];
+            if (i < args.output_values.size()) constants[node->outputs[i]] = std::move(args.output_values[i]);
+        }
+        cost.output_shapes = std::move(args.outputs);
+        result.total_flops += cost.flops;
+        result.activation_bytes += cost.output_bytes;
+        result.nodes.push_back(std::move(cost));
+    }
+    return result;
+}
+
+void GraphShapes::print() const {
+    std::cout << "Shape inference for input " << formatShape(input_shape) << ":\n";
+    for (const NodeCost& cost : nodes) {
+        std::cout << "  " << std::left << std::setw(20) << cost.node->op_type
+                  << std::setw(24) << (cost.output_shapes.empty() ? "" : formatShape(cost.output_shapes[0]))
+                  << std::right << std::setw(12) << cost.flops << " FLOPs"
+                  << std::setw(12) << cost.output_bytes << " B\n";
+    }
+    if (!complete) std::cout << "  (incomplete: a node has no shape function)\n";
+    std::cout << "Total: " << total_flops / 1e6 << " MFLOPs, "
+              << activation_bytes / 1024.0 << " KB of activations" << std::endl;
+}
@@ -23,8 +23,24 @@ Tensor::Tensor(const std::vector<int>& shape, const std::vector<float>& data)
     assert(total == data.size() && "Shape does not match data size");
 }
 
+Tensor Tensor::view(const std::vector<int>& shape, float* data, std::shared_ptr<void> keepalive) {
+    Tensor tensor;
+    tensor.shape_ = shape;
+    size_t total = 1;
+    for (int dim : shape) total *= dim;
+    tensor.external_ = data;
+    tensor.external_size_ = total;
+    tensor.keepalive_ = std::move(keepalive);
+    return tensor;
+}
+
+void Tensor::ensureShape(const std::vector<int>& shape) {
+    if (shape_ == shape) return;
+    *this = Tensor(shape);
+}
+
 void Tensor::fillRandom() {
-    for (auto& val : data_) {
+    for (auto& val : data()) {
         val = static_cast<float>(rand()) / static_cast<float>(RAND_MAX);
     }
 }
@@ -40,6 +56,7 @@ void Tensor::reorderOIHWtoOHWI() {
     int KW = shape_[3];
 
     std::vector<float> new_data(OC * KH * KW * IC);
+    const float* src = data().data();
 
     for (int oc = 0; oc < OC; ++oc) {
         for (int kh = 0; kh < KH; ++kh) {
@@ -47,13 +64,17 @@ void Tensor::reorderOIHWtoOHWI() {
                 for (int ic = 0; ic < IC; ++ic) {
                     int src_index = (((oc * IC + ic) * KH + kh) * KW) + kw;
                     int dst_index = (((oc * KH + kh) * KW + kw) * IC) + ic;
-                    new_data[dst_index] = data_[src_index];
+                    new_data[dst_index] = src[src_index];
                 }
             }
         }
     }
 
+    // The reordered weights are always owned, even if the source was a view.
     data_ = std::move(new_data);
+    external_ = nullptr;
+    external_size_ = 0;
+    keepalive_.reset();
     shape_ = {OC, KH, KW, IC};
 }
 
@@ -67,12 +88,13 @@ void Tensor::print() const {
     std::cout << "]" << std::endl;
 
     std::cout << "Tensor data (first 10 values): ";
-    size_t limit = std::min(data_.size(), static_cast<size_t>(10));
+    auto values = data();
+    size_t limit = std::min(values.size(), static_cast<size_t>(10));
     for (size_t i = 0; i < limit; ++i) {
-        std::cout << std::fixed << std::setprecision(4) << data_[i] << " ";
+        std::cout << std::fixed << std::setprecision(4) << values[i] << " ";
     }
 
-    if (data_.size() > 10)
+    if (values.size() > 10)
         std::cout << "...";
 
     std::cout << std::endl;
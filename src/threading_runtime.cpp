@@ -0,0 +1,181 @@
+#include "threading_runtime.h"
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <thread>
+#include "utils/logger.h"
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+
+// Longest pinPoolThreads() waits for every pool thread to pick up a task; a
+// pool that runs tasks on fewer threads than it reports pins what it has.
+constexpr auto kPinTimeout = std::chrono::milliseconds(20);
+
+} // namespace
+
+ThreadingRuntime::ThreadingRuntime(ThreadingOptions options) : options_(std::move(options)) {
+    threadpool_ = pthreadpool_create(options_.threads);
+    if (options_.pin_threads) {
+        pinned_threads_ = pinPoolThreads(threadpool_);
+        if (pinned_threads_ + 1 < threads()) {
+            Logger::instance().warning("Pinned ", pinned_threads_, " of ", threads() - 1, " intra-op worker threads");
+        }
+    }
+}
+
+ThreadingRuntime::~ThreadingRuntime() {
+    for (auto& [threads, pool] : smaller_pools_) pthreadpool_destroy(pool);
+    if (threadpool_) pthreadpool_destroy(threadpool_);
+}
+
+pthreadpool_t ThreadingRuntime::threadpool(size_t threads) const {
+    if (threads == 0 || threads >= this->threads()) return threadpool_;
+    if (threads == 1) return nullptr;
+    std::lock_guard<std::mutex> lock(smaller_pools_mutex_);
+    pthreadpool_t& pool = smaller_pools_[threads];
+    if (!pool) {
+        pool = pthreadpool_create(threads);
+        if (pool && options_.pin_threads) pinPoolThreads(pool);
+    }
+    return pool;
+}
+
+size_t ThreadingRuntime::threads() const {
+    return threadpool_ ? pthreadpool_get_threads_count(threadpool_) : 1;
+}
+
+uint32_t ThreadingRuntime::parallelFlags() const {
+    return options_.wait == WaitPolicy::Sleep ? PTHREADPOOL_FLAG_YIELD_WORKERS : 0;
+}
+
+int ThreadingRuntime::cpuFor(size_t index) const {
+    if (options_.cpus.empty()) return static_cast<int>(index);
+    return options_.cpus[index % options_.cpus.size()];
+}
+
+void ThreadingRuntime::setupWorker(size_t index) const {
+    if (options_.pin_threads) pinCurrentThread(cpuFor(index));
+}
+
+bool ThreadingRuntime::pinCurrentThread(int cpu) {
+#ifdef __linux__
+    if (cpu < 0 || cpu >= CPU_SETSIZE) return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
+
+bool ThreadingRuntime::bindCurrentThread(const std::vector<int>& cpus) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        if (cpu >= 0 && cpu < CPU_SETSIZE) CPU_SET(cpu, &set);
+    }
+    return CPU_COUNT(&set) > 0 && pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpus;
+    return false;
+#endif
+}
+
+// pthreadpool does not expose its threads, so each one pins itself from
+// inside a loop: one task per thread, each held until all threads have taken
+// theirs so that no thread runs two. The calling thread also runs a task but
+// keeps its affinity, and takes CPU 0 of the list; workers take 1, 2, ...
+size_t ThreadingRuntime::pinPoolThreads(pthreadpool_t pool) const {
+    struct PinState {
+        const ThreadingRuntime* runtime;
+        std::thread::id caller = std::this_thread::get_id();
+        std::mutex mutex;
+        std::condition_variable all_arrived;
+        std::set<std::thread::id> seen;
+        size_t expected = 0;
+        size_t next_cpu = 1;
+        size_t pinned = 0;
+    } state;
+    state.runtime = this;
+    state.expected = pthreadpool_get_threads_count(pool);
+
+    pthreadpool_parallelize_1d(
+        pool,
+        [](void* context, size_t) {
+            auto& state = *static_cast<PinState*>(context);
+            std::unique_lock<std::mutex> lock(state.mutex);
+            if (!state.seen.insert(std::this_thread::get_id()).second) return;
+            state.all_arrived.notify_all();
+            state.all_arrived.wait_for(lock, kPinTimeout, [&] { return state.seen.size() >= state.expected; });
+            if (std::this_thread::get_id() == state.caller) return;
+            int cpu = state.runtime->cpuFor(state.next_cpu++);
+            if (pinCurrentThread(cpu)) ++state.pinned;
+        },
+        &state, state.expected, 0);
+    return state.pinned;
+}
+
+std::vector<int> parseCpuList(const std::string& list) {
+    std::vector<int> cpus;
+    std::istringstream ranges(list);
+    for (std::string range; std::getline(ranges, range, ',');) {
+        if (range.find_first_of("0123456789") == std::string::npos) continue;
+        size_t dash = range.find('-');
+        int first = std::stoi(range.substr(0, dash));
+        int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+        for (int cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+std::vector<std::vector<int>> numaNodeCpus() {
+    std::vector<std::vector<int>> nodes;
+    std::ifstream online("/sys/devices/system/node/online");
+    std::string list;
+    if (online && std::getline(online, list)) {
+        for (int node : parseCpuList(list)) {
+            std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+            std::string cpus;
+            // Memory-only nodes have an empty list.
+            if (file && std::getline(file, cpus) && !parseCpuList(cpus).empty()) nodes.push_back(parseCpuList(cpus));
+        }
+    }
+    if (nodes.empty()) {
+        nodes.emplace_back();
+        for (unsigned cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); ++cpu) nodes[0].push_back(cpu);
+    }
+    return nodes;
+}
+
+std::vector<std::vector<int>> cpuGroups(const std::vector<std::vector<int>>& nodes, size_t groups) {
+    if (groups == 0) groups = nodes.size();
+    std::vector<std::vector<int>> result;
+    if (groups <= nodes.size()) {
+        result.resize(groups);
+        for (size_t node = 0; node < nodes.size(); ++node) {
+            auto& group = result[node % groups];
+            group.insert(group.end(), nodes[node].begin(), nodes[node].end());
+        }
+    } else {
+        for (size_t node = 0; node < nodes.size(); ++node) {
+            const auto& cpus = nodes[node];
+            size_t parts = groups / nodes.size() + (node < groups % nodes.size() ? 1 : 0);
+            parts = std::min(parts, cpus.size());
+            for (size_t part = 0; part < parts; ++part) {
+                result.emplace_back(cpus.begin() + cpus.size() * part / parts, cpus.begin() + cpus.size() * (part + 1) / parts);
+            }
+        }
+    }
+    result.erase(std::remove_if(result.begin(), result.end(), [](const auto& group) { return group.empty(); }), result.end());
+    return result;
+}
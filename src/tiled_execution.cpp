@@ -0,0 +1,199 @@
+#include "tiled_execution.h"
+#include "onnx_utils.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace {
+
+// Longer chains recompute ever wider halos at their first Convs.
+constexpr size_t kMaxChainLength = 8;
+
+bool isTileableConv(const ComputationGraph& graph, const GraphNode& node) {
+    if (node.op_type != "Conv" || node.inputs.size() != 3 || node.outputs.size() != 1) return false;
+    if (getIntListAttr(&node, "kernel_shape").size() != 2) return false;
+    auto weights = graph.tensors.find(node.inputs[1]);
+    auto bias = graph.tensors.find(node.inputs[2]);
+    return weights != graph.tensors.end() && weights->second.shape().size() == 4 &&
+           bias != graph.tensors.end() && bias->second.size() > 0;
+}
+
+TiledConv makeTiledConv(const ComputationGraph& graph, const GraphNode& node) {
+    TiledConv conv;
+    conv.node = &node;
+    conv.weights = &graph.tensors.at(node.inputs[1]);
+    conv.bias = &graph.tensors.at(node.inputs[2]);
+    conv.kernel_shape = getIntListAttr(&node, "kernel_shape");
+    conv.strides = getIntListAttr(&node, "strides");
+    conv.pads = getIntListAttr(&node, "pads");
+    conv.dilations = getIntListAttr(&node, "dilations");
+    if (conv.strides.empty()) conv.strides = {1, 1};
+    if (conv.pads.empty()) conv.pads = {0, 0, 0, 0};
+    if (conv.dilations.empty()) conv.dilations = {1, 1};
+    conv.groups = getIntAttr(&node, "group", 1);
+    conv.output_min = getFloatAttr(&node, "activation_min", Operators::kNoMin);
+    conv.output_max = getFloatAttr(&node, "activation_max", Operators::kNoMax);
+    return conv;
+}
+
+// Input rows a Conv reads to produce `rows` output rows.
+int windowRows(const TiledConv& conv, int rows) {
+    return (rows - 1) * conv.strides[0] + conv.dilations[0] * (conv.kernel_shape[0] - 1) + 1;
+}
+
+XnnOperator& operatorFor(TiledConv& conv, int top, int bottom, const KernelContext& ctx) {
+    std::unique_ptr<XnnOperator>& op = conv.operators[{top, bottom}];
+    if (!op) {
+        // ONNX order (top, left, bottom, right), as createConv2d() takes them.
+        std::vector<int> pads = {top, conv.pads[1], bottom, conv.pads[3]};
+        op = ctx.ops.createConv2d(*conv.weights, *conv.bias, conv.kernel_shape, conv.strides, pads, conv.dilations,
+                                  conv.groups, ctx.weights_cache, conv.output_min, conv.output_max);
+        // XNNPACK only sets up operators whose weights cache is finalized.
+        if (ctx.weights_cache) ctx.weights_cache->finalize(WeightsCache::Finalization::Soft);
+    }
+    return *op;
+}
+
+} // namespace
+
+std::shared_ptr<TilePlan> planTiles(ComputationGraph& graph, size_t tile_bytes) {
+    auto plan = std::make_shared<TilePlan>();
+    plan->tile_bytes = tile_bytes;
+
+    std::unordered_map<std::string, std::vector<const GraphNode*>> readers;
+    for (const GraphNode* node : graph.sorted_nodes) {
+        for (const auto& name : node->inputs) {
+            auto& nodes = readers[name];
+            if (nodes.empty() || nodes.back() != node) nodes.push_back(node);
+        }
+    }
+    for (const GraphNode* node : graph.sorted_nodes) {
+        if (plan->chain_of.count(node) || !isTileableConv(graph, *node)) continue;
+        std::vector<const GraphNode*> nodes = {node};
+        while (nodes.size() < kMaxChainLength) {
+            const std::string& output = nodes.back()->outputs[0];
+            auto it = readers.find(output);
+            if (it == readers.end() || it->second.size() != 1 || graph.keepsOutput(output)) break;
+            const GraphNode* next = it->second[0];
+            if (!isTileableConv(graph, *next) || next->inputs[0] != output ||
+                next->inputs[1] == output || next->inputs[2] == output) break;
+            nodes.push_back(next);
+        }
+        if (nodes.size() < 2) continue;
+
+        TiledChain chain;
+        for (const GraphNode* member : nodes) {
+            chain.layers.push_back(makeTiledConv(graph, *member));
+            plan->chain_of[member] = plan->chains.size();
+        }
+        for (size_t i = 0; i + 1 < nodes.size(); ++i) plan->internal.insert(nodes[i]->outputs[0]);
+        plan->chains.push_back(std::move(chain));
+    }
+
+    // Later chain members only read the previous member and initializers, so
+    // they can move up to follow the chain's first node.
+    std::vector<const GraphNode*> order;
+    for (const GraphNode* node : graph.sorted_nodes) {
+        auto it = plan->chain_of.find(node);
+        if (it == plan->chain_of.end()) {
+            order.push_back(node);
+        } else if (plan->chains[it->second].layers.front().node == node) {
+            for (const TiledConv& conv : plan->chains[it->second].layers) order.push_back(conv.node);
+        }
+    }
+    graph.sorted_nodes = std::move(order);
+    return plan;
+}
+
+void adjustLifetimes(const TilePlan& plan, const ComputationGraph& graph, std::vector<TensorLifetime>& lifetimes) {
+    lifetimes.erase(std::remove_if(lifetimes.begin(), lifetimes.end(),
+                                   [&](const TensorLifetime& lifetime) { return plan.internal.count(lifetime.name); }),
+                    lifetimes.end());
+
+    std::unordered_map<const GraphNode*, size_t> position;
+    for (size_t i = 0; i < graph.sorted_nodes.size(); ++i) position[graph.sorted_nodes[i]] = i;
+    for (const TiledChain& chain : plan.chains) {
+        const GraphNode* first = chain.layers.front().node;
+        const GraphNode* last = chain.layers.back().node;
+        for (TensorLifetime& lifetime : lifetimes) {
+            if (lifetime.name == first->inputs[0]) lifetime.last_use = std::max(lifetime.last_use, position.at(last));
+            if (lifetime.name == last->outputs[0]) lifetime.first_use = std::min(lifetime.first_use, position.at(first));
+        }
+    }
+}
+
+void runTiledChain(TiledChain& chain, const Tensor& input, Tensor& output, size_t tile_bytes, const KernelContext& ctx) {
+    if (input.shape().size() != 4) throw std::runtime_error("Tiled Conv chain expects an NHWC input");
+    const size_t count = chain.layers.size();
+
+    // Dims of each Conv's input; index `count` is the chain output.
+    std::vector<int> height(count + 1), width(count + 1), channels(count + 1);
+    height[0] = input.shape()[1];
+    width[0] = input.shape()[2];
+    channels[0] = input.shape()[3];
+    for (size_t j = 0; j < count; ++j) {
+        const TiledConv& conv = chain.layers[j];
+        height[j + 1] = (height[j] + conv.pads[0] + conv.pads[2] - windowRows(conv, 1)) / conv.strides[0] + 1;
+        width[j + 1] = (width[j] + conv.pads[1] + conv.pads[3] -
+                        conv.dilations[1] * (conv.kernel_shape[1] - 1) - 1) / conv.strides[1] + 1;
+        channels[j + 1] = conv.weights->shape()[0];
+    }
+    auto rowBytes = [&](size_t j) { return static_cast<size_t>(width[j]) * channels[j] * sizeof(float); };
+
+    if (input.shape() != chain.input_shape) {
+        // rows[j]: input rows of Conv j for a band of rows[count] output rows.
+        std::vector<int> rows(count + 1);
+        auto bandBytes = [&](int band) {
+            rows[count] = band;
+            size_t bytes = band * rowBytes(count);
+            for (size_t j = count; j-- > 0;) {
+                rows[j] = std::min(height[j], windowRows(chain.layers[j], rows[j + 1]));
+                bytes += rows[j] * rowBytes(j);
+            }
+            return bytes;
+        };
+        int band = height[count];
+        while (band > 1 && bandBytes(band) > tile_bytes) --band;
+        chain.tile_bytes = bandBytes(band);
+        chain.tile_rows = band;
+        chain.input_shape = input.shape();
+        for (size_t j = 0; j + 1 < count; ++j) chain.layers[j].tile.resize(rows[j + 1] * rowBytes(j + 1) / sizeof(float));
+    }
+
+    const int batch = input.shape()[0];
+    output.ensureShape({batch, height[count], width[count], channels[count]});
+    float* input_data = const_cast<float*>(input.data().data());
+    float* output_data = output.data().data();
+
+    std::vector<int> begin(count + 1), end(count + 1), pad_top(count), pad_bottom(count);
+    for (int n = 0; n < batch; ++n) {
+        for (int row = 0; row < height[count]; row += chain.tile_rows) {
+            // Walk the band back to the chain input; rows outside the image are padding.
+            begin[count] = row;
+            end[count] = std::min(row + chain.tile_rows, height[count]);
+            for (size_t j = count; j-- > 0;) {
+                const TiledConv& conv = chain.layers[j];
+                int first = begin[j + 1] * conv.strides[0] - conv.pads[0];
+                int last = first + windowRows(conv, end[j + 1] - begin[j + 1]);
+                pad_top[j] = std::max(0, -first);
+                pad_bottom[j] = std::max(0, last - height[j]);
+                begin[j] = std::max(first, 0);
+                end[j] = std::min(last, height[j]);
+            }
+
+            for (size_t j = 0; j < count; ++j) {
+                TiledConv& conv = chain.layers[j];
+                float* src = j == 0 ? input_data + (static_cast<size_t>(n) * height[0] + begin[0]) * rowBytes(0) / sizeof(float)
+                                    : chain.layers[j - 1].tile.data();
+                float* dst = j + 1 == count
+                    ? output_data + (static_cast<size_t>(n) * height[count] + begin[count]) * rowBytes(count) / sizeof(float)
+                    : conv.tile.data();
+                Tensor band_input = Tensor::view({1, end[j] - begin[j], width[j], channels[j]}, src, nullptr);
+                Tensor band_output = Tensor::view({1, end[j + 1] - begin[j + 1], width[j + 1], channels[j + 1]}, dst, nullptr);
+                ctx.ops.runConv2d(operatorFor(conv, pad_top[j], pad_bottom[j], ctx), band_input, band_output, ctx.threadpool);
+                if (band_output.data().data() != dst) {
+                    throw std::runtime_error("Tiled Conv produced an unexpected band shape");
+                }
+            }
+        }
+    }
+}
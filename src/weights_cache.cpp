@@ -0,0 +1,80 @@
+#include "weights_cache.h"
+#include "utils/logger.h"
+#include <stdexcept>
+
+std::shared_ptr<WeightsCache> WeightsCache::shared() {
+    static std::shared_ptr<WeightsCache> instance = std::make_shared<WeightsCache>();
+    return instance;
+}
+
+WeightsCache::WeightsCache() {
+    if (xnn_initialize(nullptr) != xnn_status_success) {
+        throw std::runtime_error("XNNPACK initialization failed");
+    }
+    if (xnn_create_weights_cache(&cache_) != xnn_status_success) {
+        throw std::runtime_error("Failed to create XNNPACK weights cache");
+    }
+}
+
+WeightsCache::~WeightsCache() {
+    if (cache_) xnn_delete_weights_cache(cache_);
+}
+
+bool WeightsCache::finalize(Finalization kind) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (finalized_) {
+        if (kind == Finalization::Hard && finalization_ == Finalization::Soft) {
+            Logger::instance().warning("Weights cache is already soft-finalized and cannot be hardened");
+            return false;
+        }
+        return true;
+    }
+
+    xnn_status status = xnn_finalize_weights_cache(
+        cache_,
+        kind == Finalization::Hard ? xnn_weights_cache_finalization_kind_hard
+                                   : xnn_weights_cache_finalization_kind_soft);
+    if (status != xnn_status_success) {
+        Logger::instance().error("Failed to finalize XNNPACK weights cache: ", status);
+        return false;
+    }
+    finalized_ = true;
+    finalization_ = kind;
+    return true;
+}
+
+bool WeightsCache::isFinalized() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return finalized_;
+}
+
+void WeightsCache::recordLookup(uint64_t fingerprint, size_t weight_bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.lookups++;
+    if (!seen_.insert(fingerprint).second) {
+        stats_.hits++;
+        stats_.bytes_saved += weight_bytes;
+    }
+}
+
+// FNV-1a over the raw bytes.
+uint64_t WeightsCache::fingerprint(const void* data, size_t bytes, uint64_t seed) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    uint64_t hash = seed ^ 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < bytes; ++i) {
+        hash ^= p[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+WeightsCache::Stats WeightsCache::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void WeightsCache::printStats() const {
+    Stats s = stats();
+    Logger::instance().info("Weights cache: ", s.hits, "/", s.lookups, " hits (",
+                            s.hitRate() * 100.0, "%), ", s.bytes_saved / 1024.0, " KB of weights shared");
+}
@@ -0,0 +1,93 @@
+#include "work_stealing_pool.h"
+#include <chrono>
+
+namespace {
+
+// Identifies the pool and queue of the worker running on this thread, if any.
+thread_local const WorkStealingPool* current_pool = nullptr;
+thread_local size_t current_queue = 0;
+
+// How long an idle worker polls for tasks under WaitPolicy::Spin.
+constexpr auto kSpinDuration = std::chrono::microseconds(50);
+
+} // namespace
+
+WorkStealingPool::WorkStealingPool(size_t threads, WorkerSetup setup, WaitPolicy wait) : wait_(wait) {
+    if (threads == 0) threads = 1;
+    for (size_t i = 0; i < threads; ++i) queues_.push_back(std::make_unique<Queue>());
+    for (size_t i = 0; i < threads; ++i) threads_.emplace_back(&WorkStealingPool::workerLoop, this, i, setup);
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto& thread : threads_) thread.join();
+}
+
+void WorkStealingPool::submit(Task task) {
+    size_t index = current_pool == this ? current_queue : next_queue_++ % queues_.size();
+    {
+        std::lock_guard<std::mutex> lock(queues_[index]->mutex);
+        queues_[index]->tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        ++pending_;
+    }
+    wake_.notify_one();
+}
+
+bool WorkStealingPool::tryPop(size_t index, Task& task) {
+    {
+        Queue& own = *queues_[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    for (size_t i = 1; i < queues_.size(); ++i) {
+        Queue& victim = *queues_[(index + i) % queues_.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::workerLoop(size_t index, const WorkerSetup& setup) {
+    current_pool = this;
+    current_queue = index;
+    if (setup) setup(index);
+    for (;;) {
+        Task task;
+        bool found = tryPop(index, task);
+        if (!found && wait_ == WaitPolicy::Spin) {
+            auto deadline = std::chrono::steady_clock::now() + kSpinDuration;
+            while (!found && std::chrono::steady_clock::now() < deadline) {
+                std::this_thread::yield();
+                found = tryPop(index, task);
+            }
+        }
+        if (found) {
+            {
+                std::lock_guard<std::mutex> lock(wake_mutex_);
+                --pending_;
+            }
+            task();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(wake_mutex_);
+        // A task counted in pending_ but not found was taken by another worker
+        // that has yet to decrement the count; look again.
+        wake_.wait(lock, [&] { return stop_ || pending_ > 0; });
+        if (stop_ && pending_ == 0) return;
+    }
+}
@@ -0,0 +1,375 @@
+#include "xnn_subgraph.h"
+#include "onnx_utils.h"
+#include "utils/logger.h"
+#include "utils/timer.h"
+#include <algorithm>
+#include <limits>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace {
+
+constexpr float kNoMin = -std::numeric_limits<float>::infinity();
+constexpr float kNoMax = +std::numeric_limits<float>::infinity();
+
+// Initializers are tensors present before execution that no node produces.
+// "input" is the graph input written by ExecutionEngine::executeGraph.
+bool isStatic(const ComputationGraph& graph, const std::unordered_set<std::string>& produced, const std::string& name) {
+    return name != "input" && !produced.count(name) && graph.tensors.count(name);
+}
+
+bool canLower(const ComputationGraph& graph, const std::unordered_set<std::string>& produced, const GraphNode* node) {
+    const std::string& op = node->op_type;
+    if (op == "Conv") {
+        return node->inputs.size() == 3 &&
+               isStatic(graph, produced, node->inputs[1]) &&
+               isStatic(graph, produced, node->inputs[2]) &&
+               graph.tensors.at(node->inputs[1]).shape().size() == 4;
+    }
+    if (op == "Gemm") {
+        return node->inputs.size() == 3 &&
+               isStatic(graph, produced, node->inputs[1]) &&
+               isStatic(graph, produced, node->inputs[2]) &&
+               graph.tensors.at(node->inputs[1]).shape().size() == 2 &&
+               getFloatAttr(node, "alpha", 1.0f) == 1.0f &&
+               getFloatAttr(node, "beta", 1.0f) == 1.0f &&
+               getIntAttr(node, "transA", 0) == 0;
+    }
+    if (op == "MatMul") {
+        return isStatic(graph, produced, node->inputs[1]) &&
+               graph.tensors.at(node->inputs[1]).shape().size() == 2;
+    }
+    if (op == "Clip") {
+        for (size_t i = 1; i < node->inputs.size() && i < 3; ++i) {
+            if (!node->inputs[i].empty() && !isStatic(graph, produced, node->inputs[i])) return false;
+        }
+        return true;
+    }
+    return op == "MaxPool" || op == "GlobalAveragePool" || op == "Add" || op == "Relu" ||
+           op == "Softmax" || op == "Flatten" || op == "Transpose";
+}
+
+std::vector<size_t> toDims(const std::vector<int>& shape) {
+    return {shape.begin(), shape.end()};
+}
+
+// Lowers one segment into an XNNPACK subgraph for the current input shapes.
+class SegmentBuilder {
+public:
+    SegmentBuilder(const ComputationGraph& graph, XnnSegment& segment) : graph_(graph), segment_(segment) {}
+
+    ~SegmentBuilder() {
+        if (subgraph_) xnn_delete_subgraph(subgraph_);
+    }
+
+    bool build(pthreadpool_t threadpool, WeightsCache* weights_cache) {
+        uint32_t external_count = segment_.inputs.size() + segment_.outputs.size();
+        if (xnn_create_subgraph(external_count, 0, &subgraph_) != xnn_status_success) return false;
+
+        for (size_t i = 0; i < segment_.inputs.size(); ++i) {
+            const std::string& name = segment_.inputs[i];
+            if (!define(name, graph_.tensors.at(name).shape(), nullptr, i, XNN_VALUE_FLAG_EXTERNAL_INPUT)) return false;
+        }
+        for (const GraphNode* node : segment_.nodes) {
+            if (!lower(node)) {
+                Logger::instance().debug("XNNPACK subgraph: cannot lower ", node->op_type, " -> ", node->outputs[0]);
+                return false;
+            }
+        }
+
+        xnn_runtime_t runtime = nullptr;
+        xnn_status status = xnn_create_runtime_v3(subgraph_, weights_cache ? weights_cache->handle() : nullptr,
+                                                  threadpool, 0, &runtime);
+        if (status != xnn_status_success) return false;
+        if (weights_cache) weights_cache->finalize(WeightsCache::Finalization::Soft);
+        if (xnn_reshape_runtime(runtime) != xnn_status_success) {
+            xnn_delete_runtime(runtime);
+            return false;
+        }
+
+        segment_.runtime = runtime;
+        segment_.input_shapes.clear();
+        for (const auto& name : segment_.inputs) segment_.input_shapes.push_back(shapes_.at(name));
+        segment_.output_shapes.clear();
+        for (const auto& name : segment_.outputs) segment_.output_shapes.push_back(shapes_.at(name));
+        return true;
+    }
+
+private:
+    bool define(const std::string& name, const std::vector<int>& shape, const float* data, uint32_t external_id, uint32_t flags) {
+        std::vector<size_t> dims = toDims(shape);
+        uint32_t id = XNN_INVALID_VALUE_ID;
+        xnn_status status = xnn_define_tensor_value(subgraph_, xnn_datatype_fp32, dims.size(), dims.data(),
+                                                    data, external_id, flags, &id);
+        if (status != xnn_status_success) return false;
+        ids_[name] = id;
+        shapes_[name] = shape;
+        return true;
+    }
+
+    // Value id of a node input; initializers are defined as static values on first use.
+    bool input(const std::string& name, uint32_t& id) {
+        if (!ids_.count(name)) {
+            const Tensor& tensor = graph_.tensors.at(name);
+            if (!define(name, tensor.shape(), tensor.data().data(), XNN_INVALID_VALUE_ID, 0)) return false;
+        }
+        id = ids_[name];
+        return true;
+    }
+
+    bool output(const std::string& name, const std::vector<int>& shape, uint32_t& id) {
+        uint32_t external_id = XNN_INVALID_VALUE_ID;
+        uint32_t flags = 0;
+        for (size_t i = 0; i < segment_.outputs.size(); ++i) {
+            if (segment_.outputs[i] == name) {
+                external_id = segment_.inputs.size() + i;
+                flags = XNN_VALUE_FLAG_EXTERNAL_OUTPUT;
+            }
+        }
+        if (!define(name, shape, nullptr, external_id, flags)) return false;
+        id = ids_[name];
+        return true;
+    }
+
+    bool lower(const GraphNode* node) {
+        const std::string& op = node->op_type;
+        uint32_t in = 0, out = 0;
+        if (!input(node->inputs[0], in)) return false;
+        const std::vector<int> in_shape = shapes_.at(node->inputs[0]);
+
+        if (op == "Conv" || op == "MaxPool") {
+            if (in_shape.size() != 4) return false;
+            std::vector<int> kernel_shape = getIntListAttr(node, "kernel_shape");
+            std::vector<int> strides = getIntListAttr(node, "strides");
+            std::vector<int> pads = getIntListAttr(node, "pads");
+            std::vector<int> dilations = getIntListAttr(node, "dilations");
+            if (strides.empty()) strides = {1, 1};
+            if (pads.empty()) pads = {0, 0, 0, 0};  // top, left, bottom, right
+            if (dilations.empty()) dilations = {1, 1};
+
+            const int OH = (in_shape[1] + pads[0] + pads[2] - (dilations[0] * (kernel_shape[0] - 1) + 1)) / strides[0] + 1;
+            const int OW = (in_shape[2] + pads[1] + pads[3] - (dilations[1] * (kernel_shape[1] - 1) + 1)) / strides[1] + 1;
+
+            if (op == "MaxPool") {
+                if (!output(node->outputs[0], {in_shape[0], OH, OW, in_shape[3]}, out)) return false;
+                return xnn_define_max_pooling_2d(
+                    subgraph_, pads[0], pads[3], pads[2], pads[1],  // top, right, bottom, left
+                    kernel_shape[0], kernel_shape[1], strides[0], strides[1], dilations[0], dilations[1],
+                    kNoMin, kNoMax, in, out, 0) == xnn_status_success;
+            }
+
+            uint32_t weights = 0, bias = 0;
+            if (!input(node->inputs[1], weights) || !input(node->inputs[2], bias)) return false;
+            const int groups = getIntAttr(node, "group", 1);
+            const int OC = shapes_.at(node->inputs[1])[0];
+            const int IC = in_shape[3];
+            if (!output(node->outputs[0], {in_shape[0], OH, OW, OC}, out)) return false;
+            return xnn_define_convolution_2d(
+                subgraph_, pads[0], pads[3], pads[2], pads[1],  // top, right, bottom, left
+                kernel_shape[0], kernel_shape[1], strides[0], strides[1], dilations[0], dilations[1],
+                groups, IC / groups, OC / groups,
+                getFloatAttr(node, "activation_min", kNoMin), getFloatAttr(node, "activation_max", kNoMax),
+                in, weights, bias, out, 0) == xnn_status_success;
+        }
+        if (op == "GlobalAveragePool") {
+            if (in_shape.size() != 4) return false;
+            if (!output(node->outputs[0], {in_shape[0], 1, 1, in_shape[3]}, out)) return false;
+            return xnn_define_global_average_pooling_2d(subgraph_, kNoMin, kNoMax, in, out, XNN_FLAG_KEEP_DIMS) == xnn_status_success;
+        }
+        if (op == "Gemm" || op == "MatMul") {
+            if (in_shape.size() != 2) return false;
+            uint32_t weights = 0, bias = XNN_INVALID_VALUE_ID;
+            if (!input(node->inputs[1], weights)) return false;
+            if (op == "Gemm" && !input(node->inputs[2], bias)) return false;
+            // XNNPACK expects [N, K] weights; ONNX B is [K, N] unless Gemm has transB.
+            bool trans_b = op == "Gemm" && getIntAttr(node, "transB", 0);
+            const std::vector<int>& b_shape = shapes_.at(node->inputs[1]);
+            if (b_shape[trans_b ? 1 : 0] != in_shape[1]) return false;
+            const int N = b_shape[trans_b ? 0 : 1];
+            if (!output(node->outputs[0], {in_shape[0], N}, out)) return false;
+            return xnn_define_fully_connected(subgraph_, getFloatAttr(node, "activation_min", kNoMin),
+                                              getFloatAttr(node, "activation_max", kNoMax), in, weights, bias, out,
+                                              trans_b ? 0 : XNN_FLAG_TRANSPOSE_WEIGHTS) == xnn_status_success;
+        }
+        if (op == "Add") {
+            uint32_t other = 0;
+            if (!input(node->inputs[1], other)) return false;
+            // Numpy-style broadcast of the two shapes.
+            const std::vector<int>& a = in_shape;
+            const std::vector<int>& b = shapes_.at(node->inputs[1]);
+            std::vector<int> shape(std::max(a.size(), b.size()), 1);
+            for (size_t i = 0; i < shape.size(); ++i) {
+                int da = i < a.size() ? a[a.size() - 1 - i] : 1;
+                int db = i < b.size() ? b[b.size() - 1 - i] : 1;
+                if (da != db && da != 1 && db != 1) return false;
+                shape[shape.size() - 1 - i] = std::max(da, db);
+            }
+            if (!output(node->outputs[0], shape, out)) return false;
+            return xnn_define_add2(subgraph_, kNoMin, kNoMax, in, other, out, 0) == xnn_status_success;
+        }
+        if (op == "Relu" || op == "Clip") {
+            float min_val = 0.0f, max_val = 0.0f;
+            auto bound = [&](size_t i) { return &graph_.tensors.at(node->inputs[i]); };  // static, see canLower()
+            if (!activationRange(*node, bound, min_val, max_val)) return false;
+            if (!output(node->outputs[0], in_shape, out)) return false;
+            return xnn_define_clamp(subgraph_, min_val, max_val, in, out, 0) == xnn_status_success;
+        }
+        if (op == "Softmax") {
+            // XNNPACK normalizes over the last dim only.
+            const int rank = static_cast<int>(in_shape.size());
+            const int64_t axis = getIntAttr(node, "axis", -1);
+            if (axis != -1 && axis != rank - 1) return false;
+            if (!output(node->outputs[0], in_shape, out)) return false;
+            return xnn_define_softmax(subgraph_, in, out, 0) == xnn_status_success;
+        }
+        if (op == "Flatten") {
+            // Same [batch, features] view as Operators::flatten. The batch is
+            // left as 0 (inferred) so the runtime can be reshaped for new batch sizes.
+            int features = 1;
+            for (size_t i = 1; i < in_shape.size(); ++i) features *= in_shape[i];
+            std::vector<int> shape = {in_shape[0], features};
+            std::vector<size_t> dims = {0, static_cast<size_t>(features)};
+            if (!output(node->outputs[0], shape, out)) return false;
+            return xnn_define_static_reshape(subgraph_, dims.size(), dims.data(), in, out, 0) == xnn_status_success;
+        }
+        if (op == "Transpose") {
+            std::vector<int> perm = getIntListAttr(node, "perm");
+            if (perm.size() != in_shape.size()) return false;
+            std::vector<int> shape(perm.size());
+            for (size_t i = 0; i < perm.size(); ++i) shape[i] = in_shape[perm[i]];
+            std::vector<size_t> dims = toDims(perm);
+            if (!output(node->outputs[0], shape, out)) return false;
+            return xnn_define_static_transpose(subgraph_, dims.size(), dims.data(), in, out, 0) == xnn_status_success;
+        }
+        return false;
+    }
+
+    const ComputationGraph& graph_;
+    XnnSegment& segment_;
+    xnn_subgraph_t subgraph_ = nullptr;
+    std::unordered_map<std::string, uint32_t> ids_;
+    std::unordered_map<std::string, std::vector<int>> shapes_;
+};
+
+// Fills in the segment's external inputs and outputs.
+void finishSegment(XnnSegment& segment, const ComputationGraph& graph,
+                   const std::unordered_set<std::string>& produced,
+                   const std::unordered_map<std::string, std::vector<const GraphNode*>>& consumers) {
+    std::unordered_set<const GraphNode*> members(segment.nodes.begin(), segment.nodes.end());
+    std::unordered_set<std::string> inside;
+    for (const GraphNode* node : segment.nodes) {
+        for (const auto& name : node->inputs) {
+            if (inside.count(name) || isStatic(graph, produced, name)) continue;
+            if (std::find(segment.inputs.begin(), segment.inputs.end(), name) == segment.inputs.end())
+                segment.inputs.push_back(name);
+        }
+        for (const auto& name : node->outputs) inside.insert(name);
+    }
+    for (const GraphNode* node : segment.nodes) {
+        for (const auto& name : node->outputs) {
+            auto it = consumers.find(name);
+            // Graph outputs, and any requested output, are read by the caller.
+            bool read_outside = it == consumers.end() || graph.keepsOutput(name);
+            if (!read_outside) {
+                for (const GraphNode* consumer : it->second) read_outside |= !members.count(consumer);
+            }
+            if (read_outside) segment.outputs.push_back(name);
+        }
+    }
+}
+
+// Propagates new input shapes through the existing runtime. Returns false if
+// XNNPACK rejects them, leaving the runtime to be rebuilt.
+bool reshapeSegment(XnnSegment& segment, const std::vector<std::vector<int>>& input_shapes) {
+    for (size_t i = 0; i < input_shapes.size(); ++i) {
+        std::vector<size_t> dims = toDims(input_shapes[i]);
+        if (xnn_reshape_external_value(segment.runtime, i, dims.size(), dims.data()) != xnn_status_success) return false;
+    }
+    if (xnn_reshape_runtime(segment.runtime) != xnn_status_success) return false;
+
+    std::vector<std::vector<int>> output_shapes;
+    for (size_t i = 0; i < segment.outputs.size(); ++i) {
+        size_t dims[XNN_MAX_TENSOR_DIMS];
+        size_t num_dims = 0;
+        if (xnn_get_external_value_shape(segment.runtime, input_shapes.size() + i, &num_dims, dims) != xnn_status_success) return false;
+        output_shapes.emplace_back(dims, dims + num_dims);
+    }
+    segment.input_shapes = input_shapes;
+    segment.output_shapes = std::move(output_shapes);
+    return true;
+}
+
+} // namespace
+
+XnnSegment::~XnnSegment() {
+    if (runtime) xnn_delete_runtime(runtime);
+}
+
+std::shared_ptr<XnnGraphPlan> lowerToXnnSubgraphs(const ComputationGraph& graph) {
+    std::unordered_set<std::string> produced;
+    std::unordered_map<std::string, std::vector<const GraphNode*>> consumers;
+    for (const GraphNode* node : graph.sorted_nodes) {
+        for (const auto& name : node->outputs) produced.insert(name);
+        for (const auto& name : node->inputs) consumers[name].push_back(node);
+    }
+
+    auto plan = std::make_shared<XnnGraphPlan>();
+    std::unique_ptr<XnnSegment> segment;
+    auto flush = [&]() {
+        if (!segment) return;
+        finishSegment(*segment, graph, produced, consumers);
+        plan->steps.push_back({nullptr, std::move(segment)});
+    };
+
+    for (const GraphNode* node : graph.sorted_nodes) {
+        if (canLower(graph, produced, node)) {
+            if (!segment) segment = std::make_unique<XnnSegment>();
+            segment->nodes.push_back(node);
+        } else {
+            flush();
+            plan->steps.push_back({node, nullptr});
+        }
+    }
+    flush();
+    return plan;
+}
+
+bool runXnnSegment(XnnSegment& segment, ComputationGraph& graph, pthreadpool_t threadpool, WeightsCache* weights_cache) {
+    if (segment.failed) return false;
+    Timer timer("XNNPACK segment: " + std::to_string(segment.nodes.size()) + " nodes");
+
+    std::vector<std::vector<int>> input_shapes;
+    for (const auto& name : segment.inputs) input_shapes.push_back(graph.tensors.at(name).shape());
+
+    if (segment.runtime && input_shapes != segment.input_shapes && !reshapeSegment(segment, input_shapes)) {
+        Logger::instance().debug("XNNPACK subgraph: rebuilding runtime for new input shapes");
+        xnn_delete_runtime(segment.runtime);
+        segment.runtime = nullptr;
+    }
+    if (!segment.runtime) {
+        SegmentBuilder builder(graph, segment);
+        if (!builder.build(threadpool, weights_cache)) {
+            Logger::instance().debug("XNNPACK subgraph: falling back to native operators for ", segment.nodes.size(), " nodes");
+            segment.failed = true;
+            return false;
+        }
+    }
+
+    std::vector<xnn_external_value> externals;
+    for (size_t i = 0; i < segment.inputs.size(); ++i) {
+        Tensor& tensor = graph.tensors.at(segment.inputs[i]);
+        externals.push_back({static_cast<uint32_t>(i), tensor.data().data()});
+    }
+    for (size_t i = 0; i < segment.outputs.size(); ++i) {
+        Tensor& tensor = graph.tensors[segment.outputs[i]] = Tensor(segment.output_shapes[i]);
+        externals.push_back({static_cast<uint32_t>(segment.inputs.size() + i), tensor.data().data()});
+    }
+
+    if (xnn_setup_runtime_v2(segment.runtime, externals.size(), externals.data()) != xnn_status_success) {
+        throw std::runtime_error("Failed to set up XNNPACK runtime");
+    }
+    if (xnn_invoke_runtime(segment.runtime) != xnn_status_success) {
+        throw std::runtime_error("Failed to run XNNPACK runtime");
+    }
+    return true;
+}
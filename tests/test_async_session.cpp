@@ -0,0 +1,106 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <thread>
+#include "async_session.h"
+#include "test_utils.h"
+
+// input [N,6,6,2] -> Conv 3x3 -> c1 -> Relu -> output
+static ComputationGraph makeGraph() {
+    ComputationGraph graph;
+    srand(29);
+    graph.tensors["c1_w"] = Tensor({3, 3, 3, 2});
+    graph.tensors["c1_b"] = Tensor({3});
+    for (auto& [name, tensor] : graph.tensors) tensor.fillRandom();
+    graph.nodes = {
+        makeNode("Conv", {"input", "c1_w", "c1_b"}, {"c1"}, {intsAttr("kernel_shape", {3, 3}), intsAttr("pads", {1, 1, 1, 1})}),
+        makeNode("Relu", {"c1"}, {"output"}),
+    };
+    graph.topologicalSort();
+    return graph;
+}
+
+static Tensor makeInput(unsigned seed) {
+    srand(seed);
+    Tensor input({1, 6, 6, 2});
+    input.fillRandom();
+    return input;
+}
+
+TEST(AsyncSessionTest, FuturesMatchSynchronousRuns) {
+    Session session(makeGraph());
+    AsyncOptions options;
+    options.workers = 2;
+    AsyncSession async(session, options);
+
+    std::vector<std::future<std::vector<Tensor>>> futures;
+    for (unsigned i = 0; i < 10; ++i) {
+        if (i % 2) {
+            futures.push_back(async.submit(makeInput(i)));
+        } else {
+            futures.push_back(async.submit([i] { return makeInput(i); }));
+        }
+    }
+    for (unsigned i = 0; i < futures.size(); ++i) {
+        std::vector<Tensor> outputs = futures[i].get();
+        std::vector<Tensor> expected = session.run(makeInput(i));
+        ASSERT_EQ(outputs.size(), 1u);
+        EXPECT_EQ(outputs[0].shape(), expected[0].shape());
+        EXPECT_TRUE(outputs[0].data() == std::vector<float>(expected[0].data()));
+    }
+    // A future is made ready before its request releases its slot (see inFlight()).
+    async.wait();
+    EXPECT_EQ(async.inFlight(), 0u);
+}
+
+TEST(AsyncSessionTest, CallbacksReceiveOutputsAndErrors) {
+    Session session(makeGraph());
+    AsyncSession async(session);
+    std::atomic<int> succeeded{0}, failed{0};
+    auto done = [&](std::vector<Tensor> outputs, std::exception_ptr error) {
+        if (error) {
+            ++failed;
+        } else if (outputs.size() == 1) {
+            ++succeeded;
+        }
+    };
+    async.submit([] { return makeInput(1); }, done);
+    async.submit([]() -> Tensor { throw std::runtime_error("decode failed"); }, done);
+    async.submit([] { return Tensor({1, 6, 6, 7}); }, done);  // wrong channel count
+    async.wait();
+    EXPECT_EQ(succeeded, 1);
+    EXPECT_EQ(failed, 2);
+
+    auto future = async.submit([]() -> Tensor { throw std::runtime_error("decode failed"); });
+    EXPECT_THROW(future.get(), std::runtime_error);
+}
+
+TEST(AsyncSessionTest, SubmitBlocksAtMaxInFlight) {
+    Session session(makeGraph());
+    AsyncOptions options;
+    options.max_in_flight = 2;
+    AsyncSession async(session, options);
+
+    std::mutex gate;
+    gate.lock();
+    auto blocked = [&] {
+        std::lock_guard<std::mutex> lock(gate);
+        return makeInput(1);
+    };
+    auto first = async.submit(blocked);
+    auto second = async.submit(blocked);
+    EXPECT_EQ(async.inFlight(), 2u);
+
+    std::atomic<bool> submitted{false};
+    std::thread third([&] {
+        async.submit(makeInput(3)).get();
+        submitted = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_FALSE(submitted);
+
+    gate.unlock();
+    third.join();
+    EXPECT_TRUE(submitted);
+    first.get();
+    second.get();
+}
@@ -0,0 +1,120 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <xnnpack.h>
+#include "autotune.h"
+#include "execution_engine.h"
+#include "test_utils.h"
+
+// input [N,10,10,8] -> Conv 3x3 stride 2 -> c1 -> depthwise Conv 3x3 -> c2 -> Conv 1x1 -> c3
+//   -> Conv 3x3 padded unevenly on each side -> output
+static ComputationGraph makeGraph() {
+    ComputationGraph graph;
+    srand(29);
+    graph.tensors["c1_w"] = Tensor({8, 3, 3, 8});
+    graph.tensors["c1_b"] = Tensor({8});
+    graph.tensors["c2_w"] = Tensor({8, 3, 3, 1});
+    graph.tensors["c2_b"] = Tensor({8});
+    graph.tensors["c3_w"] = Tensor({6, 1, 1, 8});
+    graph.tensors["c3_b"] = Tensor({6});
+    graph.tensors["c4_w"] = Tensor({4, 3, 3, 6});
+    graph.tensors["c4_b"] = Tensor({4});
+    for (auto& [name, tensor] : graph.tensors) tensor.fillRandom();
+    graph.nodes = {
+        makeNode("Conv", {"input", "c1_w", "c1_b"}, {"c1"},
+                 {intsAttr("kernel_shape", {3, 3}), intsAttr("pads", {1, 1, 1, 1}), intsAttr("strides", {2, 2})}),
+        makeNode("Conv", {"c1", "c2_w", "c2_b"}, {"c2"},
+                 {intsAttr("kernel_shape", {3, 3}), intsAttr("pads", {1, 1, 1, 1}), intAttr("group", 8)}),
+        makeNode("Conv", {"c2", "c3_w", "c3_b"}, {"c3"}, {intsAttr("kernel_shape", {1, 1})}),
+        makeNode("Conv", {"c3", "c4_w", "c4_b"}, {"output"},
+                 {intsAttr("kernel_shape", {3, 3}), intsAttr("pads", {0, 2, 1, 0})}),  // top, left, bottom, right
+    };
+    graph.topologicalSort();
+    return graph;
+}
+
+TEST(AutotuneTest, NativeConvolutionsMatchXnnpack) {
+    ASSERT_EQ(xnn_initialize(nullptr), xnn_status_success);
+    ComputationGraph graph = makeGraph();
+    Operators ops;
+    Tensor input({2, 10, 10, 8});
+    input.fillRandom();
+    const std::vector<ConvAlgorithm> expected_candidates[] = {
+        {ConvAlgorithm::Xnnpack, ConvAlgorithm::General},
+        {ConvAlgorithm::Xnnpack, ConvAlgorithm::General, ConvAlgorithm::Depthwise},
+        {ConvAlgorithm::Xnnpack, ConvAlgorithm::General, ConvAlgorithm::Pointwise},
+        {ConvAlgorithm::Xnnpack, ConvAlgorithm::General},
+    };
+
+    ThreadingOptions threading;
+    threading.threads = 3;
+    ThreadingRuntime runtime(threading);
+    for (size_t i = 0; i < graph.sorted_nodes.size(); ++i) {
+        const GraphNode& node = *graph.sorted_nodes[i];
+        ConvParams params = convParams(node);
+        if (i == 0) {
+            params.output_min = 0.0f;  // as with a fused Clip, cutting off only the larger outputs
+            params.output_max = 18.0f;
+        }
+        const Tensor& weights = graph.tensors.at(node.inputs[1]);
+        const Tensor& bias = graph.tensors.at(node.inputs[2]);
+        auto xnn = ops.createConv2d(weights, bias, params.kernel_shape, params.strides, params.pads, params.dilations,
+                                    params.groups, nullptr, params.output_min, params.output_max);
+
+        std::vector<ConvAlgorithm> candidates = convCandidates(params, weights.shape());
+        EXPECT_EQ(candidates, expected_candidates[i]) << node.outputs[0];
+        Tensor expected;
+        runConvWith(ConvAlgorithm::Xnnpack, ops, *xnn, params, input, weights, bias, expected, nullptr);
+        for (ConvAlgorithm algorithm : candidates) {
+            Tensor output;
+            runConvWith(algorithm, ops, *xnn, params, input, weights, bias, output, runtime.threadpool());
+            SCOPED_TRACE(std::string(node.outputs[0]) + " " + convAlgorithmName(algorithm));
+            expectNear(output, expected, 1e-4f);
+        }
+        input = expected;
+    }
+}
+
+TEST(AutotuneTest, ChoicesPersistAcrossStartups) {
+    const std::string path = ::testing::TempDir() + "autotune_test.tune";
+    std::remove(path.c_str());
+    ComputationGraph reference = makeGraph();
+    Tensor input({1, 10, 10, 8});
+    input.fillRandom();
+    ExecutionEngine reference_engine;
+    reference_engine.executeGraph(reference, input);
+
+    const uint64_t fingerprint = modelFingerprint(makeGraph());
+    EXPECT_EQ(modelFingerprint(reference), fingerprint);
+    {
+        auto cache = std::make_shared<TuningCache>(path, fingerprint);
+        EXPECT_EQ(cache->loaded(), 0u);
+        ComputationGraph graph = makeGraph();
+        ExecutionEngine engine;
+        engine.setAutotuning(cache);
+        engine.prepare(graph, input.shape());
+        EXPECT_EQ(cache->size(), 4u);
+        ASSERT_TRUE(cache->find(TuningCache::key("c2", {1, 5, 5, 8})));
+        engine.executeGraph(graph, input);
+        expectNear(graph.tensors["output"], reference.tensors["output"], 1e-4f);
+    }
+
+    // A later startup reads the choices back instead of measuring.
+    auto cache = std::make_shared<TuningCache>(path, fingerprint);
+    EXPECT_EQ(cache->loaded(), 4u);
+    TuningChoice pinned{ConvAlgorithm::General, 1, 123.0};
+    cache->set(TuningCache::key("c1", input.shape()), pinned);
+    ComputationGraph graph = makeGraph();
+    ExecutionEngine engine;
+    engine.setAutotuning(cache);
+    engine.prepare(graph, input.shape());
+    EXPECT_EQ(cache->find(TuningCache::key("c1", input.shape()))->micros, 123.0);
+    engine.executeGraph(graph, input);
+    expectNear(graph.tensors["output"], reference.tensors["output"], 1e-4f);
+
+    // Another model or CPU does not reuse them.
+    EXPECT_EQ(TuningCache(path, fingerprint + 1).loaded(), 0u);
+    EXPECT_EQ(TuningCache(path, fingerprint, "other cpu").loaded(), 0u);
+    std::remove(path.c_str());
+}
@@ -0,0 +1,134 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include "batching_server.h"
+#include "test_utils.h"
+
+// input [N,H,W,3] -> Conv 3x3 -> c1 -> MaxPool 2x2 -> p1 -> GlobalAveragePool -> output [N,1,1,4]
+static ComputationGraph makeGraph() {
+    ComputationGraph graph;
+    srand(23);
+    graph.tensors["c1_w"] = Tensor({4, 3, 3, 3});
+    graph.tensors["c1_b"] = Tensor({4});
+    for (auto& [name, tensor] : graph.tensors) tensor.fillRandom();
+    graph.nodes = {
+        makeNode("Conv", {"input", "c1_w", "c1_b"}, {"c1"}, {intsAttr("kernel_shape", {3, 3}), intsAttr("pads", {1, 1, 1, 1})}),
+        makeNode("MaxPool", {"c1"}, {"p1"}, {intsAttr("kernel_shape", {2, 2}), intsAttr("strides", {2, 2})}),
+        makeNode("GlobalAveragePool", {"p1"}, {"output"}),
+    };
+    graph.topologicalSort();
+    return graph;
+}
+
+// input [N,6] -> Gemm (transB) -> g -> Softmax -> output [N,4]
+static ComputationGraph makeClassifierGraph() {
+    ComputationGraph graph;
+    srand(31);
+    graph.tensors["fc_w"] = Tensor({4, 6});
+    graph.tensors["fc_b"] = Tensor({4});
+    for (auto& [name, tensor] : graph.tensors) tensor.fillRandom();
+    graph.nodes = {
+        makeNode("Gemm", {"input", "fc_w", "fc_b"}, {"g"}, {intAttr("transB", 1)}),
+        makeNode("Softmax", {"g"}, {"output"}),
+    };
+    graph.topologicalSort();
+    return graph;
+}
+
+static Tensor makeSample(unsigned seed, int size = 8) {
+    srand(seed);
+    Tensor sample({1, size, size, 3});
+    sample.fillRandom();
+    return sample;
+}
+
+// Sends every sample from its own thread at once and checks each result
+// against running the sample alone.
+static void runConcurrently(BatchingServer& server, const std::vector<Tensor>& samples,
+                            ComputationGraph (*makeModel)() = makeGraph) {
+    Session reference(makeModel());
+    std::vector<std::vector<Tensor>> results(samples.size());
+    std::vector<std::thread> clients;
+    for (size_t i = 0; i < samples.size(); ++i) {
+        clients.emplace_back([&, i] { results[i] = server.run(samples[i]); });
+    }
+    for (auto& client : clients) client.join();
+    for (size_t i = 0; i < samples.size(); ++i) {
+        ASSERT_EQ(results[i].size(), 1u);
+        expectNear(results[i][0], reference.run(samples[i])[0]);
+    }
+}
+
+TEST(BatchingServerTest, CoalescesConcurrentRequests) {
+    BatchingOptions options;
+    options.max_batch = 4;
+    options.max_wait = std::chrono::seconds(10);  // batches only close when full
+    BatchingServer server(makeGraph(), options);
+
+    std::vector<Tensor> samples;
+    for (unsigned i = 0; i < 8; ++i) samples.push_back(makeSample(i));
+    runConcurrently(server, samples);
+
+    BatchingServer::Stats stats = server.stats();
+    EXPECT_EQ(stats.requests, 8u);
+    EXPECT_EQ(stats.batches, 2u);
+    EXPECT_EQ(stats.largest_batch, 4u);
+}
+
+TEST(BatchingServerTest, BatchedSoftmaxRowsMatchSingleRuns) {
+    BatchingOptions options;
+    options.max_batch = 4;
+    options.max_wait = std::chrono::seconds(10);
+    BatchingServer server(makeClassifierGraph(), options);
+
+    std::vector<Tensor> samples;
+    for (unsigned i = 0; i < 4; ++i) {
+        srand(40 + i);
+        samples.emplace_back(std::vector<int>{1, 6});
+        samples.back().fillRandom();
+    }
+    runConcurrently(server, samples, makeClassifierGraph);
+    EXPECT_EQ(server.stats().largest_batch, 4u);
+}
+
+TEST(BatchingServerTest, FlushesAPartialBatchAfterMaxWait) {
+    BatchingOptions options;
+    options.max_batch = 16;
+    options.max_wait = std::chrono::milliseconds(5);
+    BatchingServer server(makeGraph(), options);
+
+    Tensor sample = makeSample(1);
+    std::vector<Tensor> result = server.run(sample);
+    expectNear(result[0], Session(makeGraph()).run(sample)[0]);
+    EXPECT_EQ(server.stats().batches, 1u);
+    EXPECT_EQ(server.stats().largest_batch, 1u);
+}
+
+TEST(BatchingServerTest, BatchesOnlySamplesOfTheSameShape) {
+    BatchingOptions options;
+    options.max_batch = 6;
+    options.max_wait = std::chrono::milliseconds(50);
+    options.workers = 2;
+    BatchingServer server(makeGraph(), options);
+
+    std::vector<Tensor> samples;
+    for (unsigned i = 0; i < 6; ++i) samples.push_back(makeSample(i, i % 2 ? 8 : 12));
+    runConcurrently(server, samples);
+    EXPECT_EQ(server.stats().requests, 6u);
+    EXPECT_GE(server.stats().batches, 2u);
+}
+
+TEST(BatchingServerTest, RejectsBatchedInputs) {
+    BatchingServer server(makeGraph());
+    Tensor batch({2, 8, 8, 3});
+    EXPECT_THROW(server.run(batch), std::runtime_error);
+    EXPECT_EQ(server.stats().requests, 0u);
+}
+
+TEST(BatchingServerTest, ReportsBatchFailuresToEveryCaller) {
+    BatchingServer server(makeGraph());
+    Tensor wrong_channels({1, 8, 8, 5});
+    EXPECT_THROW(server.run(wrong_channels), std::runtime_error);
+    // The server keeps serving afterwards.
+    Tensor sample = makeSample(2);
+    EXPECT_EQ(server.run(sample).size(), 1u);
+}
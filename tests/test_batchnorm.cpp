@@ -1,9 +1,10 @@
 #include <gtest/gtest.h>
 #include "operators.h"
 #include "tensor.h"
+#include <cmath>
 
 TEST(BatchNormTest, BasicBatchNorm) {
-    Tensor input({1, 3, 4, 4});
+    Tensor input({1, 4, 4, 3});  // NHWC, like every spatial operator
     Tensor scale({3});
     Tensor bias({3});
     Tensor mean({3});
@@ -14,10 +15,16 @@ TEST(BatchNormTest, BasicBatchNorm) {
     bias.fillRandom();
     mean.fillRandom();
     var.fillRandom();
+    for (auto& v : var.data()) v = std::abs(v);
 
     Operators ops;
     float epsilon = 1e-5f;
     Tensor output = ops.batchNorm(input, scale, bias, mean, var, epsilon);
 
     EXPECT_EQ(output.shape(), input.shape());
+    for (size_t i = 0; i < input.size(); ++i) {
+        size_t c = i % 3;
+        float expected = scale.data()[c] * (input.data()[i] - mean.data()[c]) / std::sqrt(var.data()[c] + epsilon) + bias.data()[c];
+        EXPECT_NEAR(output.data()[i], expected, 1e-4f);
+    }
 }
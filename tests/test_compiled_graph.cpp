@@ -0,0 +1,50 @@
+#include <gtest/gtest.h>
+#include "compiled_graph.h"
+#include "execution_engine.h"
+#include "test_utils.h"
+
+TEST(CompiledGraphTest, ResolvesTensorsToSlots) {
+    ComputationGraph graph;
+    graph.tensors["bias"] = Tensor({4}, {1.0f, 2.0f, 3.0f, 4.0f});
+    graph.nodes = {
+        makeNode("Relu", {"input"}, {"a"}),
+        makeNode("Add", {"a", "bias"}, {"b"}),
+        makeNode("Softmax", {"b"}, {"output"}),
+    };
+    graph.topologicalSort();
+
+    auto compiled = compileGraph(graph);
+    ASSERT_EQ(compiled->nodes.size(), 3u);
+    const KernelRegistry& registry = KernelRegistry::instance();
+    EXPECT_EQ(compiled->nodes[0].kernel, registry.find("Relu"));
+    EXPECT_EQ(compiled->nodes[1].kernel, registry.find("Add"));
+    EXPECT_EQ(compiled->nodes[2].kernel, registry.find("Softmax"));
+
+    // A tensor written by one node and read by the next shares its slot.
+    EXPECT_EQ(compiled->nodes[0].inputs[0], compiled->input_slot);
+    EXPECT_EQ(compiled->nodes[0].outputs[0], compiled->nodes[1].inputs[0]);
+    EXPECT_EQ(compiled->nodes[1].outputs[0], compiled->nodes[2].inputs[0]);
+    EXPECT_EQ(compiled->slots.size(), 5u);  // input, a, bias, b, output
+
+    // Slots alias the entries of graph.tensors.
+    for (const auto& [name, slot] : compiled->slot_index) {
+        EXPECT_EQ(compiled->slots[slot], &graph.tensors[name]) << name;
+    }
+    EXPECT_EQ(&compiled->at(graph.sorted_nodes[1]), &compiled->nodes[1]);
+
+    ExecutionEngine engine;
+    engine.executeGraph(graph, Tensor({4}, {-1.0f, 0.0f, 1.0f, 2.0f}));
+    engine.executeGraph(graph, Tensor({4}, {-1.0f, 0.0f, 1.0f, 2.0f}));
+    EXPECT_EQ(compiled->slots.size(), graph.compiled->slots.size());
+    EXPECT_EQ(&graph.compiled->tensor(graph.compiled->nodes[2].outputs[0]), &graph.tensors["output"]);
+    EXPECT_EQ(graph.tensors["output"].shape(), std::vector<int>({4}));
+}
+
+TEST(CompiledGraphTest, UnknownOpHasNoKernel) {
+    ComputationGraph graph;
+    graph.nodes = {makeNode("LSTM", {"input"}, {"output"})};
+    graph.topologicalSort();
+
+    auto compiled = compileGraph(graph);
+    EXPECT_EQ(compiled->nodes[0].kernel, nullptr);
+}
@@ -106,3 +106,32 @@ TEST(Conv2DTest, DepthwiseGroupConv) {
 
     if (pthreadpool_) pthreadpool_destroy(pthreadpool_);
 }
+
+TEST(Conv2DTest, PersistentOperatorReshapesOnNewInputDims) {
+    Tensor weights({4, 3, 3, 2});
+    Tensor bias({4});
+    weights.fillRandom();
+    bias.fillRandom();
+
+    xnn_status status = xnn_initialize(nullptr);
+    if (status != xnn_status_success) {
+        throw std::runtime_error("XNNPACK initialization failed");
+    }
+    pthreadpool_t pthreadpool_ = pthreadpool_create(0);
+    Operators ops;
+    auto conv = ops.createConv2d(weights, bias, {3, 3}, {1, 1}, {1, 1, 1, 1}, {1, 1}, 1);
+
+    for (int size : {4, 4, 6}) {
+        Tensor input({1, size, size, 2});
+        input.fillRandom();
+
+        Tensor output = ops.runConv2d(*conv, input, pthreadpool_);
+        Tensor expected = ops.conv2d(input, weights, bias, {3, 3}, {1, 1}, {1, 1, 1, 1}, {1, 1}, 1, pthreadpool_);
+
+        EXPECT_EQ(conv->input_shape, input.shape());
+        ASSERT_EQ(output.shape(), std::vector<int>({1, size, size, 4}));
+        EXPECT_EQ(output.data(), expected.data());
+    }
+
+    if (pthreadpool_) pthreadpool_destroy(pthreadpool_);
+}
@@ -0,0 +1,139 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <mutex>
+#include "dag_scheduler.h"
+#include "execution_engine.h"
+#include "test_utils.h"
+
+// Four branches of Gemm -> Relu -> Gemm over the same input, summed pairwise:
+// input -> b{0..3} -> add01, add23 -> output
+static ComputationGraph makeBranchyGraph(int features) {
+    ComputationGraph graph;
+    srand(21);
+    for (int b = 0; b < 4; ++b) {
+        std::string id = std::to_string(b);
+        for (const char* layer : {"_w1", "_w2"}) {
+            graph.tensors["b" + id + layer] = Tensor({features, features});
+            graph.tensors["b" + id + layer + "_bias"] = Tensor({features});
+        }
+        GraphNode fc1 = makeNode("Gemm", {"input", "b" + id + "_w1", "b" + id + "_w1_bias"}, {"b" + id + "_fc1"});
+        GraphNode fc2 = makeNode("Gemm", {"b" + id + "_relu", "b" + id + "_w2", "b" + id + "_w2_bias"}, {"b" + id});
+        fc1.attributes = {intAttr("transB", 1)};
+        fc2.attributes = {intAttr("transB", 1)};
+        graph.nodes.push_back(fc1);
+        graph.nodes.push_back(makeNode("Relu", {"b" + id + "_fc1"}, {"b" + id + "_relu"}));
+        graph.nodes.push_back(fc2);
+    }
+    for (auto& [name, tensor] : graph.tensors) tensor.fillRandom();
+    graph.nodes.push_back(makeNode("Add", {"b0", "b1"}, {"add01"}));
+    graph.nodes.push_back(makeNode("Add", {"b2", "b3"}, {"add23"}));
+    graph.nodes.push_back(makeNode("Add", {"add01", "add23"}, {"output"}));
+    graph.topologicalSort();
+    return graph;
+}
+
+static NodeDependencies chain(std::vector<std::vector<size_t>> successors) {
+    NodeDependencies dependencies;
+    dependencies.num_predecessors.assign(successors.size(), 0);
+    for (const auto& targets : successors) {
+        for (size_t target : targets) ++dependencies.num_predecessors[target];
+    }
+    dependencies.successors = std::move(successors);
+    return dependencies;
+}
+
+TEST(DagSchedulerTest, RunsEachNodeAfterItsPredecessors) {
+    // 0 -> {1, 2, 3} -> 4
+    NodeDependencies dependencies = chain({{1, 2, 3}, {4}, {4}, {4}, {}});
+    DagScheduler scheduler(3);
+    for (int repeat = 0; repeat < 20; ++repeat) {
+        std::mutex mutex;
+        std::vector<size_t> order;
+        std::atomic<int> fanning_out{0};
+        std::atomic<int> max_fanning_out{0};
+        scheduler.run(dependencies, [&](size_t node, bool fan_out) {
+            if (fan_out) max_fanning_out = std::max(max_fanning_out.load(), ++fanning_out);
+            std::lock_guard<std::mutex> lock(mutex);
+            order.push_back(node);
+            if (fan_out) --fanning_out;
+        });
+        ASSERT_EQ(order.size(), 5u);
+        EXPECT_EQ(order.front(), 0u);
+        EXPECT_EQ(order.back(), 4u);
+        EXPECT_EQ(max_fanning_out, 1);
+    }
+}
+
+TEST(DagSchedulerTest, RethrowsAndSkipsTheRest) {
+    NodeDependencies dependencies = chain({{1}, {2}, {}});
+    DagScheduler scheduler(2);
+    std::atomic<int> ran{0};
+    EXPECT_THROW(scheduler.run(dependencies, [&](size_t node, bool) {
+        ++ran;
+        if (node == 1) throw std::runtime_error("kernel failed");
+    }), std::runtime_error);
+    EXPECT_EQ(ran, 2);
+}
+
+TEST(DagSchedulerTest, OrdersNodesSharingArenaBytes) {
+    ComputationGraph graph = makeBranchyGraph(8);
+    ExecutionEngine engine;
+    engine.executeGraph(graph, Tensor({2, 8}));
+    const MemoryPlan& plan = *graph.memory_plan;
+    const CompiledGraph& compiled = *graph.compiled;
+    auto dependencies = buildDependencies(compiled, &plan);
+    auto data_only = buildDependencies(compiled, nullptr);
+    EXPECT_GT(dependencies->num_edges, data_only->num_edges);
+
+    // Every node reading an arena tensor must precede, transitively, the
+    // producer of any later tensor placed over the same bytes.
+    const size_t count = compiled.nodes.size();
+    std::vector<std::vector<bool>> reaches(count, std::vector<bool>(count, false));
+    for (size_t i = count; i-- > 0;) {
+        for (size_t next : dependencies->successors[i]) {
+            ASSERT_GT(next, i);
+            reaches[i][next] = true;
+            for (size_t j = 0; j < count; ++j) reaches[i][j] = reaches[i][j] || reaches[next][j];
+        }
+    }
+    auto bytes = [&](const std::string& name) {
+        size_t size = sizeof(float);
+        for (int dim : plan.shapes.at(name)) size *= dim;
+        return size;
+    };
+    for (const auto& lifetime : computeLifetimes(graph)) {
+        for (const auto& other : computeLifetimes(graph)) {
+            if (lifetime.last_use >= other.first_use) continue;
+            size_t begin = plan.offsets.at(lifetime.name), other_begin = plan.offsets.at(other.name);
+            if (begin + bytes(lifetime.name) <= other_begin || other_begin + bytes(other.name) <= begin) continue;
+            EXPECT_TRUE(reaches[lifetime.last_use][other.first_use]) << lifetime.name << " / " << other.name;
+        }
+    }
+}
+
+TEST(DagSchedulerTest, ParallelRunMatchesSequentialRun) {
+    ComputationGraph sequential_graph = makeBranchyGraph(32);
+    ComputationGraph parallel_graph = makeBranchyGraph(32);
+    ExecutionEngine sequential;
+    ExecutionEngine parallel;
+    parallel.setInterOpThreads(4);
+    EXPECT_EQ(parallel.interOpThreads(), 4u);
+
+    for (int batch : {1, 3, 1, 5}) {
+        Tensor input({batch, 32});
+        input.fillRandom();
+        sequential.executeGraph(sequential_graph, input);
+        for (int repeat = 0; repeat < 5; ++repeat) {
+            parallel.executeGraph(parallel_graph, input);
+            ASSERT_EQ(parallel_graph.tensors["output"].data(), sequential_graph.tensors["output"].data());
+        }
+    }
+
+    parallel.setInterOpThreads(1);
+    EXPECT_EQ(parallel.interOpThreads(), 1u);
+    Tensor input({2, 32});
+    input.fillRandom();
+    sequential.executeGraph(sequential_graph, input);
+    parallel.executeGraph(parallel_graph, input);
+    EXPECT_EQ(parallel_graph.tensors["output"].data(), sequential_graph.tensors["output"].data());
+}
@@ -0,0 +1,475 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include "execution_engine.h"
+#include "graph_optimizer.h"
+#include "onnx_utils.h"
+#include "test_utils.h"
+
+// input [1,5,5,3] -> Conv (4 channels, OHWI weights) -> conv -> BatchNormalization -> output
+static ComputationGraph makeGraph(bool with_bias) {
+    ComputationGraph graph;
+    srand(3);
+    graph.tensors["w"] = randomTensor({4, 3, 3, 3});
+    if (with_bias) graph.tensors["b"] = randomTensor({4});
+    graph.tensors["scale"] = randomTensor({4});
+    graph.tensors["shift"] = randomTensor({4});
+    graph.tensors["mean"] = randomTensor({4});
+    graph.tensors["var"] = randomTensor({4}, 1.0f);  // keep the variance positive
+
+    GraphNode conv = makeNode("Conv", {"input", "w"}, {"conv"});
+    if (with_bias) conv.inputs.push_back("b");
+    conv.attributes = {intsAttr("kernel_shape", {3, 3}), intsAttr("pads", {1, 1, 1, 1})};
+    graph.nodes = {conv, makeNode("BatchNormalization", {"conv", "scale", "shift", "mean", "var"}, {"output"})};
+    graph.topologicalSort();
+    return graph;
+}
+
+// Conv alone, then batch normalization over the channels-last output.
+static std::vector<float> reference(const ComputationGraph& source, const Tensor& input, bool with_bias) {
+    ComputationGraph graph;
+    graph.tensors["w"] = source.tensors.at("w");
+    graph.tensors["b"] = with_bias ? source.tensors.at("b") : Tensor({4});
+    GraphNode conv = makeNode("Conv", {"input", "w", "b"}, {"output"});
+    conv.attributes = source.nodes[0].attributes;
+    graph.nodes = {conv};
+    graph.topologicalSort();
+
+    ExecutionEngine engine;
+    engine.executeGraph(graph, input);
+    std::vector<float> result = graph.tensors["output"].data();
+    for (size_t i = 0; i < result.size(); ++i) {
+        size_t c = i % 4;
+        float mean = source.tensors.at("mean").data()[c];
+        float var = source.tensors.at("var").data()[c];
+        result[i] = source.tensors.at("scale").data()[c] * (result[i] - mean) / std::sqrt(var + 1e-5f) +
+                    source.tensors.at("shift").data()[c];
+    }
+    return result;
+}
+
+TEST(GraphOptimizerTest, FoldsBatchNormIntoConv) {
+    for (bool with_bias : {true, false}) {
+        ComputationGraph graph = makeGraph(with_bias);
+        Tensor input = randomTensor({1, 5, 5, 3});
+        std::vector<float> expected = reference(graph, input, with_bias);
+
+        EXPECT_EQ(foldBatchNorms(graph), 1u);
+        ASSERT_EQ(graph.nodes.size(), 1u);
+        ASSERT_EQ(graph.sorted_nodes.size(), 1u);
+        EXPECT_EQ(graph.nodes[0].op_type, "Conv");
+        EXPECT_EQ(graph.nodes[0].inputs.size(), 3u);
+        EXPECT_EQ(graph.nodes[0].outputs, std::vector<std::string>({"output"}));
+        EXPECT_FALSE(graph.tensors.count("mean"));
+        EXPECT_FALSE(graph.tensors.count("var"));
+
+        ExecutionEngine engine;
+        engine.executeGraph(graph, input);
+        ASSERT_EQ(graph.tensors["output"].size(), expected.size());
+        for (size_t i = 0; i < expected.size(); ++i) {
+            EXPECT_NEAR(graph.tensors["output"].data()[i], expected[i], 1e-4f) << "with_bias=" << with_bias;
+        }
+    }
+}
+
+TEST(GraphOptimizerTest, KeepsBatchNormWhoseInputIsShared) {
+    ComputationGraph graph = makeGraph(true);
+    graph.nodes.push_back(makeNode("Relu", {"conv"}, {"relu"}));
+    graph.topologicalSort();
+
+    EXPECT_EQ(foldBatchNorms(graph), 0u);
+    EXPECT_EQ(graph.nodes.size(), 3u);
+    EXPECT_TRUE(graph.tensors.count("mean"));
+}
+
+// input [1,5,5,3] -> Conv -> Clip -> GlobalAveragePool -> Flatten -> Gemm -> Relu -> output
+static ComputationGraph makeActivationGraph() {
+    ComputationGraph graph;
+    srand(5);
+    graph.tensors["w"] = randomTensor({4, 3, 3, 3});
+    graph.tensors["b"] = randomTensor({4});
+    graph.tensors["fc_w"] = randomTensor({6, 4});
+    graph.tensors["fc_b"] = randomTensor({6}, -0.5f);
+
+    GraphNode conv = makeNode("Conv", {"input", "w", "b"}, {"conv"});
+    conv.attributes = {intsAttr("kernel_shape", {3, 3}), intsAttr("pads", {1, 1, 1, 1})};
+    GraphNode clip = makeNode("Clip", {"conv"}, {"clip"});
+    clip.attributes = {floatAttr("min", -0.5f), floatAttr("max", 0.5f)};
+    GraphNode gemm = makeNode("Gemm", {"flat", "fc_w", "fc_b"}, {"fc"});
+    gemm.attributes = {intAttr("transB", 1)};
+    graph.nodes = {
+        conv, clip,
+        makeNode("GlobalAveragePool", {"clip"}, {"pool"}),
+        makeNode("Flatten", {"pool"}, {"flat"}),
+        gemm,
+        makeNode("Relu", {"fc"}, {"output"}),
+    };
+    graph.topologicalSort();
+    return graph;
+}
+
+TEST(GraphOptimizerTest, FusesActivationsIntoConvAndGemm) {
+    Tensor input = randomTensor({1, 5, 5, 3}, -0.5f);
+    ComputationGraph reference = makeActivationGraph();
+    ExecutionEngine reference_engine;
+    reference_engine.executeGraph(reference, input);
+    const std::vector<float> expected = reference.tensors["output"].data();
+
+    for (auto backend : {ExecutionEngine::Backend::Native, ExecutionEngine::Backend::XnnpackSubgraph}) {
+        ComputationGraph graph = makeActivationGraph();
+        EXPECT_EQ(fuseActivations(graph), 2u);
+        ASSERT_EQ(graph.sorted_nodes.size(), 4u);
+        EXPECT_EQ(graph.sorted_nodes[0]->outputs, std::vector<std::string>({"clip"}));
+        EXPECT_EQ(graph.sorted_nodes[3]->op_type, "Gemm");
+        EXPECT_EQ(graph.sorted_nodes[3]->outputs, std::vector<std::string>({"output"}));
+
+        ExecutionEngine engine(backend);
+        engine.executeGraph(graph, input);
+        ASSERT_EQ(graph.tensors["output"].size(), expected.size());
+        for (size_t i = 0; i < expected.size(); ++i) {
+            EXPECT_NEAR(graph.tensors["output"].data()[i], expected[i], 1e-4f);
+        }
+    }
+}
+
+TEST(GraphOptimizerTest, ConvBatchNormReluBecomesOneConv) {
+    ComputationGraph graph = makeGraph(true);
+    graph.nodes[1].outputs = {"bn"};
+    graph.nodes.push_back(makeNode("Relu", {"bn"}, {"output"}));
+    graph.topologicalSort();
+
+    optimizeGraph(graph);
+    ASSERT_EQ(graph.nodes.size(), 1u);
+    EXPECT_EQ(graph.nodes[0].outputs, std::vector<std::string>({"output"}));
+    EXPECT_EQ(getFloatAttr(&graph.nodes[0], "activation_min", -1.0f), 0.0f);
+}
+
+static size_t countOps(const ComputationGraph& graph, const std::string& op_type) {
+    size_t count = 0;
+    for (const GraphNode& node : graph.nodes) count += node.op_type == op_type;
+    return count;
+}
+
+static const GraphNode* findNode(const ComputationGraph& graph, const std::string& op_type) {
+    for (const GraphNode& node : graph.nodes) {
+        if (node.op_type == op_type) return &node;
+    }
+    return nullptr;
+}
+
+// input [2,4] -> Gemm -> Clip(min, max as inputs) -> output
+static ComputationGraph makeClipInputsGraph() {
+    ComputationGraph graph;
+    srand(37);
+    graph.tensors["fc_w"] = randomTensor({6, 4}, -0.5f);
+    graph.tensors["fc_b"] = randomTensor({6}, -0.5f);
+    graph.tensors["lo"] = Tensor({1}, {-0.2f});
+    graph.tensors["hi"] = Tensor({1}, {0.3f});
+    graph.nodes = {
+        makeNode("Gemm", {"input", "fc_w", "fc_b"}, {"fc"}, {intAttr("transB", 1)}),
+        makeNode("Clip", {"fc", "lo", "hi"}, {"output"}),
+    };
+    graph.topologicalSort();
+    return graph;
+}
+
+TEST(GraphOptimizerTest, ClipBoundInputsClampTheSameFusedOrNot) {
+    Tensor input = randomTensor({2, 4}, -0.5f);
+    ComputationGraph unfused = makeClipInputsGraph();
+    ExecutionEngine engine;
+    engine.executeGraph(unfused, input);
+    const std::vector<float>& expected = unfused.tensors["output"].data();
+    EXPECT_EQ(*std::min_element(expected.begin(), expected.end()), -0.2f);
+    EXPECT_EQ(*std::max_element(expected.begin(), expected.end()), 0.3f);
+
+    ComputationGraph fused = makeClipInputsGraph();
+    EXPECT_EQ(fuseActivations(fused), 1u);
+    engine.executeGraph(fused, input);
+    EXPECT_EQ(fused.tensors["output"].data(), expected);
+
+    ComputationGraph lowered = makeClipInputsGraph();
+    ExecutionEngine xnn(ExecutionEngine::Backend::XnnpackSubgraph);
+    xnn.executeGraph(lowered, input);
+    expectNear(lowered.tensors["output"], unfused.tensors["output"]);
+}
+
+TEST(GraphOptimizerTest, KeepsActivationInputsThatAreGraphOutputs) {
+    ComputationGraph graph = makeActivationGraph();
+    graph.outputs = {"fc", "output"};
+    EXPECT_EQ(fuseActivations(graph), 1u);  // only the Clip
+    EXPECT_EQ(countOps(graph, "Relu"), 1u);
+
+    graph = makeGraph(true);
+    graph.outputs = {"conv", "output"};
+    EXPECT_EQ(foldBatchNorms(graph), 0u);
+}
+
+// An NCHW model as parsed from ONNX (OIHW weights):
+// input [1,3,6,6] -> Conv -> Relu -> Conv -> Add(bias [1,4,6,6]) -> BatchNormalization -> output [1,4,6,6]
+static ComputationGraph makeNchwGraph() {
+    ComputationGraph graph;
+    srand(9);
+    graph.tensors["w1"] = randomTensor({4, 3, 3, 3});
+    graph.tensors["b1"] = randomTensor({4});
+    graph.tensors["w2"] = randomTensor({4, 4, 1, 1});
+    graph.tensors["b2"] = randomTensor({4});
+    graph.tensors["bias"] = randomTensor({1, 4, 6, 6});
+    graph.tensors["scale"] = randomTensor({4});
+    graph.tensors["shift"] = randomTensor({4});
+    graph.tensors["mean"] = randomTensor({4});
+    graph.tensors["var"] = randomTensor({4}, 1.0f);
+
+    GraphNode conv1 = makeNode("Conv", {"input", "w1", "b1"}, {"c1"});
+    conv1.attributes = {intsAttr("kernel_shape", {3, 3}), intsAttr("pads", {1, 1, 1, 1})};
+    GraphNode conv2 = makeNode("Conv", {"r1", "w2", "b2"}, {"c2"});
+    conv2.attributes = {intsAttr("kernel_shape", {1, 1})};
+    graph.nodes = {
+        conv1,
+        makeNode("Relu", {"c1"}, {"r1"}),
+        conv2,
+        makeNode("Add", {"c2", "bias"}, {"sum"}),
+        makeNode("BatchNormalization", {"sum", "scale", "shift", "mean", "var"}, {"output"}),
+    };
+    return graph;
+}
+
+TEST(GraphOptimizerTest, RunsChannelsLastWithOneTransposeAtEachEnd) {
+    ComputationGraph graph = makeNchwGraph();
+    const ComputationGraph original = makeNchwGraph();
+    assignLayouts(graph, {"output"});
+    EXPECT_EQ(countOps(graph, "Transpose"), 2u);
+    EXPECT_EQ(graph.sorted_nodes.front()->op_type, "Transpose");
+    EXPECT_EQ(graph.sorted_nodes.back()->op_type, "Transpose");
+    EXPECT_EQ(graph.tensors.at("w1").shape(), std::vector<int>({4, 3, 3, 3}));  // OHWI
+    EXPECT_FALSE(graph.tensors.count("bias"));  // replaced by its NHWC copy
+
+    Tensor input = randomTensor({1, 3, 6, 6});
+    ExecutionEngine engine;
+    engine.executeGraph(graph, input);
+    const Tensor& output = graph.tensors["output"];
+    ASSERT_EQ(output.shape(), std::vector<int>({1, 4, 6, 6}));
+
+    // Reference computed directly in NCHW.
+    auto at = [](const Tensor& t, int c, int h, int w) { return t.data()[(c * t.shape()[2] + h) * t.shape()[3] + w]; };
+    const Tensor& w1 = original.tensors.at("w1");
+    const Tensor& w2 = original.tensors.at("w2");
+    for (int oc = 0; oc < 4; ++oc) {
+        for (int h = 0; h < 6; ++h) {
+            for (int w = 0; w < 6; ++w) {
+                float sum = original.tensors.at("b2").data()[oc];
+                for (int mc = 0; mc < 4; ++mc) {
+                    float c1 = original.tensors.at("b1").data()[mc];
+                    for (int ic = 0; ic < 3; ++ic) {
+                        for (int kh = 0; kh < 3; ++kh) {
+                            for (int kw = 0; kw < 3; ++kw) {
+                                int y = h + kh - 1, x = w + kw - 1;
+                                if (y < 0 || y >= 6 || x < 0 || x >= 6) continue;
+                                c1 += at(input, ic, y, x) * w1.data()[((mc * 3 + ic) * 3 + kh) * 3 + kw];
+                            }
+                        }
+                    }
+                    sum += std::max(c1, 0.0f) * w2.data()[oc * 4 + mc];
+                }
+                sum += at(original.tensors.at("bias"), oc, h, w);
+                float expected = original.tensors.at("scale").data()[oc] * (sum - original.tensors.at("mean").data()[oc]) /
+                                 std::sqrt(original.tensors.at("var").data()[oc] + 1e-5f) + original.tensors.at("shift").data()[oc];
+                EXPECT_NEAR(at(output, oc, h, w), expected, 1e-3f);
+            }
+        }
+    }
+}
+
+// input [1,3,4,5] -> Conv 1x1 -> Softmax(softmax_attributes) -> output [1,4,4,5]
+static ComputationGraph makeConvSoftmaxGraph(std::vector<onnx::AttributeProto> softmax_attributes) {
+    ComputationGraph graph;
+    srand(17);
+    graph.tensors["w"] = randomTensor({4, 3, 1, 1});
+    graph.tensors["b"] = randomTensor({4});
+    GraphNode conv = makeNode("Conv", {"input", "w", "b"}, {"c"});
+    conv.attributes = {intsAttr("kernel_shape", {1, 1})};
+    GraphNode softmax = makeNode("Softmax", {"c"}, {"output"});
+    softmax.attributes = std::move(softmax_attributes);
+    graph.nodes = {conv, softmax};
+    return graph;
+}
+
+TEST(GraphOptimizerTest, SoftmaxFollowsItsAxisIntoChannelsLast) {
+    ComputationGraph graph = makeConvSoftmaxGraph({intAttr("axis", 1)});
+    const Tensor w = graph.tensors.at("w");
+    const Tensor b = graph.tensors.at("b");
+    assignLayouts(graph, {"output"});
+    EXPECT_EQ(countOps(graph, "Transpose"), 2u);
+    const GraphNode* softmax = findNode(graph, "Softmax");
+    ASSERT_TRUE(softmax);
+    EXPECT_EQ(getIntAttr(softmax, "axis", -1), 3);
+
+    Tensor input = randomTensor({1, 3, 4, 5});
+    ExecutionEngine engine;
+    engine.executeGraph(graph, input);
+    const Tensor& output = graph.tensors["output"];
+    ASSERT_EQ(output.shape(), std::vector<int>({1, 4, 4, 5}));
+
+    // Reference in NCHW: the Conv, then Softmax over the channels of each pixel.
+    Tensor conv({1, 4, 4, 5});
+    for (int oc = 0; oc < 4; ++oc) {
+        for (int p = 0; p < 20; ++p) {
+            float sum = b.data()[oc];
+            for (int ic = 0; ic < 3; ++ic) sum += input.data()[ic * 20 + p] * w.data()[oc * 3 + ic];
+            conv.data()[oc * 20 + p] = sum;
+        }
+    }
+    Operators ops;
+    Tensor expected = ops.softmax(conv, 1);
+    for (size_t i = 0; i < expected.size(); ++i) EXPECT_NEAR(output.data()[i], expected.data()[i], 1e-5f);
+}
+
+TEST(GraphOptimizerTest, SoftmaxOverSpatialDimsOnlyRunsInNchw) {
+    // Pre-opset-13 Softmax over H and W: no NHWC axis covers exactly those.
+    ComputationGraph graph = makeConvSoftmaxGraph({intAttr("axis", 2), intAttr("coerce_2d", 1)});
+    assignLayouts(graph, {"output"});
+    const GraphNode* softmax = findNode(graph, "Softmax");
+    ASSERT_TRUE(softmax);
+    EXPECT_EQ(getIntAttr(softmax, "axis", -1), 2);
+
+    Tensor input = randomTensor({1, 3, 4, 5});
+    ExecutionEngine engine;
+    engine.executeGraph(graph, input);
+    const Tensor& output = graph.tensors["output"];
+    ASSERT_EQ(output.shape(), std::vector<int>({1, 4, 4, 5}));
+    for (int c = 0; c < 4; ++c) {
+        float sum = 0.0f;
+        for (int p = 0; p < 20; ++p) sum += output.data()[c * 20 + p];
+        EXPECT_NEAR(sum, 1.0f, 1e-5f);
+    }
+}
+
+TEST(GraphOptimizerTest, FlattenAfterGlobalPoolNeedsNoTranspose) {
+    ComputationGraph graph;
+    graph.tensors["w"] = randomTensor({4, 3, 1, 1});
+    graph.tensors["b"] = randomTensor({4});
+    GraphNode conv = makeNode("Conv", {"input", "w", "b"}, {"conv"});
+    conv.attributes = {intsAttr("kernel_shape", {1, 1})};
+    graph.nodes = {
+        conv,
+        makeNode("GlobalAveragePool", {"conv"}, {"pool"}),
+        makeNode("Flatten", {"pool"}, {"output"}),
+    };
+    assignLayouts(graph, {"output"});
+    EXPECT_EQ(countOps(graph, "Transpose"), 1u);
+    EXPECT_EQ(graph.sorted_nodes[0]->op_type, "Transpose");
+}
+
+TEST(GraphOptimizerTest, CancelsInverseTransposes) {
+    ComputationGraph graph;
+    GraphNode to_nhwc = makeNode("Transpose", {"input"}, {"t1"});
+    to_nhwc.attributes = {intsAttr("perm", {0, 2, 3, 1})};
+    GraphNode to_nchw = makeNode("Transpose", {"t1"}, {"t2"});
+    to_nchw.attributes = {intsAttr("perm", {0, 3, 1, 2})};
+    GraphNode swap = makeNode("Transpose", {"r"}, {"t3"});
+    swap.attributes = {intsAttr("perm", {0, 1, 3, 2})};
+    GraphNode swap_back = makeNode("Transpose", {"t3"}, {"output"});
+    swap_back.attributes = {intsAttr("perm", {1, 0, 2, 3})};
+    graph.nodes = {to_nhwc, to_nchw, makeNode("Relu", {"t2"}, {"r"}), swap, swap_back};
+    graph.topologicalSort();
+
+    EXPECT_EQ(cancelTransposes(graph, {"output"}), 2u);
+    ASSERT_EQ(graph.sorted_nodes.size(), 2u);
+    EXPECT_EQ(graph.sorted_nodes[0]->inputs, std::vector<std::string>({"input"}));
+    // The second pair does not cancel out, so it becomes a single transpose.
+    EXPECT_EQ(graph.sorted_nodes[1]->inputs, std::vector<std::string>({"r"}));
+    EXPECT_EQ(getIntListAttr(graph.sorted_nodes[1], "perm"), std::vector<int>({1, 0, 3, 2}));
+
+    Tensor input = randomTensor({2, 3, 4, 5}, -0.5f);
+    ExecutionEngine engine;
+    engine.executeGraph(graph, input);
+    EXPECT_EQ(graph.tensors["output"].shape(), std::vector<int>({3, 2, 5, 4}));
+}
+
+// Constant -> shape;  Add(a, b) -> Relu -> bias;  Reshape(input, shape) -> Add(bias) -> output
+static ComputationGraph makeConstantGraph() {
+    ComputationGraph graph;
+    srand(13);
+    graph.tensors["a"] = randomTensor({1, 4}, -0.5f);
+    graph.tensors["b"] = randomTensor({1, 4}, -0.5f);
+
+    GraphNode constant = makeNode("Constant", {}, {"shape"});
+    onnx::AttributeProto value;
+    value.set_name("value");
+    value.set_type(onnx::AttributeProto::TENSOR);
+    const float dims[] = {1.0f, -1.0f};
+    value.mutable_t()->add_dims(2);
+    value.mutable_t()->set_raw_data(dims, sizeof(dims));
+    constant.attributes = {value};
+
+    graph.nodes = {
+        constant,
+        makeNode("Add", {"a", "b"}, {"ab"}),
+        makeNode("Relu", {"ab"}, {"bias"}),
+        makeNode("Reshape", {"input", "shape"}, {"flat"}),
+        makeNode("Add", {"flat", "bias"}, {"output"}),
+    };
+    graph.topologicalSort();
+    return graph;
+}
+
+TEST(GraphOptimizerTest, FoldsConstantSubgraphs) {
+    Tensor input = randomTensor({1, 2, 2});
+    ComputationGraph reference = makeConstantGraph();
+    ExecutionEngine engine;
+    engine.executeGraph(reference, input);
+
+    ComputationGraph graph = makeConstantGraph();
+    EXPECT_EQ(foldConstants(graph), 3u);
+    ASSERT_EQ(graph.sorted_nodes.size(), 2u);
+    EXPECT_EQ(graph.sorted_nodes[0]->op_type, "Reshape");
+    EXPECT_EQ(graph.tensors.at("shape").data(), std::vector<float>({1.0f, -1.0f}));
+    EXPECT_TRUE(graph.tensors.count("bias"));
+    EXPECT_FALSE(graph.tensors.count("a"));
+    EXPECT_FALSE(graph.tensors.count("ab"));
+
+    engine.executeGraph(graph, input);
+    EXPECT_EQ(graph.tensors["output"].data(), reference.tensors["output"].data());
+}
+
+// input [1,2,5,5] -> Conv 3x3 (weights from a Constant node, or an initializer) -> output
+static ComputationGraph makeConstantWeightsGraph(bool weights_from_node) {
+    ComputationGraph graph;
+    srand(31);
+    Tensor weights = randomTensor({4, 2, 3, 3}, -0.5f);  // OIHW
+    graph.tensors["b"] = randomTensor({4});
+    GraphNode conv = makeNode("Conv", {"input", "w", "b"}, {"output"},
+                              {intsAttr("kernel_shape", {3, 3}), intsAttr("pads", {1, 1, 1, 1})});
+    if (!weights_from_node) {
+        graph.tensors["w"] = weights;
+        graph.nodes = {conv};
+    } else {
+        onnx::AttributeProto value;
+        value.set_name("value");
+        value.set_type(onnx::AttributeProto::TENSOR);
+        for (int dim : weights.shape()) value.mutable_t()->add_dims(dim);
+        value.mutable_t()->set_raw_data(weights.data().data(), weights.size() * sizeof(float));
+        graph.nodes = {makeNode("Constant", {}, {"w"}, {value}), conv};
+    }
+    graph.topologicalSort();
+    return graph;
+}
+
+TEST(GraphOptimizerTest, ReordersConvWeightsOfConstantNodes) {
+    Tensor input = randomTensor({1, 2, 5, 5}, -0.5f);
+    ComputationGraph reference = makeConstantWeightsGraph(false);
+    assignLayouts(reference, {"output"});
+    ExecutionEngine engine;
+    engine.executeGraph(reference, input);
+
+    ComputationGraph graph = makeConstantWeightsGraph(true);
+    assignLayouts(graph, {"output"});
+    foldConstants(graph);
+    const GraphNode* conv = findNode(graph, "Conv");
+    ASSERT_TRUE(conv);
+    ASSERT_TRUE(graph.tensors.count(conv->inputs[1]));
+    EXPECT_EQ(graph.tensors.at(conv->inputs[1]).shape(), std::vector<int>({4, 3, 3, 2}));  // OHWI
+    EXPECT_EQ(countOps(graph, "Transpose"), 2u);  // the input and output only
+
+    engine.executeGraph(graph, input);
+    expectNear(graph.tensors["output"], reference.tensors["output"]);
+}
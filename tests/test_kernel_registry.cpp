@@ -0,0 +1,59 @@
+#include <gtest/gtest.h>
+#include "execution_engine.h"
+#include "kernel_registry.h"
+#include "test_utils.h"
+
+namespace {
+
+int scale_prepare_calls = 0;
+
+struct ScaleState : KernelState {
+    float factor = 1.0f;
+};
+
+std::unique_ptr<KernelState> prepareScale(const GraphNode& node, const KernelContext&, const KernelArgs&) {
+    scale_prepare_calls++;
+    auto state = std::make_unique<ScaleState>();
+    for (const auto& attr : node.attributes) {
+        if (attr.name() == "factor") state->factor = attr.f();
+    }
+    return state;
+}
+
+void runScale(KernelState* state, const KernelContext&, const KernelArgs& args) {
+    const Tensor& in = args.input(0);
+    Tensor& out = args.output();
+    out.ensureShape(in.shape());
+    for (size_t i = 0; i < in.size(); ++i) {
+        out.data()[i] = in.data()[i] * static_cast<ScaleState*>(state)->factor;
+    }
+}
+
+} // namespace
+
+TEST(KernelRegistryTest, BuiltinKernelsAreRegistered) {
+    const KernelRegistry& registry = KernelRegistry::instance();
+    for (const char* op : {"Conv", "MaxPool", "Gemm", "MatMul", "Add", "Relu", "Clip", "Softmax",
+                           "BatchNormalization", "GlobalAveragePool", "Transpose", "Reshape", "Flatten", "Constant"}) {
+        const Kernel* kernel = registry.find(op);
+        ASSERT_NE(kernel, nullptr) << op;
+        EXPECT_NE(kernel->run, nullptr) << op;
+    }
+    EXPECT_EQ(registry.find("LSTM"), nullptr);
+}
+
+TEST(KernelRegistryTest, CustomKernelIsPreparedOnce) {
+    KernelRegistry::instance().add("TestScale", {prepareScale, runScale});
+
+    ComputationGraph graph;
+    graph.nodes = {makeNode("TestScale", {"input"}, {"output"}, {floatAttr("factor", 3.0f)})};
+    graph.topologicalSort();
+
+    ExecutionEngine engine;
+    scale_prepare_calls = 0;
+    for (int run = 0; run < 3; ++run) {
+        engine.executeGraph(graph, Tensor({3}, {1.0f, 2.0f, -1.0f}));
+        EXPECT_EQ(graph.tensors["output"].data(), std::vector<float>({3.0f, 6.0f, -3.0f}));
+    }
+    EXPECT_EQ(scale_prepare_calls, 1);
+}
@@ -0,0 +1,156 @@
+#include <gtest/gtest.h>
+#include "execution_engine.h"
+#include "memory_planner.h"
+#include "session.h"
+#include <set>
+#include "test_utils.h"
+
+// input -> Relu -> a -> Relu -> b -> Add(a, b) -> c -> Relu -> d -> Softmax -> output
+static ComputationGraph makeGraph() {
+    ComputationGraph graph;
+    graph.nodes = {
+        makeNode("Relu", {"input"}, {"a"}),
+        makeNode("Relu", {"a"}, {"b"}),
+        makeNode("Add", {"a", "b"}, {"c"}),
+        makeNode("Relu", {"c"}, {"d"}),
+        makeNode("Softmax", {"d"}, {"output"}),
+    };
+    graph.topologicalSort();
+    return graph;
+}
+
+TEST(MemoryPlannerTest, ReusesMemoryOfDeadTensors) {
+    ComputationGraph graph = makeGraph();
+    std::vector<TensorLifetime> lifetimes = computeLifetimes(graph);
+    ASSERT_EQ(lifetimes.size(), 4u);  // "output" is never read, so it is not planned
+
+    std::unordered_map<std::string, std::vector<int>> shapes;
+    for (const auto& name : {"a", "b", "c", "d"}) shapes[name] = {1, 1000};
+    auto plan = planMemory(lifetimes, shapes);
+
+    // Add reads a and b while writing c, so three slots are needed; d reuses one.
+    EXPECT_EQ(plan->unplanned_bytes, 4 * 4032u);
+    EXPECT_EQ(plan->arena_bytes, 3 * 4032u);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(plan->arena.get()) % MemoryPlan::kAlignment, 0u);
+
+    for (const auto& x : lifetimes) {
+        for (const auto& y : lifetimes) {
+            if (x.name == y.name || x.last_use < y.first_use || y.last_use < x.first_use) continue;
+            size_t x_offset = plan->offsets.at(x.name);
+            size_t y_offset = plan->offsets.at(y.name);
+            EXPECT_TRUE(x_offset + 4000 <= y_offset || y_offset + 4000 <= x_offset) << x.name << " overlaps " << y.name;
+        }
+    }
+}
+
+TEST(MemoryPlannerTest, ArenaRunsMatchFirstRun) {
+    ComputationGraph graph = makeGraph();
+    ExecutionEngine engine;
+
+    Tensor input({2, 8});
+    input.fillRandom();
+    engine.executeGraph(graph, input);
+    std::vector<float> expected = graph.tensors["output"].data();
+
+    ASSERT_TRUE(graph.memory_plan);
+    EXPECT_TRUE(graph.tensors["c"].isView());
+    EXPECT_FALSE(graph.tensors["output"].isView());
+
+    engine.executeGraph(graph, input);
+    EXPECT_EQ(graph.tensors["output"].data(), expected);
+
+    // A new input shape replans the arena.
+    Tensor bigger({4, 8});
+    bigger.fillRandom();
+    engine.executeGraph(graph, bigger);
+    EXPECT_EQ(graph.memory_plan->input_shape, bigger.shape());
+    EXPECT_EQ(graph.tensors["c"].shape(), bigger.shape());
+    engine.executeGraph(graph, input);
+    EXPECT_EQ(graph.tensors["output"].data(), expected);
+}
+
+// input -> Relu -> a -> Clip -> b -> Relu -> c -> Relu -> d, with graph outputs a and d.
+static ComputationGraph makeReadOutputGraph() {
+    ComputationGraph graph;
+    graph.nodes = {
+        makeNode("Relu", {"input"}, {"a"}),
+        makeNode("Clip", {"a"}, {"b"}),
+        makeNode("Relu", {"b"}, {"c"}),
+        makeNode("Relu", {"c"}, {"d"}),
+    };
+    graph.outputs = {"a", "d"};
+    graph.topologicalSort();
+    return graph;
+}
+
+TEST(MemoryPlannerTest, GraphOutputsReadByLaterNodesKeepTheirOwnStorage) {
+    ComputationGraph graph = makeReadOutputGraph();
+    for (const auto& lifetime : computeLifetimes(graph)) EXPECT_NE(lifetime.name, "a");
+
+    Tensor input(std::vector<int>{1, 16}, std::vector<float>(16, 10.0f));
+    ExecutionEngine engine;
+    for (int run = 0; run < 2; ++run) {  // profiling run, then the arena
+        engine.executeGraph(graph, input);
+        EXPECT_FALSE(graph.tensors["a"].isView());
+        EXPECT_EQ(graph.tensors["a"].data(), std::vector<float>(16, 10.0f));
+        EXPECT_EQ(graph.tensors["d"].data(), std::vector<float>(16, 6.0f));
+    }
+
+    Session session(makeReadOutputGraph());
+    EXPECT_EQ(session.outputNames(), std::vector<std::string>({"a", "d"}));
+    for (int run = 0; run < 2; ++run) {
+        std::vector<Tensor> outputs = session.run(input);
+        ASSERT_EQ(outputs.size(), 2u);
+        EXPECT_EQ(outputs[0].data(), std::vector<float>(16, 10.0f));
+    }
+}
+
+// Four Relu -> Relu -> Relu chains over the input, summed by a chain of Adds.
+static ComputationGraph makeWideGraph() {
+    ComputationGraph graph;
+    for (int b = 0; b < 4; ++b) {
+        std::string id = std::to_string(b);
+        graph.nodes.push_back(makeNode("Relu", {"input"}, {"x" + id}));
+        graph.nodes.push_back(makeNode("Relu", {"x" + id}, {"y" + id}));
+        graph.nodes.push_back(makeNode("Relu", {"y" + id}, {"z" + id}));
+    }
+    graph.nodes.push_back(makeNode("Add", {"z0", "z1"}, {"s1"}));
+    graph.nodes.push_back(makeNode("Add", {"s1", "z2"}, {"s2"}));
+    graph.nodes.push_back(makeNode("Add", {"s2", "z3"}, {"output"}));
+    graph.topologicalSort();
+    return graph;
+}
+
+TEST(MemoryPlannerTest, MemoryOrderFinishesBranchesFirst) {
+    ComputationGraph fifo_graph = makeWideGraph();
+    ComputationGraph graph = makeWideGraph();
+    Tensor input({1, 1000});
+    input.fillRandom();
+    std::unordered_map<std::string, std::vector<int>> shapes;
+    for (const auto& [name, tensor] : graph.tensors) shapes[name] = input.shape();
+    for (const auto& node : graph.nodes) {
+        for (const auto& name : node.outputs) shapes[name] = input.shape();
+    }
+
+    // FIFO advances all branches in step: four x, then four y while x is read, ...
+    MemoryOrdering ordering = orderForMemory(graph, shapes);
+    EXPECT_EQ(ordering.fifo_peak_bytes, 5 * 4000u);
+    EXPECT_EQ(ordering.peak_bytes, 3 * 4000u);
+    EXPECT_EQ(peakLiveBytes(graph, shapes), ordering.peak_bytes);
+    EXPECT_EQ(peakLiveBytes(fifo_graph, shapes), ordering.fifo_peak_bytes);
+
+    std::set<std::string> produced = {"input"};
+    for (const GraphNode* node : graph.sorted_nodes) {
+        for (const auto& name : node->inputs) EXPECT_TRUE(produced.count(name)) << name;
+        produced.insert(node->outputs.begin(), node->outputs.end());
+    }
+    EXPECT_EQ(graph.sorted_nodes.size(), graph.nodes.size());
+
+    ExecutionEngine engine;
+    engine.executeGraph(fifo_graph, input);
+    engine.executeGraph(graph, input);
+    EXPECT_EQ(graph.tensors["output"].data(), fifo_graph.tensors["output"].data());
+    EXPECT_LT(graph.memory_plan->arena_bytes, fifo_graph.memory_plan->arena_bytes);
+
+    EXPECT_THROW(orderForMemory(graph, shapes), std::runtime_error);
+}
@@ -0,0 +1,123 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <fstream>
+#include "onnx_loader.h"
+#include "execution_engine.h"
+
+TEST(MmapLoaderTest, MatchesStreamLoader) {
+    ONNXModel stream_model;
+    ASSERT_TRUE(stream_model.load("../test_data/simple_matmul_relu.onnx"));
+    ComputationGraph expected = stream_model.parseGraph();
+
+    ONNXModel mapped_model;
+    ASSERT_TRUE(mapped_model.load("../test_data/simple_matmul_relu.onnx", true));
+    ComputationGraph graph = mapped_model.parseGraph();
+
+    ASSERT_EQ(graph.nodes.size(), expected.nodes.size());
+    ASSERT_EQ(graph.tensors.size(), expected.tensors.size());
+    for (const auto& [name, tensor] : expected.tensors) {
+        ASSERT_TRUE(graph.tensors.count(name)) << name;
+        EXPECT_EQ(graph.tensors[name].shape(), tensor.shape());
+        EXPECT_EQ(graph.tensors[name].data(), tensor.data()) << name;
+    }
+
+    Tensor input({1, 224});
+    input.fillRandom();
+    ExecutionEngine engine;
+    ASSERT_NO_THROW(engine.executeGraph(graph, input));
+}
+
+TEST(MmapLoaderTest, ExternalDataIsMapped) {
+    const std::string model_path = "mmap_external_test.onnx";
+    const std::string data_path = "mmap_external_test.onnx.data";
+
+    // Relu(input + weight) with the weight stored in a side file.
+    std::vector<float> weight = {1.0f, -2.0f, 3.0f, -4.0f};
+    {
+        std::ofstream data(data_path, std::ios::binary);
+        std::vector<char> padding(64, 0);
+        data.write(padding.data(), padding.size());
+        data.write(reinterpret_cast<const char*>(weight.data()), weight.size() * sizeof(float));
+    }
+
+    onnx::ModelProto model_proto;
+    auto* graph_proto = model_proto.mutable_graph();
+    graph_proto->add_input()->set_name("input");
+    graph_proto->add_output()->set_name("output");
+    auto* initializer = graph_proto->add_initializer();
+    initializer->set_name("weight");
+    initializer->set_data_type(onnx::TensorProto::FLOAT);
+    initializer->add_dims(1);
+    initializer->add_dims(4);
+    initializer->set_data_location(onnx::TensorProto::EXTERNAL);
+    auto* entry = initializer->add_external_data();
+    entry->set_key("location");
+    entry->set_value(data_path);
+    entry = initializer->add_external_data();
+    entry->set_key("offset");
+    entry->set_value("64");
+    entry = initializer->add_external_data();
+    entry->set_key("length");
+    entry->set_value("16");
+    auto* add = graph_proto->add_node();
+    add->set_op_type("Add");
+    add->add_input("input");
+    add->add_input("weight");
+    add->add_output("sum");
+    auto* relu = graph_proto->add_node();
+    relu->set_op_type("Relu");
+    relu->add_input("sum");
+    relu->add_output("output");
+    {
+        std::ofstream out(model_path, std::ios::binary);
+        ASSERT_TRUE(model_proto.SerializeToOstream(&out));
+    }
+
+    for (bool use_mmap : {false, true}) {
+        ONNXModel model;
+        ASSERT_TRUE(model.load(model_path, use_mmap));
+        ComputationGraph graph = model.parseGraph();
+
+        EXPECT_EQ(graph.tensors["weight"].isView(), use_mmap);
+        EXPECT_EQ(graph.tensors["weight"].data(), weight);
+
+        ExecutionEngine engine;
+        engine.executeGraph(graph, Tensor({1, 4}, {0.0f, 0.0f, 0.0f, 0.0f}));
+        EXPECT_EQ(graph.tensors["output"].data(), std::vector<float>({1.0f, 0.0f, 3.0f, 0.0f}));
+    }
+
+    std::remove(model_path.c_str());
+    std::remove(data_path.c_str());
+}
+
+TEST(MmapLoaderTest, RejectsInitializerSizeMismatch) {
+    const std::string model_path = "mmap_mismatch_test.onnx";
+
+    // Three floats of data for a [1,4] weight.
+    std::vector<float> weight = {1.0f, -2.0f, 3.0f};
+    onnx::ModelProto model_proto;
+    auto* graph_proto = model_proto.mutable_graph();
+    auto* initializer = graph_proto->add_initializer();
+    initializer->set_name("weight");
+    initializer->set_data_type(onnx::TensorProto::FLOAT);
+    initializer->add_dims(1);
+    initializer->add_dims(4);
+    initializer->set_raw_data(reinterpret_cast<const char*>(weight.data()), weight.size() * sizeof(float));
+    {
+        std::ofstream out(model_path, std::ios::binary);
+        ASSERT_TRUE(model_proto.SerializeToOstream(&out));
+    }
+
+    for (bool use_mmap : {false, true}) {
+        ONNXModel model;
+        ASSERT_TRUE(model.load(model_path, use_mmap));
+        try {
+            model.parseGraph();
+            ADD_FAILURE() << "expected a size mismatch, use_mmap=" << use_mmap;
+        } catch (const std::runtime_error& e) {
+            EXPECT_NE(std::string(e.what()).find("weight"), std::string::npos) << e.what();
+        }
+    }
+
+    std::remove(model_path.c_str());
+}
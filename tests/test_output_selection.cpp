@@ -0,0 +1,95 @@
+#include <gtest/gtest.h>
+#include "execution_engine.h"
+#include "memory_planner.h"
+#include "test_utils.h"
+
+// input -> Relu -> a -> Softmax -> head1
+//                  a -> Relu -> b -> Add(b, a) -> c -> Relu -> head2
+static ComputationGraph makeGraph() {
+    ComputationGraph graph;
+    graph.nodes = {
+        makeNode("Relu", {"input"}, {"a"}),
+        makeNode("Softmax", {"a"}, {"head1"}),
+        makeNode("Relu", {"a"}, {"b"}),
+        makeNode("Add", {"b", "a"}, {"c"}),
+        makeNode("Relu", {"c"}, {"head2"}),
+    };
+    graph.topologicalSort();
+    return graph;
+}
+
+static Tensor makeInput(unsigned seed) {
+    srand(seed);
+    Tensor input({4, 16});
+    input.fillRandom();
+    return input;
+}
+
+TEST(OutputSelectionTest, RunsOnlyTheNodesOfRequestedOutputs) {
+    ComputationGraph reference = makeGraph();
+    ExecutionEngine engine;
+    Tensor first = makeInput(1);
+    Tensor second = makeInput(2);
+    engine.executeGraph(reference, second);
+
+    ComputationGraph graph = makeGraph();
+    engine.executeGraph(graph, first);
+    const std::vector<float> stale_head2 = graph.tensors["head2"].data();
+
+    engine.executeGraph(graph, second, {"head1"});
+    EXPECT_EQ(graph.sorted_nodes.size(), 2u);
+    EXPECT_EQ(graph.tensors["head1"].data(), reference.tensors["head1"].data());
+    EXPECT_EQ(graph.tensors["head2"].data(), stale_head2);  // its head did not run
+
+    engine.executeGraph(graph, second, {});  // back to every node
+    EXPECT_EQ(graph.sorted_nodes.size(), 5u);
+    EXPECT_EQ(graph.tensors["head2"].data(), reference.tensors["head2"].data());
+}
+
+TEST(OutputSelectionTest, KeepsThePlanOfEachOutputSet) {
+    ComputationGraph graph = makeGraph();
+    ExecutionEngine engine;
+    Tensor input = makeInput(3);
+
+    engine.executeGraph(graph, input, {"head1"});
+    auto head1_compiled = graph.compiled;
+    auto head1_plans = graph.plan_cache;
+    engine.executeGraph(graph, input, {"head2"});
+    EXPECT_NE(graph.compiled, head1_compiled);
+    std::vector<float> head2 = graph.tensors["head2"].data();
+
+    engine.executeGraph(graph, input, {"head1"});
+    EXPECT_EQ(graph.compiled, head1_compiled);
+    EXPECT_EQ(graph.plan_cache, head1_plans);
+    EXPECT_EQ(head1_plans->hits(), 1u);
+    EXPECT_EQ(head1_plans->misses(), 1u);
+
+    engine.executeGraph(graph, makeInput(4), {"head2"});
+    engine.executeGraph(graph, input, {"head2"});
+    EXPECT_EQ(graph.tensors["head2"].data(), head2);
+}
+
+TEST(OutputSelectionTest, RequestedIntermediatesAreKept) {
+    for (auto backend : {ExecutionEngine::Backend::Native, ExecutionEngine::Backend::XnnpackSubgraph}) {
+        ComputationGraph graph = makeGraph();
+        ExecutionEngine engine(backend);
+        Tensor input = makeInput(5);
+        engine.executeGraph(graph, input, {"a", "head2"});
+        ASSERT_EQ(graph.tensors["a"].size(), input.size());
+        for (size_t i = 0; i < input.size(); ++i) {
+            EXPECT_EQ(graph.tensors["a"].data()[i], std::max(0.0f, input.data()[i]));
+        }
+        if (backend == ExecutionEngine::Backend::Native) {  // the subgraph backend has no arena plan
+            ASSERT_TRUE(graph.memory_plan);
+            EXPECT_FALSE(graph.memory_plan->offsets.count("a"));
+        }
+    }
+}
+
+TEST(OutputSelectionTest, RejectsUnknownOutputs) {
+    ComputationGraph graph = makeGraph();
+    ExecutionEngine engine;
+    EXPECT_THROW(engine.selectOutputs(graph, {"missing"}), std::runtime_error);
+    engine.executeGraph(graph, makeInput(6));
+    EXPECT_EQ(graph.sorted_nodes.size(), 5u);
+}
@@ -0,0 +1,142 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include "operators.h"
+#include "threading_runtime.h"
+
+// Each native operator on a multi-threaded pool against the same operator on
+// the calling thread alone. Tiling must not change a single bit of the result.
+class ParallelOperatorsTest : public ::testing::Test {
+protected:
+    ParallelOperatorsTest() : runtime_(makeOptions()) {}
+
+    static ThreadingOptions makeOptions() {
+        ThreadingOptions options;
+        options.threads = 4;
+        return options;
+    }
+
+    static Tensor random(const std::vector<int>& shape, unsigned seed) {
+        srand(seed);
+        Tensor tensor(shape);
+        tensor.fillRandom();
+        return tensor;
+    }
+
+    static void expectIdentical(const Tensor& actual, const Tensor& expected) {
+        ASSERT_EQ(actual.shape(), expected.shape());
+        for (size_t i = 0; i < expected.size(); ++i) {
+            ASSERT_EQ(actual.data()[i], expected.data()[i]) << "at " << i;
+        }
+    }
+
+    pthreadpool_t pool() const { return runtime_.threadpool(); }
+
+    ThreadingRuntime runtime_;
+    Operators ops_;
+};
+
+TEST_F(ParallelOperatorsTest, MatmulAndGemm) {
+    Tensor a = random({37, 300}, 1);
+    Tensor b = random({300, 129}, 2);
+    Tensor bt = random({129, 300}, 3);
+    Tensor bias = random({129}, 4);
+    Tensor serial, parallel;
+
+    ops_.matmul(a, b, serial);
+    ops_.matmul(a, b, parallel, pool());
+    expectIdentical(parallel, serial);
+
+    ops_.gemm(a, b, bias, 1.0f, 1.0f, serial, 0.0f, 6.0f);
+    ops_.gemm(a, b, bias, 1.0f, 1.0f, parallel, 0.0f, 6.0f, pool());
+    expectIdentical(parallel, serial);
+
+    // A single row, as with batch 1, is split along the columns.
+    Tensor row = random({1, 300}, 5);
+    ops_.gemm_transB(row, bt, bias, 0.5f, 2.0f, serial);
+    ops_.gemm_transB(row, bt, bias, 0.5f, 2.0f, parallel, Operators::kNoMin, Operators::kNoMax, pool());
+    expectIdentical(parallel, serial);
+}
+
+TEST_F(ParallelOperatorsTest, Elementwise) {
+    Tensor a = random({3, 41, 29, 24}, 6);
+    Tensor b = random({3, 41, 29, 24}, 7);
+    Tensor serial, parallel;
+
+    ops_.add(a, b, serial);
+    ops_.add(a, b, parallel, pool());
+    expectIdentical(parallel, serial);
+
+    ops_.relu(a, serial);
+    ops_.relu(a, parallel, pool());
+    expectIdentical(parallel, serial);
+
+    ops_.clip(a, -0.25f, 0.5f, serial);
+    ops_.clip(a, -0.25f, 0.5f, parallel, pool());
+    expectIdentical(parallel, serial);
+}
+
+TEST_F(ParallelOperatorsTest, Softmax) {
+    for (int size : {10, 100000}) {
+        Tensor input = random({1, size}, 8);
+        Tensor serial, parallel;
+        ops_.softmax(input, -1, false, serial);
+        ops_.softmax(input, -1, false, parallel, pool());
+        expectIdentical(parallel, serial);
+
+        float sum = 0.0f;
+        for (float value : parallel.data()) sum += value;
+        EXPECT_NEAR(sum, 1.0f, 1e-3f);
+    }
+}
+
+TEST_F(ParallelOperatorsTest, ChannelOperators) {
+    Tensor input = random({2, 33, 17, 40}, 9);
+    Tensor scale = random({40}, 10), bias = random({40}, 11), mean = random({40}, 12);
+    Tensor var({40});
+    for (float& value : var.data()) value = 0.5f;
+    Tensor serial, parallel;
+
+    ops_.batchNorm(input, scale, bias, mean, var, 1e-5f, serial);
+    ops_.batchNorm(input, scale, bias, mean, var, 1e-5f, parallel, pool());
+    expectIdentical(parallel, serial);
+
+    ops_.globalAveragePool(input, serial);
+    ops_.globalAveragePool(input, parallel, pool());
+    expectIdentical(parallel, serial);
+
+    ops_.transpose(input, {0, 3, 1, 2}, serial);
+    ops_.transpose(input, {0, 3, 1, 2}, parallel, pool());
+    expectIdentical(parallel, serial);
+}
+
+TEST(ParallelForTilesTest, CoversEveryIndexOnceInTilesOfAtLeastTheGrain) {
+    ThreadingOptions options;
+    options.threads = 4;
+    ThreadingRuntime runtime(options);
+
+    std::vector<std::atomic<int>> visits(10000);
+    std::atomic<size_t> smallest{visits.size()};
+    parallelForTiles(runtime.threadpool(), visits.size(), 700, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) ++visits[i];
+        if (end != visits.size()) smallest = std::min<size_t>(smallest, end - begin);
+    });
+    for (size_t i = 0; i < visits.size(); ++i) ASSERT_EQ(visits[i], 1) << "at " << i;
+    EXPECT_GE(smallest, 700u);
+
+    // Ranges within the grain run as a single tile.
+    int calls = 0;
+    parallelForTiles(runtime.threadpool(), 700, 700, [&](size_t begin, size_t end) {
+        ++calls;
+        EXPECT_EQ(begin, 0u);
+        EXPECT_EQ(end, 700u);
+    });
+    EXPECT_EQ(calls, 1);
+
+    std::vector<std::atomic<int>> cells(13 * 501);
+    parallelForTiles2D(runtime.threadpool(), 13, 501, 1, 64, [&](size_t r0, size_t r1, size_t c0, size_t c1) {
+        for (size_t r = r0; r < r1; ++r) {
+            for (size_t c = c0; c < c1; ++c) ++cells[r * 501 + c];
+        }
+    });
+    for (size_t i = 0; i < cells.size(); ++i) ASSERT_EQ(cells[i], 1) << "at " << i;
+}
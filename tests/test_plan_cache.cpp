@@ -0,0 +1,129 @@
+#include <gtest/gtest.h>
+#include "execution_engine.h"
+#include "memory_planner.h"
+#include "xnn_subgraph.h"
+#include "test_utils.h"
+
+// input [N,H,W,3] -> Conv -> Relu -> GlobalAveragePool -> Flatten -> Gemm -> output [N,5]
+static ComputationGraph makeGraph() {
+    ComputationGraph graph;
+    srand(11);
+    graph.tensors["conv_w"] = Tensor({4, 3, 3, 3});
+    graph.tensors["conv_b"] = Tensor({4});
+    graph.tensors["fc_w"] = Tensor({5, 4});
+    graph.tensors["fc_b"] = Tensor({5});
+    for (auto& [name, tensor] : graph.tensors) tensor.fillRandom();
+
+    GraphNode conv = makeNode("Conv", {"input", "conv_w", "conv_b"}, {"conv"});
+    conv.attributes = {intsAttr("kernel_shape", {3, 3}), intsAttr("pads", {1, 1, 1, 1})};
+    GraphNode gemm = makeNode("Gemm", {"flat", "fc_w", "fc_b"}, {"output"});
+    gemm.attributes = {intAttr("transB", 1)};
+
+    graph.nodes = {
+        conv,
+        makeNode("Relu", {"conv"}, {"relu"}),
+        makeNode("GlobalAveragePool", {"relu"}, {"pool"}),
+        makeNode("Flatten", {"pool"}, {"flat"}),
+        gemm,
+    };
+    graph.topologicalSort();
+    return graph;
+}
+
+static Tensor makeInput(std::vector<int> shape, unsigned seed) {
+    srand(seed);
+    Tensor input(shape);
+    input.fillRandom();
+    return input;
+}
+
+TEST(PlanCacheTest, AlternatingShapesReuseWarmPlans) {
+    ComputationGraph graph = makeGraph();
+    ExecutionEngine engine;
+    Tensor small = makeInput({1, 6, 6, 3}, 1);
+    Tensor large = makeInput({2, 8, 8, 3}, 2);
+
+    engine.executeGraph(graph, small);
+    std::vector<float> small_expected = graph.tensors["output"].data();
+    engine.executeGraph(graph, large);
+    std::vector<float> large_expected = graph.tensors["output"].data();
+    ASSERT_TRUE(graph.plan_cache);
+    EXPECT_EQ(graph.plan_cache->misses(), 2u);
+
+    for (int i = 0; i < 3; ++i) {
+        engine.executeGraph(graph, small);
+        EXPECT_EQ(graph.tensors["output"].shape(), std::vector<int>({1, 5}));
+        EXPECT_EQ(graph.tensors["output"].data(), small_expected);
+        engine.executeGraph(graph, large);
+        EXPECT_EQ(graph.tensors["output"].shape(), std::vector<int>({2, 5}));
+        EXPECT_EQ(graph.tensors["output"].data(), large_expected);
+    }
+    EXPECT_EQ(graph.plan_cache->misses(), 2u);
+    EXPECT_EQ(graph.plan_cache->hits(), 6u);
+    EXPECT_EQ(graph.plan_cache->size(), 2u);
+}
+
+TEST(PlanCacheTest, EvictsLeastRecentlyUsedPlan) {
+    PlanCache cache(2);
+    for (int batch : {1, 2, 3}) {
+        auto plan = std::make_shared<MemoryPlan>();
+        plan->input_shape = {batch, 4};
+        cache.insert(plan);
+    }
+    EXPECT_EQ(cache.size(), 2u);
+    EXPECT_FALSE(cache.find({1, 4}));
+    EXPECT_TRUE(cache.find({2, 4}));
+
+    // {2, 4} is now the most recently used, so {3, 4} goes first.
+    auto plan = std::make_shared<MemoryPlan>();
+    plan->input_shape = {4, 4};
+    cache.insert(plan);
+    EXPECT_FALSE(cache.find({3, 4}));
+    EXPECT_TRUE(cache.find({2, 4}));
+    EXPECT_EQ(cache.hits(), 2u);
+    EXPECT_EQ(cache.misses(), 2u);
+
+    cache.setCapacity(0);
+    EXPECT_EQ(cache.size(), 0u);
+}
+
+TEST(PlanCacheTest, BatchedRunMatchesPerSampleRuns) {
+    ComputationGraph graph = makeGraph();
+    ExecutionEngine engine;
+    Tensor batch = makeInput({3, 7, 5, 3}, 3);
+    engine.executeGraph(graph, batch);
+    std::vector<float> batched = graph.tensors["output"].data();
+    ASSERT_EQ(batched.size(), 15u);
+
+    const size_t sample_size = 7 * 5 * 3;
+    for (size_t n = 0; n < 3; ++n) {
+        std::vector<float> sample(batch.data().begin() + n * sample_size, batch.data().begin() + (n + 1) * sample_size);
+        engine.executeGraph(graph, Tensor({1, 7, 5, 3}, sample));
+        for (size_t i = 0; i < 5; ++i) {
+            EXPECT_NEAR(graph.tensors["output"].data()[i], batched[n * 5 + i], 1e-4f) << "sample " << n;
+        }
+    }
+}
+
+TEST(PlanCacheTest, XnnSegmentIsReshapedInPlace) {
+    ComputationGraph native_graph = makeGraph();
+    ComputationGraph graph = makeGraph();
+    ExecutionEngine native;
+    ExecutionEngine engine(ExecutionEngine::Backend::XnnpackSubgraph);
+
+    engine.executeGraph(graph, makeInput({1, 6, 6, 3}, 4));
+    ASSERT_EQ(graph.xnn_plan->steps.size(), 1u);
+    XnnSegment& segment = *graph.xnn_plan->steps[0].segment;
+    ASSERT_TRUE(segment.runtime);
+    xnn_runtime_t runtime = segment.runtime;
+
+    Tensor input = makeInput({4, 6, 6, 3}, 5);
+    engine.executeGraph(graph, input);
+    native.executeGraph(native_graph, input);
+    EXPECT_EQ(segment.runtime, runtime);
+    EXPECT_EQ(segment.output_shapes, std::vector<std::vector<int>>({{4, 5}}));
+    ASSERT_EQ(graph.tensors["output"].shape(), native_graph.tensors["output"].shape());
+    for (size_t i = 0; i < graph.tensors["output"].size(); ++i) {
+        EXPECT_NEAR(graph.tensors["output"].data()[i], native_graph.tensors["output"].data()[i], 1e-4f);
+    }
+}
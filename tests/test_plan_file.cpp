@@ -0,0 +1,76 @@
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include "onnx_loader.h"
+#include "plan_file.h"
+#include "execution_engine.h"
+
+TEST(PlanFileTest, RoundTripSimpleModel) {
+    const std::string plan_path = "simple_matmul_relu.tplan";
+
+    ONNXModel model;
+    ASSERT_TRUE(model.load("../test_data/simple_matmul_relu.onnx"));
+    ComputationGraph expected = model.parseGraph();
+    ASSERT_TRUE(savePlan(expected, plan_path));
+    ASSERT_TRUE(isPlanFile(plan_path));
+    EXPECT_FALSE(isPlanFile("../test_data/simple_matmul_relu.onnx"));
+
+    ComputationGraph graph;
+    ASSERT_TRUE(loadPlan(plan_path, graph));
+
+    ASSERT_EQ(graph.sorted_nodes.size(), expected.sorted_nodes.size());
+    for (size_t i = 0; i < graph.sorted_nodes.size(); ++i) {
+        EXPECT_EQ(graph.sorted_nodes[i]->op_type, expected.sorted_nodes[i]->op_type);
+        EXPECT_EQ(graph.sorted_nodes[i]->inputs, expected.sorted_nodes[i]->inputs);
+        EXPECT_EQ(graph.sorted_nodes[i]->outputs, expected.sorted_nodes[i]->outputs);
+        EXPECT_EQ(graph.sorted_nodes[i]->attributes.size(), expected.sorted_nodes[i]->attributes.size());
+    }
+
+    EXPECT_FALSE(expected.outputs.empty());
+    EXPECT_EQ(graph.outputs, expected.outputs);
+
+    ASSERT_EQ(graph.tensors.size(), expected.tensors.size());
+    for (const auto& [name, tensor] : expected.tensors) {
+        const Tensor& loaded = graph.tensors[name];
+        EXPECT_TRUE(loaded.isView());
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(loaded.data().data()) % 64, 0u);
+        EXPECT_EQ(loaded.shape(), tensor.shape());
+        EXPECT_EQ(loaded.data(), tensor.data());
+    }
+
+    Tensor input({1, 224});
+    input.fillRandom();
+    ExecutionEngine engine;
+    engine.executeGraph(expected, input);
+    engine.executeGraph(graph, input);
+    const std::string& output = expected.sorted_nodes.back()->outputs[0];
+    EXPECT_EQ(graph.tensors[output].data(), expected.tensors[output].data());
+
+    std::remove(plan_path.c_str());
+}
+
+TEST(PlanFileTest, RejectsTensorsWhoseSizeDisagreesWithTheirShape) {
+    const std::string plan_path = "corrupt.tplan";
+    ComputationGraph source;
+    source.tensors["w"] = Tensor({2, 3});
+    source.nodes = {GraphNode{"Add", {"input", "w"}, {"output"}, {}}};
+    source.topologicalSort();
+
+    // Metadata starts right after the 48-byte header with the only tensor:
+    // u32 name length, "w", u32 rank, i32 dims[2], u64 offset, u64 bytes.
+    const size_t second_dim = 48 + 4 + 1 + 4 + 4;
+    for (int32_t dim : {4, -3}) {
+        ASSERT_TRUE(savePlan(source, plan_path));
+        ComputationGraph graph;
+        ASSERT_TRUE(loadPlan(plan_path, graph));
+        {
+            std::fstream file(plan_path, std::ios::binary | std::ios::in | std::ios::out);
+            file.seekp(second_dim);
+            file.write(reinterpret_cast<const char*>(&dim), sizeof(dim));
+        }
+        ComputationGraph corrupt;
+        EXPECT_FALSE(loadPlan(plan_path, corrupt)) << "dim " << dim;
+    }
+    std::remove(plan_path.c_str());
+}
@@ -0,0 +1,74 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include "replicated_session.h"
+#include "test_utils.h"
+
+TEST(CpuTopologyTest, ParsesCpuLists) {
+    EXPECT_EQ(parseCpuList("0-3,8,10-11\n"), (std::vector<int>{0, 1, 2, 3, 8, 10, 11}));
+    EXPECT_EQ(parseCpuList("5"), std::vector<int>{5});
+    EXPECT_TRUE(parseCpuList("").empty());
+    EXPECT_FALSE(numaNodeCpus().empty());
+    EXPECT_FALSE(numaNodeCpus()[0].empty());
+}
+
+TEST(CpuTopologyTest, GroupsNeverSpanNodes) {
+    const std::vector<std::vector<int>> nodes = {{0, 1, 2, 3}, {4, 5, 6, 7}};
+    EXPECT_EQ(cpuGroups(nodes, 0), nodes);
+    EXPECT_EQ(cpuGroups(nodes, 1), (std::vector<std::vector<int>>{{0, 1, 2, 3, 4, 5, 6, 7}}));
+    EXPECT_EQ(cpuGroups(nodes, 4), (std::vector<std::vector<int>>{{0, 1}, {2, 3}, {4, 5}, {6, 7}}));
+    EXPECT_EQ(cpuGroups(nodes, 3), (std::vector<std::vector<int>>{{0, 1}, {2, 3}, {4, 5, 6, 7}}));
+    // No empty groups on a machine with fewer CPUs than groups.
+    EXPECT_EQ(cpuGroups({{0}}, 4), std::vector<std::vector<int>>{{0}});
+}
+
+TEST(ReplicatedSessionTest, RoundRobinsRequestsAcrossReplicas) {
+    constexpr int kThreads = 4;
+    constexpr int kRunsPerThread = 6;
+    ComputationGraph reference = makeSessionGraph(23);
+    ExecutionEngine engine;
+    std::vector<Tensor> inputs, expected;
+    for (int i = 0; i < kThreads * kRunsPerThread; ++i) {
+        inputs.push_back(makeSessionInput(i, 1 + i % 2));
+        engine.executeGraph(reference, inputs.back());
+        expected.push_back(reference.tensors["output"]);
+    }
+
+    ReplicaOptions options;
+    options.cpu_groups = {{0}, {0}, {0}};
+    options.threads = 2;
+    ReplicatedSession replicas(makeSessionGraph(23), options);
+    ASSERT_EQ(replicas.numReplicas(), 3u);
+    EXPECT_EQ(replicas.replicaCpus(1), std::vector<int>{0});
+
+    std::vector<std::vector<Tensor>> results(inputs.size());
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&, t] {
+            for (int i = t; i < kThreads * kRunsPerThread; i += kThreads) results[i] = replicas.run(inputs[i]);
+        });
+    }
+    for (auto& thread : threads) thread.join();
+
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        ASSERT_EQ(results[i].size(), 1u);
+        ASSERT_EQ(results[i][0].shape(), expected[i].shape());
+        for (size_t j = 0; j < expected[i].size(); ++j) ASSERT_EQ(results[i][0].data()[j], expected[i].data()[j]);
+    }
+    EXPECT_EQ(replicas.requestsPerReplica(), (std::vector<size_t>{8, 8, 8}));
+}
+
+TEST(ReplicatedSessionTest, ReplicasOwnTheirWeights) {
+    ComputationGraph graph = makeSessionGraph(23);
+    ReplicaOptions options;
+    options.cpu_groups = {{0}, {0}};
+    ReplicatedSession replicas(graph, options);
+
+    const float* first = replicas.replica(0).model().tensors.at("c1_w").data().data();
+    const float* second = replicas.replica(1).model().tensors.at("c1_w").data().data();
+    EXPECT_NE(first, second);
+    EXPECT_NE(first, graph.tensors.at("c1_w").data().data());
+    EXPECT_EQ(replicas.replica(0).engine().threading().threads(), 1u);
+
+    EXPECT_THROW(replicas.run(makeSessionInput(1, 1), {"missing"}), std::runtime_error);
+    EXPECT_EQ(replicas.run(makeSessionInput(1, 1)).size(), 1u);
+}
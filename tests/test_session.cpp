@@ -0,0 +1,82 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include "session.h"
+#include "test_utils.h"
+
+static void expectEqual(const Tensor& actual, const Tensor& expected) {
+    ASSERT_EQ(actual.shape(), expected.shape());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        ASSERT_EQ(actual.data()[i], expected.data()[i]) << "at " << i;
+    }
+}
+
+TEST(SessionTest, ConcurrentRunsMatchSequentialRuns) {
+    constexpr int kThreads = 6;
+    constexpr int kRunsPerThread = 8;
+    std::vector<Tensor> inputs, expected;
+    ComputationGraph reference = makeSessionGraph(17);
+    ExecutionEngine engine;
+    for (int i = 0; i < kThreads * kRunsPerThread; ++i) {
+        inputs.push_back(makeSessionInput(i, 1 + i % 3));
+        engine.executeGraph(reference, inputs.back());
+        expected.push_back(reference.tensors["output"]);
+    }
+
+    Session session(makeSessionGraph(17));
+    ASSERT_EQ(session.outputNames(), std::vector<std::string>{"output"});
+    std::vector<std::vector<Tensor>> results(inputs.size());
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&, t] {
+            for (int i = t; i < kThreads * kRunsPerThread; i += kThreads) results[i] = session.run(inputs[i]);
+        });
+    }
+    for (auto& thread : threads) thread.join();
+
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        ASSERT_EQ(results[i].size(), 1u);
+        expectEqual(results[i][0], expected[i]);
+    }
+    EXPECT_GE(session.numContexts(), 1u);
+    EXPECT_LE(session.numContexts(), static_cast<size_t>(kThreads));
+}
+
+TEST(SessionTest, ContextsShareTheModelWeights) {
+    Session session(makeSessionGraph(17));
+    const float* weights = session.model().tensors.at("c1_w").data().data();
+
+    // Two contexts at once: the second run starts while the first holds its context.
+    Tensor input = makeSessionInput(3, 1);
+    std::vector<Tensor> first, second;
+    std::thread other([&] { first = session.run(input); });
+    second = session.run(input);
+    other.join();
+    expectEqual(first[0], second[0]);
+
+    EXPECT_EQ(session.model().tensors.at("c1_w").data().data(), weights);
+    EXPECT_FALSE(session.model().tensors.count("c1"));
+    if (session.numContexts() > 1) {
+        // Each context created its own Conv operators against the shared cache.
+        EXPECT_GT(session.weightsCache()->stats().hits, 0u);
+    }
+}
+
+TEST(SessionTest, ReturnsRequestedOutputs) {
+    ComputationGraph reference = makeSessionGraph(17);
+    ExecutionEngine engine;
+    Tensor input = makeSessionInput(5, 2);
+    engine.executeGraph(reference, input, {"r1", "output"});
+
+    Session session(makeSessionGraph(17));
+    std::vector<Tensor> outputs = session.run(input, {"r1", "output"});
+    ASSERT_EQ(outputs.size(), 2u);
+    expectEqual(outputs[0], reference.tensors["r1"]);
+    expectEqual(outputs[1], reference.tensors["output"]);
+
+    // Outputs are owned copies, unaffected by later runs.
+    session.run(makeSessionInput(6, 2));
+    expectEqual(outputs[1], reference.tensors["output"]);
+
+    EXPECT_THROW(session.run(input, {"missing"}), std::runtime_error);
+    EXPECT_EQ(session.run(input).size(), 1u);
+}
@@ -0,0 +1,94 @@
+#include <gtest/gtest.h>
+#include "execution_engine.h"
+#include "memory_planner.h"
+#include "onnx_loader.h"
+#include "shape_inference.h"
+#include "test_utils.h"
+
+// input [1,6,6,3] -> Conv 3x3/2 -> Relu -> MaxPool 2x2/2 -> Reshape -> Gemm -> Softmax
+static ComputationGraph makeGraph(int fc_inputs = 4) {
+    ComputationGraph graph;
+    graph.tensors["conv_w"] = Tensor({4, 3, 3, 3});
+    graph.tensors["conv_b"] = Tensor({4});
+    graph.tensors["shape"] = Tensor({2}, {1.0f, -1.0f});
+    graph.tensors["fc_w"] = Tensor({5, fc_inputs});
+    graph.tensors["fc_b"] = Tensor({5});
+    for (auto name : {"conv_w", "conv_b", "fc_w", "fc_b"}) graph.tensors[name].fillRandom();
+
+    onnx::AttributeProto transB;
+    transB.set_name("transB");
+    transB.set_type(onnx::AttributeProto::INT);
+    transB.set_i(1);
+
+    graph.nodes = {
+        makeNode("Conv", {"input", "conv_w", "conv_b"}, {"conv"},
+                 {intsAttr("kernel_shape", {3, 3}), intsAttr("strides", {2, 2}), intsAttr("pads", {1, 1, 1, 1})}),
+        makeNode("Relu", {"conv"}, {"relu"}),
+        makeNode("MaxPool", {"relu"}, {"pool"}, {intsAttr("kernel_shape", {2, 2}), intsAttr("strides", {2, 2})}),
+        makeNode("Reshape", {"pool", "shape"}, {"flat"}),
+        makeNode("Gemm", {"flat", "fc_w", "fc_b"}, {"logits"}, {transB}),
+        makeNode("Softmax", {"logits"}, {"output"}),
+    };
+    graph.topologicalSort();
+    return graph;
+}
+
+TEST(ShapeInferenceTest, InfersShapesAndCosts) {
+    ComputationGraph graph = makeGraph();
+    GraphShapes shapes = inferShapes(graph, {1, 6, 6, 3});
+
+    ASSERT_TRUE(shapes.complete);
+    EXPECT_EQ(shapes.shapes.at("conv"), std::vector<int>({1, 3, 3, 4}));
+    EXPECT_EQ(shapes.shapes.at("pool"), std::vector<int>({1, 1, 1, 4}));
+    EXPECT_EQ(shapes.shapes.at("flat"), std::vector<int>({1, 4}));
+    EXPECT_EQ(shapes.shapes.at("output"), std::vector<int>({1, 5}));
+
+    ASSERT_EQ(shapes.nodes.size(), 6u);
+    EXPECT_EQ(shapes.nodes[0].flops, 2u * (3 * 3 * 4) * (3 * 3 * 3));  // Conv
+    EXPECT_EQ(shapes.nodes[4].flops, 2u * 5 * 4);                      // Gemm
+    EXPECT_EQ(shapes.nodes[0].output_bytes, 36 * sizeof(float));
+    EXPECT_EQ(shapes.activation_bytes, (36 + 36 + 4 + 4 + 5 + 5) * sizeof(float));
+}
+
+TEST(ShapeInferenceTest, RejectsMismatchedModel) {
+    ComputationGraph graph = makeGraph(7);
+    EXPECT_THROW(inferShapes(graph, {1, 6, 6, 3}), std::runtime_error);
+
+    ExecutionEngine engine;
+    EXPECT_THROW(engine.prepare(graph, {1, 6, 6, 3}), std::runtime_error);
+}
+
+TEST(ShapeInferenceTest, PrepareAllocatesActivationsUpFront) {
+    ComputationGraph graph = makeGraph();
+    ExecutionEngine engine;
+    engine.prepare(graph, {1, 6, 6, 3});
+
+    ASSERT_TRUE(graph.memory_plan);
+    EXPECT_TRUE(graph.tensors["conv"].isView());
+    EXPECT_EQ(graph.tensors["conv"].shape(), std::vector<int>({1, 3, 3, 4}));
+    EXPECT_EQ(graph.tensors["output"].shape(), std::vector<int>({1, 5}));
+
+    const float* conv_data = graph.tensors["conv"].data().data();
+    const float* output_data = graph.tensors["output"].data().data();
+    Tensor input({1, 6, 6, 3});
+    input.fillRandom();
+    engine.executeGraph(graph, input);
+    EXPECT_EQ(graph.tensors["conv"].data().data(), conv_data);
+    EXPECT_EQ(graph.tensors["output"].data().data(), output_data);
+}
+
+TEST(ShapeInferenceTest, MatchesExecutedShapes) {
+    ONNXModel model;
+    ASSERT_TRUE(model.load("../test_data/simple_matmul_relu.onnx"));
+    ComputationGraph graph = model.parseGraph();
+    GraphShapes shapes = inferShapes(graph, {1, 224});
+    ASSERT_TRUE(shapes.complete);
+
+    ExecutionEngine engine;
+    Tensor input({1, 224});
+    input.fillRandom();
+    engine.executeGraph(graph, input);
+    for (const auto& [name, shape] : shapes.shapes) {
+        EXPECT_EQ(graph.tensors[name].shape(), shape) << name;
+    }
+}
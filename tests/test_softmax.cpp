@@ -16,3 +16,35 @@ TEST(SoftmaxTest, BasicSoftmax) {
     // Verify sum is close to 1
     EXPECT_NEAR(sum, 1.0f, 1e-5f);
 }
+
+TEST(SoftmaxTest, NormalizesAlongAxis) {
+    Tensor input({2, 3, 4});
+    input.fillRandom();
+    Operators ops;
+
+    // axis 1: every (i, k) column over j sums to 1.
+    Tensor output = ops.softmax(input, 1);
+    for (int i = 0; i < 2; ++i) {
+        for (int k = 0; k < 4; ++k) {
+            float sum = 0.0f;
+            for (int j = 0; j < 3; ++j) sum += output.data()[(i * 3 + j) * 4 + k];
+            EXPECT_NEAR(sum, 1.0f, 1e-5f);
+        }
+    }
+
+    // Default (last) axis matches axis 2, and each batch row stays independent.
+    Tensor last = ops.softmax(input);
+    EXPECT_TRUE(last.data() == std::vector<float>(ops.softmax(input, 2).data()));
+    Tensor first_row({1, 3, 4}, std::vector<float>(input.data().begin(), input.data().begin() + 12));
+    Tensor alone = ops.softmax(first_row, 1);
+    for (int i = 0; i < 12; ++i) EXPECT_FLOAT_EQ(alone.data()[i], output.data()[i]);
+
+    // Before opset 13: one row per batch entry spanning dims 1 and 2.
+    Tensor coerced = ops.softmax(input, 1, true);
+    for (int i = 0; i < 2; ++i) {
+        float sum = 0.0f;
+        for (int j = 0; j < 12; ++j) sum += coerced.data()[i * 12 + j];
+        EXPECT_NEAR(sum, 1.0f, 1e-5f);
+    }
+    EXPECT_THROW(ops.softmax(input, 3), std::runtime_error);
+}
@@ -0,0 +1,89 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <thread>
+#include "execution_engine.h"
+#include "threading_runtime.h"
+#include "work_stealing_pool.h"
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+TEST(ThreadingRuntimeTest, ParallelForVisitsEveryIndexOnce) {
+    ThreadingOptions options;
+    options.threads = 4;
+    ThreadingRuntime runtime(options);
+    EXPECT_EQ(runtime.threads(), 4u);
+
+    for (pthreadpool_t threadpool : {runtime.threadpool(), pthreadpool_t(nullptr)}) {
+        std::vector<std::atomic<int>> visits(1000);
+        parallelFor(threadpool, visits.size(), [&](size_t i) { ++visits[i]; }, runtime.parallelFlags());
+        for (size_t i = 0; i < visits.size(); ++i) ASSERT_EQ(visits[i], 1) << "at " << i;
+    }
+}
+
+TEST(ThreadingRuntimeTest, SleepPolicyYieldsPoolWorkers) {
+    ThreadingOptions options;
+    EXPECT_EQ(ThreadingRuntime(options).parallelFlags(), 0u);
+    options.wait = WaitPolicy::Sleep;
+    EXPECT_EQ(ThreadingRuntime(options).parallelFlags(), uint32_t(PTHREADPOOL_FLAG_YIELD_WORKERS));
+}
+
+TEST(ThreadingRuntimeTest, EngineKeepsInterOpThreadsAcrossRuntimes) {
+    ComputationGraph graph;
+    graph.nodes = {{"Relu", {"input"}, {"a"}, {}}, {"Softmax", {"a"}, {"output"}, {}}};
+    graph.topologicalSort();
+
+    ExecutionEngine engine;
+    engine.setInterOpThreads(2);
+    ThreadingOptions options;
+    options.threads = 3;
+    options.wait = WaitPolicy::Sleep;
+    engine.setThreading(options);
+    EXPECT_EQ(engine.threading().threads(), 3u);
+    EXPECT_EQ(engine.interOpThreads(), 2u);
+
+    Tensor input({2, 8});
+    input.fillRandom();
+    engine.executeGraph(graph, input);
+    EXPECT_EQ(graph.tensors["output"].shape(), (std::vector<int>{2, 8}));
+}
+
+#ifdef __linux__
+TEST(ThreadingRuntimeTest, PinningLeavesTheCallerAlone) {
+    cpu_set_t before, after;
+    ASSERT_EQ(sched_getaffinity(0, sizeof(before), &before), 0);
+    int cpu = -1;
+    for (int i = 0; i < CPU_SETSIZE && cpu < 0; ++i) {
+        if (CPU_ISSET(i, &before)) cpu = i;
+    }
+    ASSERT_GE(cpu, 0);
+
+    ThreadingOptions options;
+    options.threads = 2;
+    options.pin_threads = true;
+    options.cpus = {cpu};
+    ThreadingRuntime runtime(options);
+    EXPECT_LE(runtime.pinnedThreads(), 1u);
+
+    ASSERT_EQ(sched_getaffinity(0, sizeof(after), &after), 0);
+    EXPECT_TRUE(CPU_EQUAL(&before, &after));
+}
+#endif
+
+TEST(WorkStealingPoolTest, SetsUpEveryWorkerAndRunsTasksWhileSpinning) {
+    std::mutex mutex;
+    std::set<size_t> set_up;
+    std::atomic<int> done{0};
+    {
+        WorkStealingPool pool(3, [&](size_t index) {
+            std::lock_guard<std::mutex> lock(mutex);
+            set_up.insert(index);
+        }, WaitPolicy::Spin);
+        for (int i = 0; i < 100; ++i) pool.submit([&] { ++done; });
+        while (done < 100) std::this_thread::yield();
+    }
+    EXPECT_EQ(set_up, (std::set<size_t>{0, 1, 2}));
+    EXPECT_EQ(done, 100);
+}
@@ -0,0 +1,118 @@
+#include <gtest/gtest.h>
+#include "execution_engine.h"
+#include "tiled_execution.h"
+#include "test_utils.h"
+
+static GraphNode makeConv(const std::string& name, const std::string& input, int kernel, int stride, int pad, int groups = 1) {
+    return makeNode("Conv", {input, name + "_w", name + "_b"}, {name},
+                    {intsAttr("kernel_shape", {kernel, kernel}), intsAttr("strides", {stride, stride}),
+                     intsAttr("pads", {pad, pad, pad, pad}), intAttr("group", groups)});
+}
+
+// MobileNet-style block, NHWC:
+// input [N,21,18,4] -> Conv 3x3 (Relu fused) -> c1 -> depthwise Conv 3x3/2 -> c2
+//                   -> Conv 1x1 -> c3 -> Softmax -> output
+static ComputationGraph makeGraph() {
+    ComputationGraph graph;
+    srand(31);
+    graph.tensors["c1_w"] = Tensor({8, 3, 3, 4});
+    graph.tensors["c1_b"] = Tensor({8});
+    graph.tensors["c2_w"] = Tensor({8, 3, 3, 1});
+    graph.tensors["c2_b"] = Tensor({8});
+    graph.tensors["c3_w"] = Tensor({6, 1, 1, 8});
+    graph.tensors["c3_b"] = Tensor({6});
+    for (auto& [name, tensor] : graph.tensors) tensor.fillRandom();
+
+    GraphNode c1 = makeConv("c1", "input", 3, 1, 1);
+    c1.attributes.push_back(floatAttr("activation_min", 0.0f));
+    graph.nodes = {c1, makeConv("c2", "c1", 3, 2, 1, 8), makeConv("c3", "c2", 1, 1, 0), makeNode("Softmax", {"c3"}, {"output"})};
+    graph.topologicalSort();
+    return graph;
+}
+
+static Tensor makeInput(int batch) {
+    Tensor input({batch, 21, 18, 4});
+    input.fillRandom();
+    return input;
+}
+
+TEST(TiledExecutionTest, MatchesUntiledExecution) {
+    for (size_t tile_bytes : {size_t(1), size_t(8 * 1024), size_t(1) << 30}) {
+        ComputationGraph reference = makeGraph();
+        ComputationGraph graph = makeGraph();
+        ExecutionEngine untiled;
+        ExecutionEngine tiled;
+        tiled.setTiledExecution(tile_bytes);
+
+        for (int batch : {1, 2}) {
+            Tensor input = makeInput(batch);
+            untiled.executeGraph(reference, input);
+            tiled.executeGraph(graph, input);
+            expectNear(graph.tensors["output"], reference.tensors["output"]);
+        }
+
+        ASSERT_TRUE(graph.tile_plan);
+        ASSERT_EQ(graph.tile_plan->chains.size(), 1u);
+        const TiledChain& chain = graph.tile_plan->chains[0];
+        EXPECT_EQ(chain.layers.size(), 3u);
+        if (tile_bytes == 1) {
+            EXPECT_EQ(chain.tile_rows, 1);
+        } else if (tile_bytes > 1000000) {
+            EXPECT_EQ(chain.tile_rows, 11);  // the whole output in one band
+        } else {
+            EXPECT_GT(chain.tile_rows, 1);
+            EXPECT_LT(chain.tile_rows, 11);
+            EXPECT_LE(chain.tile_bytes, tile_bytes);
+        }
+    }
+}
+
+TEST(TiledExecutionTest, IntermediatesStayOutOfTheArena) {
+    ComputationGraph reference = makeGraph();
+    ComputationGraph graph = makeGraph();
+    ExecutionEngine untiled;
+    ExecutionEngine tiled;
+    tiled.setTiledExecution(8 * 1024);
+    Tensor input = makeInput(1);
+    untiled.executeGraph(reference, input);
+    tiled.executeGraph(graph, input);
+
+    EXPECT_EQ(graph.tile_plan->internal, (std::unordered_set<std::string>{"c1", "c2"}));
+    EXPECT_FALSE(graph.memory_plan->offsets.count("c1"));
+    EXPECT_FALSE(graph.memory_plan->offsets.count("c2"));
+    EXPECT_TRUE(graph.memory_plan->offsets.count("c3"));
+    EXPECT_EQ(graph.tensors["c1"].size(), 0u);
+    EXPECT_LT(graph.memory_plan->arena_bytes, reference.memory_plan->arena_bytes);
+}
+
+TEST(TiledExecutionTest, ChainsStopAtRequestedOutputs) {
+    ComputationGraph reference = makeGraph();
+    ComputationGraph graph = makeGraph();
+    ExecutionEngine untiled;
+    ExecutionEngine tiled;
+    tiled.setTiledExecution(4 * 1024);
+    Tensor input = makeInput(1);
+    untiled.executeGraph(reference, input, {"c2", "output"});
+    tiled.executeGraph(graph, input, {"c2", "output"});
+
+    // c2 has to be materialized, so only c1 -> c2 forms a chain.
+    ASSERT_EQ(graph.tile_plan->chains.size(), 1u);
+    EXPECT_EQ(graph.tile_plan->chains[0].layers.size(), 2u);
+    expectNear(graph.tensors["c2"], reference.tensors["c2"]);
+    expectNear(graph.tensors["output"], reference.tensors["output"]);
+}
+
+TEST(TiledExecutionTest, RunsAlongsideOtherNodes) {
+    ComputationGraph reference = makeGraph();
+    ComputationGraph graph = makeGraph();
+    ExecutionEngine untiled;
+    ExecutionEngine tiled;
+    tiled.setTiledExecution(4 * 1024);
+    tiled.setInterOpThreads(3);
+    for (int repeat = 0; repeat < 3; ++repeat) {
+        Tensor input = makeInput(2);
+        untiled.executeGraph(reference, input);
+        tiled.executeGraph(graph, input);
+        expectNear(graph.tensors["output"], reference.tensors["output"]);
+    }
+}
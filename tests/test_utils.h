@@ -0,0 +1,90 @@
+#pragma once
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "graph.h"
+#include "tensor.h"
+
+// Helpers shared by the tests that build graphs in code.
+
+inline onnx::AttributeProto intsAttr(const std::string& name, std::vector<int64_t> values) {
+    onnx::AttributeProto attr;
+    attr.set_name(name);
+    attr.set_type(onnx::AttributeProto::INTS);
+    for (auto v : values) attr.add_ints(v);
+    return attr;
+}
+
+inline onnx::AttributeProto intAttr(const std::string& name, int64_t value) {
+    onnx::AttributeProto attr;
+    attr.set_name(name);
+    attr.set_type(onnx::AttributeProto::INT);
+    attr.set_i(value);
+    return attr;
+}
+
+inline onnx::AttributeProto floatAttr(const std::string& name, float value) {
+    onnx::AttributeProto attr;
+    attr.set_name(name);
+    attr.set_type(onnx::AttributeProto::FLOAT);
+    attr.set_f(value);
+    return attr;
+}
+
+inline GraphNode makeNode(const std::string& op_type, std::vector<std::string> inputs, std::vector<std::string> outputs,
+                          std::vector<onnx::AttributeProto> attributes = {}) {
+    GraphNode node;
+    node.op_type = op_type;
+    node.inputs = std::move(inputs);
+    node.outputs = std::move(outputs);
+    node.attributes = std::move(attributes);
+    return node;
+}
+
+// Uniform in [offset, offset + 1), from rand().
+inline Tensor randomTensor(std::vector<int> shape, float offset = 0.0f) {
+    Tensor tensor(shape);
+    tensor.fillRandom();
+    for (auto& v : tensor.data()) v += offset;
+    return tensor;
+}
+
+// Same shape, and each element within `tolerance` of the expected one, scaled
+// by its magnitude above 1. Stops at the first mismatch.
+inline void expectNear(const Tensor& actual, const Tensor& expected, float tolerance = 1e-5f) {
+    ASSERT_EQ(actual.shape(), expected.shape());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        ASSERT_NEAR(actual.data()[i], expected.data()[i], tolerance * (1.0f + std::fabs(expected.data()[i]))) << "at " << i;
+    }
+}
+
+// Model shared by the Session tests: input [N,8,8,3] -> Conv 3x3 -> c1 -> Relu
+// -> r1 -> Conv 1x1 -> c2 -> Softmax -> output. `seed` picks the weights.
+inline ComputationGraph makeSessionGraph(unsigned seed) {
+    ComputationGraph graph;
+    srand(seed);
+    graph.tensors["c1_w"] = Tensor({4, 3, 3, 3});
+    graph.tensors["c1_b"] = Tensor({4});
+    graph.tensors["c2_w"] = Tensor({5, 1, 1, 4});
+    graph.tensors["c2_b"] = Tensor({5});
+    for (auto& [name, tensor] : graph.tensors) tensor.fillRandom();
+    graph.nodes = {
+        makeNode("Conv", {"input", "c1_w", "c1_b"}, {"c1"}, {intsAttr("kernel_shape", {3, 3}), intsAttr("pads", {1, 1, 1, 1})}),
+        makeNode("Relu", {"c1"}, {"r1"}),
+        makeNode("Conv", {"r1", "c2_w", "c2_b"}, {"c2"}, {intsAttr("kernel_shape", {1, 1})}),
+        makeNode("Softmax", {"c2"}, {"output"}),
+    };
+    graph.topologicalSort();
+    return graph;
+}
+
+// Input [batch,8,8,3] for makeSessionGraph.
+inline Tensor makeSessionInput(unsigned seed, int batch) {
+    srand(seed);
+    Tensor input({batch, 8, 8, 3});
+    input.fillRandom();
+    return input;
+}
@@ -0,0 +1,73 @@
+#include <gtest/gtest.h>
+#include "execution_engine.h"
+#include "weights_cache.h"
+
+// input [1,8,8,4] -> Conv 3x3 (8 ch) -> Conv 1x1 (8 ch) -> output
+static ComputationGraph makeConvGraph() {
+    ComputationGraph graph;
+    srand(42);  // every replica gets identical weights
+    graph.tensors["w0"] = Tensor({8, 3, 3, 4});
+    graph.tensors["b0"] = Tensor({8});
+    graph.tensors["w1"] = Tensor({8, 1, 1, 8});
+    graph.tensors["b1"] = Tensor({8});
+    for (auto& [name, tensor] : graph.tensors) tensor.fillRandom();
+
+    auto ints = [](const std::string& name, std::vector<int64_t> values) {
+        onnx::AttributeProto attr;
+        attr.set_name(name);
+        attr.set_type(onnx::AttributeProto::INTS);
+        for (auto v : values) attr.add_ints(v);
+        return attr;
+    };
+
+    GraphNode conv0;
+    conv0.op_type = "Conv";
+    conv0.inputs = {"input", "w0", "b0"};
+    conv0.outputs = {"hidden"};
+    conv0.attributes = {ints("kernel_shape", {3, 3}), ints("pads", {1, 1, 1, 1})};
+
+    GraphNode conv1;
+    conv1.op_type = "Conv";
+    conv1.inputs = {"hidden", "w1", "b1"};
+    conv1.outputs = {"output"};
+    conv1.attributes = {ints("kernel_shape", {1, 1})};
+
+    graph.nodes = {conv0, conv1};
+    graph.topologicalSort();
+    return graph;
+}
+
+TEST(WeightsCacheTest, ReplicasShareCachedWeights) {
+    auto cache = std::make_shared<WeightsCache>();
+
+    ComputationGraph graph_a = makeConvGraph();
+    ComputationGraph graph_b = makeConvGraph();
+    Tensor input({1, 8, 8, 4});
+    input.fillRandom();
+
+    ExecutionEngine engine_a(cache);
+    engine_a.prepare(graph_a);
+    EXPECT_TRUE(cache->isFinalized());
+    EXPECT_EQ(cache->stats().lookups, 2u);
+    EXPECT_EQ(cache->stats().hits, 0u);
+
+    ExecutionEngine engine_b(cache);
+    engine_b.prepare(graph_b);
+    WeightsCache::Stats stats = cache->stats();
+    EXPECT_EQ(stats.lookups, 4u);
+    EXPECT_EQ(stats.hits, 2u);
+    EXPECT_DOUBLE_EQ(stats.hitRate(), 0.5);
+    EXPECT_EQ(stats.bytes_saved, (8 * 3 * 3 * 4 + 8 + 8 * 8 + 8) * sizeof(float));
+
+    engine_a.executeGraph(graph_a, input);
+    engine_b.executeGraph(graph_b, input);
+    EXPECT_EQ(graph_a.tensors["output"].data(), graph_b.tensors["output"].data());
+}
+
+TEST(WeightsCacheTest, FinalizeIsIdempotent) {
+    WeightsCache cache;
+    EXPECT_FALSE(cache.isFinalized());
+    EXPECT_TRUE(cache.finalize(WeightsCache::Finalization::Soft));
+    EXPECT_TRUE(cache.finalize(WeightsCache::Finalization::Soft));
+    EXPECT_FALSE(cache.finalize(WeightsCache::Finalization::Hard));
+}
@@ -0,0 +1,63 @@
+#include <gtest/gtest.h>
+#include "execution_engine.h"
+#include "xnn_subgraph.h"
+#include "test_utils.h"
+
+// input [1,6,6,3] -> Conv -> Relu -> Reshape (native only) -> Gemm -> Softmax
+static ComputationGraph makeGraph() {
+    ComputationGraph graph;
+    srand(7);
+    graph.tensors["conv_w"] = Tensor({4, 3, 3, 3});
+    graph.tensors["conv_b"] = Tensor({4});
+    graph.tensors["fc_w"] = Tensor({5, 144});
+    graph.tensors["fc_b"] = Tensor({5});
+    for (auto& [name, tensor] : graph.tensors) tensor.fillRandom();
+    graph.tensors["shape"] = Tensor({2}, {1.0f, -1.0f});
+
+    graph.nodes = {
+        makeNode("Conv", {"input", "conv_w", "conv_b"}, {"conv"}, {intsAttr("kernel_shape", {3, 3}), intsAttr("pads", {1, 1, 1, 1})}),
+        makeNode("Relu", {"conv"}, {"relu"}),
+        makeNode("Reshape", {"relu", "shape"}, {"flat"}),
+        makeNode("Gemm", {"flat", "fc_w", "fc_b"}, {"logits"}, {intAttr("transB", 1)}),
+        makeNode("Softmax", {"logits"}, {"output"}),
+    };
+    graph.topologicalSort();
+    return graph;
+}
+
+TEST(XnnSubgraphTest, PartitionsAroundUnsupportedNodes) {
+    ComputationGraph graph = makeGraph();
+    auto plan = lowerToXnnSubgraphs(graph);
+
+    ASSERT_EQ(plan->steps.size(), 3u);
+    ASSERT_TRUE(plan->steps[0].segment);
+    EXPECT_EQ(plan->steps[0].segment->nodes.size(), 2u);
+    EXPECT_EQ(plan->steps[0].segment->inputs, std::vector<std::string>({"input"}));
+    EXPECT_EQ(plan->steps[0].segment->outputs, std::vector<std::string>({"relu"}));
+    ASSERT_TRUE(plan->steps[1].node);
+    EXPECT_EQ(plan->steps[1].node->op_type, "Reshape");
+    ASSERT_TRUE(plan->steps[2].segment);
+    EXPECT_EQ(plan->steps[2].segment->inputs, std::vector<std::string>({"flat"}));
+    EXPECT_EQ(plan->steps[2].segment->outputs, std::vector<std::string>({"output"}));
+}
+
+TEST(XnnSubgraphTest, MatchesNativeBackend) {
+    ComputationGraph native_graph = makeGraph();
+    ComputationGraph xnn_graph = makeGraph();
+    Tensor input({1, 6, 6, 3});
+    input.fillRandom();
+
+    ExecutionEngine native(ExecutionEngine::Backend::Native);
+    ExecutionEngine xnn(ExecutionEngine::Backend::XnnpackSubgraph);
+    native.executeGraph(native_graph, input);
+    for (int run = 0; run < 2; ++run) {
+        xnn.executeGraph(xnn_graph, input);
+
+        const Tensor& expected = native_graph.tensors["output"];
+        const Tensor& actual = xnn_graph.tensors["output"];
+        ASSERT_EQ(actual.shape(), expected.shape());
+        for (size_t i = 0; i < expected.size(); ++i) {
+            EXPECT_NEAR(actual.data()[i], expected.data()[i], 1e-5);
+        }
+    }
+}